@@ -0,0 +1,341 @@
+#pragma once
+
+// Allocation tracker in the spirit of profile.h.
+//
+// Tracking is opt-in: exactly one translation unit of the program marks
+// itself as the place that replaces the global operator new/delete by doing
+//
+//     #define ALLOC_PROFILE_INSTALL
+//     #include "alloc_profile.h"
+//
+// and the replacement is only compiled in when the program is built with
+// -DALLOC_PROFILE, so the builds that serve or benchmark never pay for it.
+// Every other file may include the header as usual and use LOG_ALLOCATIONS,
+// AllocationScope and ASSERT_ALLOCS_AT_MOST. Without the tracker
+// LOG_ALLOCATIONS says so and ASSERT_ALLOCS_AT_MOST runs its code and prints
+// that the check was skipped.
+// Counters are per thread, so a scope only sees the allocations made by the
+// thread that opened it.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+struct AllocStats
+{
+    // Bucket i counts requests of size in [2^(i - 1), 2^i), bucket 0 is for empty ones
+    static constexpr std::size_t HISTOGRAM_SIZE = 65;
+
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    std::size_t peak_live_bytes = 0;
+    std::array<std::size_t, HISTOGRAM_SIZE> histogram = {};
+};
+
+namespace alloc_profile
+{
+
+    struct Counters
+    {
+        std::size_t count;
+        std::size_t bytes;
+        std::int64_t live_bytes;
+        std::int64_t peak_live_bytes;
+        std::array<std::size_t, AllocStats::HISTOGRAM_SIZE> histogram;
+    };
+
+    inline thread_local Counters counters = {};
+    inline bool installed = false;
+
+    inline std::size_t HistogramBucket(std::size_t size)
+    {
+        std::size_t bucket = 0;
+        while (size != 0)
+        {
+            size >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    inline void OnAllocate(std::size_t size)
+    {
+        Counters& c = counters;
+        ++c.count;
+        c.bytes += size;
+        c.live_bytes += static_cast<std::int64_t>(size);
+        if (c.live_bytes > c.peak_live_bytes)
+        {
+            c.peak_live_bytes = c.live_bytes;
+        }
+        ++c.histogram[HistogramBucket(size)];
+    }
+
+    inline void OnDeallocate(std::size_t size)
+    {
+        counters.live_bytes -= static_cast<std::int64_t>(size);
+    }
+
+}
+
+class AllocationScope
+{
+public:
+    AllocationScope() :
+        start(alloc_profile::counters),
+        outer_peak(start.peak_live_bytes)
+    {
+        alloc_profile::counters.peak_live_bytes = start.live_bytes;
+    }
+
+    ~AllocationScope()
+    {
+        auto& peak = alloc_profile::counters.peak_live_bytes;
+        if (outer_peak > peak)
+        {
+            peak = outer_peak;
+        }
+    }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator = (const AllocationScope&) = delete;
+
+    AllocStats Stats() const
+    {
+        if (!alloc_profile::installed)
+        {
+            throw std::logic_error("allocation tracking is not installed, define ALLOC_PROFILE_INSTALL in one file");
+        }
+
+        const alloc_profile::Counters& now = alloc_profile::counters;
+
+        AllocStats result;
+        result.count = now.count - start.count;
+        result.bytes = now.bytes - start.bytes;
+        if (now.peak_live_bytes > start.live_bytes)
+        {
+            result.peak_live_bytes = static_cast<std::size_t>(now.peak_live_bytes - start.live_bytes);
+        }
+        for (std::size_t i = 0; i < result.histogram.size(); ++i)
+        {
+            result.histogram[i] = now.histogram[i] - start.histogram[i];
+        }
+        return result;
+    }
+
+private:
+    alloc_profile::Counters start;
+    std::int64_t outer_peak;
+};
+
+inline std::ostream& operator << (std::ostream& os, const AllocStats& stats)
+{
+    os << stats.count << " allocs, " << stats.bytes << " bytes, "
+        << stats.peak_live_bytes << " peak live bytes";
+
+    bool first = true;
+    for (std::size_t i = 0; i < stats.histogram.size(); ++i)
+    {
+        if (stats.histogram[i] == 0)
+        {
+            continue;
+        }
+        os << (first ? ", sizes {" : ", ");
+        first = false;
+        if (i == 0)
+        {
+            os << "0";
+        }
+        else
+        {
+            os << ">=" << (std::uint64_t(1) << (i - 1));
+        }
+        os << ": " << stats.histogram[i];
+    }
+    if (!first)
+    {
+        os << "}";
+    }
+    return os;
+}
+
+class LogAllocations
+{
+public:
+    explicit LogAllocations(const std::string& msg = "") :
+        message(msg + ": ")
+    {}
+
+    ~LogAllocations()
+    {
+        if (alloc_profile::installed)
+        {
+            std::cerr << message << scope.Stats() << std::endl;
+        }
+        else
+        {
+            std::cerr << message << "allocation tracking is off" << std::endl;
+        }
+    }
+
+private:
+    std::string message;
+    AllocationScope scope;
+};
+
+inline void AssertAllocsAtMost(const AllocStats& stats, std::size_t max_count, const std::string& hint)
+{
+    if (stats.count > max_count)
+    {
+        std::ostringstream os;
+        os << "Assertion failed: " << stats.count << " allocations > " << max_count
+            << " (" << stats << ") hint: " << hint;
+        throw std::runtime_error(os.str());
+    }
+}
+
+#ifndef UNIQ_ID
+#define UNIQ_ID_IMPL(lineno) _a_local_var_##lineno
+#define UNIQ_ID(lineno) UNIQ_ID_IMPL(lineno)
+#endif
+
+#define LOG_ALLOCATIONS(message)            \
+  LogAllocations UNIQ_ID(__LINE__){message};
+
+// The code goes last so that commas in it do not split it into more arguments
+#define ASSERT_ALLOCS_AT_MOST(max_count, ...)                          \
+{                                                                      \
+  if (!alloc_profile::installed)                                       \
+  {                                                                    \
+    __VA_ARGS__;                                                       \
+    std::cerr << "allocation check skipped, tracking is off: "         \
+      << __FILE__ << ":" << __LINE__ << std::endl;                     \
+  }                                                                    \
+  else                                                                 \
+  {                                                                    \
+    AllocStats alloc_stats;                                            \
+    {                                                                  \
+      AllocationScope alloc_scope;                                     \
+      __VA_ARGS__;                                                     \
+      alloc_stats = alloc_scope.Stats();                               \
+    }                                                                  \
+    if (alloc_stats.count > (max_count))                               \
+    {                                                                  \
+      std::ostringstream os;                                           \
+      os << #__VA_ARGS__ << ", " << __FILE__ << ":" << __LINE__;       \
+      AssertAllocsAtMost(alloc_stats, max_count, os.str());            \
+    }                                                                  \
+  }                                                                    \
+}
+
+#if defined(ALLOC_PROFILE_INSTALL) && defined(ALLOC_PROFILE)
+
+// Every block is prefixed with its size so that unsized delete can account for it.
+// The prefix takes a whole alignment unit, so the returned pointer keeps the
+// alignment that was asked for.
+
+namespace alloc_profile
+{
+
+    constexpr std::size_t HEADER_SIZE = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    const bool install = (installed = true);
+
+    inline std::size_t HeaderSize(std::size_t alignment)
+    {
+        return std::max(alignment, HEADER_SIZE);
+    }
+
+    inline void* Allocate(std::size_t size, std::size_t alignment = HEADER_SIZE) noexcept
+    {
+        const std::size_t header = HeaderSize(alignment);
+        // The request cannot be served if the prefix and the rounding make it wrap around
+        if (size > SIZE_MAX - 2 * header)
+        {
+            return nullptr;
+        }
+
+        char* block;
+        if (header == HEADER_SIZE)
+        {
+            block = static_cast<char*>(std::malloc(size + header));
+        }
+        else
+        {
+            // aligned_alloc wants the size to be a multiple of the alignment
+            const std::size_t total = (size + 2 * header - 1) / header * header;
+            block = static_cast<char*>(std::aligned_alloc(header, total));
+        }
+        if (!block)
+        {
+            return nullptr;
+        }
+        *reinterpret_cast<std::size_t*>(block) = size;
+        OnAllocate(size);
+        return block + header;
+    }
+
+    inline void* AllocateOrThrow(std::size_t size, std::size_t alignment = HEADER_SIZE)
+    {
+        while (true)
+        {
+            if (void* p = Allocate(size, alignment))
+            {
+                return p;
+            }
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+            {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    inline void Deallocate(void* p, std::size_t alignment = HEADER_SIZE) noexcept
+    {
+        if (!p)
+        {
+            return;
+        }
+        char* block = static_cast<char*>(p) - HeaderSize(alignment);
+        OnDeallocate(*reinterpret_cast<std::size_t*>(block));
+        std::free(block);
+    }
+
+}
+
+void* operator new(std::size_t size) { return alloc_profile::AllocateOrThrow(size); }
+void* operator new[](std::size_t size) { return alloc_profile::AllocateOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return alloc_profile::Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return alloc_profile::Allocate(size); }
+
+void operator delete(void* p) noexcept { alloc_profile::Deallocate(p); }
+void operator delete[](void* p) noexcept { alloc_profile::Deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { alloc_profile::Deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { alloc_profile::Deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { alloc_profile::Deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { alloc_profile::Deallocate(p); }
+
+// Over-aligned types come through their own overloads, which are counted the same way
+
+void* operator new(std::size_t size, std::align_val_t al) { return alloc_profile::AllocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return alloc_profile::AllocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return alloc_profile::Allocate(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return alloc_profile::Allocate(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void* p, std::align_val_t al) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+void operator delete[](void* p, std::align_val_t al) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+void operator delete(void* p, std::size_t, std::align_val_t al) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+void operator delete[](void* p, std::size_t, std::align_val_t al) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+void operator delete(void* p, std::align_val_t al, const std::nothrow_t&) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+void operator delete[](void* p, std::align_val_t al, const std::nothrow_t&) noexcept { alloc_profile::Deallocate(p, static_cast<std::size_t>(al)); }
+
+#endif
@@ -0,0 +1,156 @@
+#include "test_runner.h"
+
+// This program only checks the tracker itself, so it is always built with it
+#define ALLOC_PROFILE
+#define ALLOC_PROFILE_INSTALL
+#include "alloc_profile.h"
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Keeps the compiler from eliding a new/delete pair
+    void* volatile sink;
+
+    void* Allocate(size_t size)
+    {
+        sink = ::operator new(size);
+        return sink;
+    }
+}
+
+void TestCountsAndBytes()
+{
+    AllocationScope scope;
+    void* a = Allocate(10);
+    void* b = Allocate(100);
+    ::operator delete(a);
+    ::operator delete(b);
+
+    const AllocStats stats = scope.Stats();
+    ASSERT_EQUAL(stats.count, 2u);
+    ASSERT_EQUAL(stats.bytes, 110u);
+    ASSERT_EQUAL(stats.peak_live_bytes, 110u);
+}
+
+void TestPeakLiveBytesInNestedScopes()
+{
+    AllocationScope outer;
+    void* big = Allocate(1000);
+    ::operator delete(big);
+    {
+        AllocationScope inner;
+        void* small = Allocate(10);
+        ::operator delete(small);
+        // The inner scope only sees its own peak...
+        ASSERT_EQUAL(inner.Stats().peak_live_bytes, 10u);
+    }
+    // ...and does not hide the earlier, higher one of the outer scope
+    ASSERT_EQUAL(outer.Stats().peak_live_bytes, 1000u);
+    ASSERT_EQUAL(outer.Stats().count, 2u);
+
+    void* live = Allocate(100);
+    {
+        AllocationScope inner;
+        void* more = Allocate(50);
+        // Peak is counted from what was live when the scope opened
+        ASSERT_EQUAL(inner.Stats().peak_live_bytes, 50u);
+        ::operator delete(more);
+    }
+    ::operator delete(live);
+    ASSERT_EQUAL(outer.Stats().peak_live_bytes, 1000u);
+}
+
+void TestHistogramBuckets()
+{
+    AllocationScope scope;
+    for (size_t size : {0, 1, 2, 3, 4, 1023, 1024})
+    {
+        ::operator delete(Allocate(size));
+    }
+
+    const AllocStats stats = scope.Stats();
+    ASSERT_EQUAL(stats.histogram[0], 1u);  // 0
+    ASSERT_EQUAL(stats.histogram[1], 1u);  // 1
+    ASSERT_EQUAL(stats.histogram[2], 2u);  // 2, 3
+    ASSERT_EQUAL(stats.histogram[3], 1u);  // 4
+    ASSERT_EQUAL(stats.histogram[10], 1u); // 1023
+    ASSERT_EQUAL(stats.histogram[11], 1u); // 1024
+}
+
+void TestOverAlignedAllocationsAreCounted()
+{
+    struct alignas(64) Line
+    {
+        char bytes[64];
+    };
+
+    AllocationScope scope;
+    auto line = make_unique<Line>();
+    ASSERT_EQUAL(reinterpret_cast<uintptr_t>(line.get()) % 64, 0u);
+    auto lines = make_unique<Line[]>(3);
+    ASSERT_EQUAL(reinterpret_cast<uintptr_t>(lines.get()) % 64, 0u);
+    line.reset();
+    lines.reset();
+
+    const AllocStats stats = scope.Stats();
+    ASSERT_EQUAL(stats.count, 2u);
+    ASSERT(stats.bytes >= 4 * sizeof(Line));
+}
+
+void TestHugeRequestThrows()
+{
+    AllocationScope scope;
+    bool thrown = false;
+    try
+    {
+        Allocate(SIZE_MAX - 1);
+    }
+    catch (const bad_alloc&)
+    {
+        thrown = true;
+    }
+    ASSERT(thrown);
+    ASSERT(::operator new(SIZE_MAX, nothrow) == nullptr);
+    ASSERT(::operator new(SIZE_MAX, align_val_t{ 64 }, nothrow) == nullptr);
+    ASSERT_EQUAL(scope.Stats().count, 0u);
+}
+
+void TestAssertAllocsAtMost()
+{
+    ASSERT_ALLOCS_AT_MOST(0, {
+        int x = 1, y = 2;
+        sink = &x;
+        sink = &y;
+    });
+
+    bool failed = false;
+    try
+    {
+        ASSERT_ALLOCS_AT_MOST(1, {
+            vector<int> a(1), b(1);
+        });
+    }
+    catch (const runtime_error&)
+    {
+        failed = true;
+    }
+    ASSERT(failed);
+}
+
+int main()
+{
+    TestRunner tr;
+    RUN_TEST(tr, TestCountsAndBytes);
+    RUN_TEST(tr, TestPeakLiveBytesInNestedScopes);
+    RUN_TEST(tr, TestHistogramBuckets);
+    RUN_TEST(tr, TestOverAlignedAllocationsAreCounted);
+    RUN_TEST(tr, TestHugeRequestThrows);
+    RUN_TEST(tr, TestAssertAllocsAtMost);
+    return 0;
+}
@@ -73,6 +73,15 @@ void AssertEqual(const T& t, const U& u, const std::string& hint = {})
     }
 }
 
+template<class T, class U, class HintBuilder>
+void AssertEqualLazy(const T& t, const U& u, HintBuilder build_hint)
+{
+    if (!(t == u))
+    {
+        AssertEqual(t, u, build_hint());
+    }
+}
+
 inline void Assert(bool b, const std::string& hint)
 {
     AssertEqual(b, true, hint);
@@ -114,20 +123,28 @@ private:
     int fail_count = 0;
 };
 
-#define ASSERT_EQUAL(x, y)              \
-{                                       \
-  std::ostringstream os;                \
-  os << #x << " != " << #y << ", "      \
-    << __FILE__ << ":" << __LINE__;     \
-  AssertEqual(x, y, os.str());          \
+// The hint is formatted only when the check fails, so a passing assertion
+// costs just the comparison. Each argument is still evaluated exactly once.
+
+#define ASSERT_EQUAL(x, y)                      \
+{                                               \
+  AssertEqualLazy(x, y, [&] {                   \
+    std::ostringstream os;                      \
+    os << #x << " != " << #y << ", "            \
+      << __FILE__ << ":" << __LINE__;           \
+    return os.str();                            \
+  });                                           \
 }
 
-#define ASSERT(x)                       \
-{                                       \
-  std::ostringstream os;                \
-  os << #x << " is false, "             \
-    << __FILE__ << ":" << __LINE__;     \
-  Assert(x, os.str());                  \
+#define ASSERT(x)                               \
+{                                               \
+  if (!(x))                                     \
+  {                                             \
+    std::ostringstream os;                      \
+    os << #x << " is false, "                   \
+      << __FILE__ << ":" << __LINE__;           \
+    Assert(false, os.str());                    \
+  }                                             \
 }
 
 #define RUN_TEST(tr, func) \
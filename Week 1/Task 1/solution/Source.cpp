@@ -1,96 +1,34 @@
 #include "test_runner.h"
 
-#include <forward_list>
+#include "hash_set.h"
+#include "test_values.h"
+
+#include <cstring>
 #include <iterator>
-#include <vector>
-#include <algorithm>
 
 using namespace std;
 
-template <typename Type, typename Hasher>
-class HashSet 
-{
-public:
-    using BucketList = std::forward_list<Type>;
-
-public:
-    explicit HashSet(std::size_t num_buckets, const Hasher& hasher = {}) :
-        buckets_count_(num_buckets),
-        hasher_(hasher),
-        storage_(std::vector<BucketList>(buckets_count_))
-    {}
-
-    void Add(const Type& value)
-    {
-        if (!this->Has(value))
-        {
-            storage_[hasher_(value) % buckets_count_].push_front(value);
-        }
-    }
-
-    bool Has(const Type& value) const 
-    {
-        const BucketList& tmp = storage_[hasher_(value) % buckets_count_];
-        auto it = std::find(tmp.begin(), tmp.end(), value);
-        if (it == tmp.end())
-        {
-            return false;
-        }
-
-        return true;
-    }
-
-    void Erase(const Type& value)
-    {
-        BucketList& tmp = storage_[hasher_(value) % buckets_count_];
-        BucketList new_bucket;
-
-        for (const auto& i : tmp)
-        {
-            if (i != value)
-            {
-                new_bucket.push_front(std::move(i));
-            }
-        }
-
-        storage_[hasher_(value) % buckets_count_] = std::move(new_bucket);
-    }
-    const BucketList& GetBucket(const Type& value) const
-    {
-        return storage_[hasher_(value) % buckets_count_];
-    }
-private:
-    std::size_t buckets_count_;
-    Hasher hasher_;
-    std::vector<BucketList> storage_;
-};
-
-
-struct IntHasher 
-{
-    std::size_t operator()(const int value) const
-    {
-        return static_cast<std::size_t>(value);
-    }
-};
-
-struct TestValue
-{
-    int value;
-
-    bool operator==(TestValue other) const 
-    {
-        return static_cast<std::size_t>(value) / 2 == static_cast<std::size_t>(other.value) / 2;
-    }
-};
-
-struct TestValueHasher 
-{
-    std::size_t operator()(const TestValue value) const
-    {
-        return static_cast<std::size_t>(value.value) / 2;
-    }
-};
+void TestOpenHashSet();
+void TestOpenHashSetMatchesStdSet();
+void TestOpenHashSetGrowth();
+void TestOpenHashSetProbeSequence();
+void BenchmarkOpenHashSet();
+void TestHashSetGrows();
+void TestHashSetMatchesStdSetDuringGrowth();
+void TestHashSetGrowthMovesNoValues();
+void TestHashSetEraseInPlace();
+void TestHashSetEraseIfAndRebuild();
+void BenchmarkHashSetGrowth();
+void BenchmarkHashSetChurn();
+void TestSwissHashSet();
+void TestSwissHashSetMatchesStdSet();
+void TestSwissHashSetGroups();
+void BenchmarkSwissHashSet();
+void TestConcurrentHashSet();
+void TestConcurrentHashSetMatchesStdSet();
+void TestConcurrentHashSetReadersDuringWrites();
+void TestConcurrentHashSetFreesRetiredNodes();
+void BenchmarkConcurrentHashSet();
 
 void TestSmoke() 
 {
@@ -155,12 +93,37 @@ void TestEquivalence()
     ASSERT_EQUAL(2, bucket.front().value);
 }
 
-int main() 
+int main(int argc, char* argv[]) 
 {
     TestRunner tr;
     RUN_TEST(tr, TestSmoke);
     RUN_TEST(tr, TestEmpty);
     RUN_TEST(tr, TestIdempotency);
     RUN_TEST(tr, TestEquivalence);
+    RUN_TEST(tr, TestOpenHashSet);
+    RUN_TEST(tr, TestOpenHashSetMatchesStdSet);
+    RUN_TEST(tr, TestOpenHashSetGrowth);
+    RUN_TEST(tr, TestOpenHashSetProbeSequence);
+    RUN_TEST(tr, TestHashSetGrows);
+    RUN_TEST(tr, TestHashSetMatchesStdSetDuringGrowth);
+    RUN_TEST(tr, TestHashSetGrowthMovesNoValues);
+    RUN_TEST(tr, TestHashSetEraseInPlace);
+    RUN_TEST(tr, TestHashSetEraseIfAndRebuild);
+    RUN_TEST(tr, TestSwissHashSet);
+    RUN_TEST(tr, TestSwissHashSetMatchesStdSet);
+    RUN_TEST(tr, TestSwissHashSetGroups);
+    RUN_TEST(tr, TestConcurrentHashSet);
+    RUN_TEST(tr, TestConcurrentHashSetMatchesStdSet);
+    RUN_TEST(tr, TestConcurrentHashSetReadersDuringWrites);
+    RUN_TEST(tr, TestConcurrentHashSetFreesRetiredNodes);
+
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        BenchmarkOpenHashSet();
+        BenchmarkHashSetGrowth();
+        BenchmarkHashSetChurn();
+        BenchmarkSwissHashSet();
+        BenchmarkConcurrentHashSet();
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// HashSet for many readers and a few writers. Has takes no lock and writes
+// no shared memory but a per-thread counter: the values are in lists of
+// immutable nodes that writers link and unlink with atomic stores, so a
+// reader sees every list as it was before or after a write, never half way.
+//
+// Writers are striped over SHARD_COUNT shards by hash, each with its own
+// mutex and bucket table; a shard grows by copying its nodes into a table
+// twice the size and publishing it, so readers still in the old one can go on.
+//
+// Unlinked nodes and old tables are freed by epochs: a reader counts itself
+// in the current epoch while it looks, and garbage is freed in batches once
+// the epoch has moved on and every reader counted in the previous one is done.
+// Readers never wait; a writer that frees a batch waits for the readers
+// that were already looking. Garbage is kept per shard under the shard lock
+// the writer already holds, so writers only share an atomic counter of it.
+//
+// Type must be copy constructible.
+template <typename Type, typename Hasher>
+class ConcurrentHashSet
+{
+public:
+    static constexpr std::size_t SHARD_COUNT = 64;
+    static constexpr double MAX_LOAD_FACTOR = 1.0;
+    // Unlinked nodes and tables kept before the writer that retires the last
+    // one frees them
+    static constexpr std::size_t RECLAIM_BATCH = 1024;
+
+public:
+    // expected_size only saves growing, the set grows as needed
+    explicit ConcurrentHashSet(std::size_t expected_size = 0, const Hasher& hasher = {}) :
+        hasher_(hasher)
+    {
+        std::size_t bucket_count = MIN_BUCKET_COUNT;
+        while (bucket_count * MAX_LOAD_FACTOR * SHARD_COUNT < expected_size)
+        {
+            bucket_count *= 2;
+        }
+        for (Shard& shard : shards_)
+        {
+            shard.table.store(new Table(bucket_count), std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentHashSet(const ConcurrentHashSet&) = delete;
+    ConcurrentHashSet& operator = (const ConcurrentHashSet&) = delete;
+
+    // Must not run concurrently with anything else
+    ~ConcurrentHashSet()
+    {
+        for (Shard& shard : shards_)
+        {
+            DeleteWithNodes(shard.table.load(std::memory_order_relaxed));
+        }
+        for (Shard& shard : shards_)
+        {
+            for (Node* node : shard.retired_nodes)
+            {
+                delete node;
+            }
+            for (Table* table : shard.retired_tables)
+            {
+                DeleteWithNodes(table);
+            }
+        }
+    }
+
+    void Add(const Type& value)
+    {
+        const std::uint64_t hash = Mix(value);
+        Shard& shard = ShardOf(hash);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            if (Find(*table, hash, value) != nullptr)
+            {
+                return;
+            }
+            const std::size_t size = shard.size.load(std::memory_order_relaxed) + 1;
+            if (size > MAX_LOAD_FACTOR * table->bucket_count)
+            {
+                table = Grow(shard, table);
+            }
+            std::atomic<Node*>& bucket = table->buckets[BucketIndex(*table, hash)];
+            // Filled in before it is published, so a reader finds it complete
+            bucket.store(new Node(value, bucket.load(std::memory_order_relaxed)), std::memory_order_release);
+            shard.size.store(size, std::memory_order_relaxed);
+        }
+        ReclaimIfNeeded();
+    }
+
+    bool Has(const Type& value) const
+    {
+        const std::uint64_t hash = Mix(value);
+        const Shard& shard = ShardOf(hash);
+        ReadGuard guard(*this);
+        const Table* table = shard.table.load(std::memory_order_acquire);
+        return Find(*table, hash, value) != nullptr;
+    }
+
+    void Erase(const Type& value)
+    {
+        const std::uint64_t hash = Mix(value);
+        Shard& shard = ShardOf(hash);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            std::atomic<Node*>* link = &table->buckets[BucketIndex(*table, hash)];
+            for (Node* node = link->load(std::memory_order_relaxed); node != nullptr; node = link->load(std::memory_order_relaxed))
+            {
+                if (node->value == value)
+                {
+                    // Readers on node still go on to the rest of the list
+                    link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+                    shard.size.store(shard.size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+                    Retire(shard, node);
+                    break;
+                }
+                link = &node->next;
+            }
+        }
+        ReclaimIfNeeded();
+    }
+
+    // Exact when no write is in progress
+    std::size_t Size() const
+    {
+        std::size_t size = 0;
+        for (const Shard& shard : shards_)
+        {
+            size += shard.size.load(std::memory_order_relaxed);
+        }
+        return size;
+    }
+
+private:
+    static constexpr std::size_t MIN_BUCKET_COUNT = 8;
+    static constexpr unsigned SHARD_BITS = 6;
+    static_assert(std::size_t(1) << SHARD_BITS == SHARD_COUNT);
+    static constexpr std::size_t READER_STRIPES = 64;
+
+    struct Node
+    {
+        Node(const Type& value, Node* next) :
+            value(value),
+            next(next)
+        {}
+
+        const Type value;
+        std::atomic<Node*> next;
+    };
+
+    struct Table
+    {
+        explicit Table(std::size_t bucket_count) :
+            bucket_count(bucket_count),
+            buckets(new std::atomic<Node*>[bucket_count])
+        {
+            unsigned bits = 0;
+            for (std::size_t count = bucket_count; count > 1; count /= 2)
+            {
+                ++bits;
+            }
+            shift = 64 - bits;
+            for (std::size_t i = 0; i < bucket_count; ++i)
+            {
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        const std::size_t bucket_count;
+        unsigned shift;
+        std::unique_ptr<std::atomic<Node*>[]> buckets;
+    };
+
+    // Padded so that writers to different shards do not share cache lines
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::atomic<Table*> table{ nullptr };
+        std::atomic<std::size_t> size{ 0 };
+        // Unlinked from the shard, readers may still be in them; under mutex
+        std::vector<Node*> retired_nodes;
+        std::vector<Table*> retired_tables;
+    };
+
+    // Readers in the epochs with even and odd numbers
+    struct alignas(64) ReaderStripe
+    {
+        std::atomic<std::int64_t> readers[2] = { 0, 0 };
+    };
+
+    // Counts the thread as a reader of the current epoch while it lives
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const ConcurrentHashSet& set) :
+            stripe_(set.reader_stripes_[StripeOfThread()])
+        {
+            for (;;)
+            {
+                parity_ = set.epoch_.load() & 1;
+                stripe_.readers[parity_].fetch_add(1);
+                // Had the epoch moved on before the count, a writer might not
+                // have seen it and freed what this reader is about to look at
+                if ((set.epoch_.load() & 1) == parity_)
+                {
+                    return;
+                }
+                stripe_.readers[parity_].fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        ~ReadGuard()
+        {
+            stripe_.readers[parity_].fetch_sub(1, std::memory_order_release);
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator = (const ReadGuard&) = delete;
+
+    private:
+        ReaderStripe& stripe_;
+        std::size_t parity_;
+    };
+
+    // Threads take the stripes in turn, so up to READER_STRIPES of them count
+    // themselves without sharing a cache line
+    static std::size_t StripeOfThread()
+    {
+        static std::atomic<std::size_t> next_stripe{ 0 };
+        thread_local const std::size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % READER_STRIPES;
+        return stripe;
+    }
+
+    std::uint64_t Mix(const Type& value) const
+    {
+        return static_cast<std::uint64_t>(hasher_(value)) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    // The shard comes from the top bits of the mixed hash, the bucket from the
+    // bits below them
+    Shard& ShardOf(std::uint64_t hash)
+    {
+        return shards_[hash >> (64 - SHARD_BITS)];
+    }
+
+    const Shard& ShardOf(std::uint64_t hash) const
+    {
+        return shards_[hash >> (64 - SHARD_BITS)];
+    }
+
+    static std::size_t BucketIndex(const Table& table, std::uint64_t hash)
+    {
+        return static_cast<std::size_t>((hash << SHARD_BITS) >> table.shift);
+    }
+
+    static const Node* Find(const Table& table, std::uint64_t hash, const Type& value)
+    {
+        const Node* node = table.buckets[BucketIndex(table, hash)].load(std::memory_order_acquire);
+        for (; node != nullptr; node = node->next.load(std::memory_order_acquire))
+        {
+            if (node->value == value)
+            {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    // Must be called with the shard locked; returns the table that replaces table
+    Table* Grow(Shard& shard, Table* table)
+    {
+        Table* grown = new Table(2 * table->bucket_count);
+        for (std::size_t i = 0; i < table->bucket_count; ++i)
+        {
+            for (Node* node = table->buckets[i].load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed))
+            {
+                std::atomic<Node*>& bucket = grown->buckets[BucketIndex(*grown, Mix(node->value))];
+                bucket.store(new Node(node->value, bucket.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+            }
+        }
+        shard.table.store(grown, std::memory_order_release);
+        Retire(shard, table);
+        return grown;
+    }
+
+    static void DeleteWithNodes(Table* table)
+    {
+        for (std::size_t i = 0; i < table->bucket_count; ++i)
+        {
+            for (Node* node = table->buckets[i].load(std::memory_order_relaxed); node != nullptr;)
+            {
+                Node* next = node->next.load(std::memory_order_relaxed);
+                delete node;
+                node = next;
+            }
+        }
+        delete table;
+    }
+
+    // Must be called with the shard locked; node is unlinked, readers may
+    // still be on it
+    void Retire(Shard& shard, Node* node)
+    {
+        shard.retired_nodes.push_back(node);
+        retired_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Must be called with the shard locked; table is replaced, readers may
+    // still be in it; its nodes go with it
+    void Retire(Shard& shard, Table* table)
+    {
+        shard.retired_tables.push_back(table);
+        retired_count_.fetch_add(table->bucket_count, std::memory_order_relaxed);
+    }
+
+    void ReclaimIfNeeded()
+    {
+        // Most calls end here, without a lock
+        if (retired_count_.load(std::memory_order_relaxed) < RECLAIM_BATCH)
+        {
+            return;
+        }
+        // A writer that finds another one freeing a batch goes on, the
+        // garbage it leaves is taken by the next batch
+        std::unique_lock<std::mutex> lock(reclaim_mutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            return;
+        }
+
+        std::vector<Node*> nodes;
+        std::vector<Table*> tables;
+        std::size_t taken = 0;
+        for (Shard& shard : shards_)
+        {
+            std::lock_guard<std::mutex> shard_lock(shard.mutex);
+            nodes.insert(nodes.end(), shard.retired_nodes.begin(), shard.retired_nodes.end());
+            shard.retired_nodes.clear();
+            for (Table* table : shard.retired_tables)
+            {
+                tables.push_back(table);
+                taken += table->bucket_count;
+            }
+            shard.retired_tables.clear();
+        }
+        retired_count_.fetch_sub(nodes.size() + taken, std::memory_order_relaxed);
+
+        // Everything taken was unlinked before the epoch moves on, so only the
+        // readers counted in the old epoch may still see it. The loads are
+        // seq_cst like the epoch increment and the reader's count and epoch
+        // check: either a reader sees the new epoch and backs off, or its
+        // count is seen here
+        const std::size_t parity = epoch_.fetch_add(1) & 1;
+        for (const ReaderStripe& stripe : reader_stripes_)
+        {
+            while (stripe.readers[parity].load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        for (Node* node : nodes)
+        {
+            delete node;
+        }
+        for (Table* table : tables)
+        {
+            DeleteWithNodes(table);
+        }
+    }
+
+    Hasher hasher_;
+    Shard shards_[SHARD_COUNT];
+
+    mutable ReaderStripe reader_stripes_[READER_STRIPES];
+    std::atomic<std::uint64_t> epoch_{ 0 };
+    // One writer at a time waits for the readers of an epoch
+    std::mutex reclaim_mutex_;
+
+    // Retired nodes plus the buckets of the retired tables, about as many as
+    // their nodes, over all the shards
+    std::atomic<std::size_t> retired_count_{ 0 };
+};
@@ -0,0 +1,344 @@
+#include "concurrent_hash_set.h"
+#include "hash_set.h"
+#include "test_values.h"
+
+#include "test_runner.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Counts its live copies, to see that the set frees what it retires
+    struct Counted
+    {
+        static atomic<int> live;
+
+        int value;
+
+        explicit Counted(int value) :
+            value(value)
+        {
+            ++live;
+        }
+
+        Counted(const Counted& other) :
+            value(other.value)
+        {
+            ++live;
+        }
+
+        ~Counted()
+        {
+            --live;
+        }
+
+        bool operator == (const Counted& other) const
+        {
+            return value == other.value;
+        }
+    };
+
+    atomic<int> Counted::live{ 0 };
+
+    struct CountedHasher
+    {
+        size_t operator()(const Counted& counted) const
+        {
+            return static_cast<size_t>(counted.value);
+        }
+    };
+}
+
+void TestConcurrentHashSet()
+{
+    ConcurrentHashSet<int, IntHasher> hash_set;
+    hash_set.Add(3);
+    hash_set.Add(4);
+    ASSERT(hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+    ASSERT(!hash_set.Has(5));
+
+    hash_set.Erase(3);
+    ASSERT(!hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+
+    hash_set.Add(3);
+    hash_set.Add(5);
+    hash_set.Add(5);
+    ASSERT_EQUAL(hash_set.Size(), 3u);
+    hash_set.Erase(5);
+    hash_set.Erase(5);
+    hash_set.Erase(42);
+    ASSERT_EQUAL(hash_set.Size(), 2u);
+
+    ConcurrentHashSet<TestValue, TestValueHasher> equivalent;
+    equivalent.Add(TestValue{ 2 });
+    equivalent.Add(TestValue{ 3 });
+    ASSERT(equivalent.Has(TestValue{ 3 }));
+    ASSERT_EQUAL(equivalent.Size(), 1u);
+
+    // Grows far past its first tables
+    ConcurrentHashSet<string, hash<string>> strings;
+    for (int i = 0; i < 20000; ++i)
+    {
+        strings.Add("a long enough string not to fit in place " + to_string(i));
+    }
+    for (int i = 0; i < 20000; i += 2)
+    {
+        strings.Erase("a long enough string not to fit in place " + to_string(i));
+    }
+    ASSERT_EQUAL(strings.Size(), 10000u);
+    for (int i = 0; i < 20000; ++i)
+    {
+        ASSERT_EQUAL(strings.Has("a long enough string not to fit in place " + to_string(i)), i % 2 == 1);
+    }
+}
+
+void TestConcurrentHashSetMatchesStdSet()
+{
+    mt19937 generator(50);
+    for (int range : { 10, 1000, 100000 })
+    {
+        ConcurrentHashSet<int, IntHasher> hash_set(range / 2);
+        CheckMatchesStdSet(hash_set, generator, range);
+    }
+}
+
+void TestConcurrentHashSetReadersDuringWrites()
+{
+    const int stable_count = 1000;
+    const int writer_count = 2;
+    const int writer_range = 20000;
+    ConcurrentHashSet<int, IntHasher> hash_set;
+    for (int value = 0; value < stable_count; ++value)
+    {
+        hash_set.Add(value);
+    }
+
+    // Writers add and erase their own values, growing and shrinking shards
+    // under the readers, which must always find the stable values and never
+    // the ones nobody adds
+    atomic<int> writers_left{ writer_count };
+    atomic<bool> consistent{ true };
+    vector<thread> threads;
+    for (int writer = 0; writer < writer_count; ++writer)
+    {
+        threads.emplace_back([&, writer] {
+            const int first = stable_count + writer * writer_range;
+            for (int round = 0; round < 3; ++round)
+            {
+                for (int value = first; value < first + writer_range; ++value)
+                {
+                    hash_set.Add(value);
+                }
+                for (int value = first; value < first + writer_range; ++value)
+                {
+                    hash_set.Erase(value);
+                }
+            }
+            for (int value = first; value < first + writer_range; value += 2)
+            {
+                hash_set.Add(value);
+            }
+            --writers_left;
+        });
+    }
+    for (int reader = 0; reader < 4; ++reader)
+    {
+        threads.emplace_back([&, reader] {
+            mt19937 generator(reader);
+            do
+            {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    const int value = static_cast<int>(generator() % stable_count);
+                    if (!hash_set.Has(value) || hash_set.Has(-1 - value))
+                    {
+                        consistent = false;
+                    }
+                    // Comes and goes, only must not crash
+                    hash_set.Has(stable_count + value);
+                }
+            } while (writers_left > 0);
+        });
+    }
+    for (thread& t : threads)
+    {
+        t.join();
+    }
+
+    ASSERT(consistent);
+    ASSERT_EQUAL(hash_set.Size(), static_cast<size_t>(stable_count + writer_count * writer_range / 2));
+    for (int value = 0; value < stable_count + writer_count * writer_range; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), value < stable_count || (value - stable_count) % 2 == 0);
+    }
+}
+
+void TestConcurrentHashSetFreesRetiredNodes()
+{
+    using CountedSet = ConcurrentHashSet<Counted, CountedHasher>;
+    {
+        CountedSet hash_set;
+        for (int round = 0; round < 20; ++round)
+        {
+            for (int value = 0; value < 5000; ++value)
+            {
+                hash_set.Add(Counted(value));
+            }
+            for (int value = 0; value < 5000; value += 2)
+            {
+                hash_set.Erase(Counted(value));
+            }
+            // What is not in the set waits for at most a batch
+            const size_t live = static_cast<size_t>(Counted::live.load());
+            ASSERT(live <= hash_set.Size() + CountedSet::RECLAIM_BATCH);
+        }
+        ASSERT_EQUAL(hash_set.Size(), 2500u);
+    }
+    ASSERT_EQUAL(Counted::live.load(), 0);
+}
+
+namespace
+{
+    // HashSet behind one lock, the simplest thread safe set
+    struct LockedHashSet
+    {
+        explicit LockedHashSet(size_t num_buckets) :
+            values(num_buckets)
+        {}
+
+        void Add(int value)
+        {
+            lock_guard<mutex> lock(m);
+            values.Add(value);
+        }
+
+        bool Has(int value) const
+        {
+            lock_guard<mutex> lock(m);
+            return values.Has(value);
+        }
+
+        void Erase(int value)
+        {
+            lock_guard<mutex> lock(m);
+            values.Erase(value);
+        }
+
+        mutable mutex m;
+        HashSet<int, IntHasher> values;
+    };
+
+    // HashSet behind a lock that readers share
+    struct SharedLockedHashSet
+    {
+        explicit SharedLockedHashSet(size_t num_buckets) :
+            values(num_buckets)
+        {}
+
+        void Add(int value)
+        {
+            unique_lock<shared_mutex> lock(m);
+            values.Add(value);
+        }
+
+        bool Has(int value) const
+        {
+            shared_lock<shared_mutex> lock(m);
+            return values.Has(value);
+        }
+
+        void Erase(int value)
+        {
+            unique_lock<shared_mutex> lock(m);
+            values.Erase(value);
+        }
+
+        mutable shared_mutex m;
+        HashSet<int, IntHasher> values;
+    };
+
+    // Every thread makes operations_per_thread calls, 95% of them Has and
+    // the rest Add and Erase in turn of values of its own; returns the
+    // millions of operations per second over all the threads
+    template <typename Set>
+    double RunReadMostly(Set& hash_set, int thread_count, int operations_per_thread)
+    {
+        const int preloaded = 1000000;
+        vector<thread> threads;
+        atomic<size_t> found{ 0 };
+        const auto start = chrono::steady_clock::now();
+        for (int t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&, t] {
+                mt19937 generator(t);
+                size_t thread_found = 0;
+                int next_write = preloaded + t * operations_per_thread;
+                for (int i = 0; i < operations_per_thread; ++i)
+                {
+                    if (i % 20 == 19)
+                    {
+                        // Adds a value and erases it on the next write
+                        if (i % 40 == 19)
+                        {
+                            hash_set.Add(next_write);
+                        }
+                        else
+                        {
+                            hash_set.Erase(next_write++);
+                        }
+                    }
+                    else
+                    {
+                        thread_found += hash_set.Has(static_cast<int>(generator() % (2 * preloaded)));
+                    }
+                }
+                found += thread_found;
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (found == 0)
+        {
+            cerr << "nothing found" << endl;
+        }
+        return static_cast<double>(thread_count) * operations_per_thread / seconds / 1e6;
+    }
+
+    template <typename Set>
+    void BenchmarkReadMostly(const string& name)
+    {
+        for (int thread_count : { 1, 2, 4, 8, 16, 32 })
+        {
+            Set hash_set(1000000);
+            for (int value = 0; value < 1000000; ++value)
+            {
+                hash_set.Add(value);
+            }
+            const double mops = RunReadMostly(hash_set, thread_count, 4000000 / thread_count);
+            cerr << name << ", 95% Has, " << thread_count << " threads: " << mops << " M ops/s" << endl;
+        }
+    }
+}
+
+void BenchmarkConcurrentHashSet()
+{
+    cerr << thread::hardware_concurrency() << " hardware threads" << endl;
+    BenchmarkReadMostly<ConcurrentHashSet<int, IntHasher>>("ConcurrentHashSet");
+    BenchmarkReadMostly<SharedLockedHashSet>("HashSet + shared_mutex");
+    BenchmarkReadMostly<LockedHashSet>("HashSet + mutex");
+}
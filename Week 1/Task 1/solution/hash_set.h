@@ -0,0 +1,175 @@
+#pragma once
+
+#include <deque>
+#include <forward_list>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+
+// Grows by linear hashing: once there are more values than buckets, every Add
+// splits one more bucket, in order, moving the values that hash elsewhere to a
+// new bucket at the end. When all the buckets of a round are split their count
+// has doubled and the next round starts. The migration is spread over the
+// Adds that cause it and values are spliced, not copied, so no Add pays for
+// rehashing the whole set. The buckets live in a deque, which never moves
+// them as it grows.
+template <typename Type, typename Hasher>
+class HashSet
+{
+public:
+    using BucketList = std::forward_list<Type>;
+
+    static constexpr double MAX_LOAD_FACTOR = 1.0;
+
+public:
+    // num_buckets is the count to start with
+    explicit HashSet(std::size_t num_buckets, const Hasher& hasher = {}) :
+        round_buckets_count_(std::max<std::size_t>(num_buckets, 1)),
+        hasher_(hasher),
+        storage_(round_buckets_count_)
+    {}
+
+    void Add(const Type& value)
+    {
+        BucketList& bucket = storage_[BucketIndex(value)];
+        if (std::find(bucket.begin(), bucket.end(), value) == bucket.end())
+        {
+            bucket.push_front(value);
+            ++size_;
+            if (size_ > MAX_LOAD_FACTOR * storage_.size())
+            {
+                Split();
+            }
+        }
+    }
+
+    bool Has(const Type& value) const
+    {
+        const BucketList& tmp = storage_[BucketIndex(value)];
+        auto it = std::find(tmp.begin(), tmp.end(), value);
+        if (it == tmp.end())
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    // Unlinks the node of value in place, nothing is allocated or copied
+    void Erase(const Type& value)
+    {
+        BucketList& bucket = storage_[BucketIndex(value)];
+        for (auto before = bucket.before_begin(), it = bucket.begin(); it != bucket.end(); before = it++)
+        {
+            if (*it == value)
+            {
+                bucket.erase_after(before);
+                --size_;
+                return;
+            }
+        }
+    }
+
+    // Erases every value the predicate holds for in one pass over the buckets,
+    // returns how many
+    template <typename Predicate>
+    std::size_t EraseIf(Predicate predicate)
+    {
+        std::size_t erased = 0;
+        for (BucketList& bucket : storage_)
+        {
+            for (auto before = bucket.before_begin(); std::next(before) != bucket.end();)
+            {
+                if (predicate(*std::next(before)))
+                {
+                    bucket.erase_after(before);
+                    ++erased;
+                }
+                else
+                {
+                    ++before;
+                }
+            }
+        }
+        size_ -= erased;
+        return erased;
+    }
+
+    // Starts over with max(num_buckets, Size()) buckets, at least one, e.g. to
+    // give back the buckets after a big EraseIf. The nodes are relinked into
+    // their new buckets, not copied.
+    void Rebuild(std::size_t num_buckets = 0)
+    {
+        const std::size_t count = std::max<std::size_t>({ num_buckets, size_, 1 });
+        std::deque<BucketList> storage(count);
+        for (BucketList& bucket : storage_)
+        {
+            while (!bucket.empty())
+            {
+                BucketList& to = storage[hasher_(bucket.front()) % count];
+                to.splice_after(to.before_begin(), bucket, bucket.before_begin());
+            }
+        }
+        storage_ = std::move(storage);
+        round_buckets_count_ = count;
+        split_ = 0;
+    }
+
+    const BucketList& GetBucket(const Type& value) const
+    {
+        return storage_[BucketIndex(value)];
+    }
+
+    std::size_t Size() const
+    {
+        return size_;
+    }
+
+    std::size_t BucketCount() const
+    {
+        return storage_.size();
+    }
+private:
+    std::size_t BucketIndex(const Type& value) const
+    {
+        const std::size_t hash = hasher_(value);
+        const std::size_t index = hash % round_buckets_count_;
+        return index < split_ ? hash % (2 * round_buckets_count_) : index;
+    }
+
+    // Splits bucket split_ into itself and a new last bucket
+    void Split()
+    {
+        storage_.emplace_back();
+        BucketList& from = storage_[split_];
+        BucketList& to = storage_.back();
+        const std::size_t sibling = storage_.size() - 1;
+
+        auto before = from.before_begin();
+        for (auto it = from.begin(); it != from.end();)
+        {
+            if (hasher_(*it) % (2 * round_buckets_count_) == sibling)
+            {
+                to.splice_after(to.before_begin(), from, before);
+                it = std::next(before);
+            }
+            else
+            {
+                before = it++;
+            }
+        }
+
+        if (++split_ == round_buckets_count_)
+        {
+            round_buckets_count_ *= 2;
+            split_ = 0;
+        }
+    }
+
+    // Buckets when the current round started; the ones before split_ are split
+    std::size_t round_buckets_count_;
+    std::size_t split_ = 0;
+    Hasher hasher_;
+    std::deque<BucketList> storage_;
+    std::size_t size_ = 0;
+};
@@ -0,0 +1,350 @@
+#include "hash_set.h"
+#include "open_hash_set.h"
+#include "test_values.h"
+
+#include "test_runner.h"
+#include "profile.h"
+#include "alloc_profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    template <typename Set>
+    size_t LongestBucket(const Set& hash_set, int max_value)
+    {
+        size_t longest = 0;
+        for (int value = 0; value < max_value; ++value)
+        {
+            const auto& bucket = hash_set.GetBucket(value);
+            longest = max<size_t>(longest, distance(bucket.begin(), bucket.end()));
+        }
+        return longest;
+    }
+}
+
+void TestHashSetGrows()
+{
+    using IntSet = HashSet<int, IntHasher>;
+    IntSet hash_set(10);
+    for (int value = 0; value < 10000; ++value)
+    {
+        hash_set.Add(value);
+        ASSERT(hash_set.Size() <= hash_set.BucketCount() * IntSet::MAX_LOAD_FACTOR);
+    }
+    ASSERT_EQUAL(hash_set.Size(), 10000u);
+    ASSERT_EQUAL(hash_set.BucketCount(), 10000u);
+    // Consecutive values over a linear hashed table: at most a pair per bucket
+    ASSERT(LongestBucket(hash_set, 10000) <= 2u);
+    for (int value = 0; value < 20000; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), value < 10000);
+    }
+
+    for (int value = 0; value < 10000; value += 2)
+    {
+        hash_set.Erase(value);
+    }
+    ASSERT_EQUAL(hash_set.Size(), 5000u);
+    for (int value = 0; value < 10000; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), value % 2 == 1);
+    }
+
+    HashSet<int, IntHasher> zero_buckets(0);
+    zero_buckets.Add(1);
+    ASSERT(zero_buckets.Has(1));
+}
+
+void TestHashSetMatchesStdSetDuringGrowth()
+{
+    mt19937 generator(47);
+    for (size_t num_buckets : { 1, 3, 7, 100 })
+    {
+        HashSet<int, IntHasher> hash_set(num_buckets);
+        set<int> expected;
+        for (int i = 0; i < 20000; ++i)
+        {
+            const int value = static_cast<int>(generator() % 30000) - 1000;
+            if (generator() % 4 == 0)
+            {
+                hash_set.Erase(value);
+                expected.erase(value);
+            }
+            else
+            {
+                hash_set.Add(value);
+                expected.insert(value);
+            }
+            // Right after a split the moved values must still be found
+            if (i % 97 == 0)
+            {
+                for (int expected_value : expected)
+                {
+                    ASSERT(hash_set.Has(expected_value));
+                }
+            }
+        }
+        ASSERT_EQUAL(hash_set.Size(), expected.size());
+        for (int value = -1000; value < 29000; ++value)
+        {
+            ASSERT_EQUAL(hash_set.Has(value), expected.count(value) == 1);
+        }
+    }
+
+    // Equivalent values stay together through the splits
+    HashSet<TestValue, TestValueHasher> equivalent(1);
+    for (int value = 0; value < 1000; ++value)
+    {
+        equivalent.Add(TestValue{ value });
+    }
+    ASSERT_EQUAL(equivalent.Size(), 500u);
+    const auto& bucket = equivalent.GetBucket(TestValue{ 998 });
+    ASSERT_EQUAL(&bucket, &equivalent.GetBucket(TestValue{ 999 }));
+    ASSERT_EQUAL(1, distance(begin(bucket), end(bucket)));
+}
+
+void TestHashSetGrowthMovesNoValues()
+{
+    // A node and the string copied into it per Add, now and then a block of
+    // the deque, nothing for the splits
+    HashSet<string, hash<string>> hash_set(1);
+    vector<string> values;
+    for (int i = 0; i < 10000; ++i)
+    {
+        values.push_back("a value too long for the small string buffer " + to_string(i));
+    }
+    ASSERT_ALLOCS_AT_MOST(2 * 10000 + 10000 / 32 + 32, {
+        for (const string& value : values)
+        {
+            hash_set.Add(value);
+        }
+    });
+    ASSERT_EQUAL(hash_set.Size(), 10000u);
+}
+
+void TestHashSetEraseInPlace()
+{
+    HashSet<int, ConstantHasher> hash_set(1);
+    for (int value = 0; value < 10; ++value)
+    {
+        hash_set.Add(value);
+    }
+    // The bucket is 9, 8, ..., 0: erase its head, its tail, a middle value and absent values
+    ASSERT_ALLOCS_AT_MOST(0, {
+        hash_set.Erase(9);
+        hash_set.Erase(0);
+        hash_set.Erase(5);
+        hash_set.Erase(5);
+        hash_set.Erase(42);
+    });
+    ASSERT_EQUAL(hash_set.Size(), 7u);
+    const auto& bucket = hash_set.GetBucket(0);
+    ASSERT_EQUAL(vector<int>(bucket.begin(), bucket.end()), vector<int>({ 8, 7, 6, 4, 3, 2, 1 }));
+
+    for (int value = 0; value < 10; ++value)
+    {
+        hash_set.Erase(value);
+    }
+    ASSERT_EQUAL(hash_set.Size(), 0u);
+    ASSERT(hash_set.GetBucket(0).empty());
+    hash_set.Add(3);
+    ASSERT(hash_set.Has(3));
+
+    HashSet<TestValue, TestValueHasher> equivalent(10);
+    equivalent.Add(TestValue{ 2 });
+    equivalent.Erase(TestValue{ 3 });
+    ASSERT(!equivalent.Has(TestValue{ 2 }));
+    ASSERT_EQUAL(equivalent.Size(), 0u);
+}
+
+void TestHashSetEraseIfAndRebuild()
+{
+    HashSet<int, IntHasher> hash_set(1);
+    for (int value = 0; value < 10000; ++value)
+    {
+        hash_set.Add(value);
+    }
+    size_t erased = 0;
+    ASSERT_ALLOCS_AT_MOST(0, {
+        erased = hash_set.EraseIf([](int value) { return value % 100 != 0; });
+    });
+    ASSERT_EQUAL(erased, 9900u);
+    ASSERT_EQUAL(hash_set.Size(), 100u);
+    ASSERT_EQUAL(hash_set.EraseIf([](int) { return false; }), 0u);
+
+    // Only the deque of buckets is allocated, the nodes are relinked
+    ASSERT_ALLOCS_AT_MOST(2 + 100 / 64, {
+        hash_set.Rebuild();
+    });
+    ASSERT_EQUAL(hash_set.BucketCount(), 100u);
+    for (int value = 0; value < 10000; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), value % 100 == 0);
+    }
+
+    // Still grows from there, and can be rebuilt bigger
+    for (int value = 0; value < 1000; ++value)
+    {
+        hash_set.Add(value);
+    }
+    ASSERT_EQUAL(hash_set.Size(), 1090u);
+    ASSERT(hash_set.BucketCount() >= 1090u);
+    hash_set.Rebuild(5000);
+    ASSERT_EQUAL(hash_set.BucketCount(), 5000u);
+    for (int value = 0; value < 10000; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), value < 1000 || value % 100 == 0);
+    }
+
+    hash_set.EraseIf([](int) { return true; });
+    hash_set.Rebuild();
+    ASSERT_EQUAL(hash_set.BucketCount(), 1u);
+    ASSERT_EQUAL(hash_set.Size(), 0u);
+    hash_set.Add(7);
+    ASSERT(hash_set.Has(7));
+}
+
+namespace
+{
+    struct Latency
+    {
+        double p50, p99, p999, p9999, max;
+    };
+
+    // Time of every single Add while the set grows from empty
+    template <typename Add>
+    Latency MeasureAdds(const vector<int>& values, Add add)
+    {
+        vector<uint32_t> nanoseconds(values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            const auto start = chrono::steady_clock::now();
+            add(values[i]);
+            nanoseconds[i] = static_cast<uint32_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+        sort(nanoseconds.begin(), nanoseconds.end());
+        auto at = [&](double quantile) {
+            return nanoseconds[min(nanoseconds.size() - 1, static_cast<size_t>(quantile * nanoseconds.size()))] / 1000.0;
+        };
+        return { at(0.5), at(0.99), at(0.999), at(0.9999), nanoseconds.back() / 1000.0 };
+    }
+
+    ostream& operator << (ostream& out, const Latency& latency)
+    {
+        return out << "latency us p50 " << latency.p50 << " p99 " << latency.p99
+            << " p99.9 " << latency.p999 << " p99.99 " << latency.p9999 << " max " << latency.max;
+    }
+}
+
+void BenchmarkHashSetGrowth()
+{
+    {
+        // What TestEmpty and friends do: few buckets for many values
+        HashSet<int, IntHasher> hash_set(10);
+        size_t found = 0;
+        LOG_DURATION("HashSet(10), Add x10k + Has x100k");
+        for (int value = 0; value < 10000; ++value)
+        {
+            hash_set.Add(value);
+        }
+        for (int i = 0; i < 100000; ++i)
+        {
+            found += hash_set.Has(i % 20000);
+        }
+        cerr << found << " found, " << hash_set.BucketCount() << " buckets" << endl;
+    }
+
+    mt19937 generator(47);
+    vector<int> values(2000000);
+    for (int& value : values)
+    {
+        value = static_cast<int>(generator());
+    }
+    {
+        HashSet<int, IntHasher> hash_set(10);
+        cerr << "HashSet(10), 2M Adds: " << MeasureAdds(values, [&](int value) { hash_set.Add(value); }) << endl;
+    }
+    {
+        unordered_set<int> hash_set;
+        cerr << "std::unordered_set, 2M Adds: " << MeasureAdds(values, [&](int value) { hash_set.insert(value); }) << endl;
+    }
+    {
+        OpenHashSet<int, IntHasher> hash_set;
+        cerr << "OpenHashSet, 2M Adds: " << MeasureAdds(values, [&](int value) { hash_set.Add(value); }) << endl;
+    }
+}
+
+void BenchmarkHashSetChurn()
+{
+    const int size = 100000;
+    mt19937 generator(48);
+    vector<int> values(size);
+    for (int& value : values)
+    {
+        value = static_cast<int>(generator());
+    }
+    for (size_t num_buckets : { size / 100, size })
+    {
+        const string name = "HashSet(" + to_string(num_buckets) + ")";
+        HashSet<int, IntHasher> hash_set(num_buckets);
+        for (int value : values)
+        {
+            hash_set.Add(value);
+        }
+        {
+            // Replaces a random value with a new one, the set stays the same size
+            LOG_DURATION(name + ": Erase + Add x1M");
+            LOG_ALLOCATIONS(name + ": Erase + Add x1M");
+            for (int i = 0; i < 1000000; ++i)
+            {
+                int& value = values[generator() % size];
+                hash_set.Erase(value);
+                value = static_cast<int>(generator());
+                hash_set.Add(value);
+            }
+        }
+        {
+            LOG_DURATION(name + ": Erase x1M, absent");
+            LOG_ALLOCATIONS(name + ": Erase x1M, absent");
+            for (int i = 0; i < 1000000; ++i)
+            {
+                hash_set.Erase(static_cast<int>(generator()));
+            }
+        }
+        {
+            HashSet<int, IntHasher> copy(num_buckets);
+            for (int value : values)
+            {
+                copy.Add(value);
+            }
+            LOG_DURATION(name + ": Erase of 90%, one by one");
+            for (int value : values)
+            {
+                if (value % 10 != 0)
+                {
+                    copy.Erase(value);
+                }
+            }
+        }
+        {
+            LOG_DURATION(name + ": EraseIf of 90%");
+            hash_set.EraseIf([](int value) { return value % 10 != 0; });
+        }
+        {
+            LOG_DURATION(name + ": Rebuild");
+            hash_set.Rebuild();
+        }
+        cerr << name << ": " << hash_set.Size() << " values in " << hash_set.BucketCount() << " buckets left" << endl;
+    }
+}
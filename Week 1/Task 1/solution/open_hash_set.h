@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Offsets from the home slot of a value, step = 0, 1, 2, ..., for OpenHashSet.
+// Linear probing keeps a probe within a few cache lines and lets Erase shift
+// the rest of the run back, so it never leaves tombstones behind.
+struct LinearProbing
+{
+    static constexpr bool BACKWARD_SHIFT_DELETE = true;
+
+    std::size_t operator()(std::size_t step) const
+    {
+        return step;
+    }
+};
+
+// Triangular numbers, which visit every slot of a power of two table. Runs of
+// values with nearby home slots do not merge, at the price of jumping around
+// memory; an erased value leaves a tombstone until the next rehash.
+struct QuadraticProbing
+{
+    static constexpr bool BACKWARD_SHIFT_DELETE = false;
+
+    std::size_t operator()(std::size_t step) const
+    {
+        return step * (step + 1) / 2;
+    }
+};
+
+// HashSet with the values in one array instead of a list per bucket, so a
+// lookup reads consecutive slots and Add allocates only when the table grows.
+// The capacity is a power of two and doubles whenever the slots in use,
+// tombstones included, would exceed the maximum load factor. The hash is
+// spread over the slots by Fibonacci hashing, so a weak hasher such as the
+// identity still fills the table evenly.
+//
+// Type must be default constructible: an empty slot holds Type().
+template <typename Type, typename Hasher, typename Probing = LinearProbing>
+class OpenHashSet
+{
+public:
+    // expected_size only saves rehashes, the set grows as needed;
+    // max_load_factor must be in (0, 1]
+    explicit OpenHashSet(std::size_t expected_size = 0, const Hasher& hasher = {}, double max_load_factor = 0.75) :
+        hasher_(hasher),
+        max_load_factor_(max_load_factor)
+    {
+        // Also rejects NaN. With no slots allowed in use the table would grow forever
+        if (!(max_load_factor > 0 && max_load_factor <= 1))
+        {
+            throw std::invalid_argument("The max load factor must be in (0, 1]");
+        }
+        Reserve(expected_size);
+    }
+
+    void Add(const Type& value)
+    {
+        if (Capacity() != 0 && FindSlot(value) != NOT_FOUND)
+        {
+            return;
+        }
+        if (size_ + tombstones_ + 1 > MaxUsedSlots(Capacity()))
+        {
+            // When tombstones fill the table it is rebuilt at its own capacity,
+            // so clearing them never undoes a Reserve
+            Rehash(std::max(size_ + 1, MaxUsedSlots(Capacity())));
+        }
+        Insert(value);
+    }
+
+    bool Has(const Type& value) const
+    {
+        return Capacity() != 0 && FindSlot(value) != NOT_FOUND;
+    }
+
+    void Erase(const Type& value)
+    {
+        if (Capacity() == 0)
+        {
+            return;
+        }
+        const std::size_t slot = FindSlot(value);
+        if (slot == NOT_FOUND)
+        {
+            return;
+        }
+
+        --size_;
+        if constexpr (Probing::BACKWARD_SHIFT_DELETE)
+        {
+            ShiftBack(slot);
+        }
+        else
+        {
+            states_[slot] = State::Deleted;
+            values_[slot] = Type();
+            ++tombstones_;
+        }
+    }
+
+    std::size_t Size() const
+    {
+        return size_;
+    }
+
+    std::size_t Capacity() const
+    {
+        return states_.size();
+    }
+
+    double LoadFactor() const
+    {
+        return Capacity() == 0 ? 0.0 : static_cast<double>(size_) / Capacity();
+    }
+
+    // Makes room for count values without another rehash
+    void Reserve(std::size_t count)
+    {
+        if (count > MaxUsedSlots(Capacity()))
+        {
+            Rehash(count);
+        }
+    }
+
+    // The slots Has(value) looks at, in order: the last one holds value or is
+    // the empty slot that proves it is absent
+    std::vector<std::size_t> ProbeSequence(const Type& value) const
+    {
+        std::vector<std::size_t> sequence;
+        if (Capacity() == 0)
+        {
+            return sequence;
+        }
+        const std::size_t home = HomeSlot(value);
+        for (std::size_t step = 0;; ++step)
+        {
+            const std::size_t slot = (home + probing_(step)) & mask_;
+            sequence.push_back(slot);
+            if (states_[slot] == State::Empty || (states_[slot] == State::Full && values_[slot] == value))
+            {
+                return sequence;
+            }
+        }
+    }
+
+    struct ProbeStats
+    {
+        // Slots looked at to find a value that is present, on average and at worst
+        double average_hit;
+        std::size_t max_hit;
+        // Slots looked at to learn a value is absent, averaged over all home slots
+        double average_miss;
+        std::size_t tombstones;
+    };
+
+    ProbeStats GetProbeStats() const
+    {
+        ProbeStats stats{ 0.0, 0, 0.0, tombstones_ };
+        if (Capacity() == 0)
+        {
+            return stats;
+        }
+        std::size_t total_hit = 0;
+        std::size_t total_miss = 0;
+        for (std::size_t slot = 0; slot < Capacity(); ++slot)
+        {
+            if (states_[slot] == State::Full)
+            {
+                const std::size_t length = ProbeSequence(values_[slot]).size();
+                total_hit += length;
+                stats.max_hit = std::max(stats.max_hit, length);
+            }
+            for (std::size_t step = 0;; ++step)
+            {
+                if (states_[(slot + probing_(step)) & mask_] == State::Empty)
+                {
+                    total_miss += step + 1;
+                    break;
+                }
+            }
+        }
+        stats.average_hit = size_ == 0 ? 0.0 : static_cast<double>(total_hit) / size_;
+        stats.average_miss = static_cast<double>(total_miss) / Capacity();
+        return stats;
+    }
+
+private:
+    enum class State : std::uint8_t
+    {
+        Empty,
+        Full,
+        Deleted,
+    };
+
+    static constexpr std::size_t NOT_FOUND = static_cast<std::size_t>(-1);
+    static constexpr std::size_t MIN_CAPACITY = 8;
+
+    std::size_t MaxUsedSlots(std::size_t capacity) const
+    {
+        if (capacity == 0)
+        {
+            return 0;
+        }
+        // At least one slot stays empty, which ends every probe
+        const std::size_t max_used = static_cast<std::size_t>(capacity * max_load_factor_);
+        return max_used < capacity ? max_used : capacity - 1;
+    }
+
+    std::size_t HomeSlot(const Type& value) const
+    {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(hasher_(value)) * 0x9e3779b97f4a7c15ULL) >> shift_);
+    }
+
+    std::size_t FindSlot(const Type& value) const
+    {
+        const std::size_t home = HomeSlot(value);
+        for (std::size_t step = 0;; ++step)
+        {
+            const std::size_t slot = (home + probing_(step)) & mask_;
+            if (states_[slot] == State::Empty)
+            {
+                return NOT_FOUND;
+            }
+            if (states_[slot] == State::Full && values_[slot] == value)
+            {
+                return slot;
+            }
+        }
+    }
+
+    // value must be absent and there must be room for it
+    template <typename Value>
+    void Insert(Value&& value)
+    {
+        const std::size_t home = HomeSlot(value);
+        for (std::size_t step = 0;; ++step)
+        {
+            const std::size_t slot = (home + probing_(step)) & mask_;
+            if (states_[slot] != State::Full)
+            {
+                if (states_[slot] == State::Deleted)
+                {
+                    --tombstones_;
+                }
+                states_[slot] = State::Full;
+                values_[slot] = std::forward<Value>(value);
+                ++size_;
+                return;
+            }
+        }
+    }
+
+    // Empties slot and moves back the values after it in the run that would
+    // not be found any more across the gap (Knuth, algorithm 6.4R)
+    void ShiftBack(std::size_t slot)
+    {
+        std::size_t gap = slot;
+        for (std::size_t next = (gap + 1) & mask_; states_[next] == State::Full; next = (next + 1) & mask_)
+        {
+            // The value at next stays if its home is cyclically in (gap, next]
+            const std::size_t home = HomeSlot(values_[next]);
+            if (((next - home) & mask_) >= ((next - gap) & mask_))
+            {
+                values_[gap] = std::move(values_[next]);
+                states_[gap] = State::Full;
+                gap = next;
+            }
+        }
+        states_[gap] = State::Empty;
+        values_[gap] = Type();
+    }
+
+    // Rebuilds the table big enough for count values, dropping tombstones
+    void Rehash(std::size_t count)
+    {
+        std::size_t capacity = MIN_CAPACITY;
+        while (MaxUsedSlots(capacity) < count)
+        {
+            capacity *= 2;
+        }
+
+        std::vector<State> old_states(capacity, State::Empty);
+        std::vector<Type> old_values(capacity);
+        old_states.swap(states_);
+        old_values.swap(values_);
+        mask_ = capacity - 1;
+        shift_ = 64;
+        for (std::size_t c = capacity; c > 1; c /= 2)
+        {
+            --shift_;
+        }
+        size_ = 0;
+        tombstones_ = 0;
+
+        for (std::size_t slot = 0; slot < old_states.size(); ++slot)
+        {
+            if (old_states[slot] == State::Full)
+            {
+                Insert(std::move(old_values[slot]));
+            }
+        }
+    }
+
+    Hasher hasher_;
+    Probing probing_;
+    double max_load_factor_;
+
+    std::vector<State> states_;
+    std::vector<Type> values_;
+    std::size_t mask_ = 0;
+    unsigned shift_ = 64;
+    std::size_t size_ = 0;
+    std::size_t tombstones_ = 0;
+};
@@ -0,0 +1,282 @@
+#include "open_hash_set.h"
+#include "hash_set.h"
+#include "test_values.h"
+
+#include "test_runner.h"
+#include "profile.h"
+#define ALLOC_PROFILE_INSTALL
+#include "alloc_profile.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    template <typename Probing>
+    void TestBasics()
+    {
+        OpenHashSet<int, IntHasher, Probing> hash_set(2);
+        hash_set.Add(3);
+        hash_set.Add(4);
+        ASSERT(hash_set.Has(3));
+        ASSERT(hash_set.Has(4));
+        ASSERT(!hash_set.Has(5));
+
+        hash_set.Erase(3);
+        ASSERT(!hash_set.Has(3));
+        ASSERT(hash_set.Has(4));
+
+        hash_set.Add(3);
+        hash_set.Add(5);
+        hash_set.Add(5);
+        ASSERT(hash_set.Has(3));
+        ASSERT(hash_set.Has(4));
+        ASSERT(hash_set.Has(5));
+        ASSERT_EQUAL(hash_set.Size(), 3u);
+
+        hash_set.Erase(5);
+        hash_set.Erase(5);
+        ASSERT(!hash_set.Has(5));
+        ASSERT_EQUAL(hash_set.Size(), 2u);
+
+        OpenHashSet<int, IntHasher, Probing> empty;
+        ASSERT_EQUAL(empty.Capacity(), 0u);
+        ASSERT(!empty.Has(0));
+        empty.Erase(0);
+        ASSERT(empty.ProbeSequence(0).empty());
+
+        OpenHashSet<TestValue, TestValueHasher, Probing> equivalent;
+        equivalent.Add(TestValue{ 2 });
+        equivalent.Add(TestValue{ 3 });
+        ASSERT(equivalent.Has(TestValue{ 2 }));
+        ASSERT(equivalent.Has(TestValue{ 3 }));
+        ASSERT_EQUAL(equivalent.Size(), 1u);
+    }
+
+    template <typename Probing>
+    void TestMatchesStdSet()
+    {
+        mt19937 generator(46);
+        for (int range : { 10, 100, 5000 })
+        {
+            OpenHashSet<int, IntHasher, Probing> hash_set;
+            CheckMatchesStdSet(hash_set, generator, range);
+            ASSERT(hash_set.LoadFactor() <= 0.75);
+        }
+    }
+}
+
+void TestOpenHashSet()
+{
+    TestBasics<LinearProbing>();
+    TestBasics<QuadraticProbing>();
+}
+
+void TestOpenHashSetMatchesStdSet()
+{
+    TestMatchesStdSet<LinearProbing>();
+    TestMatchesStdSet<QuadraticProbing>();
+}
+
+void TestOpenHashSetGrowth()
+{
+    OpenHashSet<int, IntHasher> hash_set;
+    size_t rehashes = 0;
+    for (int value = 0; value < 10000; ++value)
+    {
+        const size_t capacity = hash_set.Capacity();
+        hash_set.Add(value);
+        if (hash_set.Capacity() != capacity)
+        {
+            ++rehashes;
+            ASSERT(capacity == 0 || hash_set.Capacity() == 2 * capacity);
+        }
+        ASSERT(hash_set.LoadFactor() <= 0.75);
+    }
+    ASSERT_EQUAL(hash_set.Capacity(), 16384u);
+    ASSERT_EQUAL(rehashes, 12u);
+
+    OpenHashSet<int, IntHasher> reserved(10000);
+    const size_t capacity = reserved.Capacity();
+    ASSERT_ALLOCS_AT_MOST(0, {
+        for (int value = 0; value < 10000; ++value)
+        {
+            reserved.Add(value);
+        }
+    });
+    ASSERT_EQUAL(reserved.Capacity(), capacity);
+
+    // Clearing the tombstones keeps the reserved capacity
+    OpenHashSet<int, IntHasher, QuadraticProbing> refilled(10000);
+    for (int value = 0; value < 10000; ++value)
+    {
+        refilled.Add(value);
+        refilled.Erase(value);
+    }
+    for (int value = 10000; value < 20000; ++value)
+    {
+        refilled.Add(value);
+        ASSERT_EQUAL(refilled.Capacity(), capacity);
+    }
+    ASSERT_EQUAL(refilled.Size(), 10000u);
+
+    OpenHashSet<int, IntHasher> dense(0, {}, 0.95);
+    for (int value = 0; value < 1000; ++value)
+    {
+        dense.Add(value);
+    }
+    ASSERT_EQUAL(dense.Capacity(), 2048u);
+
+    OpenHashSet<int, IntHasher> full(0, {}, 1.0);
+    for (int value = 0; value < 1000; ++value)
+    {
+        full.Add(value);
+    }
+    ASSERT_EQUAL(full.Capacity(), 1024u);
+    ASSERT(full.Has(999));
+    for (double max_load_factor : { 0.0, -0.5, 1.5, nan("") })
+    {
+        try
+        {
+            OpenHashSet<int, IntHasher> invalid(0, {}, max_load_factor);
+            ASSERT(false);
+        }
+        catch (const invalid_argument&)
+        {
+        }
+    }
+
+    // Strings move between slots on rehash and backward shifts
+    OpenHashSet<string, hash<string>> strings;
+    for (int i = 0; i < 1000; ++i)
+    {
+        strings.Add("a long enough string not to fit in place " + to_string(i));
+    }
+    for (int i = 0; i < 1000; i += 2)
+    {
+        strings.Erase("a long enough string not to fit in place " + to_string(i));
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_EQUAL(strings.Has("a long enough string not to fit in place " + to_string(i)), i % 2 == 1);
+    }
+}
+
+void TestOpenHashSetProbeSequence()
+{
+    OpenHashSet<int, ConstantHasher, LinearProbing> linear(4);
+    OpenHashSet<int, ConstantHasher, QuadraticProbing> quadratic(4);
+    for (int value = 0; value < 4; ++value)
+    {
+        linear.Add(value);
+        quadratic.Add(value);
+    }
+    const size_t home = linear.ProbeSequence(0).front();
+    ASSERT_EQUAL(linear.ProbeSequence(2), vector<size_t>({ home, home + 1, home + 2 }));
+    ASSERT_EQUAL(linear.ProbeSequence(9).size(), 5u);
+    ASSERT_EQUAL(quadratic.ProbeSequence(3).size(), 4u);
+    ASSERT_EQUAL(quadratic.ProbeSequence(3)[2], (home + 3) & (quadratic.Capacity() - 1));
+
+    auto linear_stats = linear.GetProbeStats();
+    ASSERT_EQUAL(linear_stats.max_hit, 4u);
+    ASSERT_EQUAL(linear_stats.average_hit, 2.5);
+
+    // Linear probing closes the gap, quadratic probing leaves a tombstone to step over
+    linear.Erase(0);
+    quadratic.Erase(0);
+    ASSERT_EQUAL(linear.ProbeSequence(2).size(), 2u);
+    ASSERT_EQUAL(linear.ProbeSequence(3).size(), 3u);
+    ASSERT_EQUAL(linear.GetProbeStats().tombstones, 0u);
+    ASSERT_EQUAL(quadratic.ProbeSequence(3).size(), 4u);
+    ASSERT_EQUAL(quadratic.GetProbeStats().tombstones, 1u);
+    ASSERT(!quadratic.Has(0));
+
+    // The tombstone is reused
+    quadratic.Add(7);
+    ASSERT_EQUAL(quadratic.ProbeSequence(7).size(), 1u);
+    ASSERT_EQUAL(quadratic.GetProbeStats().tombstones, 0u);
+}
+
+namespace
+{
+    template <typename Set>
+    void BenchmarkSet(const string& name, Set& hash_set, const vector<int>& values, const vector<int>& absent)
+    {
+        size_t found = 0;
+        {
+            LOG_DURATION(name + ": Add x1M");
+            LOG_ALLOCATIONS(name + ": Add x1M");
+            for (int value : values)
+            {
+                hash_set.Add(value);
+            }
+        }
+        {
+            LOG_DURATION(name + ": Has x1M, present");
+            for (int value : values)
+            {
+                found += hash_set.Has(value);
+            }
+        }
+        {
+            LOG_DURATION(name + ": Has x1M, absent");
+            for (int value : absent)
+            {
+                found += hash_set.Has(value);
+            }
+        }
+        {
+            LOG_DURATION(name + ": Erase x1M");
+            for (int value : values)
+            {
+                hash_set.Erase(value);
+            }
+        }
+        cerr << name << ": " << found << " found" << endl;
+    }
+}
+
+void BenchmarkOpenHashSet()
+{
+    mt19937 generator(46);
+    const auto [values, absent] = MakeLookupValues(generator, 1000000);
+
+    {
+        HashSet<int, IntHasher> hash_set(values.size());
+        BenchmarkSet("HashSet, 1M buckets", hash_set, values, absent);
+    }
+    {
+        StdSet<int> hash_set;
+        BenchmarkSet("std::unordered_set", hash_set, values, absent);
+    }
+    {
+        OpenHashSet<int, IntHasher, LinearProbing> hash_set;
+        BenchmarkSet("OpenHashSet, linear", hash_set, values, absent);
+    }
+    {
+        OpenHashSet<int, IntHasher, QuadraticProbing> hash_set;
+        BenchmarkSet("OpenHashSet, quadratic", hash_set, values, absent);
+    }
+    // Filled up to the maximum load factor of 2^20 slots
+    for (double max_load_factor : { 0.5, 0.75, 0.9 })
+    {
+        OpenHashSet<int, IntHasher, LinearProbing> linear(0, {}, max_load_factor);
+        OpenHashSet<int, IntHasher, QuadraticProbing> quadratic(0, {}, max_load_factor);
+        for (size_t i = 0; linear.Size() < static_cast<size_t>(max_load_factor * (1 << 20)); ++i)
+        {
+            linear.Add(values[i]);
+            quadratic.Add(values[i]);
+        }
+        const auto linear_stats = linear.GetProbeStats();
+        const auto quadratic_stats = quadratic.GetProbeStats();
+        cerr << "max load factor " << max_load_factor << ", load " << linear.LoadFactor()
+            << ": linear probes hit " << linear_stats.average_hit << " (max " << linear_stats.max_hit << ") miss " << linear_stats.average_miss
+            << ", quadratic hit " << quadratic_stats.average_hit << " (max " << quadratic_stats.max_hit << ") miss " << quadratic_stats.average_miss << endl;
+    }
+}
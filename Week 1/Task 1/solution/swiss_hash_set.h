@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SWISS_HASH_SET_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// HashSet laid out as a Swiss table: the slots come in groups of 16, each
+// with a control byte that says whether it is empty, deleted or full and,
+// when full, holds 7 bits of the hash of its value. A lookup probes whole
+// groups, comparing the 16 control bytes with the tag of the value at once,
+// and looks at a value only when its tag matches, which is about one in 128
+// slots when the value is absent. Groups are probed in triangular steps and
+// the table is grown to keep it at most 7/8 full.
+//
+// Type must be default constructible: an empty slot holds Type().
+template <typename Type, typename Hasher>
+class SwissHashSet
+{
+public:
+    static constexpr std::size_t GROUP_SIZE = 16;
+
+public:
+    // expected_size only saves rehashes, the set grows as needed
+    explicit SwissHashSet(std::size_t expected_size = 0, const Hasher& hasher = {}) :
+        hasher_(hasher)
+    {
+        Reserve(expected_size);
+    }
+
+    void Add(const Type& value)
+    {
+        Hash hash = HashOf(value);
+        if (Capacity() != 0 && FindSlot(value, hash) != NOT_FOUND)
+        {
+            return;
+        }
+        if (size_ + tombstones_ + 1 > MaxUsedSlots(Capacity()))
+        {
+            // Like in OpenHashSet, tombstones alone never shrink the table
+            Rehash(std::max(size_ + 1, MaxUsedSlots(Capacity())));
+            hash = HashOf(value);
+        }
+        Insert(value, hash);
+    }
+
+    bool Has(const Type& value) const
+    {
+        return Capacity() != 0 && FindSlot(value, HashOf(value)) != NOT_FOUND;
+    }
+
+    void Erase(const Type& value)
+    {
+        if (Capacity() == 0)
+        {
+            return;
+        }
+        const std::size_t slot = FindSlot(value, HashOf(value));
+        if (slot == NOT_FOUND)
+        {
+            return;
+        }
+
+        // A lookup goes past a group only if the group has no empty slot. If it
+        // has one the group has never been full, no value was pushed to a later
+        // group because of it, and the slot can go back to empty.
+        const std::size_t group = slot & ~(GROUP_SIZE - 1);
+        if (MatchEmpty(&control_[group]) != 0)
+        {
+            control_[slot] = EMPTY;
+        }
+        else
+        {
+            control_[slot] = DELETED;
+            ++tombstones_;
+        }
+        values_[slot] = Type();
+        --size_;
+    }
+
+    std::size_t Size() const
+    {
+        return size_;
+    }
+
+    std::size_t Capacity() const
+    {
+        return control_.size();
+    }
+
+    std::size_t Tombstones() const
+    {
+        return tombstones_;
+    }
+
+    double LoadFactor() const
+    {
+        return Capacity() == 0 ? 0.0 : static_cast<double>(size_) / Capacity();
+    }
+
+    // Makes room for count values without another rehash
+    void Reserve(std::size_t count)
+    {
+        if (count > MaxUsedSlots(Capacity()))
+        {
+            Rehash(count);
+        }
+    }
+
+private:
+    // Control bytes: a full slot holds the tag, 0..127, in the other states
+    // the high bit is set
+    static constexpr std::int8_t EMPTY = -128;
+    static constexpr std::int8_t DELETED = -2;
+
+    static constexpr std::size_t NOT_FOUND = static_cast<std::size_t>(-1);
+
+    // Which group to start from and the tag of a value
+    struct Hash
+    {
+        std::size_t group;
+        std::int8_t tag;
+    };
+
+    // Bit i is set for the slots i of a group that match
+    using Mask = std::uint32_t;
+
+    static std::size_t MaxUsedSlots(std::size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+#if defined(SWISS_HASH_SET_SSE2)
+    static Mask MatchTag(const std::int8_t* group, std::int8_t tag)
+    {
+        const __m128i control = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<Mask>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), control)));
+    }
+
+    static Mask MatchEmptyOrDeleted(const std::int8_t* group)
+    {
+        // Both have the high bit set, which is what movemask collects
+        return static_cast<Mask>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+    }
+#else
+    static Mask MatchTag(const std::int8_t* group, std::int8_t tag)
+    {
+        Mask mask = 0;
+        for (std::size_t i = 0; i < GROUP_SIZE; ++i)
+        {
+            mask |= static_cast<Mask>(group[i] == tag) << i;
+        }
+        return mask;
+    }
+
+    static Mask MatchEmptyOrDeleted(const std::int8_t* group)
+    {
+        Mask mask = 0;
+        for (std::size_t i = 0; i < GROUP_SIZE; ++i)
+        {
+            mask |= static_cast<Mask>(group[i] < 0) << i;
+        }
+        return mask;
+    }
+#endif
+
+    static Mask MatchEmpty(const std::int8_t* group)
+    {
+        return MatchTag(group, EMPTY);
+    }
+
+    // mask must not be 0
+    static std::size_t LowestBit(Mask mask)
+    {
+#if defined(__GNUC__)
+        return static_cast<std::size_t>(__builtin_ctz(mask));
+#elif defined(_MSC_VER)
+        unsigned long result;
+        _BitScanForward(&result, mask);
+        return static_cast<std::size_t>(result);
+#else
+        std::size_t result = 0;
+        for (; (mask & 1) == 0; mask >>= 1)
+        {
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    // Starts loading the first values of a group while its control bytes are
+    // looked at, otherwise the two cache misses of a hit come one after the other
+    void PrefetchValues(std::size_t group) const
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(&values_[group * GROUP_SIZE]);
+#elif defined(SWISS_HASH_SET_SSE2)
+        _mm_prefetch(reinterpret_cast<const char*>(&values_[group * GROUP_SIZE]), _MM_HINT_T0);
+#else
+        (void)group;
+#endif
+    }
+
+    // The group comes from the top bits of the mixed hash, like in
+    // OpenHashSet, and the tag from the 7 bits below them
+    Hash HashOf(const Type& value) const
+    {
+        const std::uint64_t mixed = static_cast<std::uint64_t>(hasher_(value)) * 0x9e3779b97f4a7c15ULL;
+        const std::uint64_t top = mixed >> (shift_ - 7);
+        return { static_cast<std::size_t>(top >> 7), static_cast<std::int8_t>(top & 0x7f) };
+    }
+
+    std::size_t FindSlot(const Type& value, Hash hash) const
+    {
+        std::size_t group = hash.group;
+        PrefetchValues(group);
+        for (std::size_t step = 1;; ++step)
+        {
+            const std::int8_t* control = &control_[group * GROUP_SIZE];
+            for (Mask mask = MatchTag(control, hash.tag); mask != 0; mask &= mask - 1)
+            {
+                const std::size_t slot = group * GROUP_SIZE + LowestBit(mask);
+                if (values_[slot] == value)
+                {
+                    return slot;
+                }
+            }
+            if (MatchEmpty(control) != 0)
+            {
+                return NOT_FOUND;
+            }
+            // Triangular steps visit every group of a power of two table
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    // value must be absent and there must be room for it
+    template <typename Value>
+    void Insert(Value&& value, Hash hash)
+    {
+        std::size_t group = hash.group;
+        for (std::size_t step = 1;; ++step)
+        {
+            const Mask mask = MatchEmptyOrDeleted(&control_[group * GROUP_SIZE]);
+            if (mask != 0)
+            {
+                const std::size_t slot = group * GROUP_SIZE + LowestBit(mask);
+                if (control_[slot] == DELETED)
+                {
+                    --tombstones_;
+                }
+                control_[slot] = hash.tag;
+                values_[slot] = std::forward<Value>(value);
+                ++size_;
+                return;
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    // Rebuilds the table big enough for count values, dropping tombstones
+    void Rehash(std::size_t count)
+    {
+        std::size_t capacity = GROUP_SIZE;
+        while (MaxUsedSlots(capacity) < count)
+        {
+            capacity *= 2;
+        }
+
+        std::vector<std::int8_t> old_control(capacity, EMPTY);
+        std::vector<Type> old_values(capacity);
+        old_control.swap(control_);
+        old_values.swap(values_);
+        group_mask_ = capacity / GROUP_SIZE - 1;
+        shift_ = 64;
+        for (std::size_t groups = capacity / GROUP_SIZE; groups > 1; groups /= 2)
+        {
+            --shift_;
+        }
+        size_ = 0;
+        tombstones_ = 0;
+
+        for (std::size_t slot = 0; slot < old_control.size(); ++slot)
+        {
+            if (old_control[slot] >= 0)
+            {
+                const Hash hash = HashOf(old_values[slot]);
+                Insert(std::move(old_values[slot]), hash);
+            }
+        }
+    }
+
+    Hasher hasher_;
+
+    std::vector<std::int8_t> control_;
+    std::vector<Type> values_;
+    std::size_t group_mask_ = 0;
+    unsigned shift_ = 64;
+    std::size_t size_ = 0;
+    std::size_t tombstones_ = 0;
+};
@@ -0,0 +1,235 @@
+#include "swiss_hash_set.h"
+#include "open_hash_set.h"
+#include "hash_set.h"
+#include "test_values.h"
+
+#include "test_runner.h"
+#include "profile.h"
+#include "alloc_profile.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Values below 1000 share one probe sequence and the rest share another,
+    // so new values can fill empty groups while the old ones leave tombstones
+    struct TwoChainHasher
+    {
+        size_t operator()(int value) const
+        {
+            return value < 1000 ? 0 : 1;
+        }
+    };
+}
+
+void TestSwissHashSet()
+{
+    SwissHashSet<int, IntHasher> hash_set(2);
+    ASSERT_EQUAL(hash_set.Capacity(), 16u);
+    hash_set.Add(3);
+    hash_set.Add(4);
+    ASSERT(hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+    ASSERT(!hash_set.Has(5));
+
+    hash_set.Erase(3);
+    ASSERT(!hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+
+    hash_set.Add(3);
+    hash_set.Add(5);
+    hash_set.Add(5);
+    ASSERT(hash_set.Has(3));
+    ASSERT(hash_set.Has(5));
+    ASSERT_EQUAL(hash_set.Size(), 3u);
+    hash_set.Erase(5);
+    hash_set.Erase(5);
+    ASSERT_EQUAL(hash_set.Size(), 2u);
+
+    SwissHashSet<int, IntHasher> empty;
+    ASSERT_EQUAL(empty.Capacity(), 0u);
+    ASSERT(!empty.Has(0));
+    empty.Erase(0);
+
+    SwissHashSet<TestValue, TestValueHasher> equivalent;
+    equivalent.Add(TestValue{ 2 });
+    equivalent.Add(TestValue{ 3 });
+    ASSERT(equivalent.Has(TestValue{ 2 }));
+    ASSERT_EQUAL(equivalent.Size(), 1u);
+
+    SwissHashSet<string, hash<string>> strings;
+    for (int i = 0; i < 1000; ++i)
+    {
+        strings.Add("a long enough string not to fit in place " + to_string(i));
+    }
+    for (int i = 0; i < 1000; i += 2)
+    {
+        strings.Erase("a long enough string not to fit in place " + to_string(i));
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_EQUAL(strings.Has("a long enough string not to fit in place " + to_string(i)), i % 2 == 1);
+    }
+    ASSERT(!strings.Has(""));
+}
+
+void TestSwissHashSetMatchesStdSet()
+{
+    mt19937 generator(49);
+    for (int range : { 10, 100, 5000, 1000000 })
+    {
+        SwissHashSet<int, IntHasher> hash_set;
+        CheckMatchesStdSet(hash_set, generator, range);
+        ASSERT(hash_set.LoadFactor() <= 0.875);
+    }
+}
+
+void TestSwissHashSetGroups()
+{
+    // 14 values fill the table of one group up to 7/8
+    SwissHashSet<int, ConstantHasher> one_group(14);
+    ASSERT_EQUAL(one_group.Capacity(), 16u);
+    for (int value = 0; value < 14; ++value)
+    {
+        one_group.Add(value);
+    }
+    ASSERT_EQUAL(one_group.Capacity(), 16u);
+    // The group has empty slots left, so erased slots go back to empty
+    one_group.Erase(3);
+    ASSERT_EQUAL(one_group.Tombstones(), 0u);
+    ASSERT(!one_group.Has(3));
+
+    // With every tag equal the set still works, just comparing more values
+    SwissHashSet<int, ConstantHasher> overflow;
+    for (int value = 0; value < 100; ++value)
+    {
+        overflow.Add(value);
+    }
+    ASSERT_EQUAL(overflow.Size(), 100u);
+    // The home group is full: erasing from it leaves a tombstone that keeps
+    // the values in later groups reachable
+    overflow.Erase(0);
+    ASSERT_EQUAL(overflow.Tombstones(), 1u);
+    for (int value = 1; value < 100; ++value)
+    {
+        ASSERT(overflow.Has(value));
+    }
+    // The tombstone is reused
+    overflow.Add(1000);
+    ASSERT_EQUAL(overflow.Tombstones(), 0u);
+    ASSERT(overflow.Has(1000));
+    ASSERT(!overflow.Has(0));
+
+    SwissHashSet<int, IntHasher> reserved(10000);
+    const size_t capacity = reserved.Capacity();
+    ASSERT_ALLOCS_AT_MOST(0, {
+        for (int value = 0; value < 10000; ++value)
+        {
+            reserved.Add(value);
+        }
+        for (int value = 0; value < 10000; ++value)
+        {
+            reserved.Erase(value);
+        }
+    });
+    ASSERT_EQUAL(reserved.Capacity(), capacity);
+    ASSERT_EQUAL(reserved.Size(), 0u);
+
+    // Clearing the tombstones keeps the reserved capacity
+    SwissHashSet<int, TwoChainHasher> refilled(100);
+    const size_t refilled_capacity = refilled.Capacity();
+    for (int value = 0; value < 100; ++value)
+    {
+        refilled.Add(value);
+    }
+    for (int value = 0; value < 100; ++value)
+    {
+        refilled.Erase(value);
+    }
+    ASSERT(refilled.Tombstones() > 0);
+    for (int value = 1000; value < 1100; ++value)
+    {
+        refilled.Add(value);
+        ASSERT_EQUAL(refilled.Capacity(), refilled_capacity);
+    }
+    ASSERT_EQUAL(refilled.Tombstones(), 0u);
+    ASSERT_EQUAL(refilled.Size(), 100u);
+}
+
+namespace
+{
+    // Adds values, then looks up lookups of them with every miss rate, where
+    // a miss is a lookup of the same index in absent
+    template <typename Set, typename Type>
+    void BenchmarkLookups(const string& name, Set& hash_set, const vector<Type>& values, const vector<Type>& absent)
+    {
+        {
+            LOG_DURATION(name + ": Add x" + to_string(values.size()));
+            for (const Type& value : values)
+            {
+                hash_set.Add(value);
+            }
+        }
+        mt19937 generator(49);
+        vector<size_t> lookups(4 * values.size());
+        for (size_t& index : lookups)
+        {
+            index = generator() % values.size();
+        }
+        for (int miss_percent : { 0, 50, 100 })
+        {
+            size_t found = 0;
+            {
+                LOG_DURATION(name + ": Has x" + to_string(lookups.size()) + ", " + to_string(miss_percent) + "% miss");
+                for (size_t i = 0; i < lookups.size(); ++i)
+                {
+                    const bool miss = static_cast<int>(i % 100) < miss_percent;
+                    found += hash_set.Has(miss ? absent[lookups[i]] : values[lookups[i]]);
+                }
+            }
+            cerr << name << ": " << found << " found" << endl;
+        }
+    }
+
+    template <typename Type, typename Hasher>
+    void BenchmarkAllSets(const string& key, const vector<Type>& values, const vector<Type>& absent)
+    {
+        {
+            SwissHashSet<Type, Hasher> hash_set;
+            BenchmarkLookups("SwissHashSet, " + key, hash_set, values, absent);
+        }
+        {
+            OpenHashSet<Type, Hasher> hash_set;
+            BenchmarkLookups("OpenHashSet, " + key, hash_set, values, absent);
+        }
+        {
+            HashSet<Type, Hasher> hash_set(values.size());
+            BenchmarkLookups("HashSet, " + key, hash_set, values, absent);
+        }
+        {
+            StdSet<Type> hash_set;
+            BenchmarkLookups("std::unordered_set, " + key, hash_set, values, absent);
+        }
+    }
+}
+
+void BenchmarkSwissHashSet()
+{
+    mt19937 generator(49);
+    const auto [values, absent] = MakeLookupValues(generator, 1000000);
+    BenchmarkAllSets<int, IntHasher>("int", values, absent);
+
+    vector<string> string_values(values.size());
+    vector<string> string_absent(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        string_values[i] = "user:" + to_string(values[i]);
+        string_absent[i] = "user:" + to_string(absent[i]);
+    }
+    BenchmarkAllSets<string, hash<string>>("string", string_values, string_absent);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "test_runner.h"
+
+#include <cstddef>
+#include <random>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+struct IntHasher 
+{
+    std::size_t operator()(const int value) const
+    {
+        return static_cast<std::size_t>(value);
+    }
+};
+
+// Sends every value to the same bucket, slot or group, so that it fills and
+// overflows and probe sequences are easy to predict
+struct ConstantHasher
+{
+    std::size_t operator()(int) const
+    {
+        return 0;
+    }
+};
+
+struct TestValue
+{
+    int value;
+
+    bool operator==(TestValue other) const 
+    {
+        return static_cast<std::size_t>(value) / 2 == static_cast<std::size_t>(other.value) / 2;
+    }
+};
+
+struct TestValueHasher 
+{
+    std::size_t operator()(const TestValue value) const
+    {
+        return static_cast<std::size_t>(value.value) / 2;
+    }
+};
+
+// std::unordered_set with the API of HashSet, for the benchmarks to compare with
+template <typename Type>
+struct StdSet
+{
+    std::unordered_set<Type> values;
+
+    void Add(const Type& value)
+    {
+        values.insert(value);
+    }
+
+    bool Has(const Type& value) const
+    {
+        return values.count(value) != 0;
+    }
+
+    void Erase(const Type& value)
+    {
+        values.erase(value);
+    }
+};
+
+// Random values for the benchmarks: the even ones in values are added and
+// the odd ones in absent are looked up in vain
+struct LookupValues
+{
+    std::vector<int> values;
+    std::vector<int> absent;
+};
+
+inline LookupValues MakeLookupValues(std::mt19937& generator, std::size_t count)
+{
+    LookupValues result{ std::vector<int>(count), std::vector<int>(count) };
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        result.values[i] = static_cast<int>(generator() & ~1u);
+        result.absent[i] = static_cast<int>(generator() | 1u);
+    }
+    return result;
+}
+
+// Makes operations random Adds and Erases of values in [-range / 2, range / 2)
+// on hash_set and on a std::set, a third of them Erases, and checks that both
+// always agree
+template <typename Set>
+void CheckMatchesStdSet(Set& hash_set, std::mt19937& generator, int range, int operations = 50000)
+{
+    std::set<int> expected;
+    for (int i = 0; i < operations; ++i)
+    {
+        const int value = static_cast<int>(generator() % range) - range / 2;
+        if (generator() % 3 == 0)
+        {
+            hash_set.Erase(value);
+            expected.erase(value);
+        }
+        else
+        {
+            hash_set.Add(value);
+            expected.insert(value);
+        }
+        ASSERT_EQUAL(hash_set.Has(value), expected.count(value) == 1);
+    }
+    ASSERT_EQUAL(hash_set.Size(), expected.size());
+    for (int value = -range; value < range; ++value)
+    {
+        ASSERT_EQUAL(hash_set.Has(value), expected.count(value) == 1);
+    }
+}
@@ -1,28 +1,44 @@
 #include "test_runner.h"
 #include "stats_aggregator.h"
+#include "value_reader.h"
 
 #include <vector>
 #include <string>
 #include <map>
 #include <memory>
 #include <iostream>
+#include <fstream>
 #include <unordered_map>
 #include <functional>
+#include <optional>
 
 using namespace StatsAggregators;
 using namespace std;
 
 void TestAll();
 
+// An aggregator is given by its name optionally followed by an integer
+// parameter, e.g. "hdr:5" is a histogram keeping 5 significant bits and
+// "wmax:60" is the maximum of the last 60 values. For "ewma" the parameter is
+// the span N of the average, which gives each new value the weight 2 / (N + 1).
 unique_ptr<StatsAggregator> ReadAggregators(istream& input) 
 {
-    const unordered_map<string, std::function<unique_ptr<StatsAggregator>()>> known_builders = 
+    using Parameter = optional<int>;
+    const unordered_map<string, std::function<unique_ptr<StatsAggregator>(Parameter)>> known_builders = 
     {
-        {"sum", [] { return make_unique<Sum>(); }},
-        {"min", [] { return make_unique<Min>(); }},
-        {"max", [] { return make_unique<Max>(); }},
-        {"avg", [] { return make_unique<Average>(); }},
-        {"mode", [] { return make_unique<Mode>(); }}
+        {"sum", [](Parameter) { return make_unique<Sum>(); }},
+        {"min", [](Parameter) { return make_unique<Min>(); }},
+        {"max", [](Parameter) { return make_unique<Max>(); }},
+        {"avg", [](Parameter) { return make_unique<Average>(); }},
+        {"mode", [](Parameter) { return make_unique<Mode>(); }},
+        {"approx_mode", [](Parameter capacity) { return make_unique<ApproximateMode>(capacity.value_or(1000)); }},
+        {"hdr", [](Parameter bits) { return make_unique<Histogram>(bits.value_or(7)); }},
+        {"kll", [](Parameter k) { return make_unique<Kll>(k.value_or(200)); }},
+        {"wsum", [](Parameter window) { return make_unique<WindowSum>(window.value_or(1000)); }},
+        {"wmin", [](Parameter window) { return make_unique<WindowMin>(window.value_or(1000)); }},
+        {"wmax", [](Parameter window) { return make_unique<WindowMax>(window.value_or(1000)); }},
+        {"wavg", [](Parameter window) { return make_unique<WindowAverage>(window.value_or(1000)); }},
+        {"ewma", [](Parameter span) { return make_unique<Ewma>(2.0 / (span.value_or(199) + 1)); }}
     };
 
     auto result = make_unique<Composite>();
@@ -34,22 +50,46 @@ unique_ptr<StatsAggregator> ReadAggregators(istream& input)
     for (int i = 0; i < aggr_count; ++i) 
     {
         input >> line;
-        result->Add(known_builders.at(line)());
+
+        Parameter parameter;
+        if (size_t colon = line.find(':'); colon != string::npos)
+        {
+            parameter = stoi(line.substr(colon + 1));
+            line.resize(colon);
+        }
+        result->Add(known_builders.at(line)(parameter));
     }
 
     return result;
 }
 
-int main() 
+void BenchmarkAll();
+
+int main(int argc, char* argv[]) 
 {
     TestAll();
 
-    auto stats_aggregator = ReadAggregators(cin);
+    if (argc > 1 && string(argv[1]) == "--benchmark")
+    {
+        BenchmarkAll();
+        return 0;
+    }
 
-    for (int value; cin >> value; ) 
+    // The input is read from the file given as the argument or from stdin
+    ifstream file;
+    if (argc > 1)
     {
-        stats_aggregator->Process(value);
+        file.open(argv[1], ios::binary);
+        if (!file)
+        {
+            cerr << "Cannot open " << argv[1] << endl;
+            return 1;
+        }
     }
+    istream& input = argc > 1 ? static_cast<istream&>(file) : cin;
+
+    auto stats_aggregator = ReadAggregators(input);
+    ProcessValues(input, *stats_aggregator);
     stats_aggregator->PrintValue(cout);
 
     return 0;
@@ -64,4 +104,25 @@ void TestAll()
     RUN_TEST(tr, TestAverage);
     RUN_TEST(tr, TestMode);
     RUN_TEST(tr, TestComposite);
+    RUN_TEST(tr, TestHistogram);
+    RUN_TEST(tr, TestKll);
+    RUN_TEST(tr, TestProcessBatch);
+    RUN_TEST(tr, TestStaticComposite);
+    RUN_TEST(tr, TestMerge);
+    RUN_TEST(tr, TestSelfMerge);
+    RUN_TEST(tr, TestProcessInParallel);
+    RUN_TEST(tr, TestProcessValues);
+    RUN_TEST(tr, TestWindowAggregators);
+    RUN_TEST(tr, TestEwma);
+    RUN_TEST(tr, TestApproximateMode);
+}
+
+void BenchmarkAll()
+{
+    BenchmarkQuantiles();
+    BenchmarkBatch();
+    BenchmarkParallel();
+    BenchmarkWindows();
+    BenchmarkApproximateMode();
+    BenchmarkProcessValues();
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #include "stats_aggregator.h"
 
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <typeinfo>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 
 template <typename T>
@@ -15,6 +25,22 @@ std::ostream& operator << (std::ostream& os, const std::optional<T>& v)
     }
     return os;
 }
+void StatsAggregator::ProcessBatch(const int* values, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Process(values[i]);
+    }
+}
+
+void StatsAggregator::CheckMergeable(const StatsAggregator& other) const
+{
+    if (typeid(*this) != typeid(other))
+    {
+        throw std::invalid_argument("Cannot merge aggregators of different kinds");
+    }
+}
+
 namespace StatsAggregators
 {
     void Composite::Process(int value)
@@ -25,6 +51,14 @@ namespace StatsAggregators
         }
     }
 
+    void Composite::ProcessBatch(const int* values, std::size_t count)
+    {
+        for (auto& aggr : aggregators)
+        {
+            aggr->ProcessBatch(values, count);
+        }
+    }
+
     void Composite::PrintValue(std::ostream& output) const
     {
         for (const auto& aggr : aggregators)
@@ -34,6 +68,31 @@ namespace StatsAggregators
         }
     }
 
+    void Composite::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<Composite>(other);
+        if (that.aggregators.size() != aggregators.size())
+        {
+            throw std::invalid_argument("Cannot merge composites of different structure");
+        }
+        for (std::size_t i = 0; i < aggregators.size(); ++i)
+        {
+            aggregators[i]->CheckMergeable(*that.aggregators[i]);
+        }
+    }
+
+    // Every child is checked before any of them changes, so a composite that
+    // cannot be merged is left as it was
+    void Composite::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        const auto& that = static_cast<const Composite&>(other);
+        for (std::size_t i = 0; i < aggregators.size(); ++i)
+        {
+            aggregators[i]->Merge(*that.aggregators[i]);
+        }
+    }
+
     void Composite::Add(std::unique_ptr<StatsAggregator> aggr)
     {
         aggregators.push_back(std::move(aggr));
@@ -44,6 +103,24 @@ namespace StatsAggregators
         sum += value;
     }
 
+    // The batch loops below keep their state in locals and have no early
+    // exits, which lets the compiler vectorize them
+
+    void Sum::ProcessBatch(const int* values, std::size_t count)
+    {
+        std::int64_t batch_sum = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            batch_sum += values[i];
+        }
+        sum = static_cast<int>(sum + batch_sum);
+    }
+
+    void Sum::Merge(const StatsAggregator& other)
+    {
+        sum += CastForMerge<Sum>(other).sum;
+    }
+
     void Sum::PrintValue(std::ostream& out) const
     {
         out << "Sum is " << sum;
@@ -57,6 +134,28 @@ namespace StatsAggregators
         }
     }
 
+    void Min::ProcessBatch(const int* values, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        int batch_min = values[0];
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            batch_min = values[i] < batch_min ? values[i] : batch_min;
+        }
+        Process(batch_min);
+    }
+
+    void Min::Merge(const StatsAggregator& other)
+    {
+        if (const auto& that = CastForMerge<Min>(other); that.current_min)
+        {
+            Process(*that.current_min);
+        }
+    }
+
     void Min::PrintValue(std::ostream& out) const
     {
         out << "Min is " << current_min;
@@ -70,6 +169,28 @@ namespace StatsAggregators
         }
     }
 
+    void Max::ProcessBatch(const int* values, std::size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        int batch_max = values[0];
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            batch_max = values[i] > batch_max ? values[i] : batch_max;
+        }
+        Process(batch_max);
+    }
+
+    void Max::Merge(const StatsAggregator& other)
+    {
+        if (const auto& that = CastForMerge<Max>(other); that.current_max)
+        {
+            Process(*that.current_max);
+        }
+    }
+
     void Max::PrintValue(std::ostream& out) const
     {
         out << "Max is " << current_max;
@@ -81,6 +202,24 @@ namespace StatsAggregators
         ++total;
     }
 
+    void Average::ProcessBatch(const int* values, std::size_t count)
+    {
+        std::int64_t batch_sum = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            batch_sum += values[i];
+        }
+        sum += batch_sum;
+        total += static_cast<std::int64_t>(count);
+    }
+
+    void Average::Merge(const StatsAggregator& other)
+    {
+        const auto& that = CastForMerge<Average>(other);
+        sum += that.sum;
+        total += that.total;
+    }
+
     void Average::PrintValue(std::ostream& out) const
     {
         out << "Average is ";
@@ -103,9 +242,798 @@ namespace StatsAggregators
         }
     }
 
+    // Counts are merged exactly. The order in which the values came is lost,
+    // so a tie between the most frequent values goes to the smallest one.
+    void Mode::Merge(const StatsAggregator& other)
+    {
+        const auto& that = CastForMerge<Mode>(other);
+        if (that.count.empty())
+        {
+            return;
+        }
+
+        int mode_count = 0;
+        for (const auto& [value, value_count] : that.count)
+        {
+            count[value] += value_count;
+        }
+        for (const auto& [value, value_count] : count)
+        {
+            if (value_count > mode_count || (value_count == mode_count && value < *mode))
+            {
+                mode = value;
+                mode_count = value_count;
+            }
+        }
+    }
+
     void Mode::PrintValue(std::ostream& out) const
     {
         out << "Mode is " << mode;
     }
 
+    namespace
+    {
+        int HighestBit(std::uint32_t x)
+        {
+#if defined(__GNUC__)
+            return 31 - __builtin_clz(x);
+#elif defined(_MSC_VER)
+            unsigned long result;
+            _BitScanReverse(&result, x);
+            return static_cast<int>(result);
+#else
+            int result = 0;
+            for (int step = 16; step > 0; step /= 2)
+            {
+                if (x >> step)
+                {
+                    x >>= step;
+                    result += step;
+                }
+            }
+            return result;
+#endif
+        }
+
+        std::uint64_t RankOf(double q, std::uint64_t total)
+        {
+            auto rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(total)));
+            return std::clamp<std::uint64_t>(rank, 1, total);
+        }
+
+        template <typename QuantileAggregator>
+        void PrintQuantiles(std::ostream& out, const QuantileAggregator& aggr)
+        {
+            out << "P50 is " << aggr.Quantile(0.5)
+                << ", P95 is " << aggr.Quantile(0.95)
+                << ", P99 is " << aggr.Quantile(0.99);
+        }
+    }
+
+    ApproximateMode::ApproximateMode(std::size_t capacity) :
+        capacity(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("ApproximateMode must track at least one value");
+        }
+        slots.reserve(capacity);
+        slot_group.reserve(capacity);
+        rank.reserve(capacity);
+        order.reserve(capacity);
+        slot_of.reserve(capacity);
+    }
+
+    void ApproximateMode::Process(int value)
+    {
+        if (auto it = slot_of.find(value); it != slot_of.end())
+        {
+            Increment(it->second);
+        }
+        else if (slots.size() < capacity)
+        {
+            Append({ value, 1, 0 });
+        }
+        else
+        {
+            // The new value takes over the smallest counter. Reusing the node
+            // of the evicted value keeps the map from allocating.
+            const std::size_t slot = order.back();
+            auto node = slot_of.extract(slots[slot].value);
+            node.key() = value;
+            slot_of.insert(std::move(node));
+
+            slots[slot].value = value;
+            slots[slot].error = slots[slot].count;
+            Increment(slot);
+        }
+    }
+
+    // The count of the appended counter must not exceed any of the present ones
+    void ApproximateMode::Append(const Counter& counter)
+    {
+        const std::size_t slot = slots.size();
+        slots.push_back(counter);
+        slot_of[counter.value] = slot;
+        rank.push_back(order.size());
+        order.push_back(slot);
+
+        if (slot > 0 && groups[slot_group[order[order.size() - 2]]].count == counter.count)
+        {
+            const std::size_t group = slot_group[order[order.size() - 2]];
+            ++groups[group].end;
+            slot_group.push_back(group);
+        }
+        else
+        {
+            slot_group.push_back(NewGroup(counter.count, order.size() - 1));
+        }
+    }
+
+    void ApproximateMode::Increment(std::size_t slot)
+    {
+        const std::size_t group = slot_group[slot];
+        const std::size_t first = groups[group].begin;
+
+        const std::size_t position = rank[slot];
+        const std::size_t displaced = order[first];
+        order[position] = displaced;
+        rank[displaced] = position;
+        order[first] = slot;
+        rank[slot] = first;
+
+        if (++groups[group].begin == groups[group].end)
+        {
+            free_groups.push_back(group);
+        }
+
+        const std::uint64_t count = ++slots[slot].count;
+        if (first > 0 && groups[slot_group[order[first - 1]]].count == count)
+        {
+            const std::size_t preceding = slot_group[order[first - 1]];
+            ++groups[preceding].end;
+            slot_group[slot] = preceding;
+        }
+        else
+        {
+            slot_group[slot] = NewGroup(count, first);
+        }
+    }
+
+    std::size_t ApproximateMode::NewGroup(std::uint64_t count, std::size_t begin)
+    {
+        std::size_t group;
+        if (free_groups.empty())
+        {
+            group = groups.size();
+            groups.emplace_back();
+        }
+        else
+        {
+            group = free_groups.back();
+            free_groups.pop_back();
+        }
+        groups[group] = { count, begin, begin + 1 };
+        return group;
+    }
+
+    std::optional<int> ApproximateMode::Mode() const
+    {
+        const auto top = Top(1);
+        if (top.empty())
+        {
+            return std::nullopt;
+        }
+        return top.front().value;
+    }
+
+    std::vector<ApproximateMode::Counter> ApproximateMode::Top(std::size_t k) const
+    {
+        std::vector<Counter> result = slots;
+        k = std::min(k, result.size());
+        std::partial_sort(result.begin(), result.begin() + k, result.end(), [](const Counter& lhs, const Counter& rhs)
+            {
+                return std::make_pair(rhs.count, lhs.value) < std::make_pair(lhs.count, rhs.value);
+            });
+        result.resize(k);
+        return result;
+    }
+
+    void ApproximateMode::PrintValue(std::ostream& out) const
+    {
+        out << "Mode is " << Mode();
+    }
+
+    void ApproximateMode::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<ApproximateMode>(other);
+        if (that.capacity != capacity)
+        {
+            throw std::invalid_argument("Cannot merge summaries of different capacity");
+        }
+    }
+
+    // A value missing from a full summary may still have been seen up to its
+    // minimal count times, so that count is used as both the estimate and the
+    // error for it. Of the combined counters the largest ones are kept.
+    void ApproximateMode::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        const auto& that = static_cast<const ApproximateMode&>(other);
+
+        auto missing_count = [](const ApproximateMode& summary) -> std::uint64_t
+        {
+            return summary.slots.size() == summary.capacity ? summary.slots[summary.order.back()].count : 0;
+        };
+        const std::uint64_t this_missing = missing_count(*this);
+        const std::uint64_t that_missing = missing_count(that);
+
+        std::vector<Counter> merged;
+        merged.reserve(slots.size() + that.slots.size());
+        for (const Counter& counter : slots)
+        {
+            if (auto it = that.slot_of.find(counter.value); it != that.slot_of.end())
+            {
+                const Counter& twin = that.slots[it->second];
+                merged.push_back({ counter.value, counter.count + twin.count, counter.error + twin.error });
+            }
+            else
+            {
+                merged.push_back({ counter.value, counter.count + that_missing, counter.error + that_missing });
+            }
+        }
+        for (const Counter& counter : that.slots)
+        {
+            if (slot_of.count(counter.value) == 0)
+            {
+                merged.push_back({ counter.value, counter.count + this_missing, counter.error + this_missing });
+            }
+        }
+
+        Rebuild(std::move(merged));
+    }
+
+    void ApproximateMode::Rebuild(std::vector<Counter> counters)
+    {
+        std::sort(counters.begin(), counters.end(), [](const Counter& lhs, const Counter& rhs)
+            {
+                return std::make_pair(rhs.count, lhs.value) < std::make_pair(lhs.count, rhs.value);
+            });
+        if (counters.size() > capacity)
+        {
+            counters.resize(capacity);
+        }
+
+        slots.clear();
+        slot_group.clear();
+        rank.clear();
+        order.clear();
+        groups.clear();
+        free_groups.clear();
+        slot_of.clear();
+        for (const Counter& counter : counters)
+        {
+            Append(counter);
+        }
+    }
+
+    Histogram::Histogram(int significant_bits) :
+        significant_bits(significant_bits)
+    {
+        if (significant_bits < 1 || significant_bits > 16)
+        {
+            throw std::invalid_argument("Histogram precision must be in [1, 16] bits");
+        }
+
+        const std::size_t bucket_count = (std::size_t(1) << (significant_bits - 1)) * (34 - significant_bits);
+        negative.resize(bucket_count);
+        positive.resize(bucket_count);
+    }
+
+    // Magnitudes below 2^p are counted exactly. Above that a bucket is
+    // identified by the shift s dropping all but the p top bits and by
+    // those top bits, which lie in [2^(p - 1), 2^p).
+    std::size_t Histogram::BucketIndex(std::uint32_t magnitude) const
+    {
+        if (magnitude < (std::uint32_t(1) << significant_bits))
+        {
+            return magnitude;
+        }
+        const int shift = HighestBit(magnitude) - significant_bits + 1;
+        return (std::size_t(shift) << (significant_bits - 1)) + (magnitude >> shift);
+    }
+
+    std::uint32_t Histogram::BucketValue(std::size_t index) const
+    {
+        if (index < (std::size_t(1) << significant_bits))
+        {
+            return static_cast<std::uint32_t>(index);
+        }
+        const int shift = static_cast<int>(index >> (significant_bits - 1)) - 1;
+        const std::uint64_t top = index - (std::size_t(shift) << (significant_bits - 1));
+        const std::uint64_t middle = (top << shift) + ((std::uint64_t(1) << shift) - 1) / 2;
+        return static_cast<std::uint32_t>(std::min<std::uint64_t>(middle, std::uint64_t(1) << 31));
+    }
+
+    void Histogram::Process(int value)
+    {
+        if (value < 0)
+        {
+            ++negative[BucketIndex(0u - static_cast<std::uint32_t>(value))];
+        }
+        else
+        {
+            ++positive[BucketIndex(static_cast<std::uint32_t>(value))];
+        }
+        ++total;
+    }
+
+    std::optional<int> Histogram::Quantile(double q) const
+    {
+        if (total == 0)
+        {
+            return std::nullopt;
+        }
+
+        std::uint64_t rank = RankOf(q, total);
+        for (std::size_t i = negative.size(); i-- > 0; )
+        {
+            if (negative[i] >= rank)
+            {
+                return static_cast<int>(-static_cast<std::int64_t>(BucketValue(i)));
+            }
+            rank -= negative[i];
+        }
+        for (std::size_t i = 0; i < positive.size(); ++i)
+        {
+            if (positive[i] >= rank)
+            {
+                return static_cast<int>(std::min<std::uint32_t>(BucketValue(i), std::numeric_limits<int>::max()));
+            }
+            rank -= positive[i];
+        }
+        return std::nullopt;
+    }
+
+    void Histogram::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<Histogram>(other);
+        if (that.significant_bits != significant_bits)
+        {
+            throw std::invalid_argument("Cannot merge histograms of different precision");
+        }
+    }
+
+    void Histogram::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        const auto& that = static_cast<const Histogram&>(other);
+        for (std::size_t i = 0; i < positive.size(); ++i)
+        {
+            negative[i] += that.negative[i];
+            positive[i] += that.positive[i];
+        }
+        total += that.total;
+    }
+
+    void Histogram::PrintValue(std::ostream& out) const
+    {
+        PrintQuantiles(out, *this);
+    }
+
+    Kll::Kll(int k) :
+        k(k)
+    {
+        if (k < 2)
+        {
+            throw std::invalid_argument("Kll accuracy parameter must be at least 2");
+        }
+        Grow();
+    }
+
+    // Upper levels hold heavier items, so lower levels may be shorter:
+    // capacity decays geometrically with factor 2/3 going down from the top
+    void Kll::Grow()
+    {
+        compactors.emplace_back();
+        capacities.resize(compactors.size());
+        max_size = 0;
+        for (std::size_t level = 0; level < compactors.size(); ++level)
+        {
+            const auto depth = static_cast<double>(compactors.size() - level - 1);
+            const auto capacity = static_cast<std::size_t>(std::ceil(k * std::pow(2.0 / 3.0, depth)));
+            capacities[level] = std::max<std::size_t>(capacity, 2);
+            max_size += capacities[level];
+        }
+    }
+
+    // Sorts the first overfull compactor and promotes every other item
+    // (starting at a random parity) to the next level
+    void Kll::Compress()
+    {
+        for (std::size_t level = 0; level < compactors.size(); ++level)
+        {
+            if (compactors[level].size() < capacities[level])
+            {
+                continue;
+            }
+            if (level + 1 == compactors.size())
+            {
+                Grow();
+            }
+
+            auto& current = compactors[level];
+            auto& next = compactors[level + 1];
+            std::sort(current.begin(), current.end());
+
+            std::optional<int> odd_item;
+            if (current.size() % 2 == 1)
+            {
+                odd_item = current.back();
+                current.pop_back();
+            }
+
+            for (std::size_t i = random() % 2; i < current.size(); i += 2)
+            {
+                next.push_back(current[i]);
+            }
+            size -= current.size() / 2;
+            current.clear();
+            if (odd_item)
+            {
+                current.push_back(*odd_item);
+            }
+
+            if (size < max_size)
+            {
+                return;
+            }
+        }
+    }
+
+    void Kll::Process(int value)
+    {
+        compactors[0].push_back(value);
+        ++size;
+        ++total;
+        if (size >= max_size)
+        {
+            Compress();
+        }
+    }
+
+    std::optional<int> Kll::Quantile(double q) const
+    {
+        if (total == 0)
+        {
+            return std::nullopt;
+        }
+
+        std::vector<std::pair<int, std::uint64_t>> weighted;
+        weighted.reserve(size);
+        std::uint64_t total_weight = 0;
+        for (std::size_t level = 0; level < compactors.size(); ++level)
+        {
+            for (int value : compactors[level])
+            {
+                weighted.emplace_back(value, std::uint64_t(1) << level);
+                total_weight += std::uint64_t(1) << level;
+            }
+        }
+        std::sort(weighted.begin(), weighted.end());
+
+        const std::uint64_t rank = RankOf(q, total_weight);
+        std::uint64_t accumulated = 0;
+        for (const auto& [value, weight] : weighted)
+        {
+            accumulated += weight;
+            if (accumulated >= rank)
+            {
+                return value;
+            }
+        }
+        return weighted.back().first;
+    }
+
+    void Kll::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<Kll>(other);
+        if (that.k != k)
+        {
+            throw std::invalid_argument("Cannot merge KLL sketches of different accuracy");
+        }
+    }
+
+    // Concatenates the compactors level by level, then compresses the
+    // result back to the capacity of a single sketch
+    void Kll::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        if (MergeCopyIfSelf(*this, other))
+        {
+            return;
+        }
+        const auto& that = static_cast<const Kll&>(other);
+
+        while (compactors.size() < that.compactors.size())
+        {
+            Grow();
+        }
+        for (std::size_t level = 0; level < that.compactors.size(); ++level)
+        {
+            const auto& items = that.compactors[level];
+            compactors[level].insert(compactors[level].end(), items.begin(), items.end());
+        }
+        size += that.size;
+        total += that.total;
+
+        while (size >= max_size)
+        {
+            Compress();
+        }
+    }
+
+    void Kll::PrintValue(std::ostream& out) const
+    {
+        PrintQuantiles(out, *this);
+    }
+
+    WindowSum::WindowSum(std::size_t window)
+    {
+        if (window == 0)
+        {
+            throw std::invalid_argument("Window must not be empty");
+        }
+        ring.resize(window);
+    }
+
+    void WindowSum::Process(int value)
+    {
+        if (filled == ring.size())
+        {
+            sum -= ring[next];
+        }
+        else
+        {
+            ++filled;
+        }
+        ring[next] = value;
+        sum += value;
+        next = next + 1 == ring.size() ? 0 : next + 1;
+    }
+
+    void WindowSum::PrintValue(std::ostream& out) const
+    {
+        out << "Window sum is " << sum;
+    }
+
+    void WindowSum::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<WindowSum>(other);
+        if (that.ring.size() != ring.size())
+        {
+            throw std::invalid_argument("Cannot merge windows of different length");
+        }
+    }
+
+    void WindowSum::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        if (MergeCopyIfSelf(*this, other))
+        {
+            return;
+        }
+        const auto& that = static_cast<const WindowSum&>(other);
+
+        const std::size_t oldest = (that.next + ring.size() - that.filled) % ring.size();
+        for (std::size_t i = 0; i < that.filled; ++i)
+        {
+            Process(that.ring[(oldest + i) % ring.size()]);
+        }
+    }
+
+    std::int64_t WindowSum::Value() const
+    {
+        return sum;
+    }
+
+    std::size_t WindowSum::Count() const
+    {
+        return filled;
+    }
+
+    WindowAverage::WindowAverage(std::size_t window) :
+        window_sum(window)
+    {}
+
+    void WindowAverage::Process(int value)
+    {
+        window_sum.Process(value);
+    }
+
+    void WindowAverage::PrintValue(std::ostream& out) const
+    {
+        out << "Window average is ";
+        if (window_sum.Count() == 0)
+        {
+            out << "undefined";
+        }
+        else
+        {
+            out << window_sum.Value() / static_cast<std::int64_t>(window_sum.Count());
+        }
+    }
+
+    void WindowAverage::CheckMergeable(const StatsAggregator& other) const
+    {
+        window_sum.CheckMergeable(CastForMerge<WindowAverage>(other).window_sum);
+    }
+
+    void WindowAverage::Merge(const StatsAggregator& other)
+    {
+        window_sum.Merge(CastForMerge<WindowAverage>(other).window_sum);
+    }
+
+    WindowMin::WindowMin(std::size_t window) :
+        current_min(window)
+    {}
+
+    void WindowMin::Process(int value)
+    {
+        current_min.Push(value);
+    }
+
+    void WindowMin::PrintValue(std::ostream& out) const
+    {
+        out << "Window min is " << current_min.Value();
+    }
+
+    void WindowMin::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<WindowMin>(other);
+        if (that.current_min.Window() != current_min.Window())
+        {
+            throw std::invalid_argument("Cannot merge windows of different length");
+        }
+    }
+
+    void WindowMin::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        if (MergeCopyIfSelf(*this, other))
+        {
+            return;
+        }
+        const auto& that = static_cast<const WindowMin&>(other);
+        current_min.Append(that.current_min);
+    }
+
+    WindowMax::WindowMax(std::size_t window) :
+        current_max(window)
+    {}
+
+    void WindowMax::Process(int value)
+    {
+        current_max.Push(value);
+    }
+
+    void WindowMax::PrintValue(std::ostream& out) const
+    {
+        out << "Window max is " << current_max.Value();
+    }
+
+    void WindowMax::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<WindowMax>(other);
+        if (that.current_max.Window() != current_max.Window())
+        {
+            throw std::invalid_argument("Cannot merge windows of different length");
+        }
+    }
+
+    void WindowMax::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        if (MergeCopyIfSelf(*this, other))
+        {
+            return;
+        }
+        const auto& that = static_cast<const WindowMax&>(other);
+        current_max.Append(that.current_max);
+    }
+
+    Ewma::Ewma(double alpha) :
+        alpha(alpha)
+    {
+        if (!(alpha > 0 && alpha <= 1))
+        {
+            throw std::invalid_argument("Ewma weight must be in (0, 1]");
+        }
+    }
+
+    void Ewma::Process(int value)
+    {
+        if (!average)
+        {
+            average = value;
+            first_value = value;
+        }
+        else
+        {
+            *average += alpha * (value - *average);
+        }
+
+        // Denormal arithmetic is very slow, and such a decay doesn't matter anyway
+        decay *= 1 - alpha;
+        if (decay < std::numeric_limits<double>::min())
+        {
+            decay = 0;
+        }
+    }
+
+    void Ewma::PrintValue(std::ostream& out) const
+    {
+        out << "Ewma is " << average;
+    }
+
+    void Ewma::CheckMergeable(const StatsAggregator& other) const
+    {
+        const auto& that = CastForMerge<Ewma>(other);
+        if (that.alpha != alpha)
+        {
+            throw std::invalid_argument("Cannot merge averages of different weights");
+        }
+    }
+
+    // Had the other average started from this one instead of from its own
+    // first value, it would differ by exactly its decay * (this - first value)
+    void Ewma::Merge(const StatsAggregator& other)
+    {
+        CheckMergeable(other);
+        const auto& that = static_cast<const Ewma&>(other);
+        if (!that.average)
+        {
+            return;
+        }
+
+        if (!average)
+        {
+            average = that.average;
+            first_value = that.first_value;
+        }
+        else
+        {
+            *average = *that.average + that.decay * (*average - *that.first_value);
+        }
+        decay *= that.decay;
+    }
+
+    std::unique_ptr<StatsAggregator> ProcessInParallel(const int* values, std::size_t count,
+        const AggregatorFactory& factory, std::size_t thread_count)
+    {
+        thread_count = std::max<std::size_t>(1, std::min(thread_count, count));
+        const std::size_t shard_size = count / thread_count;
+
+        std::vector<std::future<std::unique_ptr<StatsAggregator>>> shards;
+        for (std::size_t shard = 0; shard < thread_count; ++shard)
+        {
+            const int* begin = values + shard * shard_size;
+            const std::size_t size = shard + 1 < thread_count ? shard_size : count - shard * shard_size;
+            shards.push_back(std::async(std::launch::async, [&factory, begin, size]
+                {
+                    auto aggr = factory();
+                    aggr->ProcessBatch(begin, size);
+                    return aggr;
+                }));
+        }
+
+        auto result = shards.front().get();
+        for (std::size_t shard = 1; shard < shards.size(); ++shard)
+        {
+            result->Merge(*shards[shard].get());
+        }
+        return result;
+    }
+
 }
\ No newline at end of file
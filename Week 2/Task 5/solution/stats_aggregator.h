@@ -5,7 +5,15 @@
 #include <memory>
 #include <vector>
 #include <optional>
+#include <random>
+#include <cstdint>
 #include <unordered_map>
+#include <deque>
+#include <tuple>
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+#include <functional>
 
 struct StatsAggregator 
 {
@@ -14,68 +22,375 @@ struct StatsAggregator
 
     virtual void Process(int value) = 0;
     virtual void PrintValue(std::ostream& out) const = 0;
+
+    // Same as calling Process for each of values[0..count), but with a
+    // single virtual call; simple aggregators override it with tight loops
+    virtual void ProcessBatch(const int* values, std::size_t count);
+
+    // Makes this aggregator account for all values processed by other as well.
+    // Both have to be of the same kind and configuration, otherwise Merge
+    // throws std::invalid_argument and changes nothing.
+    virtual void Merge(const StatsAggregator& other) = 0;
+
+    // Throws std::invalid_argument if Merge(other) would
+    virtual void CheckMergeable(const StatsAggregator& other) const;
 };
 
 namespace StatsAggregators
 {
 
-    class Sum : public StatsAggregator
+    template <typename Aggregator>
+    const Aggregator& CastForMerge(const StatsAggregator& other)
+    {
+        if (const auto* result = dynamic_cast<const Aggregator*>(&other))
+        {
+            return *result;
+        }
+        throw std::invalid_argument("Cannot merge aggregators of different kinds");
+    }
+
+    // Merges aggr with a copy of itself if other is aggr, for the aggregators
+    // that read other while they change; returns whether it did
+    template <typename Aggregator>
+    bool MergeCopyIfSelf(Aggregator& aggr, const StatsAggregator& other)
+    {
+        if (&other != &aggr)
+        {
+            return false;
+        }
+        const Aggregator copy = aggr;
+        aggr.Merge(copy);
+        return true;
+    }
+
+    class Sum final : public StatsAggregator
     {
     public:
         void Process(int value) override;
+        void ProcessBatch(const int* values, std::size_t count) override;
         void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
 
     private:
         int sum = 0;
     };
 
-    class Min : public StatsAggregator
+    class Min final : public StatsAggregator
     {
     public:
         void Process(int value) override;
+        void ProcessBatch(const int* values, std::size_t count) override;
         void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
 
     private:
         std::optional<int> current_min;
     };
 
-    class Max : public StatsAggregator
+    class Max final : public StatsAggregator
     {
     public:
         void Process(int value) override;
+        void ProcessBatch(const int* values, std::size_t count) override;
         void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
 
     private:
         std::optional<int> current_max;
     };
 
-    class Average : public StatsAggregator
+    class Average final : public StatsAggregator
     {
     public:
         void Process(int value) override;
+        void ProcessBatch(const int* values, std::size_t count) override;
         void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
 
     private:
-        int sum = 0;
-        int total = 0;
+        std::int64_t sum = 0;
+        std::int64_t total = 0;
     };
 
-    class Mode : public StatsAggregator
+    class Mode final : public StatsAggregator
     {
     public:
         void Process(int value) override;
         void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
 
     private:
         std::unordered_map<int, int> count;
         std::optional<int> mode;
     };
 
+    // Space-Saving summary, a fixed-memory alternative to Mode. It tracks at
+    // most capacity values; any value seen more than N / capacity times out
+    // of N is tracked, and a tracked count exceeds the true one by at most its
+    // error, which in turn is at most N / capacity.
+    class ApproximateMode final : public StatsAggregator
+    {
+    public:
+        struct Counter
+        {
+            int value;
+            std::uint64_t count;
+            std::uint64_t error;
+        };
+
+        explicit ApproximateMode(std::size_t capacity = 1000);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+        std::optional<int> Mode() const;
+        // At most k counters with the largest counts, the largest first
+        std::vector<Counter> Top(std::size_t k) const;
+
+    private:
+        struct Group
+        {
+            std::uint64_t count;
+            std::size_t begin, end;
+        };
+
+        void Append(const Counter& counter);
+        void Increment(std::size_t slot);
+        std::size_t NewGroup(std::uint64_t count, std::size_t begin);
+        void Rebuild(std::vector<Counter> counters);
+
+        std::size_t capacity;
+
+        // Stream-Summary layout: order lists the slots by count in descending
+        // order, and slots of equal count form a group occupying a range of it.
+        // An increment moves a slot to the front of its group and then into the
+        // preceding group or a new one, so it takes O(1).
+        std::vector<Counter> slots;
+        std::vector<std::size_t> slot_group;
+        std::vector<std::size_t> rank;
+        std::vector<std::size_t> order;
+        std::vector<Group> groups;
+        std::vector<std::size_t> free_groups;
+        std::unordered_map<int, std::size_t> slot_of;
+    };
+
+    // HDR-style histogram: values are counted in log-bucketed bins, each bin
+    // keeping significant_bits of the magnitude, so quantiles are reported with
+    // a relative error below 2^(1 - significant_bits). O(1) per value, memory
+    // depends only on significant_bits.
+    class Histogram final : public StatsAggregator
+    {
+    public:
+        explicit Histogram(int significant_bits = 7);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+        std::optional<int> Quantile(double q) const;
+
+    private:
+        std::size_t BucketIndex(std::uint32_t magnitude) const;
+        std::uint32_t BucketValue(std::size_t index) const;
+
+        int significant_bits;
+        std::vector<std::uint64_t> negative;
+        std::vector<std::uint64_t> positive;
+        std::uint64_t total = 0;
+    };
+
+    // KLL quantile sketch: a stack of compactors, the one on level h holding
+    // items of weight 2^h. Keeps O(k) items, rank error is about 1.7 / k.
+    class Kll final : public StatsAggregator
+    {
+    public:
+        explicit Kll(int k = 200);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+        std::optional<int> Quantile(double q) const;
+
+    private:
+        void Grow();
+        void Compress();
+
+        int k;
+        std::vector<std::vector<int>> compactors;
+        std::vector<std::size_t> capacities;
+        std::size_t size = 0;
+        std::size_t max_size = 0;
+        std::uint64_t total = 0;
+        std::minstd_rand random;
+    };
+
+    // The windowed aggregators below see only the last window values. The
+    // input carries no timestamps, so a window is measured in values: "last
+    // 60 seconds" of a 10M values/s stream is a window of 600M values.
+    // Merging appends the window of the other aggregator after this one.
+
+    class WindowSum final : public StatsAggregator
+    {
+    public:
+        explicit WindowSum(std::size_t window = 1000);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+        std::int64_t Value() const;
+        std::size_t Count() const;
+
+    private:
+        std::vector<int> ring;
+        std::size_t next = 0;
+        std::size_t filled = 0;
+        std::int64_t sum = 0;
+    };
+
+    class WindowAverage final : public StatsAggregator
+    {
+    public:
+        explicit WindowAverage(std::size_t window = 1000);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+    private:
+        WindowSum window_sum;
+    };
+
+    // Deque of values that may still become the extremum of the window, kept
+    // sorted by Better; every value is pushed and popped at most once
+    template <typename Better>
+    class MonotonicWindow
+    {
+    public:
+        explicit MonotonicWindow(std::size_t window) :
+            window(window)
+        {
+            if (window == 0)
+            {
+                throw std::invalid_argument("Window must not be empty");
+            }
+        }
+
+        void Push(int value)
+        {
+            Insert(processed++, value);
+            Expire();
+        }
+
+        void Append(const MonotonicWindow& other)
+        {
+            for (const auto& [index, value] : other.candidates)
+            {
+                Insert(processed + index, value);
+            }
+            processed += other.processed;
+            Expire();
+        }
+
+        std::optional<int> Value() const
+        {
+            if (candidates.empty())
+            {
+                return std::nullopt;
+            }
+            return candidates.front().second;
+        }
+
+        std::size_t Window() const
+        {
+            return window;
+        }
+
+    private:
+        void Insert(std::uint64_t index, int value)
+        {
+            while (!candidates.empty() && !Better()(candidates.back().second, value))
+            {
+                candidates.pop_back();
+            }
+            candidates.emplace_back(index, value);
+        }
+
+        void Expire()
+        {
+            while (!candidates.empty() && candidates.front().first + window < processed)
+            {
+                candidates.pop_front();
+            }
+        }
+
+        std::size_t window;
+        std::uint64_t processed = 0;
+        std::deque<std::pair<std::uint64_t, int>> candidates;
+    };
+
+    class WindowMin final : public StatsAggregator
+    {
+    public:
+        explicit WindowMin(std::size_t window = 1000);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+    private:
+        MonotonicWindow<std::less<int>> current_min;
+    };
+
+    class WindowMax final : public StatsAggregator
+    {
+    public:
+        explicit WindowMax(std::size_t window = 1000);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+    private:
+        MonotonicWindow<std::greater<int>> current_max;
+    };
+
+    // Exponentially weighted moving average: each new value gets weight alpha,
+    // the weight of older ones decays by (1 - alpha) per value
+    class Ewma final : public StatsAggregator
+    {
+    public:
+        explicit Ewma(double alpha = 0.01);
+
+        void Process(int value) override;
+        void PrintValue(std::ostream& out) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
+
+    private:
+        double alpha;
+        std::optional<double> average;
+        std::optional<int> first_value;
+        double decay = 1.0;
+    };
+
     class Composite : public StatsAggregator
     {
     public:
         void Process(int value) override;
+        void ProcessBatch(const int* values, std::size_t count) override;
         void PrintValue(std::ostream& output) const override;
+        void Merge(const StatsAggregator& other) override;
+        void CheckMergeable(const StatsAggregator& other) const override;
 
         void Add(std::unique_ptr<StatsAggregator> aggr);
 
@@ -83,10 +398,83 @@ namespace StatsAggregators
         std::vector<std::unique_ptr<StatsAggregator>> aggregators;
     };
 
+    // Composite whose set of aggregators is fixed at compile time. The members
+    // are stored by value and their types are final, so there is no virtual
+    // dispatch per value, e.g. StaticComposite<Sum, Min, Max, Average>.
+    template <typename... Aggregators>
+    class StaticComposite : public StatsAggregator
+    {
+    public:
+        void Process(int value) override
+        {
+            std::apply([value](auto&... aggr) { (aggr.Process(value), ...); }, aggregators);
+        }
+
+        void ProcessBatch(const int* values, std::size_t count) override
+        {
+            std::apply([values, count](auto&... aggr) { (aggr.ProcessBatch(values, count), ...); }, aggregators);
+        }
+
+        void PrintValue(std::ostream& output) const override
+        {
+            std::apply([&output](const auto&... aggr) { ((aggr.PrintValue(output), output << '\n'), ...); }, aggregators);
+        }
+
+        void Merge(const StatsAggregator& other) override
+        {
+            CheckMergeable(other);
+            MergeEach(static_cast<const StaticComposite&>(other), std::index_sequence_for<Aggregators...>{});
+        }
+
+        void CheckMergeable(const StatsAggregator& other) const override
+        {
+            CheckEach(CastForMerge<StaticComposite>(other), std::index_sequence_for<Aggregators...>{});
+        }
+
+    private:
+        template <std::size_t... Indices>
+        void CheckEach(const StaticComposite& that, std::index_sequence<Indices...>) const
+        {
+            (std::get<Indices>(aggregators).CheckMergeable(std::get<Indices>(that.aggregators)), ...);
+        }
+
+        template <std::size_t... Indices>
+        void MergeEach(const StaticComposite& that, std::index_sequence<Indices...>)
+        {
+            (std::get<Indices>(aggregators).Merge(std::get<Indices>(that.aggregators)), ...);
+        }
+
+        std::tuple<Aggregators...> aggregators;
+    };
+
+    using AggregatorFactory = std::function<std::unique_ptr<StatsAggregator>()>;
+
+    // Splits values into thread_count contiguous shards, processes each shard
+    // on its own thread with a fresh aggregator and merges the results in
+    // shard order
+    std::unique_ptr<StatsAggregator> ProcessInParallel(const int* values, std::size_t count,
+        const AggregatorFactory& factory, std::size_t thread_count);
+
     void TestSum();
     void TestMin();
     void TestMax();
     void TestAverage();
     void TestMode();
     void TestComposite();
+    void TestHistogram();
+    void TestKll();
+    void TestProcessBatch();
+    void TestStaticComposite();
+    void TestMerge();
+    void TestSelfMerge();
+    void TestProcessInParallel();
+    void TestWindowAggregators();
+    void TestEwma();
+    void TestApproximateMode();
+
+    void BenchmarkQuantiles();
+    void BenchmarkBatch();
+    void BenchmarkParallel();
+    void BenchmarkWindows();
+    void BenchmarkApproximateMode();
 }
\ No newline at end of file
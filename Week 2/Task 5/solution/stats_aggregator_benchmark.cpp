@@ -0,0 +1,254 @@
+#include "stats_aggregator.h"
+#include "value_reader.h"
+#include "profile.h"
+
+// Memory is measured by the allocation tracker, which this file installs when
+// the program is built with -DALLOC_PROFILE. Such a build pays for the tracker
+// on every new/delete, so its times are not the ones to quote.
+#define ALLOC_PROFILE_INSTALL
+#include "alloc_profile.h"
+
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace StatsAggregators
+{
+
+    namespace
+    {
+        // Latency-like stream: log-normally distributed microseconds
+        std::vector<int> LatencyValues(std::size_t count)
+        {
+            std::mt19937 generator(2864);
+            std::lognormal_distribution<double> distribution(7.0, 1.5);
+
+            std::vector<int> values(count);
+            for (int& value : values)
+            {
+                value = static_cast<int>(std::min(distribution(generator), 1e9));
+            }
+            return values;
+        }
+
+        void BenchmarkProcess(StatsAggregator& aggr, const std::vector<int>& values, const std::string& name)
+        {
+            {
+                LOG_DURATION(name + ", " + std::to_string(values.size()) + " values");
+                for (int value : values)
+                {
+                    aggr.Process(value);
+                }
+            }
+            aggr.PrintValue(std::cerr);
+            std::cerr << std::endl;
+        }
+    }
+
+    void BenchmarkQuantiles()
+    {
+        const auto values = LatencyValues(20'000'000);
+
+        Sum sum;
+        BenchmarkProcess(sum, values, "Sum::Process");
+
+        Histogram histogram;
+        BenchmarkProcess(histogram, values, "Histogram::Process");
+
+        Histogram precise_histogram(12);
+        BenchmarkProcess(precise_histogram, values, "Histogram(12)::Process");
+
+        Kll kll;
+        BenchmarkProcess(kll, values, "Kll::Process");
+
+        Kll precise_kll(2000);
+        BenchmarkProcess(precise_kll, values, "Kll(2000)::Process");
+    }
+
+    namespace
+    {
+        // Feeds total values to aggr by cycling over the buffer, either one by
+        // one through Process or in buffer-sized chunks through ProcessBatch
+        void BenchmarkPipeline(StatsAggregator& aggr, const std::vector<int>& buffer,
+            std::size_t total, bool batched, const std::string& name)
+        {
+            {
+                LOG_DURATION(name + ", " + std::to_string(total) + " values");
+                for (std::size_t done = 0; done < total; done += buffer.size())
+                {
+                    if (batched)
+                    {
+                        aggr.ProcessBatch(buffer.data(), buffer.size());
+                    }
+                    else
+                    {
+                        for (int value : buffer)
+                        {
+                            aggr.Process(value);
+                        }
+                    }
+                }
+            }
+            aggr.PrintValue(std::cerr);
+        }
+
+        std::unique_ptr<StatsAggregator> DynamicComposite()
+        {
+            auto result = std::make_unique<Composite>();
+            result->Add(std::make_unique<Sum>());
+            result->Add(std::make_unique<Min>());
+            result->Add(std::make_unique<Max>());
+            result->Add(std::make_unique<Average>());
+            return result;
+        }
+    }
+
+    void BenchmarkBatch()
+    {
+        const std::size_t total = 1'000'000'000;
+        const std::vector<int> buffer = LatencyValues(1 << 16);
+
+        BenchmarkPipeline(*DynamicComposite(), buffer, total, false, "Composite::Process");
+        BenchmarkPipeline(*DynamicComposite(), buffer, total, true, "Composite::ProcessBatch");
+
+        using Static = StaticComposite<Sum, Min, Max, Average>;
+        Static static_per_value;
+        BenchmarkPipeline(static_per_value, buffer, total, false, "StaticComposite::Process");
+        Static static_batched;
+        BenchmarkPipeline(static_batched, buffer, total, true, "StaticComposite::ProcessBatch");
+    }
+
+    void BenchmarkParallel()
+    {
+        const auto values = LatencyValues(50'000'000);
+        const AggregatorFactory factory = []
+        {
+            return std::make_unique<StaticComposite<Sum, Min, Max, Average, Histogram, Kll>>();
+        };
+
+        const std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+        {
+            std::unique_ptr<StatsAggregator> result;
+            {
+                LOG_DURATION("ProcessInParallel, " + std::to_string(values.size()) + " values, "
+                    + std::to_string(thread_count) + " threads");
+                result = ProcessInParallel(values.data(), values.size(), factory, thread_count);
+            }
+            result->PrintValue(std::cerr);
+        }
+    }
+
+    // At 10M values/s an update has to take well under 100 ns, so 10M
+    // updates should fit in a fraction of a second
+    void BenchmarkWindows()
+    {
+        const auto values = LatencyValues(10'000'000);
+
+        for (std::size_t window : {std::size_t(1000), std::size_t(10'000'000)})
+        {
+            const std::string suffix = "(" + std::to_string(window) + ")::Process";
+
+            WindowSum sum(window);
+            BenchmarkProcess(sum, values, "WindowSum" + suffix);
+            WindowMin min(window);
+            BenchmarkProcess(min, values, "WindowMin" + suffix);
+            WindowMax max(window);
+            BenchmarkProcess(max, values, "WindowMax" + suffix);
+            WindowAverage average(window);
+            BenchmarkProcess(average, values, "WindowAverage" + suffix);
+        }
+
+        Ewma ewma;
+        BenchmarkProcess(ewma, values, "Ewma::Process");
+    }
+
+    // High-cardinality stream: a tenth of the values come from a small
+    // geometrically distributed hot set, the rest are almost all distinct
+    void BenchmarkApproximateMode()
+    {
+        std::vector<int> values(20'000'000);
+        {
+            std::mt19937 generator(33);
+            std::bernoulli_distribution is_hot(0.1);
+            std::geometric_distribution<int> hot(0.01);
+            std::uniform_int_distribution<int> cold(1000, std::numeric_limits<int>::max());
+            for (int& value : values)
+            {
+                value = is_hot(generator) ? hot(generator) : cold(generator);
+            }
+        }
+
+        std::unordered_map<int, std::uint64_t> exact_counts;
+        for (int value : values)
+        {
+            ++exact_counts[value];
+        }
+
+        {
+            LOG_ALLOCATIONS("Mode");
+            Mode exact;
+            BenchmarkProcess(exact, values, "Mode::Process");
+        }
+
+        for (std::size_t capacity : {std::size_t(100), std::size_t(1000), std::size_t(10000)})
+        {
+            const std::string name = "ApproximateMode(" + std::to_string(capacity) + ")";
+            LOG_ALLOCATIONS(name);
+            ApproximateMode approximate(capacity);
+            BenchmarkProcess(approximate, values, name + "::Process");
+
+            std::cerr << "top 5 (estimate / exact):";
+            for (const auto& counter : approximate.Top(5))
+            {
+                std::cerr << ' ' << counter.value << ": " << counter.count << " / " << exact_counts[counter.value];
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+}
+
+void BenchmarkProcessValues()
+{
+    using namespace StatsAggregators;
+
+    std::string text;
+    {
+        std::ostringstream output;
+        for (int value : LatencyValues(20'000'000))
+        {
+            output << value << '\n';
+        }
+        text = output.str();
+    }
+    const std::string size = std::to_string(text.size() / 1'000'000) + " MB";
+
+    {
+        std::istringstream input(text);
+        Sum aggr;
+        {
+            LOG_DURATION("operator >>, " + size);
+            for (int value; input >> value; )
+            {
+                aggr.Process(value);
+            }
+        }
+        aggr.PrintValue(std::cerr);
+        std::cerr << std::endl;
+    }
+    {
+        std::istringstream input(text);
+        Sum aggr;
+        {
+            LOG_DURATION("ProcessValues, " + size);
+            ProcessValues(input, aggr);
+        }
+        aggr.PrintValue(std::cerr);
+        std::cerr << std::endl;
+    }
+}
@@ -2,6 +2,12 @@
 #include "test_runner.h"
 
 #include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
 
 std::string PrintedValue(const StatsAggregator& aggr)
 {
@@ -63,6 +69,11 @@ namespace StatsAggregators
         aggr.Process(16);
 
         ASSERT_EQUAL(PrintedValue(aggr), "Average is 6");
+
+        Average large;
+        large.Process(std::numeric_limits<int>::max());
+        large.Process(std::numeric_limits<int>::max());
+        ASSERT_EQUAL(PrintedValue(large), "Average is 2147483647");
     }
 
     void TestMode()
@@ -107,4 +118,483 @@ namespace StatsAggregators
         ASSERT_EQUAL(PrintedValue(aggr), expected);
     }
 
+    void TestHistogram()
+    {
+        Histogram aggr;
+        ASSERT_EQUAL(PrintedValue(aggr), "P50 is undefined, P95 is undefined, P99 is undefined");
+
+        for (int value = 100; value > 0; --value)
+        {
+            aggr.Process(value);
+        }
+        ASSERT_EQUAL(PrintedValue(aggr), "P50 is 50, P95 is 95, P99 is 99");
+
+        Histogram negative;
+        for (int value = -10; value < 0; ++value)
+        {
+            negative.Process(value);
+        }
+        ASSERT_EQUAL(*negative.Quantile(0.5), -6);
+        ASSERT_EQUAL(*negative.Quantile(0), -10);
+        ASSERT_EQUAL(*negative.Quantile(1), -1);
+
+        Histogram large;
+        large.Process(std::numeric_limits<int>::min());
+        for (int value = 1; value <= 1000000; ++value)
+        {
+            large.Process(value * 1000);
+        }
+        large.Process(std::numeric_limits<int>::max());
+        ASSERT_EQUAL(*large.Quantile(0), std::numeric_limits<int>::min());
+        ASSERT(std::abs(*large.Quantile(0.5) - 500000000) <= 500000000 / 64);
+        ASSERT(std::abs(*large.Quantile(0.99) - 990000000) <= 990000000 / 64);
+        ASSERT(*large.Quantile(1) >= std::numeric_limits<int>::max() / 64 * 63);
+
+        Histogram coarse(3);
+        for (int value = 1; value <= 1000; ++value)
+        {
+            coarse.Process(value);
+        }
+        ASSERT(std::abs(*coarse.Quantile(0.5) - 500) <= 500 / 4);
+    }
+
+    void TestKll()
+    {
+        Kll aggr;
+        ASSERT_EQUAL(PrintedValue(aggr), "P50 is undefined, P95 is undefined, P99 is undefined");
+
+        for (int value = 100; value > 0; --value)
+        {
+            aggr.Process(value);
+        }
+        ASSERT_EQUAL(PrintedValue(aggr), "P50 is 50, P95 is 95, P99 is 99");
+
+        std::vector<int> values(1000000);
+        std::iota(values.begin(), values.end(), 1);
+        std::shuffle(values.begin(), values.end(), std::mt19937{ 42 });
+
+        Kll sketch;
+        for (int value : values)
+        {
+            sketch.Process(value);
+        }
+        for (double q : {0.01, 0.25, 0.5, 0.95, 0.99})
+        {
+            const int expected = static_cast<int>(q * values.size());
+            ASSERT(std::abs(*sketch.Quantile(q) - expected) <= 20000);
+        }
+        ASSERT(*sketch.Quantile(0) <= 20000);
+    }
+
+    namespace
+    {
+        template <typename Aggregator>
+        void AssertBatchMatchesProcess(const std::vector<int>& values)
+        {
+            Aggregator one_by_one;
+            for (int value : values)
+            {
+                one_by_one.Process(value);
+            }
+
+            Aggregator batched;
+            batched.ProcessBatch(values.data(), 0);
+            batched.ProcessBatch(values.data(), 1);
+            batched.ProcessBatch(values.data() + 1, values.size() - 1);
+
+            ASSERT_EQUAL(PrintedValue(batched), PrintedValue(one_by_one));
+        }
+    }
+
+    void TestProcessBatch()
+    {
+        std::vector<int> values(10000);
+        std::mt19937 generator(5);
+        std::uniform_int_distribution<int> distribution(-1000, 1000);
+        for (int& value : values)
+        {
+            value = distribution(generator);
+        }
+
+        AssertBatchMatchesProcess<Sum>(values);
+        AssertBatchMatchesProcess<Min>(values);
+        AssertBatchMatchesProcess<Max>(values);
+        AssertBatchMatchesProcess<Average>(values);
+        AssertBatchMatchesProcess<Mode>(values);
+        AssertBatchMatchesProcess<Histogram>(values);
+        AssertBatchMatchesProcess<Kll>(values);
+        AssertBatchMatchesProcess<StaticComposite<Sum, Min, Max, Average, Mode>>(values);
+
+        Composite composite;
+        composite.Add(std::make_unique<Sum>());
+        composite.Add(std::make_unique<Min>());
+        composite.Add(std::make_unique<Average>());
+        composite.ProcessBatch(values.data(), values.size());
+
+        Composite expected;
+        expected.Add(std::make_unique<Sum>());
+        expected.Add(std::make_unique<Min>());
+        expected.Add(std::make_unique<Average>());
+        for (int value : values)
+        {
+            expected.Process(value);
+        }
+        ASSERT_EQUAL(PrintedValue(composite), PrintedValue(expected));
+    }
+
+    void TestStaticComposite()
+    {
+        StaticComposite<Sum, Min, Max, Average, Mode> aggr;
+
+        aggr.Process(3);
+        aggr.Process(8);
+        aggr.Process(-1);
+        aggr.Process(16);
+        aggr.Process(16);
+
+        std::string expected = "Sum is 42\n";
+        expected += "Min is -1\n";
+        expected += "Max is 16\n";
+        expected += "Average is 8\n";
+        expected += "Mode is 16\n";
+        ASSERT_EQUAL(PrintedValue(aggr), expected);
+    }
+
+    namespace
+    {
+        std::vector<int> RandomValues(std::size_t count, int max_value)
+        {
+            std::vector<int> values(count);
+            std::mt19937 generator(7);
+            std::uniform_int_distribution<int> distribution(-max_value, max_value);
+            for (int& value : values)
+            {
+                value = distribution(generator);
+            }
+            return values;
+        }
+
+        template <typename Aggregator>
+        void AssertMergeMatchesProcess(const std::vector<int>& values, std::size_t split)
+        {
+            Aggregator whole;
+            whole.ProcessBatch(values.data(), values.size());
+
+            Aggregator first, second;
+            first.ProcessBatch(values.data(), split);
+            second.ProcessBatch(values.data() + split, values.size() - split);
+            first.Merge(second);
+
+            ASSERT_EQUAL(PrintedValue(first), PrintedValue(whole));
+        }
+
+        std::unique_ptr<StatsAggregator> ExactComposite()
+        {
+            auto result = std::make_unique<Composite>();
+            result->Add(std::make_unique<Sum>());
+            result->Add(std::make_unique<Min>());
+            result->Add(std::make_unique<Max>());
+            result->Add(std::make_unique<Average>());
+            result->Add(std::make_unique<Histogram>());
+            return result;
+        }
+    }
+
+    void TestMerge()
+    {
+        const auto values = RandomValues(10000, 1000);
+        for (std::size_t split : {std::size_t(0), std::size_t(1), std::size_t(5000), values.size()})
+        {
+            AssertMergeMatchesProcess<Sum>(values, split);
+            AssertMergeMatchesProcess<Min>(values, split);
+            AssertMergeMatchesProcess<Max>(values, split);
+            AssertMergeMatchesProcess<Average>(values, split);
+            AssertMergeMatchesProcess<Histogram>(values, split);
+            AssertMergeMatchesProcess<StaticComposite<Sum, Min, Max, Average>>(values, split);
+        }
+
+        Mode first, second;
+        for (int value : {1, 2, 2, 3})
+        {
+            first.Process(value);
+        }
+        for (int value : {3, 3, 1})
+        {
+            second.Process(value);
+        }
+        first.Merge(second);
+        ASSERT_EQUAL(PrintedValue(first), "Mode is 3");
+
+        Mode tied, empty;
+        tied.Process(5);
+        tied.Process(4);
+        tied.Merge(empty);
+        ASSERT_EQUAL(PrintedValue(tied), "Mode is 5");
+        empty.Merge(tied);
+        ASSERT_EQUAL(PrintedValue(empty), "Mode is 4");
+
+        const auto many = RandomValues(1000000, 1000000);
+        Kll kll_first, kll_second;
+        kll_first.ProcessBatch(many.data(), many.size() / 2);
+        kll_second.ProcessBatch(many.data() + many.size() / 2, many.size() - many.size() / 2);
+        kll_first.Merge(kll_second);
+        ASSERT(std::abs(*kll_first.Quantile(0.5)) <= 40000);
+        ASSERT(std::abs(*kll_first.Quantile(0.99) - 980000) <= 40000);
+
+        Composite composite;
+        composite.Add(std::make_unique<Sum>());
+        try
+        {
+            Sum sum;
+            sum.Merge(composite);
+            ASSERT(false);
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+        try
+        {
+            Histogram(5).Merge(Histogram(6));
+            ASSERT(false);
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+
+        // A composite is checked as a whole, a mismatch in a later part
+        // leaves the earlier ones unmerged
+        auto make_composite = [&values](int k)
+        {
+            Composite result;
+            result.Add(std::make_unique<Sum>());
+            result.Add(std::make_unique<Kll>(k));
+            result.ProcessBatch(values.data(), values.size());
+            return result;
+        };
+        Composite target = make_composite(200);
+        const std::string before = PrintedValue(target);
+        Composite longer = make_composite(200);
+        longer.Add(std::make_unique<Sum>());
+        Composite less_accurate = make_composite(100);
+        for (Composite* other : {&longer, &less_accurate})
+        {
+            try
+            {
+                target.Merge(*other);
+                ASSERT(false);
+            }
+            catch (const std::invalid_argument&)
+            {
+            }
+            ASSERT_EQUAL(PrintedValue(target), before);
+        }
+    }
+
+    template <typename Aggregator>
+    void AssertSelfMergeMatchesCopy(Aggregator aggr, const std::vector<int>& values)
+    {
+        aggr.ProcessBatch(values.data(), values.size());
+        Aggregator expected = aggr;
+        const Aggregator copy = aggr;
+        expected.Merge(copy);
+        aggr.Merge(aggr);
+        ASSERT_EQUAL(PrintedValue(aggr), PrintedValue(expected));
+    }
+
+    void TestSelfMerge()
+    {
+        const auto values = RandomValues(10000, 1000);
+        AssertSelfMergeMatchesCopy(Sum(), values);
+        AssertSelfMergeMatchesCopy(Mode(), values);
+        AssertSelfMergeMatchesCopy(Histogram(), values);
+        AssertSelfMergeMatchesCopy(Kll(50), values);
+        AssertSelfMergeMatchesCopy(WindowSum(100), values);
+        AssertSelfMergeMatchesCopy(WindowAverage(100), values);
+        AssertSelfMergeMatchesCopy(WindowMin(100), values);
+        AssertSelfMergeMatchesCopy(WindowMax(100), values);
+        AssertSelfMergeMatchesCopy(Ewma(0.1), values);
+    }
+
+    void TestProcessInParallel()
+    {
+        const auto values = RandomValues(100003, 1000);
+
+        auto expected = ExactComposite();
+        expected->ProcessBatch(values.data(), values.size());
+
+        for (std::size_t thread_count : {1, 2, 3, 8})
+        {
+            auto result = ProcessInParallel(values.data(), values.size(), ExactComposite, thread_count);
+            ASSERT_EQUAL(PrintedValue(*result), PrintedValue(*expected));
+        }
+
+        auto empty = ProcessInParallel(values.data(), 0, ExactComposite, 4);
+        ASSERT_EQUAL(PrintedValue(*empty), PrintedValue(*ExactComposite()));
+    }
+
+    namespace
+    {
+        std::string WindowExpected(const std::vector<int>& values, std::size_t end, std::size_t window)
+        {
+            const std::size_t begin = end > window ? end - window : 0;
+            std::int64_t sum = 0;
+            int min = std::numeric_limits<int>::max();
+            int max = std::numeric_limits<int>::min();
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                sum += values[i];
+                min = std::min(min, values[i]);
+                max = std::max(max, values[i]);
+            }
+
+            std::ostringstream expected;
+            expected << "Window sum is " << sum << '\n';
+            if (end == begin)
+            {
+                expected << "Window min is undefined\nWindow max is undefined\nWindow average is undefined\n";
+            }
+            else
+            {
+                expected << "Window min is " << min << '\n'
+                    << "Window max is " << max << '\n'
+                    << "Window average is " << sum / static_cast<std::int64_t>(end - begin) << '\n';
+            }
+            return expected.str();
+        }
+    }
+
+    void TestWindowAggregators()
+    {
+        const auto values = RandomValues(500, 100);
+
+        for (std::size_t window : {1, 2, 3, 17, 1000})
+        {
+            Composite aggr;
+            aggr.Add(std::make_unique<WindowSum>(window));
+            aggr.Add(std::make_unique<WindowMin>(window));
+            aggr.Add(std::make_unique<WindowMax>(window));
+            aggr.Add(std::make_unique<WindowAverage>(window));
+
+            ASSERT_EQUAL(PrintedValue(aggr), WindowExpected(values, 0, window));
+            for (std::size_t i = 0; i < values.size(); ++i)
+            {
+                aggr.Process(values[i]);
+                ASSERT_EQUAL(PrintedValue(aggr), WindowExpected(values, i + 1, window));
+            }
+
+            for (std::size_t split : {std::size_t(0), std::size_t(1), window / 2, std::size_t(250), values.size()})
+            {
+                Composite first, second;
+                for (Composite* part : {&first, &second})
+                {
+                    part->Add(std::make_unique<WindowSum>(window));
+                    part->Add(std::make_unique<WindowMin>(window));
+                    part->Add(std::make_unique<WindowMax>(window));
+                    part->Add(std::make_unique<WindowAverage>(window));
+                }
+                first.ProcessBatch(values.data(), split);
+                second.ProcessBatch(values.data() + split, values.size() - split);
+                first.Merge(second);
+                ASSERT_EQUAL(PrintedValue(first), PrintedValue(aggr));
+            }
+        }
+
+        try
+        {
+            WindowMin(3).Merge(WindowMin(4));
+            ASSERT(false);
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+    }
+
+    void TestEwma()
+    {
+        Ewma aggr(0.5);
+        ASSERT_EQUAL(PrintedValue(aggr), "Ewma is undefined");
+
+        aggr.Process(1);
+        ASSERT_EQUAL(PrintedValue(aggr), "Ewma is 1");
+        aggr.Process(3);
+        ASSERT_EQUAL(PrintedValue(aggr), "Ewma is 2");
+        aggr.Process(5);
+        ASSERT_EQUAL(PrintedValue(aggr), "Ewma is 3.5");
+
+        const auto values = RandomValues(1000, 1000);
+        Ewma whole(0.1);
+        whole.ProcessBatch(values.data(), values.size());
+        for (std::size_t split : {0, 1, 500, 999, 1000})
+        {
+            Ewma first(0.1), second(0.1);
+            first.ProcessBatch(values.data(), split);
+            second.ProcessBatch(values.data() + split, values.size() - split);
+            first.Merge(second);
+            ASSERT_EQUAL(PrintedValue(first), PrintedValue(whole));
+        }
+    }
+
+    void TestApproximateMode()
+    {
+        ApproximateMode aggr(10);
+        ASSERT_EQUAL(PrintedValue(aggr), "Mode is undefined");
+
+        for (int value : {3, 3, 8, 8, 8, 8, -1, -1, -1, 16})
+        {
+            aggr.Process(value);
+        }
+        ASSERT_EQUAL(PrintedValue(aggr), "Mode is 8");
+
+        const auto top = aggr.Top(2);
+        ASSERT_EQUAL(top.size(), 2u);
+        ASSERT_EQUAL(top[0].value, 8);
+        ASSERT_EQUAL(top[0].count, 4u);
+        ASSERT_EQUAL(top[0].error, 0u);
+        ASSERT_EQUAL(top[1].value, -1);
+        ASSERT_EQUAL(aggr.Top(100).size(), 4u);
+
+        // Every third value is 7, the rest are all distinct
+        std::vector<int> values;
+        for (int i = 0; i < 30000; ++i)
+        {
+            values.push_back(i % 3 == 0 ? 7 : 1000 + i);
+        }
+
+        const std::size_t capacity = 20;
+        ApproximateMode small(capacity);
+        small.ProcessBatch(values.data(), values.size());
+        ASSERT_EQUAL(PrintedValue(small), "Mode is 7");
+
+        const auto heavy = small.Top(1).front();
+        ASSERT(heavy.count >= 10000);
+        ASSERT(heavy.count - heavy.error <= 10000);
+        ASSERT(heavy.error <= values.size() / capacity);
+
+        ApproximateMode first(capacity), second(capacity);
+        first.ProcessBatch(values.data(), 12345);
+        second.ProcessBatch(values.data() + 12345, values.size() - 12345);
+        first.Merge(second);
+        ASSERT_EQUAL(PrintedValue(first), "Mode is 7");
+        ASSERT_EQUAL(first.Top(100).size(), capacity);
+        ASSERT(first.Top(1).front().count >= 10000);
+        ASSERT(first.Top(1).front().count - first.Top(1).front().error <= 10000);
+
+        const auto random_values = RandomValues(20000, 50);
+        std::unordered_map<int, std::uint64_t> exact_counts;
+        ApproximateMode random_summary(30);
+        for (int value : random_values)
+        {
+            ++exact_counts[value];
+            random_summary.Process(value);
+        }
+        const auto counters = random_summary.Top(30);
+        ASSERT_EQUAL(counters.size(), 30u);
+        for (std::size_t i = 0; i < counters.size(); ++i)
+        {
+            ASSERT(i == 0 || counters[i - 1].count >= counters[i].count);
+            ASSERT(counters[i].count >= exact_counts[counters[i].value]);
+            ASSERT(counters[i].count - counters[i].error <= exact_counts[counters[i].value]);
+        }
+    }
+
 }
\ No newline at end of file
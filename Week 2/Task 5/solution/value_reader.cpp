@@ -0,0 +1,123 @@
+#include "value_reader.h"
+
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const std::size_t BATCH_SIZE = 4096;
+
+    bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+    }
+
+    class BatchWriter
+    {
+    public:
+        explicit BatchWriter(StatsAggregator& aggr) :
+            aggr(aggr)
+        {
+            batch.reserve(BATCH_SIZE);
+        }
+
+        ~BatchWriter()
+        {
+            Flush();
+        }
+
+        void Add(int value)
+        {
+            batch.push_back(value);
+            if (batch.size() == BATCH_SIZE)
+            {
+                Flush();
+            }
+        }
+
+        void Flush()
+        {
+            aggr.ProcessBatch(batch.data(), batch.size());
+            batch.clear();
+        }
+
+    private:
+        StatsAggregator& aggr;
+        std::vector<int> batch;
+    };
+
+    // Returns false if parsing stopped at something which is not an int
+    bool ParseValues(const char* begin, const char* end, BatchWriter& writer)
+    {
+        while (true)
+        {
+            while (begin != end && IsSpace(*begin))
+            {
+                ++begin;
+            }
+            if (begin == end)
+            {
+                return true;
+            }
+
+            // operator >> accepts an explicit plus sign, from_chars doesn't, but
+            // from_chars takes a minus after it that operator >> rejects
+            if (*begin == '+')
+            {
+                ++begin;
+                if (begin != end && *begin == '-')
+                {
+                    return false;
+                }
+            }
+
+            int value;
+            auto [next, error] = std::from_chars(begin, end, value);
+            if (error != std::errc())
+            {
+                return false;
+            }
+            writer.Add(value);
+            begin = next;
+        }
+    }
+}
+
+void ProcessValues(std::istream& input, StatsAggregator& aggr, std::size_t block_size)
+{
+    std::vector<char> buffer(block_size);
+    BatchWriter writer(aggr);
+
+    // Bytes of a token cut by the end of the previous block, moved to the front
+    std::size_t kept = 0;
+    while (true)
+    {
+        if (kept == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        input.read(buffer.data() + kept, buffer.size() - kept);
+        const char* begin = buffer.data();
+        const char* end = begin + kept + input.gcount();
+        const bool last_block = !input;
+
+        const char* parse_end = end;
+        if (!last_block)
+        {
+            while (parse_end != begin && !IsSpace(parse_end[-1]))
+            {
+                --parse_end;
+            }
+        }
+
+        if (!ParseValues(begin, parse_end, writer) || last_block)
+        {
+            return;
+        }
+
+        kept = end - parse_end;
+        std::memmove(buffer.data(), parse_end, kept);
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "stats_aggregator.h"
+
+#include <cstddef>
+#include <istream>
+
+// Reads whitespace separated integers from input until the end of the stream
+// or the first token which is not an int, like `for (int value; input >> value; )`
+// does, and feeds them to aggr through ProcessBatch. The input is read in
+// blocks of block_size bytes and parsed with std::from_chars, bypassing the
+// locale-aware formatted input of iostreams.
+void ProcessValues(std::istream& input, StatsAggregator& aggr, std::size_t block_size = 1 << 16);
+
+void TestProcessValues();
+
+void BenchmarkProcessValues();
@@ -0,0 +1,67 @@
+#include "value_reader.h"
+#include "test_runner.h"
+
+#include <sstream>
+#include <string>
+
+namespace
+{
+    std::string ProcessedBy(const std::string& text, std::size_t block_size)
+    {
+        std::istringstream input(text);
+        StatsAggregators::Composite aggr;
+        aggr.Add(std::make_unique<StatsAggregators::Sum>());
+        aggr.Add(std::make_unique<StatsAggregators::Min>());
+        aggr.Add(std::make_unique<StatsAggregators::Max>());
+        ProcessValues(input, aggr, block_size);
+
+        std::ostringstream output;
+        aggr.PrintValue(output);
+        return output.str();
+    }
+
+    std::string ProcessedByStream(const std::string& text)
+    {
+        std::istringstream input(text);
+        StatsAggregators::Composite aggr;
+        aggr.Add(std::make_unique<StatsAggregators::Sum>());
+        aggr.Add(std::make_unique<StatsAggregators::Min>());
+        aggr.Add(std::make_unique<StatsAggregators::Max>());
+        for (int value; input >> value; )
+        {
+            aggr.Process(value);
+        }
+
+        std::ostringstream output;
+        aggr.PrintValue(output);
+        return output.str();
+    }
+}
+
+void TestProcessValues()
+{
+    const std::vector<std::string> texts =
+    {
+        "",
+        "   \n",
+        "3 8 -1 16",
+        "3\r\n8\r\n-1\r\n16\r\n",
+        "\t+12   -2147483648 2147483647\n",
+        "1 2 x 100",
+        "1 2 3x 100",
+        "1 2 2147483648 100",
+        "1 2 - 100",
+        "5-7 100",
+        "1 2 +-5 100",
+        "123456789 987654321 -123456789 42 17 1000000 -999999 31337 271828 314159"
+    };
+
+    for (const auto& text : texts)
+    {
+        const std::string expected = ProcessedByStream(text);
+        for (std::size_t block_size : {1, 2, 3, 5, 16, 1 << 16})
+        {
+            ASSERT_EQUAL(ProcessedBy(text, block_size), expected);
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "geo2d.h"
+
 class Unit;
 class Building;
 class Tower;
@@ -14,6 +16,8 @@ struct GameObject
     virtual bool CollideWith(const Building& that) const = 0;
     virtual bool CollideWith(const Tower& that) const = 0;
     virtual bool CollideWith(const Fence& that) const = 0;
+
+    virtual geo2d::Rectangle GetBoundingBox() const = 0;
 };
 
 bool Collide(const GameObject& first, const GameObject& second);
\ No newline at end of file
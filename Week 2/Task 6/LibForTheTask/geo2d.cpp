@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <utility>
 
 namespace geo2d 
 {
@@ -22,6 +24,22 @@ namespace geo2d
         return x != 0 ? x / std::abs(x) : 0;
     }
 
+    // a * b <= c * d, with the products taken in 128 bits
+    bool ProductLessOrEqual(std::uint64_t a, std::uint64_t b, std::uint64_t c, std::uint64_t d)
+    {
+        auto multiply = [](std::uint64_t x, std::uint64_t y)
+        {
+            const std::uint64_t x_low = x & 0xffffffff, x_high = x >> 32;
+            const std::uint64_t y_low = y & 0xffffffff, y_high = y >> 32;
+            const std::uint64_t low_low = x_low * y_low;
+            const std::uint64_t high_low = x_high * y_low;
+            const std::uint64_t middle = (low_low >> 32) + (high_low & 0xffffffff) + x_low * y_high;
+            const std::uint64_t high = x_high * y_high + (high_low >> 32) + (middle >> 32);
+            return std::make_pair(high, (middle << 32) | (low_low & 0xffffffff));
+        };
+        return multiply(a, b) <= multiply(c, d);
+    }
+
     std::uint64_t DistanceSquared(Point p1, Point p2) 
     {
         std::int64_t diff_x = p1.x - p2.x;
@@ -43,6 +61,34 @@ namespace geo2d
         return static_cast<std::int64_t>(lhs.x)* rhs.x + static_cast<std::int64_t>(lhs.y)* rhs.y;
     }
 
+    Rectangle BoundingBox(Point p)
+    {
+        return { p, p };
+    }
+
+    Rectangle BoundingBox(Segment s)
+    {
+        return { s.p1, s.p2 };
+    }
+
+    Rectangle BoundingBox(Rectangle r)
+    {
+        return r;
+    }
+
+    Rectangle BoundingBox(Circle c)
+    {
+        auto clamp = [](std::int64_t x)
+        {
+            return static_cast<int>(std::clamp<std::int64_t>(x, std::numeric_limits<int>::min(), std::numeric_limits<int>::max()));
+        };
+        const std::int64_t radius = c.radius;
+        return {
+            { clamp(c.center.x - radius), clamp(c.center.y - radius) },
+            { clamp(c.center.x + radius), clamp(c.center.y + radius) }
+        };
+    }
+
     bool Collide(Point p, Point q) 
     {
         return p.x == q.x && p.y == q.y;
@@ -50,6 +96,11 @@ namespace geo2d
 
     bool Collide(Point p, Segment s) 
     {
+        if (Collide(s.p1, s.p2))
+        {
+            return Collide(p, s.p1);
+        }
+
         const Vector v1{ s.p1, p };
         const Vector v2{ s.p2, p };
 
@@ -125,11 +176,12 @@ namespace geo2d
     bool Collide(Circle c, Rectangle r) { return Collide(r, c); }
     bool Collide(Circle c, Segment s) {
         if (
-            ScalarProduct(Vector{ s.p1, s.p2 }, Vector{ s.p1, c.center }) >= 0 &&
-            ScalarProduct(Vector{ s.p2, s.p1 }, Vector{ s.p2, c.center }) >= 0)
+            ScalarProduct(Vector{ s.p1, s.p2 }, Vector{ s.p1, c.center }) > 0 &&
+            ScalarProduct(Vector{ s.p2, s.p1 }, Vector{ s.p2, c.center }) > 0)
         {
-            std::uint64_t double_triangle_square = abs(Vector{ s.p1, s.p2 } *Vector{ s.p1, c.center });
-            return Sqr(double_triangle_square) <= Sqr<std::uint64_t>(c.radius) * DistanceSquared(s.p1, s.p2);
+            std::uint64_t double_triangle_square = std::abs(Vector{ s.p1, s.p2 } *Vector{ s.p1, c.center });
+            return ProductLessOrEqual(double_triangle_square, double_triangle_square,
+                Sqr<std::uint64_t>(c.radius), DistanceSquared(s.p1, s.p2));
         }
         else {
             auto d = std::min(DistanceSquared(c.center, s.p1), DistanceSquared(c.center, s.p2));
@@ -11,6 +11,7 @@ namespace geo2d
     };
 
     std::uint64_t DistanceSquared(Point p1, Point p2);
+    bool ProductLessOrEqual(std::uint64_t a, std::uint64_t b, std::uint64_t c, std::uint64_t d);
 
     struct Vector 
     {
@@ -59,6 +60,11 @@ namespace geo2d
         std::uint32_t radius;
     };
 
+    Rectangle BoundingBox(Point p);
+    Rectangle BoundingBox(Segment s);
+    Rectangle BoundingBox(Rectangle r);
+    Rectangle BoundingBox(Circle c);
+
     bool Collide(Point p, Point q);
     bool Collide(Point p, Segment s);
     bool Collide(Point p, Rectangle r);
@@ -0,0 +1,293 @@
+#include "geo2d_batch.h"
+
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace geo2d
+{
+
+    void PointBatch::Add(Point p)
+    {
+        x.push_back(p.x);
+        y.push_back(p.y);
+    }
+
+    std::size_t PointBatch::Size() const
+    {
+        return x.size();
+    }
+
+    void SegmentBatch::Add(Segment s)
+    {
+        x1.push_back(s.p1.x);
+        y1.push_back(s.p1.y);
+        x2.push_back(s.p2.x);
+        y2.push_back(s.p2.y);
+    }
+
+    std::size_t SegmentBatch::Size() const
+    {
+        return x1.size();
+    }
+
+    namespace
+    {
+
+        // Scalar loops, also used for the tails of the vector kernels
+
+        template <typename Figure>
+        void CollideEach(Figure figure, const PointBatch& points, std::size_t begin, std::uint8_t* result)
+        {
+            for (std::size_t i = begin; i < points.Size(); ++i)
+            {
+                result[i] = Collide(figure, Point{ points.x[i], points.y[i] });
+            }
+        }
+
+        template <typename Figure>
+        void CollideEach(Figure figure, const SegmentBatch& segments, std::size_t begin, std::uint8_t* result)
+        {
+            for (std::size_t i = begin; i < segments.Size(); ++i)
+            {
+                const Segment s{ { segments.x1[i], segments.y1[i] }, { segments.x2[i], segments.y2[i] } };
+                result[i] = Collide(figure, s);
+            }
+        }
+
+#if defined(__AVX2__)
+
+        // The kernels repeat the integer arithmetic of geo2d.cpp lane by lane:
+        // coordinate differences are taken in int and then widened, products
+        // and sums in 64 bits.
+
+        __m256i LoadDiff(const int* values, int origin)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+            return _mm256_cvtepi32_epi64(_mm_sub_epi32(v, _mm_set1_epi32(origin)));
+        }
+
+        __m256i Diff(__m128i to, __m128i from)
+        {
+            return _mm256_cvtepi32_epi64(_mm_sub_epi32(to, from));
+        }
+
+        // Full products of the sign-extended 32-bit values
+        __m256i Mul(__m256i a, __m256i b)
+        {
+            return _mm256_mul_epi32(a, b);
+        }
+
+        // Low 64 bits of the product
+        __m256i MulLow64(__m256i a, __m256i b)
+        {
+            const __m256i low = _mm256_mul_epu32(a, b);
+            const __m256i cross = _mm256_add_epi64(
+                _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+            return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+        }
+
+        __m256i GreaterUnsigned(__m256i a, __m256i b)
+        {
+            const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+            return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+        }
+
+        __m256i Abs64(__m256i a)
+        {
+            const __m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), a);
+            return _mm256_sub_epi64(_mm256_xor_si256(a, negative), negative);
+        }
+
+        void Store4(__m256i collide, std::uint8_t* result)
+        {
+            const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(collide));
+            for (int k = 0; k < 4; ++k)
+            {
+                result[k] = (mask >> k) & 1;
+            }
+        }
+
+        __m128i Load4(const int* values)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+        }
+
+#endif
+
+    }
+
+    void CollideBatch(Circle c, const PointBatch& points, std::uint8_t* result)
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        const std::uint64_t radius = c.radius;
+        const __m256i radius_squared = _mm256_set1_epi64x(static_cast<long long>(radius * radius));
+        for (; i + 4 <= points.Size(); i += 4)
+        {
+            const __m256i dx = LoadDiff(&points.x[i], c.center.x);
+            const __m256i dy = LoadDiff(&points.y[i], c.center.y);
+            const __m256i distance = _mm256_add_epi64(Mul(dx, dx), Mul(dy, dy));
+            const __m256i far = GreaterUnsigned(distance, radius_squared);
+            Store4(_mm256_xor_si256(far, _mm256_set1_epi64x(-1)), result + i);
+        }
+#endif
+        CollideEach(c, points, i, result);
+    }
+
+    void CollideBatch(Rectangle r, const PointBatch& points, std::uint8_t* result)
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i left = _mm256_set1_epi32(r.Left());
+        const __m256i right = _mm256_set1_epi32(r.Right());
+        const __m256i bottom = _mm256_set1_epi32(r.Bottom());
+        const __m256i top = _mm256_set1_epi32(r.Top());
+        for (; i + 8 <= points.Size(); i += 8)
+        {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&points.x[i]));
+            const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&points.y[i]));
+            const __m256i outside = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpgt_epi32(left, x), _mm256_cmpgt_epi32(x, right)),
+                _mm256_or_si256(_mm256_cmpgt_epi32(bottom, y), _mm256_cmpgt_epi32(y, top)));
+            const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(outside));
+            for (int k = 0; k < 8; ++k)
+            {
+                result[i + k] = !((mask >> k) & 1);
+            }
+        }
+#endif
+        CollideEach(r, points, i, result);
+    }
+
+    void CollideBatch(Circle c, const SegmentBatch& segments, std::uint8_t* result)
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        const std::uint64_t radius = c.radius;
+        const __m256i radius_squared = _mm256_set1_epi64x(static_cast<long long>(radius * radius));
+        // Bounds keeping cross * cross and radius^2 * length^2 below 2^64
+        const __m256i max_cross = _mm256_set1_epi64x(0xffffffff);
+        const __m256i max_length_squared = _mm256_set1_epi64x(static_cast<long long>(
+            radius == 0 ? std::numeric_limits<std::uint64_t>::max() : std::numeric_limits<std::uint64_t>::max() / (radius * radius)));
+        const __m256i zero = _mm256_setzero_si256();
+        const __m128i cx = _mm_set1_epi32(c.center.x);
+        const __m128i cy = _mm_set1_epi32(c.center.y);
+        for (; i + 4 <= segments.Size(); i += 4)
+        {
+            const __m128i x1 = Load4(&segments.x1[i]);
+            const __m128i y1 = Load4(&segments.y1[i]);
+            const __m128i x2 = Load4(&segments.x2[i]);
+            const __m128i y2 = Load4(&segments.y2[i]);
+
+            // Vector{ s.p1, s.p2 }, Vector{ s.p1, c.center } and the same from s.p2
+            const __m256i forward_x = Diff(x2, x1), forward_y = Diff(y2, y1);
+            const __m256i first_x = Diff(cx, x1), first_y = Diff(cy, y1);
+            const __m256i backward_x = Diff(x1, x2), backward_y = Diff(y1, y2);
+            const __m256i second_x = Diff(cx, x2), second_y = Diff(cy, y2);
+
+            const __m256i first_dot = _mm256_add_epi64(Mul(forward_x, first_x), Mul(forward_y, first_y));
+            const __m256i second_dot = _mm256_add_epi64(Mul(backward_x, second_x), Mul(backward_y, second_y));
+            const __m256i projects_inside = _mm256_and_si256(
+                _mm256_cmpgt_epi64(first_dot, zero), _mm256_cmpgt_epi64(second_dot, zero));
+
+            // The center projects onto the segment: compare the distance to the line.
+            // The products are exact unless they may not fit into 64 bits, such
+            // lanes are left to the scalar code.
+            const __m256i cross = Abs64(_mm256_sub_epi64(Mul(forward_x, first_y), Mul(first_x, forward_y)));
+            const __m256i length_squared = _mm256_add_epi64(Mul(backward_x, backward_x), Mul(backward_y, backward_y));
+            const __m256i line_far = GreaterUnsigned(MulLow64(cross, cross), MulLow64(radius_squared, length_squared));
+            const __m256i may_overflow = _mm256_and_si256(projects_inside, _mm256_or_si256(
+                GreaterUnsigned(cross, max_cross), GreaterUnsigned(length_squared, max_length_squared)));
+
+            // Otherwise the distance to the closest end
+            const __m256i first_far = GreaterUnsigned(
+                _mm256_add_epi64(Mul(first_x, first_x), Mul(first_y, first_y)), radius_squared);
+            const __m256i second_far = GreaterUnsigned(
+                _mm256_add_epi64(Mul(second_x, second_x), Mul(second_y, second_y)), radius_squared);
+            const __m256i ends_far = _mm256_and_si256(first_far, second_far);
+
+            const __m256i far = _mm256_blendv_epi8(ends_far, line_far, projects_inside);
+            Store4(_mm256_xor_si256(far, _mm256_set1_epi64x(-1)), result + i);
+
+            const int overflow_mask = _mm256_movemask_pd(_mm256_castsi256_pd(may_overflow));
+            for (int k = 0; k < 4; ++k)
+            {
+                if ((overflow_mask >> k) & 1)
+                {
+                    const Segment s{ { segments.x1[i + k], segments.y1[i + k] }, { segments.x2[i + k], segments.y2[i + k] } };
+                    result[i + k] = Collide(c, s);
+                }
+            }
+        }
+#endif
+        CollideEach(c, segments, i, result);
+    }
+
+    void CollideBatch(Rectangle r, const SegmentBatch& segments, std::uint8_t* result)
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        // The part of a segment inside its bounding box is the whole segment, so
+        // it collides with r iff its line crosses the intersection of r and the box:
+        // the intersection is not empty and its corners are not strictly on one side
+        const __m128i left = _mm_set1_epi32(r.Left());
+        const __m128i right = _mm_set1_epi32(r.Right());
+        const __m128i bottom = _mm_set1_epi32(r.Bottom());
+        const __m128i top = _mm_set1_epi32(r.Top());
+        const __m256i zero = _mm256_setzero_si256();
+        for (; i + 4 <= segments.Size(); i += 4)
+        {
+            const __m128i x1 = Load4(&segments.x1[i]);
+            const __m128i y1 = Load4(&segments.y1[i]);
+            const __m128i x2 = Load4(&segments.x2[i]);
+            const __m128i y2 = Load4(&segments.y2[i]);
+
+            const __m128i clip_left = _mm_max_epi32(left, _mm_min_epi32(x1, x2));
+            const __m128i clip_right = _mm_min_epi32(right, _mm_max_epi32(x1, x2));
+            const __m128i clip_bottom = _mm_max_epi32(bottom, _mm_min_epi32(y1, y2));
+            const __m128i clip_top = _mm_min_epi32(top, _mm_max_epi32(y1, y2));
+            const __m256i empty = _mm256_cvtepi32_epi64(_mm_or_si128(
+                _mm_cmpgt_epi32(clip_left, clip_right), _mm_cmpgt_epi32(clip_bottom, clip_top)));
+
+            const __m256i dx = Diff(x2, x1), dy = Diff(y2, y1);
+            const __m256i to_left = Diff(clip_left, x1), to_right = Diff(clip_right, x1);
+            const __m256i to_bottom = Diff(clip_bottom, y1), to_top = Diff(clip_top, y1);
+
+            auto side = [&](__m256i to_x, __m256i to_y)
+            {
+                return _mm256_sub_epi64(Mul(dx, to_y), Mul(to_x, dy));
+            };
+            const __m256i corners[] = {
+                side(to_left, to_bottom), side(to_right, to_bottom),
+                side(to_right, to_top), side(to_left, to_top)
+            };
+
+            __m256i all_positive = _mm256_set1_epi64x(-1);
+            __m256i all_negative = _mm256_set1_epi64x(-1);
+            for (const __m256i corner : corners)
+            {
+                all_positive = _mm256_and_si256(all_positive, _mm256_cmpgt_epi64(corner, zero));
+                all_negative = _mm256_and_si256(all_negative, _mm256_cmpgt_epi64(zero, corner));
+            }
+
+            const __m256i miss = _mm256_or_si256(empty, _mm256_or_si256(all_positive, all_negative));
+            Store4(_mm256_xor_si256(miss, _mm256_set1_epi64x(-1)), result + i);
+        }
+#endif
+        CollideEach(r, segments, i, result);
+    }
+
+    const char* BatchKernelName()
+    {
+#if defined(__AVX2__)
+        return "avx2";
+#else
+        return "scalar";
+#endif
+    }
+
+}
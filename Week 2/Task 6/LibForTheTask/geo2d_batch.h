@@ -0,0 +1,45 @@
+#pragma once
+
+#include "geo2d.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Batched versions of the Collide overloads: one figure against many points
+// or segments stored as a structure of arrays. The results are exactly the
+// ones of the scalar overloads, as long as coordinate differences fit into int
+// as the scalar overloads assume too. With AVX2 enabled at compile time the
+// batches are processed by vector kernels, otherwise by a plain loop.
+
+namespace geo2d
+{
+
+    struct PointBatch
+    {
+        std::vector<int> x, y;
+
+        void Add(Point p);
+        std::size_t Size() const;
+    };
+
+    struct SegmentBatch
+    {
+        std::vector<int> x1, y1;
+        std::vector<int> x2, y2;
+
+        void Add(Segment s);
+        std::size_t Size() const;
+    };
+
+    // result[i] = Collide(figure, i-th element of the batch),
+    // result has to hold at least batch.Size() elements
+    void CollideBatch(Circle c, const PointBatch& points, std::uint8_t* result);
+    void CollideBatch(Rectangle r, const PointBatch& points, std::uint8_t* result);
+    void CollideBatch(Circle c, const SegmentBatch& segments, std::uint8_t* result);
+    void CollideBatch(Rectangle r, const SegmentBatch& segments, std::uint8_t* result);
+
+    // "avx2" or "scalar"
+    const char* BatchKernelName();
+
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Templated counterparts of the geo2d figures and Collide overloads. The type
+// of the coordinates picks the arithmetic at compile time through
+// CoordinateTraits:
+//
+//   int   - exact: differences and products in 128 bits, so nothing
+//           overflows while the coordinates and radii stay within 2^30 by
+//           absolute value. Needs a compiler with __int128.
+//   float - fast: everything in float, which is off for nearly touching
+//           figures. The functions have no data dependent branches on the
+//           common paths, so loops over them vectorize.
+
+namespace geo2d::generic
+{
+
+    template <typename T>
+    struct CoordinateTraits;
+
+#if defined(__SIZEOF_INT128__)
+    template <>
+    struct CoordinateTraits<int>
+    {
+        using Wide = __int128;
+        static constexpr bool EXACT = true;
+    };
+#endif
+
+    template <>
+    struct CoordinateTraits<float>
+    {
+        using Wide = float;
+        static constexpr bool EXACT = false;
+    };
+
+    template <typename T>
+    using Wide = typename CoordinateTraits<T>::Wide;
+
+    template <typename T>
+    struct Point
+    {
+        T x, y;
+    };
+
+    template <typename T>
+    struct Segment
+    {
+        Point<T> p1, p2;
+    };
+
+    template <typename T>
+    struct Rectangle
+    {
+        Point<T> min, max;
+
+        static Rectangle FromCorners(Point<T> p1, Point<T> p2)
+        {
+            return { { std::min(p1.x, p2.x), std::min(p1.y, p2.y) }, { std::max(p1.x, p2.x), std::max(p1.y, p2.y) } };
+        }
+    };
+
+    template <typename T>
+    struct Circle
+    {
+        Point<T> center;
+        T radius;
+    };
+
+    // (a - origin) x (b - origin)
+    template <typename T>
+    Wide<T> Cross(Point<T> origin, Point<T> a, Point<T> b)
+    {
+        using W = Wide<T>;
+        return (W(a.x) - origin.x) * (W(b.y) - origin.y) - (W(b.x) - origin.x) * (W(a.y) - origin.y);
+    }
+
+    // (a - origin) . (b - origin)
+    template <typename T>
+    Wide<T> Dot(Point<T> origin, Point<T> a, Point<T> b)
+    {
+        using W = Wide<T>;
+        return (W(a.x) - origin.x) * (W(b.x) - origin.x) + (W(a.y) - origin.y) * (W(b.y) - origin.y);
+    }
+
+    template <typename T>
+    Wide<T> DistanceSquared(Point<T> a, Point<T> b)
+    {
+        return Dot(a, b, b);
+    }
+
+    template <typename T>
+    int Sign(T x)
+    {
+        return (x > 0) - (x < 0);
+    }
+
+    template <typename T>
+    bool Collide(Point<T> p, Point<T> q)
+    {
+        return p.x == q.x && p.y == q.y;
+    }
+
+    template <typename T>
+    bool Collide(Point<T> p, Rectangle<T> r)
+    {
+        return (r.min.x <= p.x) & (p.x <= r.max.x) & (r.min.y <= p.y) & (p.y <= r.max.y);
+    }
+
+    template <typename T>
+    bool Collide(Point<T> p, Circle<T> c)
+    {
+        return DistanceSquared(p, c.center) <= Wide<T>(c.radius) * c.radius;
+    }
+
+    template <typename T>
+    bool Collide(Point<T> p, Segment<T> s)
+    {
+        if (Collide(s.p1, s.p2))
+        {
+            return Collide(p, s.p1);
+        }
+        return Cross(s.p1, s.p2, p) == 0 && Dot(s.p1, s.p2, p) >= 0 && Dot(s.p2, s.p1, p) >= 0;
+    }
+
+    template <typename T>
+    bool Collide(Rectangle<T> r1, Rectangle<T> r2)
+    {
+        return (std::max(r1.min.x, r2.min.x) <= std::min(r1.max.x, r2.max.x))
+            & (std::max(r1.min.y, r2.min.y) <= std::min(r1.max.y, r2.max.y));
+    }
+
+    template <typename T>
+    bool Collide(Rectangle<T> r, Circle<T> c)
+    {
+        // The point of the rectangle closest to the center
+        const Point<T> closest{ std::clamp(c.center.x, r.min.x, r.max.x), std::clamp(c.center.y, r.min.y, r.max.y) };
+        return Collide(closest, c);
+    }
+
+    template <typename T>
+    bool Collide(Circle<T> c1, Circle<T> c2)
+    {
+        const Wide<T> radii = Wide<T>(c1.radius) + c2.radius;
+        return DistanceSquared(c1.center, c2.center) <= radii * radii;
+    }
+
+    template <typename T>
+    bool Collide(Segment<T> s1, Segment<T> s2)
+    {
+        const auto box1 = Rectangle<T>::FromCorners(s1.p1, s1.p2);
+        const auto box2 = Rectangle<T>::FromCorners(s2.p1, s2.p2);
+        if (!Collide(box1, box2))
+        {
+            return false;
+        }
+        return Sign(Cross(s1.p1, s1.p2, s2.p1)) * Sign(Cross(s1.p1, s1.p2, s2.p2)) <= 0
+            && Sign(Cross(s2.p1, s2.p2, s1.p1)) * Sign(Cross(s2.p1, s2.p2, s1.p2)) <= 0;
+    }
+
+    template <typename T>
+    bool Collide(Segment<T> s, Rectangle<T> r)
+    {
+        // Inside its bounding box the line of the segment is the segment, so it
+        // has to cross the part of the rectangle within the box: the part is not
+        // empty and its corners are not all strictly on one side of the line
+        const auto box = Rectangle<T>::FromCorners(s.p1, s.p2);
+        const Rectangle<T> clip{
+            { std::max(r.min.x, box.min.x), std::max(r.min.y, box.min.y) },
+            { std::min(r.max.x, box.max.x), std::min(r.max.y, box.max.y) }
+        };
+        if ((clip.min.x > clip.max.x) | (clip.min.y > clip.max.y))
+        {
+            return false;
+        }
+
+        const Wide<T> sides[] = {
+            Cross(s.p1, s.p2, clip.min), Cross(s.p1, s.p2, Point<T>{ clip.max.x, clip.min.y }),
+            Cross(s.p1, s.p2, clip.max), Cross(s.p1, s.p2, Point<T>{ clip.min.x, clip.max.y })
+        };
+        bool all_positive = true, all_negative = true;
+        for (const Wide<T>& side : sides)
+        {
+            all_positive &= side > 0;
+            all_negative &= side < 0;
+        }
+        return !all_positive && !all_negative;
+    }
+
+    template <typename T>
+    bool Collide(Segment<T> s, Circle<T> c)
+    {
+        const Wide<T> radius_squared = Wide<T>(c.radius) * c.radius;
+        if (Dot(s.p1, s.p2, c.center) > 0 && Dot(s.p2, s.p1, c.center) > 0)
+        {
+            const Wide<T> cross = Cross(s.p1, s.p2, c.center);
+            return cross * cross <= radius_squared * DistanceSquared(s.p1, s.p2);
+        }
+        return std::min(DistanceSquared(c.center, s.p1), DistanceSquared(c.center, s.p2)) <= radius_squared;
+    }
+
+    template <typename T> bool Collide(Segment<T> s, Point<T> p) { return Collide(p, s); }
+    template <typename T> bool Collide(Rectangle<T> r, Point<T> p) { return Collide(p, r); }
+    template <typename T> bool Collide(Rectangle<T> r, Segment<T> s) { return Collide(s, r); }
+    template <typename T> bool Collide(Circle<T> c, Point<T> p) { return Collide(p, c); }
+    template <typename T> bool Collide(Circle<T> c, Segment<T> s) { return Collide(s, c); }
+    template <typename T> bool Collide(Circle<T> c, Rectangle<T> r) { return Collide(r, c); }
+
+    // result[i] = Collide(figure, Point<T>{ xs[i], ys[i] })
+    template <typename Figure, typename T>
+    void CollideBatch(Figure figure, const T* xs, const T* ys, std::size_t count, std::uint8_t* result)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            result[i] = Collide(figure, Point<T>{ xs[i], ys[i] });
+        }
+    }
+
+}
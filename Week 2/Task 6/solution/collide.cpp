@@ -1,92 +1,23 @@
 #include "geo2d.h"
 #include "game_object.h"
+#include "game_objects.h"
+
+#include "spatial_index.h"
+#include "test_objects.h"
 
 #include "test_runner.h"
+#include "profile.h"
 
-#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
 
 
-class Unit : public GameObject
-{
-public:
-    explicit Unit(geo2d::Point position) :
-        position_(position)
-    {}
-
-    bool Collide(const GameObject& gameObject) const override;
-        
-    bool CollideWith(const Unit& unit) const override;
-    bool CollideWith(const Building& building) const override;
-    bool CollideWith(const Tower& tower) const override;
-    bool CollideWith(const Fence& fence) const override;
-
-    geo2d::Point GetFigure() const;
-
-private:
-    geo2d::Point position_;
-};
-
-class Building : public GameObject
-{
-public:
-    explicit Building(geo2d::Rectangle geometry) :
-        rectangle_(geometry)
-    {}
-
-    bool Collide(const GameObject& gameObject) const override;
-    
-    bool CollideWith(const Unit& unit) const override;
-    bool CollideWith(const Building& building) const override;
-    bool CollideWith(const Tower& tower) const override;
-    bool CollideWith(const Fence& fence) const override;
-
-    geo2d::Rectangle GetFigure() const;
-
-private:
-    geo2d::Rectangle rectangle_;
-};
-
-class Tower : public GameObject
-{
-public:
-    explicit Tower(geo2d::Circle geometry) :
-        circle_(geometry)
-    {}
-
-    bool Collide(const GameObject& gameObject) const override;
-
-    bool CollideWith(const Unit& unit) const override;
-    bool CollideWith(const Building& building) const override;
-    bool CollideWith(const Tower& tower) const override;
-    bool CollideWith(const Fence& fence) const override;
-
-    geo2d::Circle GetFigure() const;
-
-private:
-    geo2d::Circle circle_;
-};
-
-class Fence : public GameObject
-{
-public:
-    explicit Fence(geo2d::Segment geometry) :
-        segment_(geometry)
-    {}
-
-    bool Collide(const GameObject& gameObject) const override;
-
-    bool CollideWith(const Unit& unit) const override;
-    bool CollideWith(const Building& building) const override;
-    bool CollideWith(const Tower& tower) const override;
-    bool CollideWith(const Fence& fence) const override;
-
-    geo2d::Segment GetFigure() const;
-
-private:
-    geo2d::Segment segment_;
-};
-
 bool Unit::Collide(const GameObject& gameObject) const
 {
     return gameObject.CollideWith(*this);
@@ -109,6 +40,11 @@ bool Unit::CollideWith(const Fence& fence) const
     return geo2d::Collide(position_, fence.GetFigure());
 }
 
+geo2d::Rectangle Unit::GetBoundingBox() const
+{
+    return geo2d::BoundingBox(position_);
+}
+
 geo2d::Point Unit::GetFigure() const
 {
     return position_;
@@ -137,6 +73,11 @@ bool Building::CollideWith(const Fence& fence) const
     return geo2d::Collide(rectangle_, fence.GetFigure());
 }
 
+geo2d::Rectangle Building::GetBoundingBox() const
+{
+    return geo2d::BoundingBox(rectangle_);
+}
+
 geo2d::Rectangle Building::GetFigure() const
 {
     return rectangle_;
@@ -165,6 +106,11 @@ bool Tower::CollideWith(const Fence& fence) const
     return geo2d::Collide(circle_, fence.GetFigure());
 }
 
+geo2d::Rectangle Tower::GetBoundingBox() const
+{
+    return geo2d::BoundingBox(circle_);
+}
+
 geo2d::Circle Tower::GetFigure() const
 {
     return circle_;
@@ -193,6 +139,11 @@ bool Fence::CollideWith(const Fence& fence) const
     return geo2d::Collide(segment_, fence.GetFigure());
 }
 
+geo2d::Rectangle Fence::GetBoundingBox() const
+{
+    return geo2d::BoundingBox(segment_);
+}
+
 geo2d::Segment Fence::GetFigure() const
 {
     return segment_;
@@ -208,16 +159,7 @@ void TestAddingNewObjectOnMap()
 {
     using namespace geo2d;
 
-    const std::vector<std::shared_ptr<GameObject>> game_map = 
-    {
-      std::make_shared<Unit>(Point{3, 3}),
-      std::make_shared<Unit>(Point{5, 5}),
-      std::make_shared<Unit>(Point{3, 7}),
-      std::make_shared<Fence>(Segment{{7, 3}, {9, 8}}),
-      std::make_shared<Tower>(Circle{Point{9, 4}, 1}),
-      std::make_shared<Tower>(Circle{Point{10, 7}, 1}),
-      std::make_shared<Building>(Rectangle{{11, 4}, {14, 6}})
-    };
+    const std::vector<std::shared_ptr<GameObject>> game_map = MakeGameMap();
 
     for (size_t i = 0; i < game_map.size(); ++i) 
     {
@@ -254,9 +196,234 @@ void TestAddingNewObjectOnMap()
     ASSERT(!Collide(*new_defense_tower, *game_map[6]));
 }
 
-int main() 
+void TestSpatialIndex()
+{
+    using namespace geo2d;
+
+    const std::vector<std::shared_ptr<GameObject>> game_map = MakeGameMap();
+
+    SpatialIndex index(4);
+    for (const auto& object : game_map)
+    {
+        index.Insert(object);
+    }
+    ASSERT_EQUAL(index.Size(), game_map.size());
+
+    const Building new_warehouse(Rectangle{ {4, 3}, {9, 6} });
+    ASSERT_EQUAL(index.FindColliding(new_warehouse), (std::vector<SpatialIndex::ObjectId>{ 1, 3, 4 }));
+
+    const Tower new_defense_tower(Circle{ {8, 2}, 2 });
+    ASSERT_EQUAL(index.FindColliding(new_defense_tower), (std::vector<SpatialIndex::ObjectId>{ 3, 4 }));
+
+    index.Remove(3);
+    ASSERT_EQUAL(index.Size(), game_map.size() - 1);
+    ASSERT_EQUAL(index.FindColliding(new_warehouse), (std::vector<SpatialIndex::ObjectId>{ 1, 4 }));
+
+    index.Move(0, std::make_shared<Unit>(Point{ 8, 1 }));
+    ASSERT_EQUAL(index.FindColliding(new_defense_tower), (std::vector<SpatialIndex::ObjectId>{ 0, 4 }));
+    ASSERT_EQUAL(index.FindColliding(new_warehouse), (std::vector<SpatialIndex::ObjectId>{ 1, 4 }));
+
+    // A removed id is not in use until it is given out again, once
+    auto throws_out_of_range = [](auto action)
+    {
+        try
+        {
+            action();
+        }
+        catch (const std::out_of_range&)
+        {
+            return true;
+        }
+        return false;
+    };
+    ASSERT(throws_out_of_range([&] { index.Remove(3); }));
+    ASSERT(throws_out_of_range([&] { index.Move(3, std::make_shared<Unit>(Point{ 0, 0 })); }));
+    ASSERT(throws_out_of_range([&] { index.Get(3); }));
+    ASSERT(throws_out_of_range([&] { index.Remove(100); }));
+    ASSERT_EQUAL(index.Size(), game_map.size() - 1);
+
+    // Ids of removed objects are reused
+    ASSERT_EQUAL(index.Insert(std::make_shared<Unit>(Point{ -5, -5 })), 3u);
+    ASSERT_EQUAL(index.Insert(std::make_shared<Unit>(Point{ -6, -6 })), game_map.size());
+    ASSERT_EQUAL(index.FindColliding(Unit(Point{ -5, -5 })), (std::vector<SpatialIndex::ObjectId>{ 3 }));
+}
+
+void TestSpatialIndexAtTheEndsOfInt()
+{
+    using namespace geo2d;
+
+    // With cells of size 1 the cell indices reach the largest and smallest int
+    const int max = std::numeric_limits<int>::max();
+    const int min = std::numeric_limits<int>::min();
+    SpatialIndex index(1);
+    index.Insert(std::make_shared<Unit>(Point{ max, max }));
+    index.Insert(std::make_shared<Building>(Rectangle{ {max - 2, max - 2}, {max, max} }));
+    index.Insert(std::make_shared<Unit>(Point{ min, min }));
+
+    ASSERT_EQUAL(index.FindColliding(Unit(Point{ max, max })), (std::vector<SpatialIndex::ObjectId>{ 0, 1 }));
+    ASSERT_EQUAL(index.FindColliding(Building(Rectangle{ {min, min}, {min + 1, min + 1} })), (std::vector<SpatialIndex::ObjectId>{ 2 }));
+    index.Move(1, std::make_shared<Building>(Rectangle{ {max - 1, 0}, {max, 1} }));
+    ASSERT_EQUAL(index.FindColliding(Unit(Point{ max, max })), (std::vector<SpatialIndex::ObjectId>{ 0 }));
+    index.Remove(0);
+    ASSERT_EQUAL(index.FindColliding(Unit(Point{ max, max })), (std::vector<SpatialIndex::ObjectId>{}));
+}
+
+void TestSpatialIndexMatchesBruteForce()
+{
+    std::mt19937 generator(34);
+    const int map_size = 200;
+
+    // A small cell size makes the largest objects go to the oversized list
+    SpatialIndex index(3);
+    std::vector<std::shared_ptr<GameObject>> objects;
+    for (int i = 0; i < 500; ++i)
+    {
+        objects.push_back(MakeRandomObject(generator, map_size, 40));
+        ASSERT_EQUAL(index.Insert(objects.back()), objects.size() - 1);
+    }
+
+    for (int i = 0; i < 200; ++i)
+    {
+        const size_t id = generator() % objects.size();
+        if (!objects[id])
+        {
+            continue;
+        }
+        if (i % 4 == 0)
+        {
+            index.Remove(id);
+            objects[id].reset();
+        }
+        else
+        {
+            objects[id] = MakeRandomObject(generator, map_size, 40);
+            index.Move(id, objects[id]);
+        }
+    }
+
+    for (int i = 0; i < 300; ++i)
+    {
+        const auto query = MakeRandomObject(generator, map_size, 40);
+        ASSERT_EQUAL(index.FindColliding(*query), FindCollidingBruteForce(objects, *query));
+    }
+}
+
+void BenchmarkSpatialIndex()
+{
+    std::mt19937 generator(100000);
+    const size_t object_count = 100'000;
+    const size_t query_count = 1'000;
+    const size_t move_count = 100'000;
+    const int map_size = 100'000;
+    const int max_object_size = 100;
+
+    std::vector<std::shared_ptr<GameObject>> objects;
+    objects.reserve(object_count);
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        objects.push_back(MakeRandomObject(generator, map_size, max_object_size));
+    }
+    std::vector<std::shared_ptr<GameObject>> queries;
+    for (size_t i = 0; i < query_count; ++i)
+    {
+        queries.push_back(MakeRandomObject(generator, map_size, max_object_size));
+    }
+
+    SpatialIndex index(2 * max_object_size);
+    {
+        LOG_DURATION("Insert 100k objects");
+        for (const auto& object : objects)
+        {
+            index.Insert(object);
+        }
+    }
+
+    size_t brute_force_collisions = 0;
+    {
+        LOG_DURATION("1k queries, brute force");
+        for (const auto& query : queries)
+        {
+            brute_force_collisions += FindCollidingBruteForce(objects, *query).size();
+        }
+    }
+
+    size_t index_collisions = 0;
+    {
+        LOG_DURATION("1k queries, spatial index");
+        for (const auto& query : queries)
+        {
+            index_collisions += index.FindColliding(*query).size();
+        }
+    }
+    std::cerr << "Collisions found: " << brute_force_collisions << " vs " << index_collisions << std::endl;
+
+    {
+        // Small steps, as units walking on the map
+        std::uniform_int_distribution<int> step(-3, 3);
+        LOG_DURATION("Move 100k units");
+        for (size_t i = 0; i < move_count; ++i)
+        {
+            const size_t id = generator() % object_count;
+            const geo2d::Rectangle bounds = objects[id]->GetBoundingBox();
+            auto unit = std::make_shared<Unit>(geo2d::Point{ bounds.Left() + step(generator), bounds.Bottom() + step(generator) });
+            index.Move(id, unit);
+            objects[id] = std::move(unit);
+        }
+    }
+}
+
+void TestBatchPoints();
+void TestBatchSegments();
+void TestBatchEdgeCases();
+void BenchmarkBatchCollide();
+void TestCollisionWorld();
+void TestCollisionWorldMatchesGameObjects();
+void BenchmarkCollisionWorld();
+void TestWorkStealingPool();
+void TestFindCollidingPairs();
+void TestFindCollidingPairsMatchesBruteForce();
+void TestFindCollidingPairsWithExtremeCoordinates();
+void BenchmarkFindCollidingPairs();
+void TestCollisionTracker();
+void TestCollisionTrackerMatchesFromScratch();
+void BenchmarkCollisionTracker();
+void TestGenericExactMatchesGeo2d();
+void TestGenericLargeCoordinates();
+void TestGenericFloatAgreesAwayFromBoundaries();
+void TestGenericFloatBatch();
+void BenchmarkGenericCollide();
+
+int main(int argc, char* argv[])
 {
     TestRunner tr;
     RUN_TEST(tr, TestAddingNewObjectOnMap);
+    RUN_TEST(tr, TestSpatialIndex);
+    RUN_TEST(tr, TestSpatialIndexAtTheEndsOfInt);
+    RUN_TEST(tr, TestSpatialIndexMatchesBruteForce);
+    RUN_TEST(tr, TestBatchPoints);
+    RUN_TEST(tr, TestBatchSegments);
+    RUN_TEST(tr, TestBatchEdgeCases);
+    RUN_TEST(tr, TestCollisionWorld);
+    RUN_TEST(tr, TestCollisionWorldMatchesGameObjects);
+    RUN_TEST(tr, TestWorkStealingPool);
+    RUN_TEST(tr, TestFindCollidingPairs);
+    RUN_TEST(tr, TestFindCollidingPairsMatchesBruteForce);
+    RUN_TEST(tr, TestFindCollidingPairsWithExtremeCoordinates);
+    RUN_TEST(tr, TestCollisionTracker);
+    RUN_TEST(tr, TestCollisionTrackerMatchesFromScratch);
+    RUN_TEST(tr, TestGenericExactMatchesGeo2d);
+    RUN_TEST(tr, TestGenericLargeCoordinates);
+    RUN_TEST(tr, TestGenericFloatAgreesAwayFromBoundaries);
+    RUN_TEST(tr, TestGenericFloatBatch);
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0)
+    {
+        BenchmarkSpatialIndex();
+        BenchmarkBatchCollide();
+        BenchmarkCollisionWorld();
+        BenchmarkFindCollidingPairs();
+        BenchmarkCollisionTracker();
+        BenchmarkGenericCollide();
+    }
     return 0;
 }
\ No newline at end of file
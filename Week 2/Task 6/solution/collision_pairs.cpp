@@ -0,0 +1,203 @@
+#include "collision_pairs.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace
+{
+    struct Grid
+    {
+        std::int64_t min_x = 0, min_y = 0;
+        std::int64_t cell_size = 1;
+        std::int64_t width = 0, height = 0;
+
+        // Objects of cell c are entries[starts[c]..starts[c + 1])
+        std::vector<std::size_t> starts;
+        std::vector<std::uint32_t> entries;
+
+        std::int64_t Column(std::int64_t x) const { return (x - min_x) / cell_size; }
+        std::int64_t Row(std::int64_t y) const { return (y - min_y) / cell_size; }
+    };
+
+    const std::int64_t CELLS_PER_OBJECT = 2;
+    const std::size_t CELLS_PER_TASK = 256;
+    const std::int64_t ROWS_PER_BAND = 8;
+    const std::size_t OBJECTS_PER_TASK = 16384;
+
+    // Cells about twice as large as an average object, but no more of them
+    // than a couple per object
+    Grid MakeGrid(const std::vector<geo2d::Rectangle>& boxes)
+    {
+        Grid grid;
+        std::int64_t max_x = std::numeric_limits<int>::min(), max_y = std::numeric_limits<int>::min();
+        grid.min_x = std::numeric_limits<int>::max();
+        grid.min_y = std::numeric_limits<int>::max();
+        std::int64_t total_extent = 0;
+        for (const geo2d::Rectangle& box : boxes)
+        {
+            grid.min_x = std::min<std::int64_t>(grid.min_x, box.Left());
+            grid.min_y = std::min<std::int64_t>(grid.min_y, box.Bottom());
+            max_x = std::max<std::int64_t>(max_x, box.Right());
+            max_y = std::max<std::int64_t>(max_y, box.Top());
+            total_extent += std::max<std::int64_t>(
+                static_cast<std::int64_t>(box.Right()) - box.Left(), static_cast<std::int64_t>(box.Top()) - box.Bottom());
+        }
+
+        const std::int64_t count = static_cast<std::int64_t>(boxes.size());
+        grid.cell_size = std::max<std::int64_t>(1, 2 * total_extent / count);
+        // width * height > max_cells, without the product, which overflows
+        // for objects spread over the whole range of int
+        const std::int64_t max_cells = CELLS_PER_OBJECT * count;
+        auto too_many_cells = [&]
+        {
+            const std::int64_t width = (max_x - grid.min_x) / grid.cell_size + 1;
+            const std::int64_t height = (max_y - grid.min_y) / grid.cell_size + 1;
+            return width > max_cells / height;
+        };
+        while (too_many_cells())
+        {
+            grid.cell_size *= 2;
+        }
+        grid.width = (max_x - grid.min_x) / grid.cell_size + 1;
+        grid.height = (max_y - grid.min_y) / grid.cell_size + 1;
+        return grid;
+    }
+
+    // Counting sort of the objects by cells. The objects are first split by
+    // bands of rows, then every band sorts its own cells in parallel.
+    void FillGrid(Grid& grid, const std::vector<geo2d::Rectangle>& boxes, WorkStealingPool& pool)
+    {
+        const std::size_t band_count = static_cast<std::size_t>((grid.height + ROWS_PER_BAND - 1) / ROWS_PER_BAND);
+        std::vector<std::vector<std::uint32_t>> bands(band_count);
+        // Entries every band will hold, then the offsets of the bands in entries
+        std::vector<std::size_t> band_starts(band_count + 1, 0);
+
+        for (std::uint32_t i = 0; i < boxes.size(); ++i)
+        {
+            const std::int64_t first_row = grid.Row(boxes[i].Bottom()), last_row = grid.Row(boxes[i].Top());
+            const std::int64_t columns = grid.Column(boxes[i].Right()) - grid.Column(boxes[i].Left()) + 1;
+            for (std::int64_t band = first_row / ROWS_PER_BAND; band <= last_row / ROWS_PER_BAND; ++band)
+            {
+                const std::int64_t rows = std::min(last_row, (band + 1) * ROWS_PER_BAND - 1)
+                    - std::max(first_row, band * ROWS_PER_BAND) + 1;
+                bands[band].push_back(i);
+                band_starts[band + 1] += rows * columns;
+            }
+        }
+        for (std::size_t band = 1; band <= band_count; ++band)
+        {
+            band_starts[band] += band_starts[band - 1];
+        }
+
+        grid.starts.assign(grid.width * grid.height + 1, 0);
+        grid.starts.back() = band_starts.back();
+        grid.entries.resize(band_starts.back());
+
+        pool.Run(band_count, [&](std::size_t band, std::size_t)
+            {
+                const std::int64_t first_row = band * ROWS_PER_BAND;
+                const std::int64_t last_row = std::min(grid.height, first_row + ROWS_PER_BAND) - 1;
+                const std::size_t first_cell = first_row * grid.width;
+                std::vector<std::size_t> filled((last_row - first_row + 1) * grid.width + 1, 0);
+
+                auto for_each_cell = [&](const geo2d::Rectangle& box, auto action)
+                {
+                    const std::int64_t begin = std::max(first_row, grid.Row(box.Bottom()));
+                    const std::int64_t end = std::min(last_row, grid.Row(box.Top()));
+                    for (std::int64_t row = begin; row <= end; ++row)
+                    {
+                        for (std::int64_t column = grid.Column(box.Left()); column <= grid.Column(box.Right()); ++column)
+                        {
+                            action(row * grid.width + column - first_cell);
+                        }
+                    }
+                };
+
+                for (std::uint32_t i : bands[band])
+                {
+                    for_each_cell(boxes[i], [&](std::size_t cell) { ++filled[cell + 1]; });
+                }
+                filled[0] = band_starts[band];
+                for (std::size_t cell = 1; cell < filled.size(); ++cell)
+                {
+                    filled[cell] += filled[cell - 1];
+                }
+                std::copy(filled.begin(), filled.end() - 1, grid.starts.begin() + first_cell);
+                for (std::uint32_t i : bands[band])
+                {
+                    for_each_cell(boxes[i], [&](std::size_t cell) { grid.entries[filled[cell]++] = i; });
+                }
+            });
+    }
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> FindCollidingPairs(
+    const std::vector<std::shared_ptr<GameObject>>& objects, WorkStealingPool& pool)
+{
+    using Pair = std::pair<std::size_t, std::size_t>;
+    if (objects.empty())
+    {
+        return {};
+    }
+
+    std::vector<geo2d::Rectangle> boxes(objects.size(), geo2d::Rectangle({ 0, 0 }, { 0, 0 }));
+    pool.Run((objects.size() + OBJECTS_PER_TASK - 1) / OBJECTS_PER_TASK, [&](std::size_t task, std::size_t)
+        {
+            const std::size_t last = std::min(objects.size(), (task + 1) * OBJECTS_PER_TASK);
+            for (std::size_t i = task * OBJECTS_PER_TASK; i < last; ++i)
+            {
+                boxes[i] = objects[i]->GetBoundingBox();
+            }
+        });
+
+    Grid grid = MakeGrid(boxes);
+    FillGrid(grid, boxes, pool);
+
+    std::vector<std::vector<Pair>> found(pool.ThreadCount());
+    const std::size_t cell_count = grid.starts.size() - 1;
+    const std::size_t task_count = (cell_count + CELLS_PER_TASK - 1) / CELLS_PER_TASK;
+
+    pool.Run(task_count, [&](std::size_t task, std::size_t worker)
+        {
+            std::vector<Pair>& result = found[worker];
+            const std::size_t last_cell = std::min(cell_count, (task + 1) * CELLS_PER_TASK);
+            for (std::size_t cell = task * CELLS_PER_TASK; cell < last_cell; ++cell)
+            {
+                const std::int64_t row = cell / grid.width;
+                const std::int64_t column = cell % grid.width;
+                for (std::size_t a = grid.starts[cell]; a < grid.starts[cell + 1]; ++a)
+                {
+                    const std::uint32_t i = grid.entries[a];
+                    for (std::size_t b = a + 1; b < grid.starts[cell + 1]; ++b)
+                    {
+                        const std::uint32_t j = grid.entries[b];
+                        if (!geo2d::Collide(boxes[i], boxes[j]))
+                        {
+                            continue;
+                        }
+                        // Only the cell with the corner of the intersection reports the pair
+                        const int corner_x = std::max(boxes[i].Left(), boxes[j].Left());
+                        const int corner_y = std::max(boxes[i].Bottom(), boxes[j].Bottom());
+                        if (grid.Column(corner_x) != column || grid.Row(corner_y) != row)
+                        {
+                            continue;
+                        }
+                        // The objects of a cell are in increasing order, so i < j
+                        if (Collide(*objects[i], *objects[j]))
+                        {
+                            result.emplace_back(i, j);
+                        }
+                    }
+                }
+            }
+        });
+
+    std::vector<Pair> result;
+    for (const auto& pairs : found)
+    {
+        result.insert(result.end(), pairs.begin(), pairs.end());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "game_object.h"
+#include "work_stealing_pool.h"
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// All pairs (i, j), i < j, of colliding objects in increasing order.
+//
+// The broad phase puts the bounding boxes into a uniform grid. Every pair of
+// intersecting boxes is checked by the cell holding the bottom left corner of
+// their intersection only, so the cells, which are split into tasks for the
+// pool, never report a pair twice. The narrow phase is Collide().
+std::vector<std::pair<std::size_t, std::size_t>> FindCollidingPairs(
+    const std::vector<std::shared_ptr<GameObject>>& objects, WorkStealingPool& pool);
@@ -0,0 +1,132 @@
+#include "collision_pairs.h"
+#include "game_objects.h"
+#include "test_objects.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace geo2d;
+using Pairs = std::vector<std::pair<size_t, size_t>>;
+
+void TestWorkStealingPool()
+{
+    for (size_t thread_count : { 1, 2, 5 })
+    {
+        WorkStealingPool pool(thread_count);
+        ASSERT_EQUAL(pool.ThreadCount(), thread_count);
+
+        // Several batches on the same threads, with tasks of very different lengths
+        for (size_t task_count : { 0, 1, 7, 1000 })
+        {
+            std::vector<std::atomic<int>> runs(task_count);
+            pool.Run(task_count, [&](size_t task, size_t worker)
+                {
+                    ASSERT(worker < thread_count);
+                    if (task % 97 == 0)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    ++runs[task];
+                });
+            for (const auto& count : runs)
+            {
+                ASSERT_EQUAL(count.load(), 1);
+            }
+        }
+    }
+}
+
+void TestFindCollidingPairs()
+{
+    const std::vector<std::shared_ptr<GameObject>> game_map = MakeGameMap();
+
+    WorkStealingPool pool(3);
+    ASSERT_EQUAL(FindCollidingPairs({}, pool), Pairs{});
+    ASSERT_EQUAL(FindCollidingPairs(game_map, pool), Pairs{});
+
+    auto with_new_objects = game_map;
+    with_new_objects.push_back(std::make_shared<Building>(Rectangle{ {4, 3}, {9, 6} }));
+    with_new_objects.push_back(std::make_shared<Tower>(Circle{ {8, 2}, 2 }));
+    ASSERT_EQUAL(FindCollidingPairs(with_new_objects, pool), (Pairs{ {1, 7}, {3, 7}, {3, 8}, {4, 7}, {4, 8}, {7, 8} }));
+}
+
+void TestFindCollidingPairsMatchesBruteForce()
+{
+    std::mt19937 generator(37);
+    // From sparse maps to ones where everything overlaps, with objects of very different sizes
+    for (int map_size : { 100, 1000, 10000 })
+    {
+        const auto objects = MakeRandomMap(generator, 1500, map_size, 300);
+        const Pairs expected = FindCollidingPairsBruteForce(objects);
+        for (size_t thread_count : { 1, 4 })
+        {
+            WorkStealingPool pool(thread_count);
+            ASSERT_EQUAL(FindCollidingPairs(objects, pool), expected);
+        }
+    }
+}
+
+void TestFindCollidingPairsWithExtremeCoordinates()
+{
+    // The grid must not overflow; fences and towers are left out, as the
+    // narrow phase of geo2d computes their vectors in int
+    const int min = std::numeric_limits<int>::min() + 1;
+    const int max = std::numeric_limits<int>::max();
+    const std::vector<std::shared_ptr<GameObject>> objects =
+    {
+      std::make_shared<Unit>(Point{ min, min }),
+      std::make_shared<Unit>(Point{ max, max }),
+      std::make_shared<Unit>(Point{ max, min }),
+      std::make_shared<Building>(Rectangle{ { min, min }, { max, max } }),
+      std::make_shared<Building>(Rectangle{ { 0, 0 }, { max, max } }),
+      std::make_shared<Unit>(Point{ -1, -1 }),
+    };
+    WorkStealingPool pool(2);
+    ASSERT_EQUAL(FindCollidingPairs(objects, pool), FindCollidingPairsBruteForce(objects));
+    ASSERT_EQUAL(FindCollidingPairs({ objects[0], objects[1] }, pool), Pairs{});
+}
+
+void BenchmarkFindCollidingPairs()
+{
+    {
+        std::mt19937 generator(10000);
+        const auto objects = MakeRandomMap(generator, 10'000, 10'000, 50);
+        WorkStealingPool pool(1);
+        Pairs brute_force, grid;
+        {
+            LOG_DURATION("10k objects, brute force");
+            brute_force = FindCollidingPairsBruteForce(objects);
+        }
+        {
+            LOG_DURATION("10k objects, grid, 1 thread");
+            grid = FindCollidingPairs(objects, pool);
+        }
+        ASSERT_EQUAL(brute_force, grid);
+    }
+
+    std::mt19937 generator(1000000);
+    const auto objects = MakeRandomMap(generator, 1'000'000, 1'000'000, 500);
+    size_t pair_count = 0;
+    for (size_t thread_count : { 1, 2, 4, 8 })
+    {
+        WorkStealingPool pool(thread_count);
+        LOG_DURATION("1M objects, grid, " + std::to_string(thread_count) + " threads");
+        const Pairs pairs = FindCollidingPairs(objects, pool);
+        if (pair_count != 0)
+        {
+            ASSERT_EQUAL(pairs.size(), pair_count);
+        }
+        pair_count = pairs.size();
+    }
+    std::cerr << "Hardware threads: " << std::thread::hardware_concurrency()
+        << ", colliding pairs: " << pair_count << std::endl;
+}
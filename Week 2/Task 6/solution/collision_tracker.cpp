@@ -0,0 +1,293 @@
+#include "collision_tracker.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+CollisionTracker::ObjectId CollisionTracker::Add(std::shared_ptr<const GameObject> object)
+{
+    Entry entry;
+    entry.object = std::move(object);
+    entries.push_back(std::move(entry));
+    bounds.emplace_back();
+    positions.emplace_back();
+    neighbours.emplace_back();
+    rebuild_needed = true;
+    return entries.size() - 1;
+}
+
+void CollisionTracker::Remove(ObjectId id)
+{
+    Entry& entry = entries.at(id);
+    if (!entry.alive)
+    {
+        throw std::invalid_argument("The object is already removed");
+    }
+    entry.alive = false;
+    entry.object.reset();
+    rebuild_needed = true;
+}
+
+void CollisionTracker::Move(ObjectId id, std::shared_ptr<const GameObject> object)
+{
+    Entry& entry = entries.at(id);
+    if (!entry.alive)
+    {
+        throw std::invalid_argument("The object is removed");
+    }
+    entry.object = std::move(object);
+    if (!entry.dirty)
+    {
+        entry.dirty = true;
+        dirty.push_back(id);
+    }
+}
+
+CollisionTracker::Changes CollisionTracker::Update()
+{
+    Changes changes;
+
+    if (rebuild_needed)
+    {
+        Rebuild();
+
+        for (auto it = colliding.begin(); it != colliding.end();)
+        {
+            if (neighbours[it->first].count(it->second) == 0)
+            {
+                changes.exited.push_back(*it);
+                it = colliding.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (ObjectId id = 0; id < neighbours.size(); ++id)
+        {
+            for (ObjectId other : neighbours[id])
+            {
+                if (id < other)
+                {
+                    Evaluate(id, other, changes);
+                }
+            }
+        }
+    }
+    else
+    {
+        std::vector<Pair> separated;
+        for (ObjectId id : dirty)
+        {
+            SiftEndpoints(id, separated);
+        }
+
+        // Pairs which stopped overlapping, then the moved objects against
+        // everything they overlap now
+        for (const auto& [first, second] : separated)
+        {
+            Evaluate(first, second, changes);
+        }
+        for (ObjectId id : dirty)
+        {
+            for (ObjectId other : neighbours[id])
+            {
+                if (!entries[other].dirty || id < other)
+                {
+                    Evaluate(id, other, changes);
+                }
+            }
+        }
+    }
+
+    for (ObjectId id : dirty)
+    {
+        entries[id].dirty = false;
+    }
+    dirty.clear();
+
+    std::sort(changes.entered.begin(), changes.entered.end());
+    std::sort(changes.exited.begin(), changes.exited.end());
+    return changes;
+}
+
+std::vector<CollisionTracker::Pair> CollisionTracker::CollidingPairs() const
+{
+    return { colliding.begin(), colliding.end() };
+}
+
+bool CollisionTracker::Less(const Endpoint& lhs, const Endpoint& rhs)
+{
+    // A start goes before an end at the same coordinate: touching boxes overlap
+    return std::tie(lhs.value, lhs.is_max, lhs.id) < std::tie(rhs.value, rhs.is_max, rhs.id);
+}
+
+bool CollisionTracker::BoxesOverlap(ObjectId first, ObjectId second) const
+{
+    const Bounds& lhs = bounds[first];
+    const Bounds& rhs = bounds[second];
+    for (int axis : { X, Y })
+    {
+        if (lhs[axis][0] > rhs[axis][1] || rhs[axis][0] > lhs[axis][1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CollisionTracker::Rebuild()
+{
+    for (Axis axis : { X, Y })
+    {
+        axes[axis].clear();
+    }
+    for (ObjectId id = 0; id < entries.size(); ++id)
+    {
+        neighbours[id].clear();
+        if (!entries[id].alive)
+        {
+            continue;
+        }
+        SetBounds(id);
+        for (Axis axis : { X, Y })
+        {
+            axes[axis].push_back({ bounds[id][axis][0], false, static_cast<std::uint32_t>(id) });
+            axes[axis].push_back({ bounds[id][axis][1], true, static_cast<std::uint32_t>(id) });
+        }
+    }
+
+    for (Axis axis : { X, Y })
+    {
+        std::sort(axes[axis].begin(), axes[axis].end(), Less);
+        for (std::size_t position = 0; position < axes[axis].size(); ++position)
+        {
+            const Endpoint& endpoint = axes[axis][position];
+            positions[endpoint.id][axis][endpoint.is_max] = static_cast<std::uint32_t>(position);
+        }
+    }
+
+    // Sweep along x keeping the boxes the line is crossing
+    std::vector<ObjectId> active;
+    std::vector<std::size_t> active_position(entries.size());
+    for (const Endpoint& endpoint : axes[X])
+    {
+        if (!endpoint.is_max)
+        {
+            for (ObjectId other : active)
+            {
+                if (BoxesOverlap(endpoint.id, other))
+                {
+                    SetNeighbours(endpoint.id, other, true);
+                }
+            }
+            active_position[endpoint.id] = active.size();
+            active.push_back(endpoint.id);
+        }
+        else
+        {
+            const std::size_t position = active_position[endpoint.id];
+            active[position] = active.back();
+            active_position[active[position]] = position;
+            active.pop_back();
+        }
+    }
+
+    rebuild_needed = false;
+}
+
+void CollisionTracker::SetBounds(ObjectId id)
+{
+    const geo2d::Rectangle box = entries[id].object->GetBoundingBox();
+    bounds[id] = { { { box.Left(), box.Right() }, { box.Bottom(), box.Top() } } };
+}
+
+void CollisionTracker::SiftEndpoints(ObjectId id, std::vector<Pair>& separated)
+{
+    SetBounds(id);
+    const Positions& own = positions[id];
+    for (Axis axis : { X, Y })
+    {
+        axes[axis][own[axis][0]].value = bounds[id][axis][0];
+        axes[axis][own[axis][1]].value = bounds[id][axis][1];
+
+        // Widen first, so that the start never has to pass the end of the same box
+        SiftRight(axis, own[axis][1], separated);
+        SiftLeft(axis, own[axis][0], separated);
+        SiftRight(axis, own[axis][0], separated);
+        SiftLeft(axis, own[axis][1], separated);
+    }
+}
+
+void CollisionTracker::SiftLeft(Axis axis, std::size_t position, std::vector<Pair>& separated)
+{
+    const std::vector<Endpoint>& endpoints = axes[axis];
+    while (position > 0 && Less(endpoints[position], endpoints[position - 1]))
+    {
+        SwapWithNext(axis, position - 1, separated);
+        --position;
+    }
+}
+
+void CollisionTracker::SiftRight(Axis axis, std::size_t position, std::vector<Pair>& separated)
+{
+    const std::vector<Endpoint>& endpoints = axes[axis];
+    while (position + 1 < endpoints.size() && Less(endpoints[position + 1], endpoints[position]))
+    {
+        SwapWithNext(axis, position, separated);
+        ++position;
+    }
+}
+
+void CollisionTracker::SwapWithNext(Axis axis, std::size_t position, std::vector<Pair>& separated)
+{
+    std::vector<Endpoint>& endpoints = axes[axis];
+    Endpoint& first = endpoints[position];
+    Endpoint& second = endpoints[position + 1];
+    std::swap(first, second);
+    positions[first.id][axis][first.is_max] = static_cast<std::uint32_t>(position);
+    positions[second.id][axis][second.is_max] = static_cast<std::uint32_t>(position + 1);
+
+    // Pairs that start overlapping contain a moved object and are checked with
+    // its neighbours, the ones that stop overlapping are collected
+    if (first.is_max != second.is_max
+        && !SetNeighbours(first.id, second.id, BoxesOverlap(first.id, second.id)))
+    {
+        separated.emplace_back(std::min(first.id, second.id), std::max(first.id, second.id));
+    }
+}
+
+bool CollisionTracker::SetNeighbours(ObjectId first, ObjectId second, bool are_neighbours)
+{
+    if (are_neighbours)
+    {
+        neighbours[first].insert(second);
+        neighbours[second].insert(first);
+        return true;
+    }
+    if (neighbours[first].erase(second) == 0)
+    {
+        return true;
+    }
+    neighbours[second].erase(first);
+    return false;
+}
+
+void CollisionTracker::Evaluate(ObjectId first, ObjectId second, Changes& changes)
+{
+    const Pair pair = std::minmax(first, second);
+    const bool collide = neighbours[first].count(second) != 0
+        && Collide(*entries[first].object, *entries[second].object);
+    const bool collided = colliding.count(pair) != 0;
+
+    if (collide && !collided)
+    {
+        colliding.insert(pair);
+        changes.entered.push_back(pair);
+    }
+    else if (!collide && collided)
+    {
+        colliding.erase(pair);
+        changes.exited.push_back(pair);
+    }
+}
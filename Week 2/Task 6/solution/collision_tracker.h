@@ -0,0 +1,93 @@
+#pragma once
+
+#include "game_object.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Keeps the set of colliding pairs of objects up to date between ticks.
+//
+// The broad phase is sweep and prune: the ends of the bounding boxes are kept
+// sorted along both axes, and a moved object is sifted to its new place by
+// insertion sort, which is cheap while objects move little per tick. Every
+// swap of the start of one box with the end of another changes the overlap
+// of the pair on that axis, so only those pairs have their overlap of boxes
+// checked. Adding or removing objects makes the next update sort from scratch.
+class CollisionTracker
+{
+public:
+    using ObjectId = std::size_t;
+    // Smaller id first
+    using Pair = std::pair<ObjectId, ObjectId>;
+
+    struct Changes
+    {
+        std::vector<Pair> entered;
+        std::vector<Pair> exited;
+    };
+
+    // The changes take effect on the next Update
+    ObjectId Add(std::shared_ptr<const GameObject> object);
+    void Remove(ObjectId id);
+    void Move(ObjectId id, std::shared_ptr<const GameObject> object);
+
+    // Applies the changes made since the previous update and reports the pairs
+    // that started and stopped colliding, in increasing order
+    Changes Update();
+
+    std::vector<Pair> CollidingPairs() const;
+
+private:
+    enum Axis { X, Y };
+
+    struct Endpoint
+    {
+        int value;
+        bool is_max;
+        std::uint32_t id;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const GameObject> object;
+        bool alive = true;
+        bool dirty = false;
+    };
+
+    // Minimum and maximum by axis
+    using Bounds = std::array<std::array<int, 2>, 2>;
+    // Positions of the minimum and maximum in the axes
+    using Positions = std::array<std::array<std::uint32_t, 2>, 2>;
+
+    static bool Less(const Endpoint& lhs, const Endpoint& rhs);
+    bool BoxesOverlap(ObjectId first, ObjectId second) const;
+
+    void Rebuild();
+    void SetBounds(ObjectId id);
+    void SiftEndpoints(ObjectId id, std::vector<Pair>& separated);
+    void SiftLeft(Axis axis, std::size_t position, std::vector<Pair>& separated);
+    void SiftRight(Axis axis, std::size_t position, std::vector<Pair>& separated);
+    void SwapWithNext(Axis axis, std::size_t position, std::vector<Pair>& separated);
+    // False if the pair has just stopped being neighbours
+    bool SetNeighbours(ObjectId first, ObjectId second, bool are_neighbours);
+
+    void Evaluate(ObjectId first, ObjectId second, Changes& changes);
+
+    std::vector<Entry> entries;
+    // Apart from the entries, as the sorting only needs these
+    std::vector<Bounds> bounds;
+    std::vector<Positions> positions;
+    std::vector<ObjectId> dirty;
+    bool rebuild_needed = false;
+
+    std::array<std::vector<Endpoint>, 2> axes;
+    // Objects whose bounding boxes overlap
+    std::vector<std::unordered_set<ObjectId>> neighbours;
+    std::set<Pair> colliding;
+};
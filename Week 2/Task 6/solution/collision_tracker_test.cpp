@@ -0,0 +1,214 @@
+#include "collision_tracker.h"
+#include "collision_pairs.h"
+#include "game_objects.h"
+#include "test_objects.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace geo2d;
+using Pairs = std::vector<CollisionTracker::Pair>;
+
+namespace
+{
+    // Units are moved by a few steps, other objects are moved anywhere
+    std::shared_ptr<GameObject> MoveObject(std::mt19937& generator, const GameObject& object, int step, int map_size)
+    {
+        const geo2d::Rectangle box = object.GetBoundingBox();
+        if (dynamic_cast<const Unit*>(&object))
+        {
+            std::uniform_int_distribution<int> shift(-step, step);
+            return std::make_shared<Unit>(Point{ box.Left() + shift(generator), box.Bottom() + shift(generator) });
+        }
+        return MakeRandomObject(generator, map_size, step * 4);
+    }
+
+    Pairs Difference(const Pairs& lhs, const Pairs& rhs)
+    {
+        Pairs result;
+        std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(result));
+        return result;
+    }
+
+    // Colliding pairs of the alive objects, by the ids of the tracker
+    Pairs FindPairsFromScratch(const std::vector<std::shared_ptr<GameObject>>& objects, WorkStealingPool& pool)
+    {
+        std::vector<std::shared_ptr<GameObject>> alive;
+        std::vector<size_t> ids;
+        for (size_t id = 0; id < objects.size(); ++id)
+        {
+            if (objects[id])
+            {
+                alive.push_back(objects[id]);
+                ids.push_back(id);
+            }
+        }
+        Pairs result;
+        for (const auto& [first, second] : FindCollidingPairs(alive, pool))
+        {
+            result.emplace_back(ids[first], ids[second]);
+        }
+        return result;
+    }
+}
+
+void TestCollisionTracker()
+{
+    CollisionTracker tracker;
+    const auto tower = tracker.Add(std::make_shared<Tower>(Circle{ { 10, 10 }, 2 }));
+    const auto fence = tracker.Add(std::make_shared<Fence>(Segment{ { 0, 0 }, { 0, 20 } }));
+    const auto unit = tracker.Add(std::make_shared<Unit>(Point{ 5, 10 }));
+
+    auto changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, Pairs{});
+    ASSERT_EQUAL(changes.exited, Pairs{});
+
+    // The unit walks into the tower, stays there and walks through to the fence
+    tracker.Move(unit, std::make_shared<Unit>(Point{ 8, 10 }));
+    changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, (Pairs{ { tower, unit } }));
+    ASSERT_EQUAL(changes.exited, Pairs{});
+
+    tracker.Move(unit, std::make_shared<Unit>(Point{ 9, 11 }));
+    changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, Pairs{});
+    ASSERT_EQUAL(changes.exited, Pairs{});
+    ASSERT_EQUAL(tracker.CollidingPairs(), (Pairs{ { tower, unit } }));
+
+    tracker.Move(unit, std::make_shared<Unit>(Point{ 0, 11 }));
+    changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, (Pairs{ { fence, unit } }));
+    ASSERT_EQUAL(changes.exited, (Pairs{ { tower, unit } }));
+
+    // A new building covers everything, then the fence is taken down
+    const auto building = tracker.Add(std::make_shared<Building>(Rectangle{ { -1, -1 }, { 20, 20 } }));
+    changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, (Pairs{ { tower, building }, { fence, building }, { unit, building } }));
+
+    tracker.Remove(fence);
+    changes = tracker.Update();
+    ASSERT_EQUAL(changes.entered, Pairs{});
+    ASSERT_EQUAL(changes.exited, (Pairs{ { fence, unit }, { fence, building } }));
+    ASSERT_EQUAL(tracker.CollidingPairs(), (Pairs{ { tower, building }, { unit, building } }));
+}
+
+void TestCollisionTrackerMatchesFromScratch()
+{
+    std::mt19937 generator(38);
+    WorkStealingPool pool(2);
+    const int map_size = 300;
+
+    for (int step : { 1, 5, 50 })
+    {
+        CollisionTracker tracker;
+        std::vector<std::shared_ptr<GameObject>> objects;
+        for (int i = 0; i < 300; ++i)
+        {
+            objects.push_back(MakeRandomObject(generator, map_size, 20));
+            ASSERT_EQUAL(tracker.Add(objects.back()), objects.size() - 1);
+        }
+
+        Pairs expected_before;
+        for (int tick = 0; tick < 60; ++tick)
+        {
+            // Mostly moves, sometimes objects come and go
+            for (int change = 0; change < 30; ++change)
+            {
+                const size_t id = generator() % objects.size();
+                if (!objects[id])
+                {
+                    continue;
+                }
+                if (tick % 10 == 9 && change % 10 == 0)
+                {
+                    tracker.Remove(id);
+                    objects[id].reset();
+                    objects.push_back(MakeRandomObject(generator, map_size, 20));
+                    ASSERT_EQUAL(tracker.Add(objects.back()), objects.size() - 1);
+                }
+                else
+                {
+                    objects[id] = MoveObject(generator, *objects[id], step, map_size);
+                    tracker.Move(id, objects[id]);
+                }
+            }
+
+            const auto changes = tracker.Update();
+            const Pairs expected = FindPairsFromScratch(objects, pool);
+            ASSERT_EQUAL(tracker.CollidingPairs(), expected);
+            ASSERT_EQUAL(changes.entered, Difference(expected, expected_before));
+            ASSERT_EQUAL(changes.exited, Difference(expected_before, expected));
+            expected_before = expected;
+        }
+    }
+}
+
+void BenchmarkCollisionTracker()
+{
+    std::mt19937 generator(100000);
+    const int map_size = 100'000;
+    const size_t object_count = 100'000;
+    const int tick_count = 50;
+
+    CollisionTracker tracker;
+    std::vector<std::shared_ptr<GameObject>> objects;
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        objects.push_back(MakeRandomObject(generator, map_size, 100));
+        tracker.Add(objects.back());
+    }
+    {
+        LOG_DURATION("Tracker, initial update of 100k objects");
+        tracker.Update();
+    }
+
+    // A tenth of the objects are units, walking a few steps every tick
+    std::vector<size_t> units;
+    for (size_t id = 0; id < object_count; ++id)
+    {
+        if (dynamic_cast<const Unit*>(objects[id].get()))
+        {
+            units.push_back(id);
+        }
+    }
+    units.resize(object_count / 10);
+
+    WorkStealingPool pool(1);
+    std::uniform_int_distribution<int> shift(-3, 3);
+    size_t tracked_changes = 0, from_scratch_pairs = 0;
+    std::chrono::steady_clock::duration tracker_time{}, from_scratch_time{};
+    for (int tick = 0; tick < tick_count; ++tick)
+    {
+        for (size_t id : units)
+        {
+            const geo2d::Rectangle box = objects[id]->GetBoundingBox();
+            objects[id] = std::make_shared<Unit>(Point{ box.Left() + shift(generator), box.Bottom() + shift(generator) });
+            tracker.Move(id, objects[id]);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        const auto changes = tracker.Update();
+        tracked_changes += changes.entered.size() + changes.exited.size();
+        tracker_time += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        from_scratch_pairs += FindCollidingPairs(objects, pool).size();
+        from_scratch_time += std::chrono::steady_clock::now() - start;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    std::cerr << "Tracker, 50 ticks: " << duration_cast<milliseconds>(tracker_time).count() << " ms" << std::endl;
+    std::cerr << "FindCollidingPairs from scratch, 50 ticks: "
+        << duration_cast<milliseconds>(from_scratch_time).count() << " ms" << std::endl;
+    std::cerr << "Entered and exited pairs: " << tracked_changes
+        << ", colliding pairs per tick: " << from_scratch_pairs / tick_count << std::endl;
+}
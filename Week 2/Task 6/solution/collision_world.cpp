@@ -0,0 +1,157 @@
+#include "collision_world.h"
+
+#include <ostream>
+
+const std::array<CollisionWorld::PairTest, CollisionWorld::KIND_COUNT * CollisionWorld::KIND_COUNT> CollisionWorld::PAIR_TESTS =
+    CollisionWorld::MakePairTests(std::make_index_sequence<KIND_COUNT * KIND_COUNT>());
+
+std::size_t CollisionWorld::CountOf(std::size_t kind) const
+{
+    return std::apply([kind](const auto&... same_kind)
+        {
+            const std::size_t sizes[] = { same_kind.size()... };
+            return sizes[kind];
+        }, shapes);
+}
+
+std::size_t CollisionWorld::Size() const
+{
+    return std::apply([](const auto&... same_kind)
+        {
+            return (same_kind.size() + ...);
+        }, shapes);
+}
+
+bool CollisionWorld::Collide(Handle first, Handle second) const
+{
+    const std::size_t pair = static_cast<std::size_t>(first.kind) * KIND_COUNT + static_cast<std::size_t>(second.kind);
+    return PAIR_TESTS[pair](shapes, first.index, second.index);
+}
+
+geo2d::Rectangle CollisionWorld::GetBoundingBox(Handle handle) const
+{
+    geo2d::Rectangle result({ 0, 0 }, { 0, 0 });
+    VisitShape<0>(shapes, handle, [&result](const auto& shape)
+        {
+            result = geo2d::BoundingBox(shape);
+            return true;
+        });
+    return result;
+}
+
+std::vector<CollisionWorld::Handle> CollisionWorld::FindColliding(Handle handle) const
+{
+    std::vector<Handle> result;
+    for (std::size_t kind = 0; kind < KIND_COUNT; ++kind)
+    {
+        const PairTest test = PAIR_TESTS[static_cast<std::size_t>(handle.kind) * KIND_COUNT + kind];
+        const std::size_t count = CountOf(kind);
+        for (std::uint32_t index = 0; index < count; ++index)
+        {
+            if (test(shapes, handle.index, index))
+            {
+                result.push_back({ static_cast<Kind>(kind), index });
+            }
+        }
+    }
+    return result;
+}
+
+namespace
+{
+    template <typename First, typename Second>
+    std::size_t CountPairs(const std::vector<First>& first, const std::vector<Second>& second)
+    {
+        std::size_t result = 0;
+        for (const First& lhs : first)
+        {
+            for (const Second& rhs : second)
+            {
+                result += geo2d::Collide(lhs, rhs);
+            }
+        }
+        return result;
+    }
+
+    template <typename Shape>
+    std::size_t CountPairs(const std::vector<Shape>& shapes)
+    {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < shapes.size(); ++i)
+        {
+            for (std::size_t j = i + 1; j < shapes.size(); ++j)
+            {
+                result += geo2d::Collide(shapes[i], shapes[j]);
+            }
+        }
+        return result;
+    }
+}
+
+std::size_t CollisionWorld::CountCollidingPairs() const
+{
+    // Every pair of kinds gets its own loop with the test inlined
+    const auto& [points, segments, rectangles, circles] = shapes;
+    return CountPairs(points) + CountPairs(segments) + CountPairs(rectangles) + CountPairs(circles)
+        + CountPairs(points, segments) + CountPairs(points, rectangles) + CountPairs(points, circles)
+        + CountPairs(segments, rectangles) + CountPairs(segments, circles)
+        + CountPairs(rectangles, circles);
+}
+
+bool operator == (CollisionWorld::Handle lhs, CollisionWorld::Handle rhs)
+{
+    return lhs.kind == rhs.kind && lhs.index == rhs.index;
+}
+
+bool operator < (CollisionWorld::Handle lhs, CollisionWorld::Handle rhs)
+{
+    return std::make_pair(lhs.kind, lhs.index) < std::make_pair(rhs.kind, rhs.index);
+}
+
+std::ostream& operator << (std::ostream& os, CollisionWorld::Handle handle)
+{
+    static const char* const NAMES[] = { "point", "segment", "rectangle", "circle" };
+    return os << NAMES[static_cast<std::size_t>(handle.kind)] << " #" << handle.index;
+}
+
+
+bool WorldObject::Collide(const GameObject& gameObject) const
+{
+    switch (handle_.kind)
+    {
+    case CollisionWorld::Kind::Point:
+        return gameObject.CollideWith(Unit(world_.Shapes<geo2d::Point>()[handle_.index]));
+    case CollisionWorld::Kind::Segment:
+        return gameObject.CollideWith(Fence(world_.Shapes<geo2d::Segment>()[handle_.index]));
+    case CollisionWorld::Kind::Rectangle:
+        return gameObject.CollideWith(Building(world_.Shapes<geo2d::Rectangle>()[handle_.index]));
+    case CollisionWorld::Kind::Circle:
+        return gameObject.CollideWith(Tower(world_.Shapes<geo2d::Circle>()[handle_.index]));
+    }
+    return false;
+}
+
+bool WorldObject::CollideWith(const Unit& unit) const
+{
+    return world_.Collide(handle_, unit.GetFigure());
+}
+
+bool WorldObject::CollideWith(const Building& building) const
+{
+    return world_.Collide(handle_, building.GetFigure());
+}
+
+bool WorldObject::CollideWith(const Tower& tower) const
+{
+    return world_.Collide(handle_, tower.GetFigure());
+}
+
+bool WorldObject::CollideWith(const Fence& fence) const
+{
+    return world_.Collide(handle_, fence.GetFigure());
+}
+
+geo2d::Rectangle WorldObject::GetBoundingBox() const
+{
+    return world_.GetBoundingBox(handle_);
+}
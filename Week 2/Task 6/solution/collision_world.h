@@ -0,0 +1,180 @@
+#pragma once
+
+#include "geo2d.h"
+#include "game_object.h"
+#include "game_objects.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Shapes of the same kind are kept in one contiguous array. A pair of objects
+// is tested by the function a compile-time table holds for the pair of their
+// kinds, which avoids both the double virtual dispatch of GameObject and
+// allocating every object on its own.
+class CollisionWorld
+{
+public:
+    // In the order of the arrays in Storage
+    enum class Kind : std::uint8_t
+    {
+        Point,
+        Segment,
+        Rectangle,
+        Circle
+    };
+    static constexpr std::size_t KIND_COUNT = 4;
+
+    struct Handle
+    {
+        Kind kind;
+        std::uint32_t index;
+    };
+
+    template <typename Shape>
+    Handle Add(Shape shape);
+    // The shape has to be of the same kind as the one it replaces
+    template <typename Shape>
+    void Set(Handle handle, Shape shape);
+    template <typename Shape>
+    const std::vector<Shape>& Shapes() const;
+
+    std::size_t Size() const;
+
+    bool Collide(Handle first, Handle second) const;
+    template <typename Shape>
+    bool Collide(Handle handle, Shape shape) const;
+
+    geo2d::Rectangle GetBoundingBox(Handle handle) const;
+
+    // All objects colliding with the given one, including itself
+    std::vector<Handle> FindColliding(Handle handle) const;
+    // Number of colliding pairs of different objects
+    std::size_t CountCollidingPairs() const;
+
+private:
+    using Storage = std::tuple<
+        std::vector<geo2d::Point>,
+        std::vector<geo2d::Segment>,
+        std::vector<geo2d::Rectangle>,
+        std::vector<geo2d::Circle>
+    >;
+    using PairTest = bool (*)(const Storage& shapes, std::uint32_t first, std::uint32_t second);
+
+    static constexpr Kind KindOf(const geo2d::Point*) { return Kind::Point; }
+    static constexpr Kind KindOf(const geo2d::Segment*) { return Kind::Segment; }
+    static constexpr Kind KindOf(const geo2d::Rectangle*) { return Kind::Rectangle; }
+    static constexpr Kind KindOf(const geo2d::Circle*) { return Kind::Circle; }
+
+    template <typename Shape>
+    static constexpr std::size_t IndexOf()
+    {
+        return static_cast<std::size_t>(KindOf(static_cast<const Shape*>(nullptr)));
+    }
+
+    template <std::size_t First, std::size_t Second>
+    static bool CollidePair(const Storage& shapes, std::uint32_t first, std::uint32_t second)
+    {
+        return geo2d::Collide(std::get<First>(shapes)[first], std::get<Second>(shapes)[second]);
+    }
+
+    template <std::size_t... Pairs>
+    static constexpr std::array<PairTest, sizeof...(Pairs)> MakePairTests(std::index_sequence<Pairs...>)
+    {
+        return { &CollidePair<Pairs / KIND_COUNT, Pairs % KIND_COUNT>... };
+    }
+
+    // Indexed by first kind * KIND_COUNT + second kind
+    static const std::array<PairTest, KIND_COUNT * KIND_COUNT> PAIR_TESTS;
+
+    std::size_t CountOf(std::size_t kind) const;
+
+    template <std::size_t Index, typename Function>
+    static bool VisitShape(const Storage& shapes, Handle handle, Function function);
+
+    Storage shapes;
+};
+
+bool operator == (CollisionWorld::Handle lhs, CollisionWorld::Handle rhs);
+bool operator < (CollisionWorld::Handle lhs, CollisionWorld::Handle rhs);
+std::ostream& operator << (std::ostream& os, CollisionWorld::Handle handle);
+
+// GameObject view of an object of a world, for the code written against the
+// virtual interface. The world has to outlive it.
+class WorldObject : public GameObject
+{
+public:
+    WorldObject(const CollisionWorld& world, CollisionWorld::Handle handle) :
+        world_(world),
+        handle_(handle)
+    {}
+
+    bool Collide(const GameObject& gameObject) const override;
+
+    bool CollideWith(const Unit& unit) const override;
+    bool CollideWith(const Building& building) const override;
+    bool CollideWith(const Tower& tower) const override;
+    bool CollideWith(const Fence& fence) const override;
+
+    geo2d::Rectangle GetBoundingBox() const override;
+
+private:
+    const CollisionWorld& world_;
+    CollisionWorld::Handle handle_;
+};
+
+
+template <typename Shape>
+CollisionWorld::Handle CollisionWorld::Add(Shape shape)
+{
+    auto& same_kind = std::get<IndexOf<Shape>()>(shapes);
+    same_kind.push_back(shape);
+    return { KindOf(&shape), static_cast<std::uint32_t>(same_kind.size() - 1) };
+}
+
+template <typename Shape>
+void CollisionWorld::Set(Handle handle, Shape shape)
+{
+    if (handle.kind != KindOf(&shape))
+    {
+        throw std::invalid_argument("An object can't change its kind");
+    }
+    std::get<IndexOf<Shape>()>(shapes)[handle.index] = shape;
+}
+
+template <typename Shape>
+const std::vector<Shape>& CollisionWorld::Shapes() const
+{
+    return std::get<IndexOf<Shape>()>(shapes);
+}
+
+template <std::size_t Index, typename Function>
+bool CollisionWorld::VisitShape(const Storage& shapes, Handle handle, Function function)
+{
+    if constexpr (Index < KIND_COUNT)
+    {
+        if (static_cast<std::size_t>(handle.kind) == Index)
+        {
+            return function(std::get<Index>(shapes)[handle.index]);
+        }
+        return VisitShape<Index + 1>(shapes, handle, function);
+    }
+    else
+    {
+        throw std::invalid_argument("Unknown kind of shape");
+    }
+}
+
+template <typename Shape>
+bool CollisionWorld::Collide(Handle handle, Shape shape) const
+{
+    return VisitShape<0>(shapes, handle, [shape](const auto& own)
+        {
+            return geo2d::Collide(own, shape);
+        });
+}
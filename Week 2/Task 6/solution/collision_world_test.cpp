@@ -0,0 +1,176 @@
+#include "collision_world.h"
+#include "test_objects.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace geo2d;
+using Handle = CollisionWorld::Handle;
+
+namespace
+{
+    // The same object added to a world and created as a GameObject
+    struct RandomWorld
+    {
+        CollisionWorld world;
+        std::vector<Handle> handles;
+        std::vector<std::shared_ptr<GameObject>> objects;
+    };
+
+    RandomWorld MakeRandomWorld(std::mt19937& generator, size_t size, int map_size, int max_object_size)
+    {
+        RandomWorld result;
+        for (size_t i = 0; i < size; ++i)
+        {
+            WithRandomFigure(generator, map_size, max_object_size, [&result](const auto& figure) {
+                result.handles.push_back(result.world.Add(figure));
+                result.objects.push_back(MakeObject(figure));
+            });
+        }
+        return result;
+    }
+
+    std::uint64_t ReadCycles()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        // Nanoseconds where no cycle counter is available
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+}
+
+void TestCollisionWorld()
+{
+    CollisionWorld world;
+    const std::vector<Handle> handles =
+    {
+        world.Add(Point{ 3, 3 }),
+        world.Add(Point{ 5, 5 }),
+        world.Add(Point{ 3, 7 }),
+        world.Add(Segment{ { 7, 3 }, { 9, 8 } }),
+        world.Add(Circle{ Point{ 9, 4 }, 1 }),
+        world.Add(Circle{ Point{ 10, 7 }, 1 }),
+        world.Add(Rectangle{ { 11, 4 }, { 14, 6 } })
+    };
+    ASSERT_EQUAL(world.Size(), handles.size());
+    ASSERT_EQUAL(handles[4], (Handle{ CollisionWorld::Kind::Circle, 0 }));
+
+    for (size_t i = 0; i < handles.size(); ++i)
+    {
+        ASSERT(world.Collide(handles[i], handles[i]));
+        for (size_t j = 0; j < i; ++j)
+        {
+            ASSERT(!world.Collide(handles[i], handles[j]));
+        }
+    }
+    ASSERT_EQUAL(world.CountCollidingPairs(), 0u);
+
+    const Handle warehouse = world.Add(Rectangle{ { 4, 3 }, { 9, 6 } });
+    std::vector<Handle> expected = { handles[1], handles[3], handles[4], warehouse };
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQUAL(world.FindColliding(warehouse), expected);
+    ASSERT_EQUAL(world.CountCollidingPairs(), 3u);
+
+    world.Set(warehouse, Rectangle{ { 100, 100 }, { 101, 101 } });
+    ASSERT_EQUAL(world.FindColliding(warehouse), std::vector<Handle>{ warehouse });
+    ASSERT_EQUAL(world.CountCollidingPairs(), 0u);
+
+    try
+    {
+        world.Set(warehouse, Point{ 1, 1 });
+        Assert(false, "A rectangle became a point");
+    }
+    catch (const std::invalid_argument&)
+    {}
+}
+
+void TestCollisionWorldMatchesGameObjects()
+{
+    std::mt19937 generator(36);
+    const RandomWorld random_world = MakeRandomWorld(generator, 300, 200, 30);
+    const CollisionWorld& world = random_world.world;
+
+    size_t pairs = 0;
+    for (size_t i = 0; i < random_world.handles.size(); ++i)
+    {
+        const WorldObject facade(world, random_world.handles[i]);
+        ASSERT_EQUAL(facade.GetBoundingBox().Left(), random_world.objects[i]->GetBoundingBox().Left());
+        ASSERT_EQUAL(facade.GetBoundingBox().Top(), random_world.objects[i]->GetBoundingBox().Top());
+
+        for (size_t j = 0; j < random_world.handles.size(); ++j)
+        {
+            const bool expected = Collide(*random_world.objects[i], *random_world.objects[j]);
+            ASSERT_EQUAL(world.Collide(random_world.handles[i], random_world.handles[j]), expected);
+            // The facade both ways round and against another facade
+            ASSERT_EQUAL(Collide(facade, *random_world.objects[j]), expected);
+            ASSERT_EQUAL(Collide(*random_world.objects[j], facade), expected);
+            ASSERT_EQUAL(Collide(facade, WorldObject(world, random_world.handles[j])), expected);
+            pairs += (j < i && expected);
+        }
+    }
+    ASSERT_EQUAL(world.CountCollidingPairs(), pairs);
+}
+
+void BenchmarkCollisionWorld()
+{
+    std::mt19937 generator(3000);
+    const RandomWorld random_world = MakeRandomWorld(generator, 3000, 10000, 200);
+    const size_t n = random_world.handles.size();
+    const double pair_count = static_cast<double>(n) * (n - 1) / 2;
+
+    auto report = [pair_count](const char* name, std::uint64_t cycles, size_t collisions)
+    {
+        std::cerr << name << ": " << cycles / pair_count << " cycles per pair, "
+            << collisions << " collisions" << std::endl;
+    };
+
+    {
+        LOG_DURATION("All pairs, GameObject double dispatch");
+        const std::uint64_t start = ReadCycles();
+        size_t collisions = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (size_t j = i + 1; j < n; ++j)
+            {
+                collisions += Collide(*random_world.objects[i], *random_world.objects[j]);
+            }
+        }
+        report("GameObject double dispatch", ReadCycles() - start, collisions);
+    }
+    {
+        LOG_DURATION("All pairs, CollisionWorld pair table");
+        const std::uint64_t start = ReadCycles();
+        size_t collisions = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (size_t j = i + 1; j < n; ++j)
+            {
+                collisions += random_world.world.Collide(random_world.handles[i], random_world.handles[j]);
+            }
+        }
+        report("CollisionWorld pair table", ReadCycles() - start, collisions);
+    }
+    {
+        LOG_DURATION("All pairs, CollisionWorld per-kind loops");
+        const std::uint64_t start = ReadCycles();
+        const size_t collisions = random_world.world.CountCollidingPairs();
+        report("CollisionWorld per-kind loops", ReadCycles() - start, collisions);
+    }
+}
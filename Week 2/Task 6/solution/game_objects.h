@@ -0,0 +1,88 @@
+#pragma once
+
+#include "geo2d.h"
+#include "game_object.h"
+
+class Unit : public GameObject
+{
+public:
+    explicit Unit(geo2d::Point position) :
+        position_(position)
+    {}
+
+    bool Collide(const GameObject& gameObject) const override;
+        
+    bool CollideWith(const Unit& unit) const override;
+    bool CollideWith(const Building& building) const override;
+    bool CollideWith(const Tower& tower) const override;
+    bool CollideWith(const Fence& fence) const override;
+
+    geo2d::Rectangle GetBoundingBox() const override;
+    geo2d::Point GetFigure() const;
+
+private:
+    geo2d::Point position_;
+};
+
+class Building : public GameObject
+{
+public:
+    explicit Building(geo2d::Rectangle geometry) :
+        rectangle_(geometry)
+    {}
+
+    bool Collide(const GameObject& gameObject) const override;
+    
+    bool CollideWith(const Unit& unit) const override;
+    bool CollideWith(const Building& building) const override;
+    bool CollideWith(const Tower& tower) const override;
+    bool CollideWith(const Fence& fence) const override;
+
+    geo2d::Rectangle GetBoundingBox() const override;
+    geo2d::Rectangle GetFigure() const;
+
+private:
+    geo2d::Rectangle rectangle_;
+};
+
+class Tower : public GameObject
+{
+public:
+    explicit Tower(geo2d::Circle geometry) :
+        circle_(geometry)
+    {}
+
+    bool Collide(const GameObject& gameObject) const override;
+
+    bool CollideWith(const Unit& unit) const override;
+    bool CollideWith(const Building& building) const override;
+    bool CollideWith(const Tower& tower) const override;
+    bool CollideWith(const Fence& fence) const override;
+
+    geo2d::Rectangle GetBoundingBox() const override;
+    geo2d::Circle GetFigure() const;
+
+private:
+    geo2d::Circle circle_;
+};
+
+class Fence : public GameObject
+{
+public:
+    explicit Fence(geo2d::Segment geometry) :
+        segment_(geometry)
+    {}
+
+    bool Collide(const GameObject& gameObject) const override;
+
+    bool CollideWith(const Unit& unit) const override;
+    bool CollideWith(const Building& building) const override;
+    bool CollideWith(const Tower& tower) const override;
+    bool CollideWith(const Fence& fence) const override;
+
+    geo2d::Rectangle GetBoundingBox() const override;
+    geo2d::Segment GetFigure() const;
+
+private:
+    geo2d::Segment segment_;
+};
@@ -0,0 +1,178 @@
+#include "geo2d_batch.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace geo2d;
+
+namespace
+{
+    Point RandomPoint(std::mt19937& generator, int range)
+    {
+        std::uniform_int_distribution<int> coordinate(-range, range);
+        return { coordinate(generator), coordinate(generator) };
+    }
+
+    template <typename Figure, typename Batch, typename Element>
+    void AssertBatchMatchesScalar(Figure figure, const Batch& batch, const std::vector<Element>& elements)
+    {
+        std::vector<std::uint8_t> result(batch.Size());
+        CollideBatch(figure, batch, result.data());
+        for (size_t i = 0; i < elements.size(); ++i)
+        {
+            ASSERT_EQUAL(static_cast<bool>(result[i]), Collide(figure, elements[i]));
+        }
+    }
+
+    // Figures of all sizes, from degenerate ones to ones covering the whole range
+    template <typename Check>
+    void ForRandomFigures(std::mt19937& generator, int range, Check check)
+    {
+        std::uniform_int_distribution<int> size_log(0, 20);
+        for (int i = 0; i < 200; ++i)
+        {
+            const Point center = RandomPoint(generator, range);
+            const int size = (1 << size_log(generator)) - 1;
+            std::uniform_int_distribution<int> offset(-size, size);
+            check(Circle{ center, static_cast<std::uint32_t>(size) });
+            check(Rectangle{ center, Point{ center.x + offset(generator), center.y + offset(generator) } });
+        }
+    }
+}
+
+void TestBatchPoints()
+{
+    std::mt19937 generator(35);
+    for (int range : { 4, 100, 1 << 20, 1 << 29 })
+    {
+        PointBatch batch;
+        std::vector<Point> points;
+        // Not a multiple of the vector width, to go through the tails as well
+        for (int i = 0; i < 1003; ++i)
+        {
+            points.push_back(RandomPoint(generator, range));
+            batch.Add(points.back());
+        }
+
+        ForRandomFigures(generator, range, [&](auto figure)
+            {
+                AssertBatchMatchesScalar(figure, batch, points);
+            });
+    }
+}
+
+void TestBatchSegments()
+{
+    std::mt19937 generator(36);
+    for (int range : { 4, 100, 1 << 20, 1 << 29 })
+    {
+        SegmentBatch batch;
+        std::vector<Segment> segments;
+        for (int i = 0; i < 1003; ++i)
+        {
+            const Point p1 = RandomPoint(generator, range);
+            // Every fourth one degenerate
+            const Point p2 = i % 4 == 0 ? p1 : RandomPoint(generator, range);
+            segments.push_back({ p1, p2 });
+            batch.Add(segments.back());
+        }
+
+        ForRandomFigures(generator, range, [&](auto figure)
+            {
+                AssertBatchMatchesScalar(figure, batch, segments);
+            });
+    }
+}
+
+void TestBatchEdgeCases()
+{
+    SegmentBatch batch;
+    const std::vector<Segment> segments = {
+        { { 0, 0 }, { 65536, 0 } },
+        { { 0, 0 }, { 0, 0 } },
+        { { -3, 5 }, { 3, 5 } },
+        { { 2, -10 }, { 2, 10 } },
+        { { 1, 1 }, { 1, 1 } },
+    };
+    for (const Segment& s : segments)
+    {
+        batch.Add(s);
+    }
+
+    // The cross product of the first segment and the center does not fit into int
+    const Circle far_from_line{ { 100, 49152 }, 16384 };
+    AssertBatchMatchesScalar(far_from_line, batch, segments);
+    ASSERT(!Collide(far_from_line, segments[0]));
+
+    AssertBatchMatchesScalar(Circle{ { 0, 0 }, 5 }, batch, segments);
+    AssertBatchMatchesScalar(Circle{ { 0, 0 }, 0xffffffffu }, batch, segments);
+    AssertBatchMatchesScalar(Rectangle{ { 0, 0 }, { 2, 5 } }, batch, segments);
+    AssertBatchMatchesScalar(Rectangle{ { 1, 1 }, { 1, 1 } }, batch, segments);
+    AssertBatchMatchesScalar(Rectangle{ { 3, 6 }, { 4, 7 } }, batch, segments);
+}
+
+void BenchmarkBatchCollide()
+{
+    std::mt19937 generator(1000000);
+    const size_t count = 1'000'000;
+    const int range = 1 << 20;
+    const int repetitions = 20;
+
+    PointBatch points;
+    SegmentBatch segments;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Point p = RandomPoint(generator, range);
+        points.Add(p);
+        segments.Add({ p, Point{ p.x + 100, p.y - 50 } });
+    }
+
+    const Circle circle{ { 0, 0 }, range / 2 };
+    const Rectangle rectangle{ { -range / 2, -range / 3 }, { range / 3, range / 2 } };
+    std::vector<std::uint8_t> result(count);
+    std::cerr << "Batch kernels: " << BatchKernelName() << std::endl;
+
+    auto run = [&](const char* name, auto figure, const auto& batch, auto get)
+    {
+        size_t scalar_hits = 0;
+        {
+            LOG_DURATION(std::string(name) + ", scalar x20");
+            for (int r = 0; r < repetitions; ++r)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    scalar_hits += Collide(figure, get(batch, i));
+                }
+            }
+        }
+        size_t batch_hits = 0;
+        {
+            LOG_DURATION(std::string(name) + ", batch x20");
+            for (int r = 0; r < repetitions; ++r)
+            {
+                CollideBatch(figure, batch, result.data());
+                for (std::uint8_t hit : result)
+                {
+                    batch_hits += hit;
+                }
+            }
+        }
+        ASSERT_EQUAL(scalar_hits, batch_hits);
+    };
+
+    auto point = [](const PointBatch& b, size_t i) { return Point{ b.x[i], b.y[i] }; };
+    auto segment = [](const SegmentBatch& b, size_t i)
+    {
+        return Segment{ { b.x1[i], b.y1[i] }, { b.x2[i], b.y2[i] } };
+    };
+
+    run("Circle vs 1M points", circle, points, point);
+    run("Rectangle vs 1M points", rectangle, points, point);
+    run("Circle vs 1M segments", circle, segments, segment);
+    run("Rectangle vs 1M segments", rectangle, segments, segment);
+}
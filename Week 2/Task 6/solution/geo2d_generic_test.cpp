@@ -0,0 +1,342 @@
+#include "geo2d.h"
+#include "geo2d_batch.h"
+#include "geo2d_generic.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace generic = geo2d::generic;
+
+namespace
+{
+    generic::Point<int> ToGeneric(geo2d::Point p)
+    {
+        return { p.x, p.y };
+    }
+
+    generic::Segment<int> ToGeneric(geo2d::Segment s)
+    {
+        return { ToGeneric(s.p1), ToGeneric(s.p2) };
+    }
+
+    generic::Rectangle<int> ToGeneric(geo2d::Rectangle r)
+    {
+        return { ToGeneric(r.BottomLeft()), ToGeneric(r.TopRight()) };
+    }
+
+    generic::Circle<int> ToGeneric(geo2d::Circle c)
+    {
+        return { ToGeneric(c.center), static_cast<int>(c.radius) };
+    }
+
+    template <typename T>
+    generic::Point<T> Convert(generic::Point<int> p)
+    {
+        return { static_cast<T>(p.x), static_cast<T>(p.y) };
+    }
+
+    template <typename T>
+    generic::Segment<T> Convert(generic::Segment<int> s)
+    {
+        return { Convert<T>(s.p1), Convert<T>(s.p2) };
+    }
+
+    template <typename T>
+    generic::Rectangle<T> Convert(generic::Rectangle<int> r)
+    {
+        return { Convert<T>(r.min), Convert<T>(r.max) };
+    }
+
+    template <typename T>
+    generic::Circle<T> Convert(generic::Circle<int> c)
+    {
+        return { Convert<T>(c.center), static_cast<T>(c.radius) };
+    }
+
+    struct RandomFigures
+    {
+        std::vector<geo2d::Point> points;
+        std::vector<geo2d::Segment> segments;
+        std::vector<geo2d::Rectangle> rectangles;
+        std::vector<geo2d::Circle> circles;
+    };
+
+    // Figures of all sizes within [-range, range], some of them degenerate
+    RandomFigures MakeRandomFigures(std::mt19937& generator, int range, size_t count)
+    {
+        std::uniform_int_distribution<int> coordinate(-range, range);
+        std::uniform_int_distribution<int> size_log(0, 30);
+        auto point = [&] { return geo2d::Point{ coordinate(generator), coordinate(generator) }; };
+        auto near = [&](geo2d::Point p)
+        {
+            const int size = std::min(range, (1 << size_log(generator)) - 1);
+            std::uniform_int_distribution<int> offset(-size, size);
+            return geo2d::Point{
+                std::clamp(p.x + offset(generator), -range, range),
+                std::clamp(p.y + offset(generator), -range, range)
+            };
+        };
+
+        RandomFigures result;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const geo2d::Point p = point();
+            result.points.push_back(p);
+            result.segments.push_back({ p, i % 8 == 0 ? p : near(p) });
+            result.rectangles.push_back({ p, i % 8 == 1 ? p : near(p) });
+            const geo2d::Point q = near(p);
+            const std::int64_t radius = std::max(std::abs(std::int64_t(q.x) - p.x), std::abs(std::int64_t(q.y) - p.y));
+            result.circles.push_back({ p, static_cast<std::uint32_t>(std::min<std::int64_t>(radius, range)) });
+        }
+        return result;
+    }
+
+    template <typename Figures, typename Check>
+    void ForEachPairOfFigures(const Figures& figures, Check check)
+    {
+        auto with = [&](const auto& lhs)
+        {
+            for (size_t i = 0; i < lhs.size(); ++i)
+            {
+                const size_t j = (i * 7 + 3) % lhs.size();
+                check(lhs[i], figures.points[j]);
+                check(lhs[i], figures.segments[j]);
+                check(lhs[i], figures.rectangles[j]);
+                check(lhs[i], figures.circles[j]);
+            }
+        };
+        with(figures.points);
+        with(figures.segments);
+        with(figures.rectangles);
+        with(figures.circles);
+    }
+}
+
+void TestGenericExactMatchesGeo2d()
+{
+    std::mt19937 generator(39);
+    // Up to the limit of the exact path, where the products of geo2d need all 128 bits
+    for (int range : { 10, 1000, 1 << 20, (1 << 30) - 1 })
+    {
+        const RandomFigures figures = MakeRandomFigures(generator, range, 3000);
+        ForEachPairOfFigures(figures, [](const auto& lhs, const auto& rhs)
+            {
+                ASSERT_EQUAL(generic::Collide(ToGeneric(lhs), ToGeneric(rhs)), geo2d::Collide(lhs, rhs));
+            });
+    }
+}
+
+void TestGenericLargeCoordinates()
+{
+    // The cross product of the segment and the center is 2^32, its square 2^64
+    const geo2d::Segment segment{ { 0, 0 }, { 65536, 0 } };
+    const geo2d::Circle circle{ { 100, 65536 }, 1 };
+    ASSERT(!geo2d::Collide(circle, segment));
+    ASSERT(!generic::Collide(ToGeneric(circle), ToGeneric(segment)));
+
+    // The radius squared times the length squared is about 2^121, the distance
+    // to the line is a bit less than 759250124
+    const int far = (1 << 30) - 2;
+    const geo2d::Segment long_segment{ { -far, -far }, { far, far } };
+    const geo2d::Circle just_touching{ { far / 2, -far / 2 }, 759250124 };
+    const geo2d::Circle just_missing{ { far / 2, -far / 2 }, 759250123 };
+    ASSERT(geo2d::Collide(just_touching, long_segment));
+    ASSERT(!geo2d::Collide(just_missing, long_segment));
+    ASSERT(generic::Collide(ToGeneric(just_touching), ToGeneric(long_segment)));
+    ASSERT(!generic::Collide(ToGeneric(just_missing), ToGeneric(long_segment)));
+}
+
+void TestGenericFloatAgreesAwayFromBoundaries()
+{
+    std::mt19937 generator(391);
+    // Small enough for the floats to hold the coordinates exactly
+    const RandomFigures figures = MakeRandomFigures(generator, 1 << 12, 5000);
+
+    auto inflate = [](auto figure, int by)
+    {
+        if constexpr (std::is_same_v<decltype(figure), generic::Circle<int>>)
+        {
+            figure.radius = std::max(0, figure.radius + by);
+        }
+        else if constexpr (std::is_same_v<decltype(figure), generic::Rectangle<int>>)
+        {
+            if (figure.max.x - figure.min.x + 2 * by >= 0 && figure.max.y - figure.min.y + 2 * by >= 0)
+            {
+                figure.min = { figure.min.x - by, figure.min.y - by };
+                figure.max = { figure.max.x + by, figure.max.y + by };
+            }
+        }
+        return figure;
+    };
+
+    size_t checked = 0, differ = 0, segment_pairs = 0, segment_pairs_differ = 0;
+    ForEachPairOfFigures(figures, [&](const auto& lhs, const auto& rhs)
+        {
+            const auto exact_lhs = ToGeneric(lhs);
+            const auto exact_rhs = ToGeneric(rhs);
+            const bool exact = generic::Collide(exact_lhs, exact_rhs);
+            const bool fast = generic::Collide(Convert<float>(exact_lhs), Convert<float>(exact_rhs));
+
+            using Lhs = std::decay_t<decltype(exact_lhs)>;
+            using Rhs = std::decay_t<decltype(exact_rhs)>;
+            constexpr bool has_segments = std::is_same_v<Lhs, generic::Segment<int>> || std::is_same_v<Rhs, generic::Segment<int>>;
+            if constexpr (has_segments)
+            {
+                ++segment_pairs;
+                segment_pairs_differ += exact != fast;
+            }
+            else
+            {
+                // Figures a unit away from touching may come out either way
+                const bool sure = generic::Collide(inflate(exact_lhs, -1), inflate(exact_rhs, -1))
+                    == generic::Collide(inflate(exact_lhs, 1), inflate(exact_rhs, 1));
+                if (sure)
+                {
+                    ++checked;
+                    differ += exact != fast;
+                }
+            }
+        });
+
+    ASSERT(checked > 10000);
+    ASSERT_EQUAL(differ, 0u);
+    // Lines through nearly touching figures are rare with random figures
+    ASSERT(segment_pairs_differ * 1000 < segment_pairs);
+}
+
+void TestGenericFloatBatch()
+{
+    std::mt19937 generator(392);
+    std::uniform_real_distribution<float> coordinate(-1000, 1000);
+    std::vector<float> xs(1001), ys(1001);
+    for (size_t i = 0; i < xs.size(); ++i)
+    {
+        xs[i] = coordinate(generator);
+        ys[i] = coordinate(generator);
+    }
+
+    const generic::Circle<float> circle{ { 10, -20 }, 500 };
+    const auto rectangle = generic::Rectangle<float>::FromCorners({ -300, 100 }, { 700, -400 });
+    std::vector<std::uint8_t> result(xs.size());
+
+    generic::CollideBatch(circle, xs.data(), ys.data(), xs.size(), result.data());
+    for (size_t i = 0; i < xs.size(); ++i)
+    {
+        ASSERT_EQUAL(static_cast<bool>(result[i]), generic::Collide(circle, generic::Point<float>{ xs[i], ys[i] }));
+    }
+    generic::CollideBatch(rectangle, xs.data(), ys.data(), xs.size(), result.data());
+    for (size_t i = 0; i < xs.size(); ++i)
+    {
+        ASSERT_EQUAL(static_cast<bool>(result[i]), generic::Collide(rectangle, generic::Point<float>{ xs[i], ys[i] }));
+    }
+}
+
+void BenchmarkGenericCollide()
+{
+    std::mt19937 generator(1000000);
+    const size_t count = 1'000'000;
+    const int range = 1 << 20;
+    const int repetitions = 20;
+
+    std::vector<geo2d::Point> points;
+    std::vector<geo2d::Segment> segments;
+    std::vector<int> xs, ys;
+    std::vector<float> float_xs, float_ys;
+    std::uniform_int_distribution<int> coordinate(-range, range);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const geo2d::Point p{ coordinate(generator), coordinate(generator) };
+        points.push_back(p);
+        segments.push_back({ p, { p.x + 100, p.y - 50 } });
+        xs.push_back(p.x);
+        ys.push_back(p.y);
+        float_xs.push_back(static_cast<float>(p.x));
+        float_ys.push_back(static_cast<float>(p.y));
+    }
+
+    const geo2d::Circle circle{ { 0, 0 }, range / 2 };
+    const geo2d::Rectangle rectangle{ { -range / 2, -range / 3 }, { range / 3, range / 2 } };
+    std::vector<std::uint8_t> result(count);
+
+    auto run = [&](const std::string& name, auto collide_all)
+    {
+        size_t hits = 0;
+        {
+            LOG_DURATION(name + " x20");
+            for (int r = 0; r < repetitions; ++r)
+            {
+                collide_all();
+                for (std::uint8_t hit : result)
+                {
+                    hits += hit;
+                }
+            }
+        }
+        return hits;
+    };
+
+    auto compare_on_points = [&](const std::string& name, auto figure)
+    {
+        const auto exact_figure = ToGeneric(figure);
+        const auto float_figure = Convert<float>(exact_figure);
+        const size_t geo2d_hits = run(name + ", geo2d", [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    result[i] = geo2d::Collide(figure, points[i]);
+                }
+            });
+        const size_t exact_hits = run(name + ", generic<int>", [&]
+            {
+                generic::CollideBatch(exact_figure, xs.data(), ys.data(), count, result.data());
+            });
+        const size_t float_hits = run(name + ", generic<float>", [&]
+            {
+                generic::CollideBatch(float_figure, float_xs.data(), float_ys.data(), count, result.data());
+            });
+        ASSERT_EQUAL(geo2d_hits, exact_hits);
+        std::cerr << "float misses " << (exact_hits > float_hits ? exact_hits - float_hits : float_hits - exact_hits)
+            << " of " << exact_hits << " hits" << std::endl;
+    };
+
+    auto compare_on_segments = [&](const std::string& name, auto figure)
+    {
+        const auto exact_figure = ToGeneric(figure);
+        const auto float_figure = Convert<float>(exact_figure);
+        const size_t geo2d_hits = run(name + ", geo2d", [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    result[i] = geo2d::Collide(figure, segments[i]);
+                }
+            });
+        const size_t exact_hits = run(name + ", generic<int>", [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    result[i] = generic::Collide(exact_figure, ToGeneric(segments[i]));
+                }
+            });
+        const size_t float_hits = run(name + ", generic<float>", [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    result[i] = generic::Collide(float_figure, Convert<float>(ToGeneric(segments[i])));
+                }
+            });
+        ASSERT_EQUAL(geo2d_hits, exact_hits);
+        std::cerr << "float misses " << (exact_hits > float_hits ? exact_hits - float_hits : float_hits - exact_hits)
+            << " of " << exact_hits << " hits" << std::endl;
+    };
+
+    compare_on_points("Circle vs 1M points", circle);
+    compare_on_points("Rectangle vs 1M points", rectangle);
+    compare_on_segments("Circle vs 1M segments", circle);
+    compare_on_segments("Rectangle vs 1M segments", rectangle);
+}
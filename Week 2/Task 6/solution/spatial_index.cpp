@@ -0,0 +1,229 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+    int FloorDiv(int value, int divisor)
+    {
+        const int quotient = value / divisor;
+        return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+    }
+
+    void EraseFrom(std::vector<SpatialIndex::ObjectId>& ids, SpatialIndex::ObjectId id)
+    {
+        auto it = std::find(ids.begin(), ids.end(), id);
+        *it = ids.back();
+        ids.pop_back();
+    }
+}
+
+SpatialIndex::Entry& SpatialIndex::EntryOf(ObjectId id)
+{
+    return const_cast<Entry&>(static_cast<const SpatialIndex&>(*this).EntryOf(id));
+}
+
+const SpatialIndex::Entry& SpatialIndex::EntryOf(ObjectId id) const
+{
+    const std::optional<Entry>& entry = entries.at(id);
+    if (!entry.has_value())
+    {
+        throw std::out_of_range("The object is removed");
+    }
+    return *entry;
+}
+
+std::int64_t SpatialIndex::CellRange::Count() const
+{
+    return (static_cast<std::int64_t>(x_end) - x_begin + 1) * (static_cast<std::int64_t>(y_end) - y_begin + 1);
+}
+
+SpatialIndex::SpatialIndex(int cell_size) :
+    cell_size(cell_size)
+{
+    if (cell_size <= 0)
+    {
+        throw std::invalid_argument("Cell size must be positive");
+    }
+}
+
+SpatialIndex::ObjectId SpatialIndex::Insert(std::shared_ptr<const GameObject> object)
+{
+    const geo2d::Rectangle bounds = object->GetBoundingBox();
+    Entry entry{ std::move(object), bounds, CellsOf(bounds) };
+
+    ObjectId id;
+    if (free_ids.empty())
+    {
+        id = entries.size();
+        entries.push_back(std::move(entry));
+    }
+    else
+    {
+        id = free_ids.back();
+        free_ids.pop_back();
+        entries[id] = std::move(entry);
+    }
+
+    Register(id);
+    return id;
+}
+
+void SpatialIndex::Remove(ObjectId id)
+{
+    EntryOf(id);
+    Unregister(id);
+    entries.at(id).reset();
+    free_ids.push_back(id);
+}
+
+void SpatialIndex::Move(ObjectId id, std::shared_ptr<const GameObject> object)
+{
+    Entry& entry = EntryOf(id);
+    const geo2d::Rectangle bounds = object->GetBoundingBox();
+    const CellRange cells_now = CellsOf(bounds);
+
+    const CellRange& cells_before = entry.cells;
+    const bool same_cells = cells_before.x_begin == cells_now.x_begin && cells_before.x_end == cells_now.x_end
+        && cells_before.y_begin == cells_now.y_begin && cells_before.y_end == cells_now.y_end;
+
+    // Most moves stay within the same cells and need no re-registration
+    if (!same_cells)
+    {
+        Unregister(id);
+    }
+    entry.object = std::move(object);
+    entry.bounds = bounds;
+    entry.cells = cells_now;
+    if (!same_cells)
+    {
+        Register(id);
+    }
+}
+
+const GameObject& SpatialIndex::Get(ObjectId id) const
+{
+    return *EntryOf(id).object;
+}
+
+std::size_t SpatialIndex::Size() const
+{
+    return entries.size() - free_ids.size();
+}
+
+std::vector<SpatialIndex::ObjectId> SpatialIndex::FindCandidates(const geo2d::Rectangle& bounds) const
+{
+    std::vector<ObjectId> result;
+    auto add_if_intersects = [&](ObjectId id)
+    {
+        if (geo2d::Collide(bounds, entries[id]->bounds))
+        {
+            result.push_back(id);
+        }
+    };
+
+    for (ObjectId id : oversized)
+    {
+        add_if_intersects(id);
+    }
+
+    const CellRange range = CellsOf(bounds);
+    if (range.Count() > static_cast<std::int64_t>(cells.size()))
+    {
+        // The query covers more cells than there are non-empty ones
+        for (const auto& [key, ids] : cells)
+        {
+            for (ObjectId id : ids)
+            {
+                add_if_intersects(id);
+            }
+        }
+    }
+    else
+    {
+        for (std::int64_t x = range.x_begin; x <= range.x_end; ++x)
+        {
+            for (std::int64_t y = range.y_begin; y <= range.y_end; ++y)
+            {
+                if (auto it = cells.find(CellKey(x, y)); it != cells.end())
+                {
+                    for (ObjectId id : it->second)
+                    {
+                        add_if_intersects(id);
+                    }
+                }
+            }
+        }
+    }
+
+    // An object spanning several cells is found in each of them
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<SpatialIndex::ObjectId> SpatialIndex::FindColliding(const GameObject& object) const
+{
+    std::vector<ObjectId> result = FindCandidates(object.GetBoundingBox());
+    result.erase(std::remove_if(result.begin(), result.end(), [&](ObjectId id)
+        {
+            return !Collide(object, *entries[id]->object);
+        }), result.end());
+    return result;
+}
+
+SpatialIndex::CellRange SpatialIndex::CellsOf(const geo2d::Rectangle& bounds) const
+{
+    return {
+        FloorDiv(bounds.Left(), cell_size), FloorDiv(bounds.Right(), cell_size),
+        FloorDiv(bounds.Bottom(), cell_size), FloorDiv(bounds.Top(), cell_size)
+    };
+}
+
+std::uint64_t SpatialIndex::CellKey(std::int64_t x, std::int64_t y)
+{
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y);
+}
+
+void SpatialIndex::Register(ObjectId id)
+{
+    const CellRange& range = entries[id]->cells;
+    if (range.Count() > MAX_CELLS_PER_OBJECT)
+    {
+        oversized.push_back(id);
+        return;
+    }
+
+    for (std::int64_t x = range.x_begin; x <= range.x_end; ++x)
+    {
+        for (std::int64_t y = range.y_begin; y <= range.y_end; ++y)
+        {
+            cells[CellKey(x, y)].push_back(id);
+        }
+    }
+}
+
+void SpatialIndex::Unregister(ObjectId id)
+{
+    const CellRange& range = entries.at(id)->cells;
+    if (range.Count() > MAX_CELLS_PER_OBJECT)
+    {
+        EraseFrom(oversized, id);
+        return;
+    }
+
+    for (std::int64_t x = range.x_begin; x <= range.x_end; ++x)
+    {
+        for (std::int64_t y = range.y_begin; y <= range.y_end; ++y)
+        {
+            auto it = cells.find(CellKey(x, y));
+            EraseFrom(it->second, id);
+            if (it->second.empty())
+            {
+                cells.erase(it);
+            }
+        }
+    }
+}
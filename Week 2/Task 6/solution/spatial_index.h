@@ -0,0 +1,72 @@
+#pragma once
+
+#include "game_object.h"
+#include "geo2d.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Broad phase for collision queries: a uniform grid over the bounding boxes
+// of the objects. An object is registered in every cell its bounding box
+// touches, except for the ones spanning too many cells, which are kept in a
+// separate list checked by every query. Narrow-phase checks go through
+// Collide(const GameObject&, const GameObject&).
+class SpatialIndex
+{
+public:
+    using ObjectId = std::size_t;
+
+    explicit SpatialIndex(int cell_size = 64);
+
+    ObjectId Insert(std::shared_ptr<const GameObject> object);
+    // Remove, Move and Get throw std::out_of_range for an id not in use
+    void Remove(ObjectId id);
+    // Replaces the object by its new state, e.g. a unit at a new position
+    void Move(ObjectId id, std::shared_ptr<const GameObject> object);
+
+    const GameObject& Get(ObjectId id) const;
+    std::size_t Size() const;
+
+    // Objects whose bounding boxes intersect bounds, in increasing order of ids
+    std::vector<ObjectId> FindCandidates(const geo2d::Rectangle& bounds) const;
+    // Objects colliding with object, in increasing order of ids
+    std::vector<ObjectId> FindColliding(const GameObject& object) const;
+
+private:
+    static const std::int64_t MAX_CELLS_PER_OBJECT = 64;
+
+    struct CellRange
+    {
+        int x_begin, x_end;
+        int y_begin, y_end;
+
+        std::int64_t Count() const;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const GameObject> object;
+        geo2d::Rectangle bounds;
+        CellRange cells;
+    };
+
+    // Throws std::out_of_range for ids never given out or already removed
+    Entry& EntryOf(ObjectId id);
+    const Entry& EntryOf(ObjectId id) const;
+    CellRange CellsOf(const geo2d::Rectangle& bounds) const;
+    // Cells are walked with 64-bit indices, so that a range ending at the
+    // largest int does not overflow the loop
+    static std::uint64_t CellKey(std::int64_t x, std::int64_t y);
+
+    void Register(ObjectId id);
+    void Unregister(ObjectId id);
+
+    int cell_size;
+    std::vector<std::optional<Entry>> entries;
+    std::vector<ObjectId> free_ids;
+    std::unordered_map<std::uint64_t, std::vector<ObjectId>> cells;
+    std::vector<ObjectId> oversized;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "game_objects.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Objects, reference answers and printers shared by the collision tests and
+// benchmarks. Include it before test_runner.h, whose printers have to see the
+// one for pairs of ids.
+
+inline std::ostream& operator << (std::ostream& os, const std::pair<std::size_t, std::size_t>& pair)
+{
+    return os << "(" << pair.first << ", " << pair.second << ")";
+}
+
+// The map of the original test: no two objects on it collide
+inline std::vector<std::shared_ptr<GameObject>> MakeGameMap()
+{
+    using namespace geo2d;
+
+    return {
+      std::make_shared<Unit>(Point{3, 3}),
+      std::make_shared<Unit>(Point{5, 5}),
+      std::make_shared<Unit>(Point{3, 7}),
+      std::make_shared<Fence>(Segment{{7, 3}, {9, 8}}),
+      std::make_shared<Tower>(Circle{Point{9, 4}, 1}),
+      std::make_shared<Tower>(Circle{Point{10, 7}, 1}),
+      std::make_shared<Building>(Rectangle{{11, 4}, {14, 6}})
+    };
+}
+
+inline std::shared_ptr<GameObject> MakeObject(geo2d::Point point)
+{
+    return std::make_shared<Unit>(point);
+}
+
+inline std::shared_ptr<GameObject> MakeObject(geo2d::Segment segment)
+{
+    return std::make_shared<Fence>(segment);
+}
+
+inline std::shared_ptr<GameObject> MakeObject(geo2d::Rectangle rectangle)
+{
+    return std::make_shared<Building>(rectangle);
+}
+
+inline std::shared_ptr<GameObject> MakeObject(geo2d::Circle circle)
+{
+    return std::make_shared<Tower>(circle);
+}
+
+// Calls make with a random point, segment, rectangle or circle that starts
+// in [-map_size / 2, map_size / 2] on both axes and extends by at most
+// max_object_size, and returns what make returns
+template <typename Make>
+auto WithRandomFigure(std::mt19937& generator, int map_size, int max_object_size, Make make)
+{
+    using namespace geo2d;
+
+    std::uniform_int_distribution<int> coordinate(-map_size / 2, map_size / 2);
+    std::uniform_int_distribution<int> offset(-max_object_size, max_object_size);
+    const Point p{ coordinate(generator), coordinate(generator) };
+
+    switch (generator() % 4)
+    {
+    case 0:
+        return make(p);
+    case 1:
+        return make(Rectangle{ p, Point{ p.x + offset(generator), p.y + offset(generator) } });
+    case 2:
+        return make(Circle{ p, static_cast<std::uint32_t>(std::abs(offset(generator))) });
+    default:
+        return make(Segment{ p, Point{ p.x + offset(generator), p.y + offset(generator) } });
+    }
+}
+
+inline std::shared_ptr<GameObject> MakeRandomObject(std::mt19937& generator, int map_size, int max_object_size)
+{
+    return WithRandomFigure(generator, map_size, max_object_size, [](const auto& figure) {
+        return MakeObject(figure);
+    });
+}
+
+inline std::vector<std::shared_ptr<GameObject>> MakeRandomMap(
+    std::mt19937& generator, std::size_t size, int map_size, int max_object_size)
+{
+    std::vector<std::shared_ptr<GameObject>> result;
+    result.reserve(size);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        result.push_back(MakeRandomObject(generator, map_size, max_object_size));
+    }
+    return result;
+}
+
+// Indices of the objects colliding with object, checked one by one; null objects are skipped
+inline std::vector<std::size_t> FindCollidingBruteForce(
+    const std::vector<std::shared_ptr<GameObject>>& objects, const GameObject& object)
+{
+    std::vector<std::size_t> result;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        if (objects[i] && Collide(object, *objects[i]))
+        {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+// Pairs (i, j), i < j, of colliding objects in increasing order
+inline std::vector<std::pair<std::size_t, std::size_t>> FindCollidingPairsBruteForce(
+    const std::vector<std::shared_ptr<GameObject>>& objects)
+{
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        if (!objects[i])
+        {
+            continue;
+        }
+        for (std::size_t j : FindCollidingBruteForce(objects, *objects[i]))
+        {
+            if (j > i)
+            {
+                result.emplace_back(i, j);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,114 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(std::size_t thread_count)
+{
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for (std::size_t i = 0; i < thread_count; ++i)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([this, i] { Work(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    batch_started.notify_all();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::Run(std::size_t task_count, const Task& task)
+{
+    const std::size_t thread_count = ThreadCount();
+    for (std::size_t worker = 0; worker < thread_count; ++worker)
+    {
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        for (std::size_t i = task_count * worker / thread_count; i < task_count * (worker + 1) / thread_count; ++i)
+        {
+            queues[worker]->tasks.push_back(i);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    current_task = &task;
+    busy_workers = thread_count;
+    ++batch;
+    batch_started.notify_all();
+    batch_finished.wait(lock, [this] { return busy_workers == 0; });
+    current_task = nullptr;
+}
+
+std::size_t WorkStealingPool::ThreadCount() const
+{
+    return threads.size();
+}
+
+void WorkStealingPool::Work(std::size_t worker)
+{
+    std::size_t last_batch = 0;
+    while (true)
+    {
+        const Task* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            batch_started.wait(lock, [&] { return stopping || batch != last_batch; });
+            if (stopping)
+            {
+                return;
+            }
+            last_batch = batch;
+            task = current_task;
+        }
+
+        std::size_t index;
+        while (TakeTask(worker, index))
+        {
+            (*task)(index, worker);
+        }
+
+        // All the queues were empty, the tasks still running belong to other workers
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy_workers == 0)
+        {
+            batch_finished.notify_one();
+        }
+    }
+}
+
+bool WorkStealingPool::TakeTask(std::size_t worker, std::size_t& task)
+{
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        Queue& victim = *queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running batches of indexed tasks. Every worker
+// starts with a contiguous block of the tasks in its own deque and takes them
+// from the back; a worker that runs out steals from the front of the others.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(std::size_t task, std::size_t worker)>;
+
+    explicit WorkStealingPool(std::size_t thread_count = std::thread::hardware_concurrency());
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator = (const WorkStealingPool&) = delete;
+
+    // Runs task(i, worker) for every i in [0, task_count) and waits for all of them.
+    // Tasks must not throw.
+    void Run(std::size_t task_count, const Task& task);
+
+    std::size_t ThreadCount() const;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    void Work(std::size_t worker);
+    bool TakeTask(std::size_t worker, std::size_t& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable batch_started;
+    std::condition_variable batch_finished;
+    const Task* current_task = nullptr;
+    std::size_t batch = 0;
+    std::size_t busy_workers = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+};
@@ -1,4 +1,8 @@
 #include "test_runner.h"
+#include "comment_server.h"
+#include "concurrent_comment_server.h"
+#include "http_server.h"
+#include "load_generator.h"
 
 #include <vector>
 #include <string>
@@ -6,222 +10,11 @@
 #include <sstream>
 #include <utility>
 #include <map>
-#include <optional>
-#include <unordered_set>
+#include <memory>
+#include <cstring>
 
 using namespace std;
 
-enum class HttpCode 
-{
-    Ok = 200,
-    NotFound = 404,
-    Found = 302,
-};
-
-class HttpResponse 
-{
-public:
-    explicit HttpResponse(HttpCode code) :
-        code_(code)
-    {}
-
-    HttpResponse& AddHeader(string name, string value)
-    {
-        headers_.push_back(make_pair(name, value));
-        return *this;
-    }
-    HttpResponse& SetContent(string a_content)
-    {
-        content_ = move(a_content);
-        return *this;
-    }
-    HttpResponse& SetCode(HttpCode a_code)
-    {
-        code_ = a_code;
-        return *this;
-    }
-
-    string GetCode() const
-    {
-        if (code_ == HttpCode::Found)
-        {
-            return string("302 Found");
-        }
-        else if(code_ == HttpCode::Ok)
-        {
-            return string("200 OK");
-        }
-        
-        return string("404 Not found");
-    }
-
-    friend ostream& operator << (ostream& out, const HttpResponse& resp);
-private:
-    HttpCode code_;
-    vector<pair<string, string>> headers_;
-    string content_;
-};
-
-ostream& operator << (ostream& out, const HttpResponse& resp)
-{
-    out << "HTTP/1.1 " << resp.GetCode() << '\n';
-    for (const auto& i : resp.headers_)
-    {
-        out << i.first << ": " << i.second << '\n';
-    }
-
-    if (!resp.content_.empty())
-    {
-        out << "Content-Length: " << resp.content_.size() << '\n';
-        return out << '\n' << resp.content_;
-    }
-    else
-    {
-        return out << '\n';
-    }
-}
-
-
-struct HttpRequest 
-{
-    string method, path, body;
-    map<string, string> get_params;
-};
-
-pair<string, string> SplitBy(const string& what, const string& by) 
-{
-    size_t pos = what.find(by);
-    if (by.size() < what.size() && pos < what.size() - by.size()) 
-    {
-        return { what.substr(0, pos), what.substr(pos + by.size()) };
-    }
-    else 
-    {
-        return { what, {} };
-    }
-}
-
-template<typename T>
-T FromString(const string& s) 
-{
-    T x;
-    istringstream is(s);
-    is >> x;
-    return x;
-}
-
-pair<size_t, string> ParseIdAndContent(const string& body) 
-{
-    auto [id_string, content] = SplitBy(body, " ");
-    return { FromString<size_t>(id_string), content };
-}
-
-struct LastCommentInfo 
-{
-    size_t user_id, consecutive_count;
-};
-
-class CommentServer 
-{
-private:
-    vector<vector<string>> comments_;
-    std::optional<LastCommentInfo> last_comment;
-    unordered_set<size_t> banned_users;
-
-public:
-    HttpResponse ServeRequest(const HttpRequest& req) 
-    {
-        if (req.method == "POST")
-        {
-            if (req.path == "/add_user")
-            {
-                comments_.emplace_back();
-                HttpResponse response(HttpCode::Ok);
-                response.SetContent(to_string(comments_.size() - 1));
-
-                return response;
-            }
-            else if (req.path == "/add_comment")
-            {
-                auto [user_id, comment] = ParseIdAndContent(req.body);
-
-                if (!last_comment || last_comment->user_id != user_id) 
-                {
-                    last_comment = LastCommentInfo{ user_id, 1 };
-                }
-                else if (++last_comment->consecutive_count > 3) 
-                {
-                    banned_users.insert(user_id);
-                }
-
-                if (banned_users.count(user_id) == 0) 
-                {
-                    HttpResponse response(HttpCode::Ok);
-                    comments_[user_id].push_back(string(comment));
-                    return response;
-                }
-                else 
-                {
-                    HttpResponse response(HttpCode::Found);
-                    response.AddHeader("Location", "/captcha");
-                    return response;
-                }
-            }
-            else if (req.path == "/checkcaptcha") 
-            {
-                HttpResponse response1(HttpCode::Found);
-                if (auto [id, response] = ParseIdAndContent(req.body); response == "42")
-                {
-                    response1.SetCode(HttpCode::Ok);
-                    banned_users.erase(id);
-                    if (last_comment && last_comment->user_id == id) {
-                        last_comment.reset();
-                    }
-                    return response1;
-                }
-                response1.AddHeader("Location", "/captcha");
-                return response1;
-            }
-            else 
-            {
-                HttpResponse response(HttpCode::NotFound);
-                return response;
-            }
-        }
-        else if (req.method == "GET")
-        {
-            if (req.path == "/user_comments")
-            {
-                HttpResponse response(HttpCode::Ok);
-                auto user_id = FromString<size_t>(req.get_params.at("user_id"));
-                string content;
-                for (const string& c : comments_[user_id])
-                {
-                    content += c + '\n';
-                }
-                response.SetContent(content);
-
-                return response;
-            }
-            else if (req.path == "/captcha")
-            {
-                HttpResponse response(HttpCode::Ok);
-                response.SetContent("What's the answer for The Ultimate Question of Life, the Universe, and Everything?");
-                return response;
-            }
-            else
-            {
-                HttpResponse response(HttpCode::NotFound);
-                return response;
-            }
-        }
-    }
-};
-
-
-
-
-
 //testing
 
 struct HttpHeader 
@@ -278,6 +71,7 @@ istream& operator >>(istream& input, ParsedResponse& r)
     return input;
 }
 
+template <typename CommentServer>
 void Test(CommentServer& srv, const HttpRequest& request, const ParsedResponse& expected)
 {
     stringstream ss;
@@ -335,10 +129,115 @@ void TestServer()
     Test(cs, { "POST", "/add_uesr" }, not_found);
 }
 
-int main()
+void TestHttpRequestParser();
+void TestHttpServerServesCommentServer();
+void TestHttpServerErrors();
+void TestHttpServerClosesIdleConnections();
+void TestHttpServerWaitsForFreeDescriptors();
+void TestHttpServerCommitsInGroups();
+void BenchmarkHttpServer();
+void TestConcurrentCommentServerMatchesCommentServer();
+void TestConcurrentCommentServerUnderContention();
+void BenchmarkConcurrentCommentServer();
+void TestHttpResponseHead();
+void TestResponseQueue();
+void TestResponseQueueDoesNotAllocate();
+void BenchmarkUserCommentsResponses();
+void TestCommentLog();
+void TestUserCommentsPagination();
+void TestResponseQueueSendsContentViews();
+void BenchmarkHeavyTimeline();
+void TestRouteTable();
+void TestRouteTableWithManyLiterals();
+void TestRouteTableRejectsMalformedRoutes();
+void TestUserCommentsByPathParameter();
+void BenchmarkRouter();
+void TestCommentJournalRestoresServers();
+void TestCommentJournalReplaysInParallel();
+void TestCommentJournalCutsCorruptedTail();
+void TestCommentJournalCommitsInGroups();
+void TestCommentServerStopsWhenTheJournalFails();
+void TestConcurrentCommentServerShowsOnlyWhatIsOnDisk();
+void BenchmarkCommentJournal();
+
+// --serve PORT runs the comment server over HTTP until it is killed,
+// --load PORT [CONNECTIONS [PIPELINE_DEPTH [REQUESTS]]] puts load on one
+int main(int argc, char* argv[])
 {
     TestRunner tr;
     RUN_TEST(tr, TestServer<CommentServer>);
+    RUN_TEST(tr, TestServer<ConcurrentCommentServer>);
+    RUN_TEST(tr, TestHttpRequestParser);
+    RUN_TEST(tr, TestHttpServerServesCommentServer);
+    RUN_TEST(tr, TestHttpServerErrors);
+    RUN_TEST(tr, TestHttpServerClosesIdleConnections);
+    RUN_TEST(tr, TestHttpServerWaitsForFreeDescriptors);
+    RUN_TEST(tr, TestConcurrentCommentServerMatchesCommentServer);
+    RUN_TEST(tr, TestConcurrentCommentServerUnderContention);
+    RUN_TEST(tr, TestHttpResponseHead);
+    RUN_TEST(tr, TestResponseQueue);
+    RUN_TEST(tr, TestResponseQueueDoesNotAllocate);
+    RUN_TEST(tr, TestCommentLog);
+    RUN_TEST(tr, TestUserCommentsPagination);
+    RUN_TEST(tr, TestResponseQueueSendsContentViews);
+    RUN_TEST(tr, TestRouteTable);
+    RUN_TEST(tr, TestRouteTableWithManyLiterals);
+    RUN_TEST(tr, TestRouteTableRejectsMalformedRoutes);
+    RUN_TEST(tr, TestUserCommentsByPathParameter);
+    RUN_TEST(tr, TestCommentJournalRestoresServers);
+    RUN_TEST(tr, TestCommentJournalReplaysInParallel);
+    RUN_TEST(tr, TestCommentJournalCutsCorruptedTail);
+    RUN_TEST(tr, TestCommentJournalCommitsInGroups);
+    RUN_TEST(tr, TestCommentServerStopsWhenTheJournalFails);
+    RUN_TEST(tr, TestConcurrentCommentServerShowsOnlyWhatIsOnDisk);
+    RUN_TEST(tr, TestHttpServerCommitsInGroups);
+
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        BenchmarkHttpServer();
+        BenchmarkConcurrentCommentServer();
+        BenchmarkUserCommentsResponses();
+        BenchmarkHeavyTimeline();
+        BenchmarkRouter();
+        BenchmarkCommentJournal();
+    }
+    else if (argc > 2 && strcmp(argv[1], "--serve") == 0)
+    {
+        // An optional third argument is the journal that keeps the comments across restarts
+        unique_ptr<CommentJournal> journal = argc > 3 ? make_unique<CommentJournal>(argv[3]) : nullptr;
+        CommentServer comments = journal ? CommentServer(*journal, CommentServer::CommitMode::Deferred) : CommentServer();
+        HttpServer server([&comments](const HttpRequest& req) { return comments.ServeRequest(req); }, FromString<uint16_t>(argv[2]));
+        if (journal)
+        {
+            // One sync for all the requests of an event batch
+            server.SetCommit([&comments] { comments.Commit(); });
+        }
+        cerr << "Serving on 127.0.0.1:" << server.Port() << endl;
+        server.Run();
+    }
+    else if (argc > 2 && strcmp(argv[1], "--load") == 0)
+    {
+        LoadOptions options;
+        options.port = FromString<uint16_t>(argv[2]);
+        if (argc > 3)
+        {
+            options.connections = FromString<size_t>(argv[3]);
+        }
+        if (argc > 4)
+        {
+            options.pipeline_depth = FromString<size_t>(argv[4]);
+        }
+        if (argc > 5)
+        {
+            options.total_requests = FromString<size_t>(argv[5]);
+        }
+        options.requests = {
+            "POST /add_user HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+            "GET /captcha HTTP/1.1\r\n\r\n",
+            "GET /user_comments?user_id=0 HTTP/1.1\r\n\r\n",
+        };
+        cerr << RunLoad(options) << endl;
+    }
 
     return 0;
 }
\ No newline at end of file
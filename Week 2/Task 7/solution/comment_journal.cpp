@@ -0,0 +1,456 @@
+#include "comment_journal.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr char MAGIC[] = "CMTJRNL1";
+    constexpr std::size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+    // Body size and CRC-32C of the body
+    constexpr std::size_t HEADER_SIZE = 8;
+    // Event type and user id, followed by the comment
+    constexpr std::size_t EVENT_SIZE = 9;
+
+    [[noreturn]] void ThrowErrno(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Slicing by 8: eight tables let the loop take eight bytes per step
+    const std::array<std::array<std::uint32_t, 256>, 8>& CrcTables()
+    {
+        static const auto tables = [] {
+            std::array<std::array<std::uint32_t, 256>, 8> result{};
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+                }
+                result[0][i] = crc;
+            }
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                for (std::size_t table = 1; table < 8; ++table)
+                {
+                    result[table][i] = (result[table - 1][i] >> 8) ^ result[0][result[table - 1][i] & 0xff];
+                }
+            }
+            return result;
+        }();
+        return tables;
+    }
+
+    // Continues the CRC-32C of the bytes before data; start from 0
+    std::uint32_t Crc32c(std::uint32_t crc, const char* data, std::size_t size)
+    {
+        const auto& t = CrcTables();
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+        crc = ~crc;
+        for (; size >= 8; size -= 8, p += 8)
+        {
+            std::uint32_t low;
+            std::uint32_t high;
+            std::memcpy(&low, p, 4);
+            std::memcpy(&high, p + 4, 4);
+            low ^= crc;
+            crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+                ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+        }
+        for (; size > 0; --size, ++p)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+        }
+        return ~crc;
+    }
+
+    std::uint32_t LoadU32(const char* data)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::uint64_t LoadU64(const char* data)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void WriteAll(int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                ThrowErrno("write");
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    // Calls work(0) ... work(count - 1), all but the last on threads of their own
+    template <typename Work>
+    void RunInParallel(std::size_t count, Work work)
+    {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i + 1 < count; ++i)
+        {
+            threads.emplace_back(work, i);
+        }
+        work(count - 1);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+CommentJournal::CommentJournal(std::string a_path) :
+    path(std::move(a_path))
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        ThrowErrno("open");
+    }
+}
+
+CommentJournal::~CommentJournal()
+{
+    try
+    {
+        // Events nobody waited for are still written
+        WaitDurable(appended);
+    }
+    catch (const std::system_error&)
+    {
+    }
+    close(fd);
+}
+
+std::size_t CommentJournal::DefaultReplayThreads()
+{
+    std::size_t threads = 1;
+    while (threads * 2 <= std::min<std::size_t>(std::thread::hardware_concurrency(), 64))
+    {
+        threads *= 2;
+    }
+    return threads;
+}
+
+CommentJournal::ReplayReport CommentJournal::Replay(const ReplayHandlers& handlers, std::size_t thread_count, std::size_t window_size)
+{
+    if (replayed)
+    {
+        throw std::logic_error("comment journal replayed twice");
+    }
+    thread_count = std::max<std::size_t>(thread_count, 1);
+
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        ThrowErrno("fstat");
+    }
+    const std::size_t size = static_cast<std::size_t>(status.st_size);
+
+    ReplayReport report;
+    if (size < MAGIC_SIZE)
+    {
+        // New, or the crash came before the magic made it to disk
+        if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0)
+        {
+            ThrowErrno("ftruncate");
+        }
+        WriteAll(fd, MAGIC, MAGIC_SIZE);
+        if (fdatasync(fd) != 0)
+        {
+            ThrowErrno("fdatasync");
+        }
+        report.bytes = MAGIC_SIZE;
+        report.discarded_bytes = size;
+        appended = durable = MAGIC_SIZE;
+        replayed = true;
+        return report;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        ThrowErrno("mmap");
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapping);
+    if (std::memcmp(data, MAGIC, MAGIC_SIZE) != 0)
+    {
+        munmap(mapping, size);
+        throw std::runtime_error(path + " is not a comment journal");
+    }
+
+    // What a thread found in its part of the window: the records that pass the
+    // checksum, by the thread that applies them, up to the first that does not
+    struct Part
+    {
+        std::vector<std::vector<std::size_t>> records;
+        std::size_t first_bad;
+        std::size_t user_count;
+        std::size_t users;
+        std::size_t comments;
+    };
+    std::vector<Part> parts(thread_count);
+    std::vector<std::size_t> starts;
+
+    std::size_t pos = MAGIC_SIZE;
+    for (bool torn = false; pos < size && !torn;)
+    {
+        // Finding where records start is the only sequential step, and it
+        // reads no more than the headers
+        starts.clear();
+        const std::size_t window_end = pos + std::min(window_size, size - pos);
+        std::size_t end = pos;
+        while (end < window_end)
+        {
+            if (size - end < HEADER_SIZE + EVENT_SIZE)
+            {
+                torn = true;
+                break;
+            }
+            const std::size_t body_size = LoadU32(data + end);
+            if (body_size < EVENT_SIZE || body_size > size - end - HEADER_SIZE)
+            {
+                torn = true;
+                break;
+            }
+            starts.push_back(end);
+            end += HEADER_SIZE + body_size;
+        }
+
+        RunInParallel(thread_count, [&](std::size_t index) {
+            Part& part = parts[index];
+            part.records.resize(thread_count);
+            for (auto& records : part.records)
+            {
+                records.clear();
+            }
+            part.first_bad = starts.size();
+            part.user_count = part.users = part.comments = 0;
+
+            const std::size_t first = starts.size() * index / thread_count;
+            const std::size_t last = starts.size() * (index + 1) / thread_count;
+            for (std::size_t i = first; i < last; ++i)
+            {
+                const char* record = data + starts[i];
+                const std::size_t body_size = LoadU32(record);
+                const char* body = record + HEADER_SIZE;
+                const auto type = static_cast<EventType>(body[0]);
+                if (LoadU32(record + 4) != Crc32c(0, body, body_size)
+                    || (type != EventType::AddUser && type != EventType::AddComment))
+                {
+                    part.first_bad = i;
+                    break;
+                }
+                const std::size_t user_id = LoadU64(body + 1);
+                if (type == EventType::AddUser)
+                {
+                    part.user_count = std::max(part.user_count, user_id + 1);
+                    ++part.users;
+                }
+                else
+                {
+                    ++part.comments;
+                }
+                part.records[user_id % thread_count].push_back(starts[i]);
+            }
+        });
+
+        // Nothing past the first bad record counts, wherever the threads stopped
+        std::size_t valid_parts = thread_count;
+        std::size_t user_count = 0;
+        for (std::size_t i = 0; i < thread_count; ++i)
+        {
+            user_count = std::max(user_count, parts[i].user_count);
+            report.users += parts[i].users;
+            report.comments += parts[i].comments;
+            if (parts[i].first_bad < starts.size())
+            {
+                valid_parts = i + 1;
+                end = starts[parts[i].first_bad];
+                torn = true;
+                break;
+            }
+        }
+        if (user_count > 0)
+        {
+            handlers.reserve_users(user_count);
+        }
+
+        RunInParallel(thread_count, [&](std::size_t index) {
+            for (std::size_t part = 0; part < valid_parts; ++part)
+            {
+                for (std::size_t record : parts[part].records[index])
+                {
+                    const char* body = data + record + HEADER_SIZE;
+                    const std::size_t user_id = LoadU64(body + 1);
+                    if (static_cast<EventType>(body[0]) == EventType::AddUser)
+                    {
+                        handlers.add_user(user_id);
+                    }
+                    else
+                    {
+                        const std::size_t comment_size = LoadU32(data + record) - EVENT_SIZE;
+                        handlers.add_comment(user_id, std::string_view(body + EVENT_SIZE, comment_size));
+                    }
+                }
+            }
+        });
+        pos = end;
+    }
+    munmap(mapping, size);
+
+    report.bytes = pos;
+    report.discarded_bytes = size - pos;
+    if (pos < size)
+    {
+        if (ftruncate(fd, static_cast<off_t>(pos)) != 0 || fdatasync(fd) != 0)
+        {
+            ThrowErrno("ftruncate");
+        }
+    }
+    if (lseek(fd, static_cast<off_t>(pos), SEEK_SET) < 0)
+    {
+        ThrowErrno("lseek");
+    }
+    appended = durable = pos;
+    replayed = true;
+    return report;
+}
+
+std::uint64_t CommentJournal::AddUser(std::size_t user_id)
+{
+    return Append(EventType::AddUser, user_id, {});
+}
+
+std::uint64_t CommentJournal::AddComment(std::size_t user_id, std::string_view comment)
+{
+    return Append(EventType::AddComment, user_id, comment);
+}
+
+std::uint64_t CommentJournal::Append(EventType type, std::size_t user_id, std::string_view comment)
+{
+    char header[HEADER_SIZE + EVENT_SIZE];
+    const std::uint32_t body_size = static_cast<std::uint32_t>(EVENT_SIZE + comment.size());
+    const std::uint64_t id = user_id;
+    std::memcpy(header, &body_size, 4);
+    header[HEADER_SIZE] = static_cast<char>(type);
+    std::memcpy(header + HEADER_SIZE + 1, &id, 8);
+    // The checksum is computed before taking the lock
+    const std::uint32_t crc = Crc32c(Crc32c(0, header + HEADER_SIZE, EVENT_SIZE), comment.data(), comment.size());
+    std::memcpy(header + 4, &crc, 4);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!replayed)
+    {
+        throw std::logic_error("comment journal appended to before Replay");
+    }
+    if (sync_error != 0)
+    {
+        throw std::system_error(sync_error, std::generic_category(), "comment journal");
+    }
+    pending.append(header, sizeof(header));
+    pending.append(comment);
+    appended += sizeof(header) + comment.size();
+    return appended;
+}
+
+void CommentJournal::WaitDurable(std::uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (durable < ticket)
+    {
+        if (sync_error != 0)
+        {
+            throw std::system_error(sync_error, std::generic_category(), "comment journal");
+        }
+        if (syncing)
+        {
+            synced.wait(lock);
+            continue;
+        }
+
+        // This caller writes for everyone who is waiting
+        syncing = true;
+        if (before_sync)
+        {
+            lock.unlock();
+            before_sync();
+            lock.lock();
+        }
+        writing.clear();
+        std::swap(writing, pending);
+        const std::uint64_t batch_end = appended;
+        lock.unlock();
+
+        int error = 0;
+        try
+        {
+            WriteAll(fd, writing.data(), writing.size());
+            if (fdatasync(fd) != 0)
+            {
+                ThrowErrno("fdatasync");
+            }
+        }
+        catch (const std::system_error& e)
+        {
+            error = e.code().value();
+        }
+
+        lock.lock();
+        syncing = false;
+        ++sync_count;
+        if (error != 0)
+        {
+            sync_error = error;
+        }
+        else
+        {
+            durable.store(batch_end, std::memory_order_release);
+        }
+        synced.notify_all();
+    }
+}
+
+std::uint64_t CommentJournal::Durable() const
+{
+    return durable.load(std::memory_order_acquire);
+}
+
+std::size_t CommentJournal::SyncCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return sync_count;
+}
+
+void CommentJournal::SetBeforeSync(std::function<void()> hook)
+{
+    before_sync = std::move(hook);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only file of the events that create users and comments, so that a
+// server can be rebuilt after a restart (Linux only). Every record is a
+// header with its size and CRC-32C and a body with the event; a torn or
+// corrupted tail left by a crash is found by the checksum and cut off.
+//
+// Appending only copies the record to a memory buffer. A caller that needs it
+// on disk waits for its ticket, and waiting callers commit as a group: one of
+// them writes everything buffered so far and calls fdatasync while the rest
+// wait, so one sync covers every request that arrived in the meantime.
+//
+// Replay reads the file through mmap in windows and works on every window in
+// parallel: checking the records is split by position and applying them by
+// user. The time to restart grows with the size of the log divided by the
+// number of threads, and the memory the replay itself needs is one window.
+class CommentJournal
+{
+public:
+    static constexpr std::size_t REPLAY_WINDOW_SIZE = 64 * 1024 * 1024;
+
+    // Opens or creates the file. Throws std::system_error.
+    explicit CommentJournal(std::string path);
+    ~CommentJournal();
+
+    CommentJournal(const CommentJournal&) = delete;
+    CommentJournal& operator = (const CommentJournal&) = delete;
+
+    // What Replay feeds the events to. reserve_users is called alone, with the
+    // number of users the events that follow may refer to. The other two are
+    // called from several threads at once, but never for two events of one
+    // user, which come in the order they were recorded. Events of users with
+    // the same id modulo the thread count are never given concurrently either.
+    struct ReplayHandlers
+    {
+        std::function<void(std::size_t user_count)> reserve_users;
+        std::function<void(std::size_t user_id)> add_user;
+        std::function<void(std::size_t user_id, std::string_view comment)> add_comment;
+    };
+
+    struct ReplayReport
+    {
+        std::size_t users = 0;
+        std::size_t comments = 0;
+        // Bytes of the file up to the end of the last valid record and of the tail cut off after it
+        std::size_t bytes = 0;
+        std::size_t discarded_bytes = 0;
+    };
+
+    // A power of two, so that the threads of a replay split users the same way
+    // as any power of two number of shards up to 64
+    static std::size_t DefaultReplayThreads();
+
+    // Feeds the events already in the file to handlers using thread_count
+    // threads, window_size bytes at a time, then cuts off whatever follows the
+    // last valid record. Must be called once, before anything is appended.
+    ReplayReport Replay(const ReplayHandlers& handlers, std::size_t thread_count, std::size_t window_size = REPLAY_WINDOW_SIZE);
+
+    // Buffer an event and return the ticket to wait for it. Throw
+    // std::logic_error before Replay and std::system_error once writing has
+    // failed, since nothing buffered after that can be written any more.
+    std::uint64_t AddUser(std::size_t user_id);
+    std::uint64_t AddComment(std::size_t user_id, std::string_view comment);
+
+    // Returns when the events up to ticket are on disk. Throws std::system_error
+    // if writing fails, and so does every later call: what is on disk is not
+    // known any more.
+    void WaitDurable(std::uint64_t ticket);
+
+    // Ticket of the last event on disk, without waiting for anything
+    std::uint64_t Durable() const;
+
+    // Number of fdatasync calls so far
+    std::size_t SyncCount() const;
+
+    // Called without the lock by the caller that is about to write a group,
+    // before it takes what is buffered, so tests can decide when a group is
+    // complete. Must be set before anything is appended.
+    void SetBeforeSync(std::function<void()> hook);
+
+private:
+    enum class EventType : std::uint8_t
+    {
+        AddUser = 1,
+        AddComment = 2,
+    };
+
+    std::uint64_t Append(EventType type, std::size_t user_id, std::string_view comment);
+
+    std::string path;
+    int fd = -1;
+    bool replayed = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable synced;
+    // Records appended but not written yet, and the spare buffer the writer swaps in
+    std::string pending;
+    std::string writing;
+    // Tickets are end offsets in the file
+    std::uint64_t appended = 0;
+    // Only written under mutex, but read by Durable without it
+    std::atomic<std::uint64_t> durable{ 0 };
+    bool syncing = false;
+    int sync_error = 0;
+    std::size_t sync_count = 0;
+    std::function<void()> before_sync;
+};
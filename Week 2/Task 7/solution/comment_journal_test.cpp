@@ -0,0 +1,504 @@
+#include "comment_journal.h"
+#include "comment_server.h"
+#include "concurrent_comment_server.h"
+
+#include "test_runner.h"
+#include "profile.h"
+#include "temp_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace
+{
+    string ReadFile(const string& path)
+    {
+        ifstream input(path, ios::binary);
+        return string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+
+    void WriteFile(const string& path, const string& content)
+    {
+        ofstream output(path, ios::binary | ios::trunc);
+        output << content;
+    }
+
+    HttpRequest UserComments(size_t user_id)
+    {
+        return { "GET", "/user_comments", "", {{"user_id", to_string(user_id)}} };
+    }
+
+    template <typename Server>
+    void TestRestore()
+    {
+        TempFile file;
+        {
+            CommentJournal journal(file.Path());
+            Server server(journal);
+            ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_user" }).GetContent(), "0");
+            ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_user" }).GetContent(), "1");
+            server.ServeRequest({ "POST", "/add_comment", "0 hello" });
+            server.ServeRequest({ "POST", "/add_comment", "1 hi" });
+            server.ServeRequest({ "POST", "/add_comment", "0 with spaces and\nnew lines" });
+            server.ServeRequest({ "POST", "/add_comment", "1 " });
+        }
+        {
+            CommentJournal journal(file.Path());
+            Server server(journal);
+            ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "hello\nwith spaces and\nnew lines\n");
+            ASSERT_EQUAL(server.ServeRequest(UserComments(1)).GetContent(), "hi\n\n");
+            ASSERT_EQUAL(server.ServeRequest(UserComments(2)).GetCode(), "404 Not found");
+
+            // Ids go on where they stopped, and banned comments are not recorded
+            ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_user" }).GetContent(), "2");
+            for (int i = 0; i < 5; ++i)
+            {
+                server.ServeRequest({ "POST", "/add_comment", "2 spam" + to_string(i) });
+            }
+        }
+        {
+            CommentJournal journal(file.Path());
+            Server server(journal);
+            ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "hello\nwith spaces and\nnew lines\n");
+            ASSERT_EQUAL(server.ServeRequest(UserComments(2)).GetContent(), "spam0\nspam1\nspam2\n");
+            // The ban is gone with the restart
+            ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_comment", "2 back" }).GetCode(), "200 OK");
+        }
+    }
+
+    struct ReplayedUser
+    {
+        bool added = false;
+        vector<string> comments;
+    };
+
+    // Replays the journal the way a server does. Events of one user given
+    // concurrently would be a data race on its comments.
+    vector<ReplayedUser> Replay(CommentJournal& journal, size_t thread_count, size_t window_size, CommentJournal::ReplayReport& report)
+    {
+        vector<ReplayedUser> users;
+        atomic<bool> consistent{ true };
+
+        CommentJournal::ReplayHandlers handlers;
+        handlers.reserve_users = [&](size_t user_count) {
+            if (user_count > users.size())
+            {
+                users.resize(user_count);
+            }
+        };
+        handlers.add_user = [&](size_t user_id) {
+            users[user_id].added = true;
+        };
+        handlers.add_comment = [&](size_t user_id, string_view comment) {
+            if (!users[user_id].added)
+            {
+                consistent = false;
+            }
+            users[user_id].comments.emplace_back(comment);
+        };
+        report = journal.Replay(handlers, thread_count, window_size);
+        ASSERT(consistent);
+        return users;
+    }
+}
+
+void TestCommentJournalRestoresServers()
+{
+    TestRestore<CommentServer>();
+    TestRestore<ConcurrentCommentServer>();
+}
+
+void TestCommentJournalReplaysInParallel()
+{
+    TempFile file;
+    vector<vector<string>> expected(50);
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        ASSERT(Replay(journal, 1, 100, report).empty());
+        ASSERT_EQUAL(report.bytes, 8u);
+
+        uint64_t ticket = 0;
+        for (size_t user_id = 0; user_id < expected.size(); ++user_id)
+        {
+            journal.AddUser(user_id);
+            for (size_t i = 0; i < 20 + user_id * 7 % 13; ++i)
+            {
+                expected[user_id].push_back(string(i * user_id % 300, char('a' + i % 26)));
+                ticket = journal.AddComment(user_id, expected[user_id].back());
+            }
+        }
+        journal.WaitDurable(ticket);
+    }
+
+    for (size_t thread_count : { 1, 2, 3, 8 })
+    {
+        for (size_t window_size : { size_t(1), size_t(1000), CommentJournal::REPLAY_WINDOW_SIZE })
+        {
+            CommentJournal journal(file.Path());
+            CommentJournal::ReplayReport report;
+            const vector<ReplayedUser> users = Replay(journal, thread_count, window_size, report);
+            ASSERT_EQUAL(users.size(), expected.size());
+            for (size_t user_id = 0; user_id < users.size(); ++user_id)
+            {
+                ASSERT(users[user_id].added);
+                ASSERT_EQUAL(users[user_id].comments, expected[user_id]);
+            }
+            ASSERT_EQUAL(report.users, expected.size());
+            ASSERT_EQUAL(report.discarded_bytes, 0u);
+        }
+    }
+}
+
+void TestCommentJournalCutsCorruptedTail()
+{
+    TempFile file;
+    vector<size_t> sizes;
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        journal.WaitDurable(journal.AddUser(0));
+        for (int i = 0; i < 10; ++i)
+        {
+            journal.WaitDurable(journal.AddComment(0, "comment " + to_string(i)));
+            sizes.push_back(ReadFile(file.Path()).size());
+        }
+    }
+    const string intact = ReadFile(file.Path());
+
+    // A write torn in the middle of the last record
+    WriteFile(file.Path(), intact.substr(0, intact.size() - 3));
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        const vector<ReplayedUser> users = Replay(journal, 2, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        ASSERT_EQUAL(users[0].comments.size(), 9u);
+        ASSERT_EQUAL(report.bytes, sizes[8]);
+        ASSERT_EQUAL(report.discarded_bytes, sizes[9] - sizes[8] - 3);
+        // Appends go right after the last valid record
+        journal.WaitDurable(journal.AddComment(0, "after the crash"));
+    }
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        const vector<ReplayedUser> users = Replay(journal, 2, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        ASSERT_EQUAL(users[0].comments.size(), 10u);
+        ASSERT_EQUAL(users[0].comments.back(), "after the crash");
+        ASSERT_EQUAL(report.discarded_bytes, 0u);
+    }
+
+    // A corrupted byte in the sixth comment loses it and everything after it
+    string corrupted = intact;
+    corrupted[sizes[5] - 2] ^= 1;
+    WriteFile(file.Path(), corrupted);
+    for (size_t thread_count : { 1, 4 })
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        const vector<ReplayedUser> users = Replay(journal, thread_count, 40, report);
+        ASSERT_EQUAL(users[0].comments, vector<string>({ "comment 0", "comment 1", "comment 2", "comment 3", "comment 4" }));
+        ASSERT_EQUAL(report.comments, 5u);
+        ASSERT_EQUAL(report.bytes, sizes[4]);
+        ASSERT_EQUAL(ReadFile(file.Path()).size(), sizes[4]);
+    }
+
+    // Zeros where the file system extended the file but the data never came
+    WriteFile(file.Path(), intact + string(100, '\0'));
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        ASSERT_EQUAL(report.comments, 10u);
+        ASSERT_EQUAL(report.discarded_bytes, 100u);
+    }
+
+    WriteFile(file.Path(), "not a journal");
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        bool thrown = false;
+        try
+        {
+            Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        }
+        catch (const runtime_error&)
+        {
+            thrown = true;
+        }
+        ASSERT(thrown);
+    }
+}
+
+namespace
+{
+    template <typename Server>
+    void TestStopsWhenTheJournalFails()
+    {
+        TempFile file;
+        {
+            CommentJournal journal(file.Path());
+            Server server(journal);
+            server.ServeRequest({ "POST", "/add_user" });
+            server.ServeRequest({ "POST", "/add_comment", "0 kept" });
+
+            // Writing past the current end of the file fails with EFBIG
+            rlimit old_limit;
+            ASSERT(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+            rlimit limit = old_limit;
+            limit.rlim_cur = ReadFile(file.Path()).size();
+            const auto old_handler = signal(SIGXFSZ, SIG_IGN);
+            ASSERT(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+            bool add_failed = false;
+            try
+            {
+                server.ServeRequest({ "POST", "/add_comment", "0 lost" });
+            }
+            catch (const system_error&)
+            {
+                add_failed = true;
+            }
+            setrlimit(RLIMIT_FSIZE, &old_limit);
+            signal(SIGXFSZ, old_handler);
+            ASSERT(add_failed);
+
+            // Nor does the journal buffer what it could never write
+            bool append_refused = false;
+            try
+            {
+                journal.AddComment(0, "never buffered");
+            }
+            catch (const system_error&)
+            {
+                append_refused = true;
+            }
+            ASSERT(append_refused);
+
+            // Nothing is answered any more, so the lost comment is never shown
+            for (const HttpRequest& request : { UserComments(0), HttpRequest{ "POST", "/add_user" } })
+            {
+                bool refused = false;
+                try
+                {
+                    server.ServeRequest(request);
+                }
+                catch (const runtime_error&)
+                {
+                    refused = true;
+                }
+                ASSERT(refused);
+            }
+        }
+
+        CommentJournal journal(file.Path());
+        Server server(journal);
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "kept\n");
+    }
+}
+
+void TestCommentServerStopsWhenTheJournalFails()
+{
+    TestStopsWhenTheJournalFails<CommentServer>();
+    TestStopsWhenTheJournalFails<ConcurrentCommentServer>();
+}
+
+void TestConcurrentCommentServerShowsOnlyWhatIsOnDisk()
+{
+    TempFile file;
+    CommentJournal journal(file.Path());
+    ConcurrentCommentServer server(journal);
+    ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_user" }).GetContent(), "0");
+    ASSERT_EQUAL(server.ServeRequest({ "POST", "/add_comment", "0 synced" }).GetCode(), "200 OK");
+
+    // The sync of the request in flight waits until the test has looked
+    mutex m;
+    condition_variable changed;
+    bool syncing = false;
+    bool release = false;
+    journal.SetBeforeSync([&] {
+        unique_lock<mutex> lock(m);
+        syncing = true;
+        changed.notify_all();
+        changed.wait(lock, [&] { return release; });
+        syncing = false;
+    });
+    const auto serve_while_syncing = [&](HttpRequest request) {
+        thread writer([&] { server.ServeRequest(request); });
+        {
+            unique_lock<mutex> lock(m);
+            changed.wait(lock, [&] { return syncing; });
+        }
+        return writer;
+    };
+    const auto finish_sync = [&](thread& writer) {
+        {
+            lock_guard<mutex> lock(m);
+            release = true;
+        }
+        changed.notify_all();
+        writer.join();
+        release = false;
+    };
+
+    thread writer = serve_while_syncing({ "POST", "/add_comment", "0 in flight" });
+    ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "synced\n");
+    finish_sync(writer);
+    ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "synced\nin flight\n");
+
+    writer = serve_while_syncing({ "POST", "/add_user" });
+    ASSERT_EQUAL(server.ServeRequest(UserComments(1)).GetCode(), "404 Not found");
+    finish_sync(writer);
+    ASSERT_EQUAL(server.ServeRequest(UserComments(1)).GetContent(), "");
+}
+
+void TestCommentJournalCommitsInGroups()
+{
+    TempFile file;
+    const size_t thread_count = 8;
+    const size_t per_thread = 50;
+    size_t sync_count = 0;
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        for (size_t user_id = 0; user_id < thread_count; ++user_id)
+        {
+            journal.AddUser(user_id);
+        }
+
+        // A group is written once every thread still running has its comment
+        // buffered, and each thread has at most one. Comments that are on
+        // disk but not counted yet only make a group start early.
+        atomic<size_t> appended = 0;
+        atomic<size_t> committed = 0;
+        atomic<size_t> running = thread_count;
+        journal.SetBeforeSync([&] {
+            while (appended.load() - committed.load() < running.load())
+            {
+                this_thread::yield();
+            }
+        });
+
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (size_t i = 0; i < per_thread; ++i)
+                {
+                    const uint64_t ticket = journal.AddComment(t, to_string(i));
+                    ++appended;
+                    journal.WaitDurable(ticket);
+                    ++committed;
+                }
+                --running;
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+        sync_count = journal.SyncCount();
+    }
+    // One sync per request is what grouping is there to avoid
+    ASSERT(sync_count < thread_count * per_thread / 2);
+
+    CommentJournal journal(file.Path());
+    CommentJournal::ReplayReport report;
+    const vector<ReplayedUser> users = Replay(journal, 4, CommentJournal::REPLAY_WINDOW_SIZE, report);
+    ASSERT_EQUAL(users.size(), thread_count);
+    for (const ReplayedUser& user : users)
+    {
+        ASSERT_EQUAL(user.comments.size(), per_thread);
+        for (size_t i = 0; i < per_thread; ++i)
+        {
+            ASSERT_EQUAL(user.comments[i], to_string(i));
+        }
+    }
+}
+
+void BenchmarkCommentJournal()
+{
+    for (size_t thread_count : { 1, 8, 64 })
+    {
+        TempFile file;
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        const size_t per_thread = 4000 / thread_count;
+
+        const auto start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&journal, t, per_thread] {
+                for (size_t i = 0; i < per_thread; ++i)
+                {
+                    journal.WaitDurable(journal.AddComment(t, "a durable comment of some typical length"));
+                }
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+        const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        const size_t total = per_thread * thread_count;
+        cerr << "Durable add_comment, " << thread_count << " threads: " << total << " in " << elapsed << " ms, "
+            << total * 1000 / max<long long>(elapsed, 1) << " per second, " << journal.SyncCount() << " syncs" << endl;
+    }
+
+    // Replay of a big journal, as the server does it on startup
+    TempFile file;
+    const size_t user_count = 100000;
+    const size_t comment_count = 10000000;
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayReport report;
+        Replay(journal, 1, CommentJournal::REPLAY_WINDOW_SIZE, report);
+        for (size_t user_id = 0; user_id < user_count; ++user_id)
+        {
+            journal.AddUser(user_id);
+        }
+        uint64_t ticket = 0;
+        for (size_t i = 0; i < comment_count; ++i)
+        {
+            ticket = journal.AddComment(i * 7919 % user_count, "a replayed comment, number " + to_string(i));
+            if (i % 100000 == 0)
+            {
+                journal.WaitDurable(ticket);
+            }
+        }
+        journal.WaitDurable(ticket);
+    }
+    {
+        CommentJournal journal(file.Path());
+        LOG_DURATION("Replay of 10M comments into ConcurrentCommentServer, " + to_string(CommentJournal::DefaultReplayThreads()) + " threads");
+        ConcurrentCommentServer server(journal);
+    }
+    for (size_t thread_count : { 1, 4 })
+    {
+        CommentJournal journal(file.Path());
+        CommentJournal::ReplayHandlers handlers;
+        handlers.reserve_users = [](size_t) {};
+        handlers.add_user = [](size_t) {};
+        handlers.add_comment = [](size_t, string_view) {};
+        LOG_DURATION("Replay of 10M comments, checksums only, " + to_string(thread_count) + " threads");
+        const CommentJournal::ReplayReport report = journal.Replay(handlers, thread_count);
+        cerr << report.comments << " comments, " << report.bytes / (1024 * 1024) << " MB" << endl;
+    }
+}
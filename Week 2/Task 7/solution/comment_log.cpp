@@ -0,0 +1,46 @@
+#include "comment_log.h"
+
+#include <algorithm>
+#include <cstring>
+
+void CommentLog::Append(std::string_view comment)
+{
+    const std::size_t size = comment.size() + 1;
+    if (chunks.empty() || chunks.back().capacity - chunks.back().size < size)
+    {
+        const std::size_t preferred = chunks.empty()
+            ? FIRST_CHUNK_SIZE
+            : std::min(chunks.back().capacity * 2, MAX_CHUNK_SIZE);
+        const std::size_t capacity = std::max(preferred, size);
+        // Not value-initialized, every byte is written before it is read
+        chunks.push_back({ std::unique_ptr<char[]>(new char[capacity]), capacity, 0, starts.size() });
+    }
+
+    Chunk& chunk = chunks.back();
+    std::memcpy(chunk.data.get() + chunk.size, comment.data(), comment.size());
+    chunk.data[chunk.size + comment.size()] = '\n';
+    starts.push_back({ static_cast<std::uint32_t>(chunks.size() - 1), static_cast<std::uint32_t>(chunk.size) });
+    chunk.size += size;
+}
+
+std::size_t CommentLog::Size() const
+{
+    return starts.size();
+}
+
+void CommentLog::Slice(std::size_t offset, std::size_t limit, std::vector<std::string_view>& parts) const
+{
+    const std::size_t end = offset + std::min(limit, Size() - std::min(offset, Size()));
+    while (offset < end)
+    {
+        // The run of requested comments within the chunk of the first one
+        const Position start = starts[offset];
+        const Chunk& chunk = chunks[start.chunk];
+        const std::size_t next_chunk_first = start.chunk + 1 < chunks.size() ? chunks[start.chunk + 1].first_comment : Size();
+        const std::size_t run_end = std::min(end, next_chunk_first);
+        const std::size_t end_offset = run_end < next_chunk_first ? starts[run_end].offset : chunk.size;
+
+        parts.emplace_back(chunk.data.get() + start.offset, end_offset - start.offset);
+        offset = run_end;
+    }
+}
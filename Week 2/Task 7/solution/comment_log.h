@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only log of the comments of one user, each stored followed by '\n'.
+// The text lives in chunks that are never moved or freed while the log
+// exists, and a comment never straddles two chunks, so any run of comments is
+// a handful of contiguous views - one per chunk it spans - that stay valid as
+// later comments are appended. Chunks grow geometrically, which keeps both the
+// slack of a quiet user and the number of views of a busy one small.
+class CommentLog
+{
+public:
+    static constexpr std::size_t FIRST_CHUNK_SIZE = 256;
+    static constexpr std::size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+    void Append(std::string_view comment);
+
+    // Number of comments
+    std::size_t Size() const;
+
+    // Appends to parts the views covering comments [offset, offset + limit),
+    // clamped to the log, in order
+    void Slice(std::size_t offset, std::size_t limit, std::vector<std::string_view>& parts) const;
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t capacity;
+        std::size_t size;
+        // Index of the first comment stored in the chunk
+        std::size_t first_comment;
+    };
+
+    struct Position
+    {
+        std::uint32_t chunk;
+        std::uint32_t offset;
+    };
+
+    std::vector<Chunk> chunks;
+    std::vector<Position> starts;
+};
@@ -0,0 +1,267 @@
+#include "comment_log.h"
+#include "comment_server.h"
+#include "concurrent_comment_server.h"
+#include "response_queue.h"
+
+#include "test_runner.h"
+#include "profile.h"
+#include "alloc_profile.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    string Join(const vector<string_view>& parts)
+    {
+        string result;
+        for (string_view part : parts)
+        {
+            result += part;
+        }
+        return result;
+    }
+
+    string Expected(const vector<string>& comments, size_t offset, size_t limit)
+    {
+        string result;
+        for (size_t i = offset; i < comments.size() && i - offset < limit; ++i)
+        {
+            result += comments[i];
+            result += '\n';
+        }
+        return result;
+    }
+
+    HttpRequest UserComments(size_t user_id, const string& offset = "", const string& limit = "")
+    {
+        HttpRequest request{ "GET", "/user_comments", "", {{"user_id", to_string(user_id)}} };
+        if (!offset.empty())
+        {
+            request.get_params["offset"] = offset;
+        }
+        if (!limit.empty())
+        {
+            request.get_params["limit"] = limit;
+        }
+        return request;
+    }
+
+    template <typename Server>
+    void TestPagination()
+    {
+        Server server;
+        server.ServeRequest({ "POST", "/add_user" });
+        server.ServeRequest({ "POST", "/add_user" });
+        for (int i = 0; i < 10; ++i)
+        {
+            // Alternating users so that nobody gets banned
+            server.ServeRequest({ "POST", "/add_comment", "0 c" + to_string(i) });
+            server.ServeRequest({ "POST", "/add_comment", "1 other" });
+        }
+
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0)).GetContent(), "c0\nc1\nc2\nc3\nc4\nc5\nc6\nc7\nc8\nc9\n");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "3")).GetContent(), "c3\nc4\nc5\nc6\nc7\nc8\nc9\n");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "", "2")).GetContent(), "c0\nc1\n");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "8", "5")).GetContent(), "c8\nc9\n");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "10", "5")).GetContent(), "");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "1000")).GetContent(), "");
+        ASSERT_EQUAL(server.ServeRequest(UserComments(0, "4", "0")).GetContent(), "");
+
+        ostringstream os;
+        os << server.ServeRequest(UserComments(0, "5", "1"));
+        ASSERT_EQUAL(os.str(), "HTTP/1.1 200 OK\nContent-Length: 3\n\nc5\n");
+    }
+}
+
+void TestCommentLog()
+{
+    mt19937 generator(43);
+    CommentLog log;
+    vector<string> comments;
+
+    ASSERT_EQUAL(log.Size(), 0u);
+    vector<string_view> parts;
+    log.Slice(0, 10, parts);
+    ASSERT(parts.empty());
+
+    // Sizes from empty to larger than the biggest chunk
+    for (int i = 0; i < 3000; ++i)
+    {
+        size_t size = generator() % 40;
+        if (i % 500 == 7)
+        {
+            size = CommentLog::MAX_CHUNK_SIZE + generator() % 1000;
+        }
+        comments.push_back(string(size, 'a' + i % 26));
+        log.Append(comments.back());
+    }
+    ASSERT_EQUAL(log.Size(), comments.size());
+
+    vector<pair<size_t, size_t>> ranges = { {0, 3000}, {0, 1}, {2999, 5}, {3000, 1}, {5000, 1}, {10, 0}, {0, size_t(-1)}, {7, size_t(-1)} };
+    for (int i = 0; i < 200; ++i)
+    {
+        ranges.push_back({ generator() % 3100, generator() % 300 });
+    }
+
+    vector<vector<string_view>> slices;
+    for (auto [offset, limit] : ranges)
+    {
+        parts.clear();
+        log.Slice(offset, limit, parts);
+        ASSERT_EQUAL(Join(parts), Expected(comments, offset, limit));
+        slices.push_back(parts);
+    }
+
+    // A long run is a few views, not one per comment
+    parts.clear();
+    log.Slice(0, 3000, parts);
+    ASSERT(parts.size() < 40);
+
+    // Views taken earlier still read the same text after many more comments
+    for (int i = 0; i < 20000; ++i)
+    {
+        log.Append("later comment " + to_string(i));
+    }
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        ASSERT_EQUAL(Join(slices[i]), Expected(comments, ranges[i].first, ranges[i].second));
+    }
+}
+
+void TestUserCommentsPagination()
+{
+    TestPagination<CommentServer>();
+    TestPagination<ConcurrentCommentServer>();
+}
+
+void TestResponseQueueSendsContentViews()
+{
+    CommentLog log;
+    vector<string> comments;
+    for (int i = 0; i < 2000; ++i)
+    {
+        comments.push_back("comment number " + to_string(i));
+        log.Append(comments.back());
+    }
+
+    string expected;
+    ResponseQueue queue;
+    for (size_t offset : { 0, 100, 1999 })
+    {
+        vector<string_view> parts;
+        log.Slice(offset, 1000, parts);
+        HttpResponse response(HttpCode::Ok);
+        response.SetContentView(move(parts));
+        response.AppendHead(expected, true);
+        expected += Expected(comments, offset, 1000);
+        queue.Push(response, true);
+    }
+    HttpResponse owned(HttpCode::Ok);
+    owned.SetContent("owned");
+    owned.AppendHead(expected, false);
+    expected += "owned";
+    queue.Push(owned, false);
+
+    // Fewer iovecs than views in one response, and writes that stop mid-part
+    string sent;
+    iovec iov[3];
+    while (!queue.Empty())
+    {
+        const size_t count = queue.Gather(iov, 3);
+        size_t bytes = 0;
+        for (size_t i = 0; i < count && bytes < 5000; ++i)
+        {
+            const size_t part = min<size_t>(iov[i].iov_len, 5000 - bytes);
+            sent.append(static_cast<const char*>(iov[i].iov_base), part);
+            bytes += part;
+        }
+        queue.Consume(bytes);
+    }
+    ASSERT_EQUAL(sent, expected);
+}
+
+void BenchmarkHeavyTimeline()
+{
+    // One user with 100k comments, about 3.5 MB of text
+    CommentServer server;
+    server.ServeRequest({ "POST", "/add_user" });
+    server.ServeRequest({ "POST", "/add_user" });
+    vector<string> comments;
+    for (int i = 0; i < 100000; ++i)
+    {
+        comments.push_back("a comment of a heavy user, number " + to_string(i));
+        server.ServeRequest({ "POST", "/add_comment", "0 " + comments.back() });
+        server.ServeRequest({ "POST", "/add_comment", "1 keeps the ban away" });
+    }
+
+    const int count = 1000;
+    size_t total = 0;
+    {
+        LOG_DURATION("Heavy timeline x1000, concatenated as before");
+        LOG_ALLOCATIONS("Heavy timeline x1000, concatenated as before");
+        for (int i = 0; i < count; ++i)
+        {
+            string content;
+            for (const string& c : comments)
+            {
+                content += c + '\n';
+            }
+            total += content.size();
+        }
+    }
+    {
+        LOG_DURATION("Heavy timeline x1000, ServeRequest + ResponseQueue");
+        LOG_ALLOCATIONS("Heavy timeline x1000, ServeRequest + ResponseQueue");
+        ResponseQueue queue;
+        iovec iov[64];
+        for (int i = 0; i < count; ++i)
+        {
+            HttpResponse response = server.ServeRequest(UserComments(0));
+            queue.Push(response, true);
+            while (!queue.Empty())
+            {
+                const size_t parts = queue.Gather(iov, 64);
+                size_t bytes = 0;
+                for (size_t part = 0; part < parts; ++part)
+                {
+                    bytes += iov[part].iov_len;
+                }
+                queue.Consume(bytes);
+                total -= bytes;
+            }
+        }
+    }
+    {
+        LOG_DURATION("Heavy timeline pages of 50 x100k, ServeRequest + ResponseQueue");
+        LOG_ALLOCATIONS("Heavy timeline pages of 50 x100k, ServeRequest + ResponseQueue");
+        ResponseQueue queue;
+        iovec iov[8];
+        vector<HttpRequest> pages;
+        for (int page = 0; page < 2000; ++page)
+        {
+            pages.push_back(UserComments(0, to_string(page * 50), "50"));
+        }
+        for (int i = 0; i < 100000; ++i)
+        {
+            HttpResponse response = server.ServeRequest(pages[i % pages.size()]);
+            queue.Push(response, true);
+            const size_t parts = queue.Gather(iov, 8);
+            size_t bytes = 0;
+            for (size_t part = 0; part < parts; ++part)
+            {
+                bytes += iov[part].iov_len;
+            }
+            queue.Consume(bytes);
+        }
+    }
+    // The heads are the only difference between what both ways produced
+    cerr << "heavy timeline bytes difference: " << static_cast<long long>(total) << endl;
+}
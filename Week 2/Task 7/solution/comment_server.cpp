@@ -0,0 +1,344 @@
+#include "comment_server.h"
+#include "router.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    struct StatusStrings
+    {
+        string_view code;
+        string_view status_line;
+    };
+
+    StatusStrings GetStatusStrings(HttpCode code)
+    {
+        switch (code)
+        {
+        case HttpCode::Ok:
+            return { "200 OK", "HTTP/1.1 200 OK\r\n" };
+        case HttpCode::Found:
+            return { "302 Found", "HTTP/1.1 302 Found\r\n" };
+        default:
+            return { "404 Not found", "HTTP/1.1 404 Not found\r\n" };
+        }
+    }
+}
+
+HttpResponse& HttpResponse::AddHeader(string name, string value)
+{
+    headers_.emplace_back(move(name), move(value));
+    return *this;
+}
+
+HttpResponse& HttpResponse::SetContent(string a_content)
+{
+    content_ = move(a_content);
+    content_view_.clear();
+    return *this;
+}
+
+HttpResponse& HttpResponse::SetContentView(vector<string_view> parts)
+{
+    content_.clear();
+    content_view_ = move(parts);
+    return *this;
+}
+
+HttpResponse& HttpResponse::SetCode(HttpCode a_code)
+{
+    code_ = a_code;
+    return *this;
+}
+
+string_view HttpResponse::GetCode() const
+{
+    return GetStatusStrings(code_).code;
+}
+
+void HttpResponse::AppendHead(string& out, bool keep_alive) const
+{
+    out += GetStatusStrings(code_).status_line;
+    for (const auto& [name, value] : headers_)
+    {
+        out += name;
+        out += ": ";
+        out += value;
+        out += "\r\n";
+    }
+
+    char length[24];
+    const auto length_end = to_chars(begin(length), end(length), GetContentSize()).ptr;
+    out += "Content-Length: ";
+    out.append(length, length_end);
+    out += keep_alive ? string_view("\r\n\r\n") : string_view("\r\nConnection: close\r\n\r\n");
+}
+
+size_t HttpResponse::GetContentSize() const
+{
+    size_t size = content_.size();
+    for (string_view part : content_view_)
+    {
+        size += part.size();
+    }
+    return size;
+}
+
+const vector<string_view>& HttpResponse::GetContentView() const
+{
+    return content_view_;
+}
+
+string HttpResponse::GetContent() const
+{
+    if (content_view_.empty())
+    {
+        return content_;
+    }
+    string content;
+    content.reserve(GetContentSize());
+    for (string_view part : content_view_)
+    {
+        content += part;
+    }
+    return content;
+}
+
+string HttpResponse::TakeContent()
+{
+    if (content_view_.empty())
+    {
+        return move(content_);
+    }
+    return GetContent();
+}
+
+ostream& operator << (ostream& out, const HttpResponse& resp)
+{
+    out << "HTTP/1.1 " << resp.GetCode() << '\n';
+    for (const auto& i : resp.headers_)
+    {
+        out << i.first << ": " << i.second << '\n';
+    }
+
+    if (const size_t size = resp.GetContentSize(); size != 0)
+    {
+        out << "Content-Length: " << size << '\n' << '\n' << resp.content_;
+        for (string_view part : resp.content_view_)
+        {
+            out << part;
+        }
+        return out;
+    }
+    else
+    {
+        return out << '\n';
+    }
+}
+
+pair<string, string> SplitBy(const string& what, const string& by)
+{
+    size_t pos = what.find(by);
+    if (by.size() < what.size() && pos < what.size() - by.size())
+    {
+        return { what.substr(0, pos), what.substr(pos + by.size()) };
+    }
+    else
+    {
+        return { what, {} };
+    }
+}
+
+pair<size_t, string> ParseIdAndContent(const string& body)
+{
+    auto [id_string, content] = SplitBy(body, " ");
+    return { FromString<size_t>(id_string), content };
+}
+
+CommentRange ParseCommentRange(const map<string, string>& get_params)
+{
+    CommentRange range{ 0, numeric_limits<size_t>::max() };
+    if (auto offset = get_params.find("offset"); offset != get_params.end())
+    {
+        range.offset = FromString<size_t>(offset->second);
+    }
+    if (auto limit = get_params.find("limit"); limit != get_params.end())
+    {
+        range.limit = FromString<size_t>(limit->second);
+    }
+    return range;
+}
+
+CommentServer::CommentServer(CommentJournal& journal, CommitMode commit_mode) :
+    journal_(&journal),
+    commit_mode_(commit_mode)
+{
+    CommentJournal::ReplayHandlers handlers;
+    // Users are created up front, so that the threads of the replay only touch the logs
+    handlers.reserve_users = [this](size_t user_count) {
+        comments_.resize(max(comments_.size(), user_count));
+    };
+    handlers.add_user = [](size_t) {};
+    handlers.add_comment = [this](size_t user_id, string_view comment) {
+        if (user_id < comments_.size())
+        {
+            comments_[user_id].Append(comment);
+        }
+    };
+    journal.Replay(handlers, CommentJournal::DefaultReplayThreads());
+}
+
+const Router<CommentServer>& CommentServer::Routes()
+{
+    static const Router<CommentServer> routes = move(Router<CommentServer>()
+        .Add("POST", "/add_user", [](CommentServer& server, const HttpRequest&, const RouteParams&) {
+            return server.AddUser();
+        })
+        .Add("POST", "/add_comment", [](CommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto [user_id, comment] = ParseIdAndContent(req.body);
+            return server.AddComment(user_id, comment);
+        })
+        .Add("POST", "/checkcaptcha", [](CommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto [user_id, answer] = ParseIdAndContent(req.body);
+            return server.CheckCaptcha(user_id, answer);
+        })
+        .Add("GET", "/user_comments", [](CommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto user_id_param = req.get_params.find("user_id");
+            if (user_id_param == req.get_params.end())
+            {
+                return HttpResponse(HttpCode::NotFound);
+            }
+            return server.UserComments(FromString<size_t>(user_id_param->second), ParseCommentRange(req.get_params));
+        })
+        .Add("GET", "/users/:user_id/comments", [](CommentServer& server, const HttpRequest& req, const RouteParams& params) {
+            return server.UserComments(FromString<size_t>(string(params.Get("user_id"))), ParseCommentRange(req.get_params));
+        })
+        .Add("GET", "/captcha", [](CommentServer&, const HttpRequest&, const RouteParams&) {
+            HttpResponse response(HttpCode::Ok);
+            response.SetContent("What's the answer for The Ultimate Question of Life, the Universe, and Everything?");
+            return response;
+        })
+        .Compile());
+    return routes;
+}
+
+HttpResponse CommentServer::ServeRequest(const HttpRequest& req)
+{
+    if (journal_failed_)
+    {
+        throw runtime_error("comment journal failed");
+    }
+    return Routes().Dispatch(*this, req);
+}
+
+void CommentServer::Commit()
+{
+    if (!journal_)
+    {
+        return;
+    }
+    try
+    {
+        journal_->WaitDurable(last_ticket_);
+    }
+    catch (...)
+    {
+        journal_failed_ = true;
+        throw;
+    }
+}
+
+void CommentServer::Record(uint64_t ticket)
+{
+    last_ticket_ = ticket;
+    if (commit_mode_ == CommitMode::PerRequest)
+    {
+        Commit();
+    }
+}
+
+HttpResponse CommentServer::AddUser()
+{
+    if (journal_)
+    {
+        Record(journal_->AddUser(comments_.size()));
+    }
+    comments_.emplace_back();
+    HttpResponse response(HttpCode::Ok);
+    response.SetContent(to_string(comments_.size() - 1));
+
+    return response;
+}
+
+HttpResponse CommentServer::AddComment(size_t user_id, const string& comment)
+{
+    // Requests come from the network now, so an unknown user must not index past the end
+    if (user_id >= comments_.size())
+    {
+        return HttpResponse(HttpCode::NotFound);
+    }
+
+    if (!last_comment || last_comment->user_id != user_id)
+    {
+        last_comment = LastCommentInfo{ user_id, 1 };
+    }
+    else if (++last_comment->consecutive_count > 3)
+    {
+        banned_users.insert(user_id);
+    }
+
+    if (banned_users.count(user_id) == 0)
+    {
+        HttpResponse response(HttpCode::Ok);
+        if (journal_)
+        {
+            Record(journal_->AddComment(user_id, comment));
+        }
+        comments_[user_id].Append(comment);
+        return response;
+    }
+    else
+    {
+        HttpResponse response(HttpCode::Found);
+        response.AddHeader("Location", "/captcha");
+        return response;
+    }
+}
+
+HttpResponse CommentServer::CheckCaptcha(size_t user_id, const string& answer)
+{
+    HttpResponse response(HttpCode::Found);
+    if (answer == "42")
+    {
+        response.SetCode(HttpCode::Ok);
+        banned_users.erase(user_id);
+        if (last_comment && last_comment->user_id == user_id) {
+            last_comment.reset();
+        }
+        return response;
+    }
+    response.AddHeader("Location", "/captcha");
+    return response;
+}
+
+HttpResponse CommentServer::UserComments(size_t user_id, CommentRange range)
+{
+    if (user_id >= comments_.size())
+    {
+        return HttpResponse(HttpCode::NotFound);
+    }
+
+    HttpResponse response(HttpCode::Ok);
+    // The body points into the log, which never moves what it has stored
+    vector<string_view> parts;
+    comments_[user_id].Slice(range.offset, range.limit, parts);
+    response.SetContentView(move(parts));
+
+    return response;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "comment_journal.h"
+#include "comment_log.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+enum class HttpCode
+{
+    Ok = 200,
+    NotFound = 404,
+    Found = 302,
+};
+
+class HttpResponse
+{
+public:
+    explicit HttpResponse(HttpCode code) :
+        code_(code)
+    {}
+
+    HttpResponse& AddHeader(std::string name, std::string value);
+    HttpResponse& SetContent(std::string a_content);
+    // The content is the concatenation of parts that point into storage the
+    // handler guarantees to outlive the response, so it is sent without a copy
+    HttpResponse& SetContentView(std::vector<std::string_view> parts);
+    HttpResponse& SetCode(HttpCode a_code);
+
+    // "200 OK" and so on, static strings
+    std::string_view GetCode() const;
+
+    // Appends the status line and the headers in the wire format, with CRLF line
+    // ends and a Content-Length that is always present so the connection can be
+    // kept alive. The content itself is not copied, it goes out as is. Nothing
+    // is allocated when out has the capacity.
+    void AppendHead(std::string& out, bool keep_alive) const;
+
+    std::size_t GetContentSize() const;
+    // Parts of content set by SetContentView, empty for an owned content
+    const std::vector<std::string_view>& GetContentView() const;
+    // The whole content, copied together when it is a view
+    std::string GetContent() const;
+    std::string TakeContent();
+
+    friend std::ostream& operator << (std::ostream& out, const HttpResponse& resp);
+private:
+    HttpCode code_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string content_;
+    std::vector<std::string_view> content_view_;
+};
+
+std::ostream& operator << (std::ostream& out, const HttpResponse& resp);
+
+struct HttpRequest
+{
+    std::string method, path, body;
+    std::map<std::string, std::string> get_params;
+};
+
+std::pair<std::string, std::string> SplitBy(const std::string& what, const std::string& by);
+
+template<typename T>
+T FromString(const std::string& s)
+{
+    T x;
+    std::istringstream is(s);
+    is >> x;
+    return x;
+}
+
+std::pair<size_t, std::string> ParseIdAndContent(const std::string& body);
+
+// The comments of /user_comments a request asks for: all of them unless it
+// gives "offset" (skip that many) and "limit" (at most that many)
+struct CommentRange
+{
+    size_t offset, limit;
+};
+
+CommentRange ParseCommentRange(const std::map<std::string, std::string>& get_params);
+
+template <typename Target>
+class Router;
+
+struct LastCommentInfo
+{
+    size_t user_id, consecutive_count;
+};
+
+class CommentServer
+{
+public:
+    enum class CommitMode
+    {
+        // A request that records an event answers once the event is on disk
+        PerRequest,
+        // Requests only append their events and the caller calls Commit
+        // before it sends their answers, so one sync covers all of them
+        Deferred,
+    };
+
+private:
+    std::vector<CommentLog> comments_;
+    std::optional<LastCommentInfo> last_comment;
+    std::unordered_set<size_t> banned_users;
+    CommentJournal* journal_ = nullptr;
+    CommitMode commit_mode_ = CommitMode::PerRequest;
+    std::uint64_t last_ticket_ = 0;
+    bool journal_failed_ = false;
+
+    // Compiled once and shared by all the servers
+    static const Router<CommentServer>& Routes();
+
+    HttpResponse AddUser();
+    HttpResponse AddComment(size_t user_id, const std::string& comment);
+    HttpResponse CheckCaptcha(size_t user_id, const std::string& answer);
+    HttpResponse UserComments(size_t user_id, CommentRange range);
+
+    // Commits at once in the PerRequest mode
+    void Record(std::uint64_t ticket);
+
+public:
+    CommentServer() = default;
+    // Rebuilds the users and comments recorded in journal and records the new
+    // ones there, see CommitMode. Whom the spam rule has banned is not
+    // recorded, a restart starts over.
+    //
+    // Once writing the journal fails, what is in memory may be ahead of what
+    // is on disk, so the server throws for every request from then on rather
+    // than show anything that a restart would lose. A request whose own event
+    // failed to commit changes nothing that could be shown.
+    explicit CommentServer(CommentJournal& journal, CommitMode commit_mode = CommitMode::PerRequest);
+
+    HttpResponse ServeRequest(const HttpRequest& req);
+
+    // Returns when the events of all the requests served so far are on disk.
+    // Throws std::system_error if writing the journal fails.
+    void Commit();
+};
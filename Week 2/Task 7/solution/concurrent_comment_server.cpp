@@ -0,0 +1,264 @@
+#include "concurrent_comment_server.h"
+#include "router.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+ConcurrentCommentServer::ConcurrentCommentServer(CommentJournal& a_journal) :
+    journal(&a_journal)
+{
+    // With a power of two number of threads, up to SHARD_COUNT, the users of
+    // a shard are all replayed by one thread and the locks are never contended
+    CommentJournal::ReplayHandlers handlers;
+    handlers.reserve_users = [this](size_t count) {
+        user_count.store(max(user_count.load(), count));
+    };
+    handlers.add_user = [this](size_t user_id) {
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.mutex);
+        const size_t index = user_id / SHARD_COUNT;
+        if (index >= shard.users.size())
+        {
+            shard.users.resize(index + 1);
+        }
+        shard.users[index].exists = true;
+    };
+    handlers.add_comment = [this](size_t user_id, string_view comment) {
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.mutex);
+        if (User* user = FindUser(shard, user_id))
+        {
+            user->comments.Append(comment);
+        }
+    };
+    journal->Replay(handlers, CommentJournal::DefaultReplayThreads());
+}
+
+const Router<ConcurrentCommentServer>& ConcurrentCommentServer::Routes()
+{
+    static const Router<ConcurrentCommentServer> routes = move(Router<ConcurrentCommentServer>()
+        .Add("POST", "/add_user", [](ConcurrentCommentServer& server, const HttpRequest&, const RouteParams&) {
+            return server.AddUser();
+        })
+        .Add("POST", "/add_comment", [](ConcurrentCommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto [user_id, comment] = ParseIdAndContent(req.body);
+            return server.AddComment(user_id, comment);
+        })
+        .Add("POST", "/checkcaptcha", [](ConcurrentCommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto [user_id, answer] = ParseIdAndContent(req.body);
+            return server.CheckCaptcha(user_id, answer);
+        })
+        .Add("GET", "/user_comments", [](ConcurrentCommentServer& server, const HttpRequest& req, const RouteParams&) {
+            auto user_id_param = req.get_params.find("user_id");
+            if (user_id_param == req.get_params.end())
+            {
+                return HttpResponse(HttpCode::NotFound);
+            }
+            return server.UserComments(FromString<size_t>(user_id_param->second), ParseCommentRange(req.get_params));
+        })
+        .Add("GET", "/users/:user_id/comments", [](ConcurrentCommentServer& server, const HttpRequest& req, const RouteParams& params) {
+            return server.UserComments(FromString<size_t>(string(params.Get("user_id"))), ParseCommentRange(req.get_params));
+        })
+        .Add("GET", "/captcha", [](ConcurrentCommentServer&, const HttpRequest&, const RouteParams&) {
+            HttpResponse response(HttpCode::Ok);
+            response.SetContent("What's the answer for The Ultimate Question of Life, the Universe, and Everything?");
+            return response;
+        })
+        .Compile());
+    return routes;
+}
+
+HttpResponse ConcurrentCommentServer::ServeRequest(const HttpRequest& req)
+{
+    if (journal_failed.load())
+    {
+        throw runtime_error("comment journal failed");
+    }
+    return Routes().Dispatch(*this, req);
+}
+
+void ConcurrentCommentServer::Commit(uint64_t ticket)
+{
+    try
+    {
+        journal->WaitDurable(ticket);
+    }
+    catch (...)
+    {
+        journal_failed.store(true);
+        throw;
+    }
+}
+
+ConcurrentCommentServer::Shard& ConcurrentCommentServer::ShardOf(size_t user_id)
+{
+    return shards[user_id % SHARD_COUNT];
+}
+
+ConcurrentCommentServer::User* ConcurrentCommentServer::FindUser(Shard& shard, size_t user_id)
+{
+    const size_t index = user_id / SHARD_COUNT;
+    if (index >= shard.users.size() || !shard.users[index].exists)
+    {
+        return nullptr;
+    }
+    return &shard.users[index];
+}
+
+size_t ConcurrentCommentServer::CommittedComments(User& user)
+{
+    // Without a journal nothing is ever unsynced
+    if (!user.unsynced.empty())
+    {
+        const auto synced_end = upper_bound(user.unsynced.begin(), user.unsynced.end(), journal->Durable());
+        user.unsynced.erase(user.unsynced.begin(), synced_end);
+    }
+    return user.comments.Size() - user.unsynced.size();
+}
+
+HttpResponse ConcurrentCommentServer::AddUser()
+{
+    const size_t user_id = user_count.fetch_add(1);
+    // The user is created once its event is on disk, so no comment of it can
+    // be recorded before, and a failed sync leaves no user behind
+    if (journal)
+    {
+        Commit(journal->AddUser(user_id));
+    }
+
+    // Ids are handed out in order, but concurrent additions to one shard may
+    // arrive out of order, hence the explicit exists flag
+    {
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.mutex);
+        const size_t index = user_id / SHARD_COUNT;
+        if (index >= shard.users.size())
+        {
+            shard.users.resize(index + 1);
+        }
+        shard.users[index].exists = true;
+    }
+
+    HttpResponse response(HttpCode::Ok);
+    response.SetContent(to_string(user_id));
+    return response;
+}
+
+HttpResponse ConcurrentCommentServer::AddComment(size_t user_id, string_view comment)
+{
+    Shard& shard = ShardOf(user_id);
+    uint64_t ticket = 0;
+    {
+        lock_guard<mutex> lock(shard.mutex);
+        User* user = FindUser(shard, user_id);
+        if (!user)
+        {
+            return HttpResponse(HttpCode::NotFound);
+        }
+
+        if (CountConsecutive(user_id) > 3)
+        {
+            user->banned = true;
+        }
+
+        if (user->banned)
+        {
+            HttpResponse response(HttpCode::Found);
+            response.AddHeader("Location", "/captcha");
+            return response;
+        }
+
+        if (journal)
+        {
+            ticket = journal->AddComment(user_id, comment);
+            // Also drops the tickets already synced, so that a user nobody reads keeps few
+            CommittedComments(*user);
+            user->unsynced.push_back(ticket);
+        }
+        user->comments.Append(comment);
+    }
+
+    // Waiting for the disk without the lock lets other requests of the shard join the sync
+    if (journal)
+    {
+        Commit(ticket);
+    }
+    return HttpResponse(HttpCode::Ok);
+}
+
+HttpResponse ConcurrentCommentServer::CheckCaptcha(size_t user_id, const string& answer)
+{
+    if (answer != "42")
+    {
+        HttpResponse response(HttpCode::Found);
+        response.AddHeader("Location", "/captcha");
+        return response;
+    }
+
+    Shard& shard = ShardOf(user_id);
+    lock_guard<mutex> lock(shard.mutex);
+    if (User* user = FindUser(shard, user_id))
+    {
+        user->banned = false;
+    }
+    ForgetLastComment(user_id);
+    return HttpResponse(HttpCode::Ok);
+}
+
+HttpResponse ConcurrentCommentServer::UserComments(size_t user_id, CommentRange range)
+{
+    // The views stay valid after the lock is released: appends only write past
+    // them, and the lock orders those writes after the ones the views cover
+    vector<string_view> parts;
+    {
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.mutex);
+        User* user = FindUser(shard, user_id);
+        if (!user)
+        {
+            return HttpResponse(HttpCode::NotFound);
+        }
+        // Comments whose events are not on disk yet are not shown
+        const size_t committed = CommittedComments(*user);
+        if (range.offset < committed)
+        {
+            user->comments.Slice(range.offset, min(range.limit, committed - range.offset), parts);
+        }
+    }
+
+    HttpResponse response(HttpCode::Ok);
+    response.SetContentView(move(parts));
+    return response;
+}
+
+size_t ConcurrentCommentServer::CountConsecutive(size_t user_id)
+{
+    uint64_t last = last_comment.load(memory_order_relaxed);
+    uint64_t next;
+    do
+    {
+        if (last != NO_LAST_COMMENT && (last >> COUNT_BITS) == user_id)
+        {
+            next = (last & COUNT_MASK) == COUNT_MASK ? last : last + 1;
+        }
+        else
+        {
+            next = (uint64_t(user_id) << COUNT_BITS) | 1;
+        }
+    } while (!last_comment.compare_exchange_weak(last, next, memory_order_acq_rel, memory_order_relaxed));
+    return next & COUNT_MASK;
+}
+
+void ConcurrentCommentServer::ForgetLastComment(size_t user_id)
+{
+    uint64_t last = last_comment.load(memory_order_relaxed);
+    while (last != NO_LAST_COMMENT && (last >> COUNT_BITS) == user_id)
+    {
+        if (last_comment.compare_exchange_weak(last, NO_LAST_COMMENT, memory_order_acq_rel, memory_order_relaxed))
+        {
+            break;
+        }
+    }
+}
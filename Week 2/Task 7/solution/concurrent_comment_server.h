@@ -0,0 +1,92 @@
+#pragma once
+
+#include "comment_journal.h"
+#include "comment_server.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// CommentServer that can be called from any number of threads. Users are
+// striped over SHARD_COUNT shards by id and every shard guards its users with
+// its own mutex, so requests about different users rarely wait for each other.
+//
+// The spam rule is global: a user is banned when more than three comments in a
+// row, over all users, are theirs. Under concurrency "in a row" means in the
+// order in which add_comment requests update the last commenter, which is a
+// single atomic word. A request updates it while holding the shard lock of its
+// user, so the update and the ban it implies take effect together with respect
+// to every other request about the same user, e.g. a captcha being solved.
+class ConcurrentCommentServer
+{
+public:
+    static constexpr std::size_t SHARD_COUNT = 64;
+
+    ConcurrentCommentServer() = default;
+    // Rebuilds the users and comments recorded in journal and records the new
+    // ones there. A request appends its event while it holds the lock of its
+    // user, so the journal has the events of a user in the order they took
+    // effect, and answers once the event is on disk; requests that wait
+    // together share one sync. Bans are not recorded, a restart starts over.
+    //
+    // Nothing is shown before its event is on disk: a user exists once its
+    // event is, and a comment is kept in the log from the start but only read
+    // once the journal has synced past its ticket. Once writing the journal
+    // fails the server throws for every request, like CommentServer.
+    explicit ConcurrentCommentServer(CommentJournal& journal);
+
+    HttpResponse ServeRequest(const HttpRequest& req);
+
+private:
+    struct User
+    {
+        bool exists = false;
+        bool banned = false;
+        CommentLog comments;
+        // Tickets of the last comments, oldest first, that may not be on disk yet
+        std::vector<std::uint64_t> unsynced;
+    };
+
+    // Padded so that shards do not share cache lines
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        // User id / SHARD_COUNT
+        std::vector<User> users;
+    };
+
+    // User id in the high 48 bits, saturated count of consecutive comments in the low 16
+    static constexpr std::uint64_t NO_LAST_COMMENT = ~std::uint64_t(0);
+    static constexpr unsigned COUNT_BITS = 16;
+    static constexpr std::uint64_t COUNT_MASK = (std::uint64_t(1) << COUNT_BITS) - 1;
+
+    // Compiled once and shared by all the servers
+    static const Router<ConcurrentCommentServer>& Routes();
+
+    Shard& ShardOf(std::size_t user_id);
+    // Must be called with the shard of user_id locked; nullptr for unknown users
+    User* FindUser(Shard& shard, std::size_t user_id);
+    // Must be called with the shard of user locked; the number of its comments on disk
+    std::size_t CommittedComments(User& user);
+    // Returns when the event of ticket is on disk, or throws and fails the server
+    void Commit(std::uint64_t ticket);
+
+    HttpResponse AddUser();
+    HttpResponse AddComment(std::size_t user_id, std::string_view comment);
+    HttpResponse CheckCaptcha(std::size_t user_id, const std::string& answer);
+    HttpResponse UserComments(std::size_t user_id, CommentRange range);
+
+    // Records a comment of user_id and returns how many comments in a row are theirs
+    std::size_t CountConsecutive(std::size_t user_id);
+    void ForgetLastComment(std::size_t user_id);
+
+    CommentJournal* journal = nullptr;
+    std::atomic<bool> journal_failed{ false };
+    std::atomic<std::size_t> user_count{ 0 };
+    std::atomic<std::uint64_t> last_comment{ NO_LAST_COMMENT };
+    Shard shards[SHARD_COUNT];
+};
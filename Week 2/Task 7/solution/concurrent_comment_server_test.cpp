@@ -0,0 +1,242 @@
+#include "comment_server.h"
+#include "concurrent_comment_server.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    string ToString(const HttpResponse& response)
+    {
+        ostringstream os;
+        os << response;
+        return os.str();
+    }
+
+    HttpRequest RandomRequest(mt19937& generator, size_t max_user)
+    {
+        uniform_int_distribution<size_t> user(0, max_user);
+        const string id = to_string(user(generator));
+        switch (uniform_int_distribution<int>(0, 6)(generator))
+        {
+        case 0:
+            return { "POST", "/add_user" };
+        case 1:
+        case 2:
+            return { "POST", "/add_comment", id + " comment " + to_string(generator() % 100) };
+        case 3:
+            return { "POST", "/checkcaptcha", id + (generator() % 2 ? " 42" : " 24") };
+        case 4:
+            return { "GET", "/user_comments", "", {{"user_id", id}} };
+        case 5:
+            return { "GET", "/captcha" };
+        default:
+            return { "GET", "/nothing" };
+        }
+    }
+
+    template <typename Server>
+    void Preload(Server& server, size_t users, size_t comments_per_user)
+    {
+        for (size_t user = 0; user < users; ++user)
+        {
+            server.ServeRequest({ "POST", "/add_user" });
+        }
+        for (size_t i = 0; i < comments_per_user; ++i)
+        {
+            for (size_t user = 0; user < users; ++user)
+            {
+                server.ServeRequest({ "POST", "/add_comment", to_string(user) + " preloaded comment " + to_string(i) });
+            }
+        }
+    }
+}
+
+void TestConcurrentCommentServerMatchesCommentServer()
+{
+    mt19937 generator(41);
+    for (int round = 0; round < 20; ++round)
+    {
+        CommentServer expected;
+        ConcurrentCommentServer actual;
+        // Few users so that runs of comments by the same user and bans are common
+        const size_t max_user = 1 + round % 5;
+        for (int i = 0; i < 500; ++i)
+        {
+            const HttpRequest request = RandomRequest(generator, max_user);
+            ASSERT_EQUAL(ToString(actual.ServeRequest(request)), ToString(expected.ServeRequest(request)));
+        }
+    }
+}
+
+void TestConcurrentCommentServerUnderContention()
+{
+    const size_t thread_count = 8;
+
+    // Concurrently added users get distinct consecutive ids
+    ConcurrentCommentServer server;
+    vector<vector<size_t>> ids(thread_count);
+    {
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 100; ++i)
+                {
+                    ids[t].push_back(FromString<size_t>(server.ServeRequest({ "POST", "/add_user" }).TakeContent()));
+                }
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+    }
+    vector<size_t> all_ids;
+    for (const auto& thread_ids : ids)
+    {
+        all_ids.insert(all_ids.end(), thread_ids.begin(), thread_ids.end());
+    }
+    sort(all_ids.begin(), all_ids.end());
+    for (size_t i = 0; i < all_ids.size(); ++i)
+    {
+        ASSERT_EQUAL(all_ids[i], i);
+    }
+
+    // Every thread comments as its own user. Whatever the interleaving, the
+    // first three comments of a user pass, and once a user is banned all the
+    // following ones are refused since nobody solves the captcha
+    const int comments_per_thread = 2000;
+    vector<vector<int>> codes(thread_count);
+    {
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < comments_per_thread; ++i)
+                {
+                    const string response = ToString(server.ServeRequest({ "POST", "/add_comment", to_string(t) + " c" + to_string(i) }));
+                    codes[t].push_back(response.find("302") != string::npos ? 302 : 200);
+                }
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+    }
+    for (size_t t = 0; t < thread_count; ++t)
+    {
+        const auto first_ban = find(codes[t].begin(), codes[t].end(), 302);
+        ASSERT(first_ban - codes[t].begin() >= 3);
+        ASSERT(all_of(first_ban, codes[t].end(), [](int code) { return code == 302; }));
+
+        const string stored = server.ServeRequest({ "GET", "/user_comments", "", {{"user_id", to_string(t)}} }).TakeContent();
+        ASSERT_EQUAL(static_cast<long>(count(stored.begin(), stored.end(), '\n')), first_ban - codes[t].begin());
+    }
+
+    // A lone writer among readers is banned exactly after its third comment
+    ConcurrentCommentServer quiet;
+    Preload(quiet, 64, 2);
+    vector<thread> readers;
+    for (size_t t = 0; t + 1 < thread_count; ++t)
+    {
+        readers.emplace_back([&quiet, t] {
+            for (int i = 0; i < 2000; ++i)
+            {
+                quiet.ServeRequest({ "GET", "/user_comments", "", {{"user_id", to_string((t + i) % 64)}} });
+            }
+        });
+    }
+    int passed = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        passed += ToString(quiet.ServeRequest({ "POST", "/add_comment", "5 spam" })).find("200") != string::npos;
+    }
+    for (thread& t : readers)
+    {
+        t.join();
+    }
+    ASSERT_EQUAL(passed, 3);
+}
+
+void BenchmarkConcurrentCommentServer()
+{
+    const size_t users = 1000;
+    const size_t total_requests = 400000;
+
+    // The requests are generated up front so that only serving is measured
+    mt19937 generator(7);
+    vector<HttpRequest> requests;
+    requests.reserve(total_requests);
+    for (size_t i = 0; i < total_requests; ++i)
+    {
+        const string id = to_string(generator() % users);
+        const unsigned kind = generator() % 10;
+        if (kind < 6)
+        {
+            requests.push_back({ "GET", "/user_comments", "", {{"user_id", id}} });
+        }
+        else if (kind < 8)
+        {
+            requests.push_back({ "POST", "/add_comment", id + " a comment of moderate length" });
+        }
+        else if (kind < 9)
+        {
+            requests.push_back({ "GET", "/captcha" });
+        }
+        else
+        {
+            requests.push_back({ "POST", "/checkcaptcha", id + " 42" });
+        }
+    }
+
+    auto run = [&requests](size_t thread_count, auto serve) {
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (size_t i = t; i < requests.size(); i += thread_count)
+                {
+                    serve(requests[i]);
+                }
+            });
+        }
+        for (thread& t : threads)
+        {
+            t.join();
+        }
+    };
+
+    for (size_t thread_count : { 1, 2, 4, 8 })
+    {
+        {
+            CommentServer server;
+            Preload(server, users, 5);
+            mutex server_mutex;
+            LOG_DURATION("CommentServer behind a mutex, " + to_string(thread_count) + " threads, 400k requests");
+            run(thread_count, [&](const HttpRequest& request) {
+                lock_guard<mutex> lock(server_mutex);
+                return server.ServeRequest(request);
+            });
+        }
+        {
+            ConcurrentCommentServer server;
+            Preload(server, users, 5);
+            LOG_DURATION("ConcurrentCommentServer, " + to_string(thread_count) + " threads, 400k requests");
+            run(thread_count, [&](const HttpRequest& request) {
+                return server.ServeRequest(request);
+            });
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#include "http_parser.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    constexpr std::string_view CRLF = "\r\n";
+    constexpr std::string_view HEAD_END = "\r\n\r\n";
+
+    bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+            [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+    }
+
+    std::string_view Trim(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        {
+            s.remove_prefix(1);
+        }
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    int HexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+}
+
+std::string DecodeQueryComponent(std::string_view component)
+{
+    std::string result;
+    result.reserve(component.size());
+    for (size_t i = 0; i < component.size(); ++i)
+    {
+        const char c = component[i];
+        if (c == '+')
+        {
+            result += ' ';
+        }
+        else if (c == '%' && i + 2 < component.size() && HexValue(component[i + 1]) >= 0 && HexValue(component[i + 2]) >= 0)
+        {
+            result += static_cast<char>(HexValue(component[i + 1]) * 16 + HexValue(component[i + 2]));
+            i += 2;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}
+
+HttpRequestParser::Status HttpRequestParser::Parse(std::string_view data)
+{
+    if (head_size == 0)
+    {
+        // The terminator may straddle the previous end of data
+        const size_t from = scanned < HEAD_END.size() ? 0 : scanned - (HEAD_END.size() - 1);
+        const size_t end = data.find(HEAD_END, from);
+        if (end == std::string_view::npos)
+        {
+            scanned = data.size();
+            return data.size() > MAX_HEAD_SIZE ? Status::Error : Status::Incomplete;
+        }
+        if (end + HEAD_END.size() > MAX_HEAD_SIZE || !ParseHead(data.substr(0, end)))
+        {
+            return Status::Error;
+        }
+        head_size = end + HEAD_END.size();
+    }
+
+    if (data.size() < head_size + content_length)
+    {
+        return Status::Incomplete;
+    }
+    request.body.assign(data.substr(head_size, content_length));
+    return Status::Complete;
+}
+
+const HttpRequest& HttpRequestParser::Request() const
+{
+    return request;
+}
+
+size_t HttpRequestParser::Consumed() const
+{
+    return head_size + content_length;
+}
+
+bool HttpRequestParser::KeepAlive() const
+{
+    return keep_alive;
+}
+
+void HttpRequestParser::Reset()
+{
+    scanned = 0;
+    head_size = 0;
+    content_length = 0;
+    keep_alive = true;
+    request.method.clear();
+    request.path.clear();
+    request.body.clear();
+    request.get_params.clear();
+}
+
+bool HttpRequestParser::ParseHead(std::string_view head)
+{
+    size_t line_end = head.find(CRLF);
+    std::string_view request_line = head.substr(0, line_end);
+
+    // METHOD SP request-target SP HTTP-version
+    const size_t first_space = request_line.find(' ');
+    const size_t last_space = request_line.rfind(' ');
+    if (first_space == std::string_view::npos || first_space == last_space)
+    {
+        return false;
+    }
+    const std::string_view method = request_line.substr(0, first_space);
+    const std::string_view target = request_line.substr(first_space + 1, last_space - first_space - 1);
+    const std::string_view version = request_line.substr(last_space + 1);
+    if (method.empty() || target.empty() || target.front() != '/')
+    {
+        return false;
+    }
+    if (version == "HTTP/1.0")
+    {
+        keep_alive = false;
+    }
+    else if (version != "HTTP/1.1")
+    {
+        return false;
+    }
+    request.method.assign(method);
+    ParseTarget(target);
+
+    while (line_end != std::string_view::npos)
+    {
+        const size_t line_start = line_end + CRLF.size();
+        line_end = head.find(CRLF, line_start);
+        if (!ParseHeader(head.substr(line_start, line_end == std::string_view::npos ? std::string_view::npos : line_end - line_start)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpRequestParser::ParseHeader(std::string_view line)
+{
+    const size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0)
+    {
+        return false;
+    }
+    const std::string_view name = line.substr(0, colon);
+    const std::string_view value = Trim(line.substr(colon + 1));
+
+    if (EqualsIgnoreCase(name, "Content-Length"))
+    {
+        if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; }))
+        {
+            return false;
+        }
+        content_length = 0;
+        for (char c : value)
+        {
+            content_length = content_length * 10 + (c - '0');
+        }
+        return content_length <= MAX_BODY_SIZE;
+    }
+    if (EqualsIgnoreCase(name, "Transfer-Encoding"))
+    {
+        return false;
+    }
+    if (EqualsIgnoreCase(name, "Connection"))
+    {
+        if (EqualsIgnoreCase(value, "close"))
+        {
+            keep_alive = false;
+        }
+        else if (EqualsIgnoreCase(value, "keep-alive"))
+        {
+            keep_alive = true;
+        }
+    }
+    return true;
+}
+
+void HttpRequestParser::ParseTarget(std::string_view target)
+{
+    const size_t question = target.find('?');
+    request.path.assign(target.substr(0, question));
+    if (question == std::string_view::npos)
+    {
+        return;
+    }
+
+    std::string_view query = target.substr(question + 1);
+    while (!query.empty())
+    {
+        const size_t amp = query.find('&');
+        const std::string_view pair = query.substr(0, amp);
+        query.remove_prefix(amp == std::string_view::npos ? query.size() : amp + 1);
+        if (pair.empty())
+        {
+            continue;
+        }
+        const size_t eq = pair.find('=');
+        const std::string_view name = pair.substr(0, eq);
+        const std::string_view value = eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+        request.get_params[DecodeQueryComponent(name)] = DecodeQueryComponent(value);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "comment_server.h"
+
+#include <cstddef>
+#include <string_view>
+
+// Incremental HTTP/1.1 request parser. The connection keeps appending what it
+// reads to its buffer and calls Parse with everything not consumed yet; the
+// parser remembers how far it has looked for the end of the head, so a request
+// trickling in byte by byte is not rescanned from the start every time.
+// Requests are framed by Content-Length only, chunked bodies are rejected.
+class HttpRequestParser
+{
+public:
+    enum class Status
+    {
+        Incomplete,
+        Complete,
+        Error,
+    };
+
+    static constexpr std::size_t MAX_HEAD_SIZE = 8 * 1024;
+    static constexpr std::size_t MAX_BODY_SIZE = 1024 * 1024;
+
+    // data has to start with the same bytes as on the previous call until
+    // Complete or Error is returned
+    Status Parse(std::string_view data);
+
+    // Valid after Complete, until Reset
+    const HttpRequest& Request() const;
+    std::size_t Consumed() const;
+    bool KeepAlive() const;
+
+    // Gets ready for the next request on the same connection
+    void Reset();
+
+private:
+    bool ParseHead(std::string_view head);
+    bool ParseHeader(std::string_view line);
+    void ParseTarget(std::string_view target);
+
+    std::size_t scanned = 0;
+    std::size_t head_size = 0;
+    std::size_t content_length = 0;
+    bool keep_alive = true;
+    HttpRequest request;
+};
+
+// Decodes %XX escapes and '+' of a query string component
+std::string DecodeQueryComponent(std::string_view component);
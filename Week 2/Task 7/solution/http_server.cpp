@@ -0,0 +1,546 @@
+#include "http_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <string_view>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+    // Reading stops while this much output waits for a slow reader, so a
+    // client pipelining without reading cannot make the server buffer forever
+    constexpr std::size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+    constexpr std::size_t READ_CHUNK = 64 * 1024;
+    // A peer that keeps sending after its connection was closed is cut off with a reset
+    constexpr std::size_t MAX_DRAINED_INPUT = 1024 * 1024;
+    constexpr std::size_t MAX_IOVECS = 64;
+    constexpr int MAX_EVENTS = 256;
+
+    constexpr std::string_view BAD_REQUEST =
+        "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    constexpr std::string_view INTERNAL_ERROR =
+        "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+    [[noreturn]] void ThrowSystemError(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    bool WouldBlock(int error)
+    {
+        return error == EAGAIN || error == EWOULDBLOCK;
+    }
+}
+
+HttpServer::HttpServer(Handler a_handler, std::uint16_t a_port, std::chrono::milliseconds a_idle_timeout) :
+    handler(std::move(a_handler)),
+    idle_timeout(a_idle_timeout),
+    // A connection outlives its deadline by at most a quarter of the timeout
+    sweep_interval(std::max(a_idle_timeout / 4, std::chrono::milliseconds(1))),
+    read_buffer(READ_CHUNK)
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        ThrowSystemError("socket");
+    }
+    const int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(a_port);
+    if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        const int error = errno;
+        close(listen_fd);
+        errno = error;
+        ThrowSystemError("bind");
+    }
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &length);
+    port = ntohs(address.sin_port);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0)
+    {
+        const int error = errno;
+        close(listen_fd);
+        close(epoll_fd);
+        close(wake_fd);
+        errno = error;
+        ThrowSystemError("epoll");
+    }
+
+    // The listening socket and the wake-up eventfd are told apart from connections by their data.ptr
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = &wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+}
+
+HttpServer::~HttpServer()
+{
+    for (auto& [fd, connection] : connections)
+    {
+        close(fd);
+    }
+    close(wake_fd);
+    close(epoll_fd);
+    close(listen_fd);
+}
+
+std::uint16_t HttpServer::Port() const
+{
+    return port;
+}
+
+void HttpServer::SetCommit(std::function<void()> a_commit)
+{
+    commit = std::move(a_commit);
+}
+
+void HttpServer::Stop()
+{
+    const std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(wake_fd, &one, sizeof(one));
+}
+
+void HttpServer::Run()
+{
+    epoll_event events[MAX_EVENTS];
+    stopping = false;
+    now = std::chrono::steady_clock::now();
+    next_sweep = now + sweep_interval;
+    while (!stopping)
+    {
+        // Without connections there is nothing to sweep and no reason to wake
+        // up, unless accepting waits for descriptors that may be freed elsewhere
+        int timeout = -1;
+        if (!connections.empty() || accept_paused)
+        {
+            timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(
+                std::chrono::ceil<std::chrono::milliseconds>(next_sweep - now).count(), 0));
+        }
+        const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        now = std::chrono::steady_clock::now();
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ThrowSystemError("epoll_wait");
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (events[i].data.ptr == &listen_fd)
+            {
+                Accept();
+                continue;
+            }
+            if (events[i].data.ptr == &wake_fd)
+            {
+                std::uint64_t value;
+                [[maybe_unused]] ssize_t read_bytes = read(wake_fd, &value, sizeof(value));
+                stopping = true;
+                continue;
+            }
+
+            auto& connection = *static_cast<Connection*>(events[i].data.ptr);
+            if (connection.dead)
+            {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                connection.read_blocked = false;
+            }
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP))
+            {
+                connection.hang_up_reported = true;
+            }
+            if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            {
+                connection.write_blocked = false;
+            }
+            ready.push_back(&connection);
+        }
+
+        // All the requests that came in are handled before the first answer
+        // goes out, so the commit before it covers them all
+        for (Connection* connection : ready)
+        {
+            Receive(*connection);
+        }
+        for (Connection* connection : ready)
+        {
+            Service(*connection);
+        }
+        ready.clear();
+        // Answers that could not be written yet are committed too, a closed
+        // connection must not stay in the list past the batch
+        Commit();
+
+        if (now >= next_sweep)
+        {
+            Sweep();
+            if (accept_paused)
+            {
+                ResumeAccept();
+            }
+            next_sweep = now + sweep_interval;
+        }
+        closed.clear();
+    }
+}
+
+void HttpServer::Accept()
+{
+    while (true)
+    {
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // The connection stays in the backlog, and the listening socket,
+            // being level-triggered, would be reported ready at once again
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                PauseAccept();
+            }
+            // EAGAIN ends the backlog; anything else is retried on the next event
+            return;
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->deadline = now + idle_timeout;
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection.get();
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close(fd);
+            continue;
+        }
+        connections[fd] = std::move(connection);
+    }
+}
+
+void HttpServer::PauseAccept()
+{
+    epoll_event event = {};
+    event.data.ptr = &listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &event);
+    accept_paused = true;
+}
+
+void HttpServer::ResumeAccept()
+{
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_fd, &event);
+    accept_paused = false;
+}
+
+void HttpServer::Service(Connection& connection)
+{
+    bool progress = true;
+    bool active = false;
+    while (progress && !connection.dead)
+    {
+        progress = Read(connection);
+        progress |= Process(connection);
+        progress |= Flush(connection);
+        active |= progress;
+    }
+    if (active && !connection.draining)
+    {
+        connection.deadline = now + idle_timeout;
+    }
+
+    if (!connection.dead && connection.output.Empty())
+    {
+        if (connection.peer_closed)
+        {
+            connection.dead = connection.read_blocked || connection.closing;
+        }
+        else if (connection.closing)
+        {
+            if (!connection.draining)
+            {
+                shutdown(connection.fd, SHUT_WR);
+                connection.draining = true;
+                // What the peer keeps sending does not extend this one
+                connection.deadline = now + std::min(idle_timeout, LINGER_TIMEOUT);
+            }
+            Drain(connection);
+        }
+    }
+    if (connection.dead)
+    {
+        Close(connection);
+    }
+}
+
+void HttpServer::Receive(Connection& connection)
+{
+    bool progress = true;
+    while (progress && !connection.dead)
+    {
+        progress = Read(connection);
+        progress |= Process(connection);
+        if (progress)
+        {
+            connection.deadline = now + idle_timeout;
+        }
+    }
+}
+
+bool HttpServer::Read(Connection& connection)
+{
+    if (connection.read_blocked || connection.peer_closed || connection.closing || connection.output.Size() >= MAX_PENDING_OUTPUT)
+    {
+        return false;
+    }
+
+    const ssize_t count = read(connection.fd, read_buffer.data(), read_buffer.size());
+    if (count > 0)
+    {
+        connection.input.append(read_buffer.data(), count);
+        // A short read drained the socket; more data arriving later raises a new edge
+        connection.read_blocked = static_cast<size_t>(count) < read_buffer.size() && !connection.hang_up_reported;
+        return true;
+    }
+    if (count == 0)
+    {
+        connection.peer_closed = true;
+        connection.read_blocked = true;
+    }
+    else if (WouldBlock(errno))
+    {
+        connection.read_blocked = true;
+    }
+    else if (errno != EINTR)
+    {
+        connection.dead = true;
+    }
+    return false;
+}
+
+void HttpServer::Drain(Connection& connection)
+{
+    while (!connection.read_blocked)
+    {
+        const ssize_t count = read(connection.fd, read_buffer.data(), read_buffer.size());
+        if (count > 0)
+        {
+            connection.drained_bytes += count;
+            if (connection.drained_bytes > MAX_DRAINED_INPUT)
+            {
+                connection.dead = true;
+                return;
+            }
+        }
+        else if (count == 0 || !(WouldBlock(errno) || errno == EINTR))
+        {
+            connection.dead = true;
+            return;
+        }
+        else if (errno != EINTR)
+        {
+            connection.read_blocked = true;
+        }
+    }
+}
+
+bool HttpServer::Process(Connection& connection)
+{
+    bool progress = false;
+    while (!connection.closing && connection.output.Size() < MAX_PENDING_OUTPUT)
+    {
+        const std::string_view unparsed = std::string_view(connection.input).substr(connection.input_offset);
+        if (unparsed.empty())
+        {
+            break;
+        }
+
+        const auto status = connection.parser.Parse(unparsed);
+        if (status == HttpRequestParser::Status::Incomplete)
+        {
+            break;
+        }
+
+        if (status == HttpRequestParser::Status::Error)
+        {
+            connection.output.PushRaw(BAD_REQUEST);
+            connection.closing = true;
+        }
+        else
+        {
+            const bool keep_alive = connection.parser.KeepAlive();
+            try
+            {
+                HttpResponse response = handler(connection.parser.Request());
+                connection.output.Push(response, keep_alive);
+                // Errors are answered without a commit, they have recorded nothing
+                if (commit && !connection.uncommitted)
+                {
+                    connection.uncommitted = true;
+                    uncommitted.push_back(&connection);
+                }
+            }
+            catch (const std::exception&)
+            {
+                connection.output.PushRaw(INTERNAL_ERROR);
+                connection.closing = true;
+            }
+            connection.closing |= !keep_alive;
+            connection.input_offset += connection.parser.Consumed();
+            connection.parser.Reset();
+        }
+        progress = true;
+    }
+
+    // Drop the consumed prefix once it is most of the buffer so the copy is amortized
+    std::string& input = connection.input;
+    if (connection.input_offset == input.size())
+    {
+        input.clear();
+        connection.input_offset = 0;
+    }
+    else if (connection.input_offset > input.size() / 2)
+    {
+        input.erase(0, connection.input_offset);
+        connection.input_offset = 0;
+    }
+    return progress;
+}
+
+void HttpServer::Commit()
+{
+    if (uncommitted.empty())
+    {
+        return;
+    }
+    bool failed = false;
+    try
+    {
+        commit();
+    }
+    catch (const std::exception&)
+    {
+        failed = true;
+    }
+    for (Connection* connection : uncommitted)
+    {
+        connection->uncommitted = false;
+        if (failed)
+        {
+            Close(*connection);
+        }
+    }
+    uncommitted.clear();
+}
+
+bool HttpServer::Flush(Connection& connection)
+{
+    if (connection.write_blocked || connection.output.Empty())
+    {
+        return false;
+    }
+    Commit();
+    if (connection.dead)
+    {
+        return false;
+    }
+
+    iovec iov[MAX_IOVECS];
+    const size_t iov_count = connection.output.Gather(iov, MAX_IOVECS);
+
+    // writev with MSG_NOSIGNAL, so a peer that went away gives EPIPE instead of SIGPIPE
+    msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = iov_count;
+    const ssize_t count = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+    if (count < 0)
+    {
+        if (WouldBlock(errno))
+        {
+            connection.write_blocked = true;
+        }
+        else if (errno != EINTR)
+        {
+            connection.dead = true;
+        }
+        return false;
+    }
+
+    size_t requested = 0;
+    for (size_t i = 0; i < iov_count; ++i)
+    {
+        requested += iov[i].iov_len;
+    }
+    connection.write_blocked = static_cast<size_t>(count) < requested;
+
+    connection.output.Consume(count);
+    return count > 0;
+}
+
+void HttpServer::Close(Connection& connection)
+{
+    if (connection.fd < 0)
+    {
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    close(connection.fd);
+    auto it = connections.find(connection.fd);
+    closed.push_back(std::move(it->second));
+    connections.erase(it);
+    connection.fd = -1;
+    connection.dead = true;
+    // The descriptor just freed can take a connection waiting in the backlog
+    if (accept_paused)
+    {
+        ResumeAccept();
+    }
+}
+
+void HttpServer::Sweep()
+{
+    std::vector<Connection*> expired;
+    for (auto& [fd, connection] : connections)
+    {
+        if (connection->deadline <= now)
+        {
+            expired.push_back(connection.get());
+        }
+    }
+    for (Connection* connection : expired)
+    {
+        Close(*connection);
+    }
+}
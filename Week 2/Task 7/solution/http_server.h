@@ -0,0 +1,134 @@
+#pragma once
+
+#include "comment_server.h"
+#include "http_parser.h"
+#include "response_queue.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded HTTP/1.1 front end on 127.0.0.1 built on edge-triggered
+// epoll and non-blocking sockets (Linux only). Connections are kept alive and
+// may pipeline: every complete request in the input buffer is handed to the
+// handler in order, and the responses are written with one scatter-gather call
+// over the heads and the untouched bodies of as many of them as are queued
+// (see ResponseQueue).
+//
+// Every ready connection is read and its requests handled before any answer
+// goes out, so a commit hook (see SetCommit) called before sending covers the
+// requests of all of them at once.
+//
+// A connection that reads or writes nothing for the idle timeout is closed,
+// and so is one still lingering after its last response for LINGER_TIMEOUT
+// or the idle timeout, whichever is shorter.
+//
+// When the process runs out of file descriptors, new connections wait in the
+// backlog: the listening socket is not watched until a connection closes or
+// the next sweep, rather than being reported ready again and again.
+class HttpServer
+{
+public:
+    using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+    static constexpr std::chrono::milliseconds DEFAULT_IDLE_TIMEOUT{ 30000 };
+    static constexpr std::chrono::milliseconds LINGER_TIMEOUT{ 2000 };
+
+    // Port 0 lets the system pick a free one, see Port().
+    // Throws std::system_error when the socket cannot be set up.
+    explicit HttpServer(Handler handler, std::uint16_t port = 0, std::chrono::milliseconds idle_timeout = DEFAULT_IDLE_TIMEOUT);
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator = (const HttpServer&) = delete;
+
+    std::uint16_t Port() const;
+
+    // commit is called before answers go out when requests were handled since
+    // its last call, e.g. to make what they recorded durable with one sync.
+    // If it throws, the connections with answers it was to cover are closed
+    // without them. Must be set before Run.
+    void SetCommit(std::function<void()> commit);
+
+    // Serves connections until Stop is called
+    void Run();
+    // May be called from any thread
+    void Stop();
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+        std::string input;
+        std::size_t input_offset = 0;
+        HttpRequestParser parser;
+
+        ResponseQueue output;
+
+        // Edge-triggered readiness: set when a call would block, cleared by the next event
+        bool read_blocked = false;
+        bool write_blocked = false;
+        // The peer's FIN has been announced; it raises no new edge once reported,
+        // so from then on reads go on until they return 0
+        bool hang_up_reported = false;
+        bool peer_closed = false;
+        // No more requests are read after a Connection: close or a bad request
+        bool closing = false;
+        // Once the last response is out the write side is shut down and the input is
+        // discarded until the peer closes; closing with unread input would send a
+        // reset that may destroy the responses the peer has not read yet
+        bool draining = false;
+        std::size_t drained_bytes = 0;
+        bool dead = false;
+        // Has answers the next commit has to cover
+        bool uncommitted = false;
+
+        // Pushed back by every read or write until the connection lingers
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void Accept();
+    void PauseAccept();
+    void ResumeAccept();
+    void Service(Connection& connection);
+    // Reads and handles requests without answering them
+    void Receive(Connection& connection);
+    bool Read(Connection& connection);
+    void Drain(Connection& connection);
+    bool Process(Connection& connection);
+    void Commit();
+    bool Flush(Connection& connection);
+    void Close(Connection& connection);
+    // Closes the connections past their deadline
+    void Sweep();
+
+    Handler handler;
+    std::function<void()> commit;
+    std::chrono::milliseconds idle_timeout;
+    std::chrono::milliseconds sweep_interval;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::uint16_t port = 0;
+    bool stopping = false;
+    // The listening socket is out of the epoll set until a descriptor may be free
+    bool accept_paused = false;
+    // Taken once per event batch
+    std::chrono::steady_clock::time_point now;
+    std::chrono::steady_clock::time_point next_sweep;
+
+    // Every read lands here first and only what arrived is appended to the connection
+    std::vector<char> read_buffer;
+    // Connections with events in the current batch, and those of them with uncommitted answers
+    std::vector<Connection*> ready;
+    std::vector<Connection*> uncommitted;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    // Kept alive until the end of the event batch, which may still point to them
+    std::vector<std::unique_ptr<Connection>> closed;
+};
@@ -0,0 +1,529 @@
+#include "comment_journal.h"
+#include "comment_server.h"
+#include "http_parser.h"
+#include "http_server.h"
+#include "load_generator.h"
+
+#include <ostream>
+#include <string>
+#include <utility>
+
+// Has to be declared before the printers of test_runner.h use it
+std::ostream& operator << (std::ostream& os, const std::pair<std::string, std::string>& header)
+{
+    return os << header.first << ": " << header.second;
+}
+
+#include "test_runner.h"
+#include "temp_file.h"
+
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    using Status = HttpRequestParser::Status;
+
+    struct WireResponse
+    {
+        int code = 0;
+        vector<pair<string, string>> headers;
+        string content;
+    };
+
+    // Reads responses framed by Content-Length until the data runs out
+    vector<WireResponse> ParseWireResponses(string_view data)
+    {
+        vector<WireResponse> result;
+        while (!data.empty())
+        {
+            const size_t head_end = data.find("\r\n\r\n");
+            ASSERT(head_end != string_view::npos);
+            string_view head = data.substr(0, head_end);
+
+            WireResponse response;
+            response.code = stoi(string(head.substr(9, 3)));
+            size_t content_length = 0;
+            for (size_t line = head.find("\r\n"); line != string_view::npos; )
+            {
+                const size_t next = head.find("\r\n", line + 2);
+                const string_view header = head.substr(line + 2, next == string_view::npos ? string_view::npos : next - line - 2);
+                const size_t colon = header.find(": ");
+                string name(header.substr(0, colon));
+                string value(header.substr(colon + 2));
+                if (name == "Content-Length")
+                {
+                    content_length = stoul(value);
+                }
+                else
+                {
+                    response.headers.emplace_back(move(name), move(value));
+                }
+                line = next;
+            }
+            ASSERT(data.size() >= head_end + 4 + content_length);
+            response.content = string(data.substr(head_end + 4, content_length));
+            result.push_back(move(response));
+            data.remove_prefix(head_end + 4 + content_length);
+        }
+        return result;
+    }
+
+    int ConnectTo(uint16_t port)
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        ASSERT(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+        return fd;
+    }
+
+    // Gives up quietly when the server has closed the connection
+    void SendAll(int fd, string_view data)
+    {
+        while (!data.empty())
+        {
+            const ssize_t count = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (count <= 0)
+            {
+                return;
+            }
+            data.remove_prefix(count);
+        }
+    }
+
+    string ReadUntilClosed(int fd)
+    {
+        string result;
+        char buffer[4096];
+        while (true)
+        {
+            const ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count <= 0)
+            {
+                break;
+            }
+            result.append(buffer, count);
+        }
+        return result;
+    }
+
+    // Sends the requests in pieces of at most chunk bytes and returns what came
+    // back until the server closed the connection. Sending runs in its own thread
+    // because the server stops reading while the client does not read its answers.
+    string Exchange(uint16_t port, const string& requests, size_t chunk = string::npos)
+    {
+        const int fd = ConnectTo(port);
+        std::thread sender([&] {
+            for (size_t i = 0; i < requests.size(); i += chunk)
+            {
+                SendAll(fd, string_view(requests).substr(i, chunk));
+            }
+        });
+        string result = ReadUntilClosed(fd);
+        sender.join();
+        close(fd);
+        return result;
+    }
+
+    class ServerThread
+    {
+    public:
+        explicit ServerThread(HttpServer::Handler handler, chrono::milliseconds idle_timeout = HttpServer::DEFAULT_IDLE_TIMEOUT,
+            function<void()> commit = {}) :
+            server(move(handler), 0, idle_timeout),
+            thread([this, commit = move(commit)]() mutable {
+                if (commit)
+                {
+                    server.SetCommit(move(commit));
+                }
+                server.Run();
+            })
+        {}
+
+        ~ServerThread()
+        {
+            server.Stop();
+            thread.join();
+        }
+
+        uint16_t Port() const
+        {
+            return server.Port();
+        }
+
+    private:
+        HttpServer server;
+        std::thread thread;
+    };
+
+    string Get(const string& target, string_view extra_headers = "")
+    {
+        return "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n" + string(extra_headers) + "\r\n";
+    }
+
+    string Post(const string& target, const string& body, string_view extra_headers = "")
+    {
+        return "POST " + target + " HTTP/1.1\r\nHost: localhost\r\nContent-Length: " + to_string(body.size())
+            + "\r\n" + string(extra_headers) + "\r\n" + body;
+    }
+}
+
+void TestHttpRequestParser()
+{
+    {
+        const string data = Post("/add_comment?x=1&user_id=%31+2&flag", "0 Hello");
+        HttpRequestParser parser;
+        // Every prefix is incomplete, the parser must not lose its place between calls
+        for (size_t i = 1; i < data.size(); ++i)
+        {
+            ASSERT(parser.Parse(string_view(data).substr(0, i)) == Status::Incomplete);
+        }
+        ASSERT(parser.Parse(data) == Status::Complete);
+        ASSERT_EQUAL(parser.Consumed(), data.size());
+        ASSERT(parser.KeepAlive());
+        const HttpRequest& request = parser.Request();
+        ASSERT_EQUAL(request.method, "POST");
+        ASSERT_EQUAL(request.path, "/add_comment");
+        ASSERT_EQUAL(request.body, "0 Hello");
+        ASSERT_EQUAL(request.get_params, (map<string, string>{ {"x", "1"}, {"user_id", "1 2"}, {"flag", ""} }));
+    }
+    {
+        const string first = Get("/captcha");
+        const string data = first + Get("/user_comments?user_id=0", "Connection: close\r\n");
+        HttpRequestParser parser;
+        ASSERT(parser.Parse(data) == Status::Complete);
+        ASSERT_EQUAL(parser.Consumed(), first.size());
+        ASSERT_EQUAL(parser.Request().path, "/captcha");
+        ASSERT(parser.Request().get_params.empty());
+        parser.Reset();
+        ASSERT(parser.Parse(string_view(data).substr(first.size())) == Status::Complete);
+        ASSERT_EQUAL(parser.Request().get_params.at("user_id"), "0");
+        ASSERT(!parser.KeepAlive());
+    }
+    {
+        HttpRequestParser parser;
+        ASSERT(parser.Parse("GET / HTTP/1.0\r\n\r\n") == Status::Complete);
+        ASSERT(!parser.KeepAlive());
+        parser.Reset();
+        ASSERT(parser.Parse("GET / HTTP/1.0\r\nconnection: Keep-Alive\r\n\r\n") == Status::Complete);
+        ASSERT(parser.KeepAlive());
+    }
+    for (const string& bad : {
+        string("GET /\r\n\r\n"),
+        string("GET / HTTP/2.0\r\n\r\n"),
+        string("GET nopath HTTP/1.1\r\n\r\n"),
+        string("GET / HTTP/1.1\r\nno colon\r\n\r\n"),
+        string("POST / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n"),
+        string("POST / HTTP/1.1\r\nContent-Length: 2000000\r\n\r\n"),
+        string("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"),
+        "GET / HTTP/1.1\r\nX: " + string(HttpRequestParser::MAX_HEAD_SIZE, 'x'),
+    })
+    {
+        HttpRequestParser parser;
+        ASSERT(parser.Parse(bad) == Status::Error);
+    }
+}
+
+void TestHttpServerServesCommentServer()
+{
+    CommentServer comments;
+    ServerThread server([&comments](const HttpRequest& request) { return comments.ServeRequest(request); });
+
+    // The whole session pipelined in one connection, the last request asks to close it
+    const string session =
+        Post("/add_user", "") +
+        Post("/add_user", "") +
+        Post("/add_comment", "0 Hello") +
+        Post("/add_comment", "1 Hi") +
+        Post("/add_comment", "1 Buy my goods") +
+        Post("/add_comment", "1 Enlarge") +
+        Post("/add_comment", "1 Buy my goods") +
+        Post("/add_comment", "0 What are you selling?") +
+        Get("/user_comments?user_id=0") +
+        Get("/captcha") +
+        Post("/checkcaptcha", "1 42") +
+        Get("/user_comments?user_id=1") +
+        Get("/user_commntes") +
+        Get("/user_comments?user_id=7", "Connection: close\r\n");
+
+    const vector<WireResponse> responses = ParseWireResponses(Exchange(server.Port(), session));
+    vector<int> codes;
+    for (const WireResponse& response : responses)
+    {
+        codes.push_back(response.code);
+    }
+    ASSERT_EQUAL(codes, (vector<int>{ 200, 200, 200, 200, 200, 200, 302, 200, 200, 200, 200, 200, 404, 404 }));
+    ASSERT_EQUAL(responses[1].content, "1");
+    ASSERT_EQUAL(responses[6].headers, (vector<pair<string, string>>{ {"Location", "/captcha"} }));
+    ASSERT_EQUAL(responses[8].content, "Hello\nWhat are you selling?\n");
+    ASSERT_EQUAL(responses[11].content, "Hi\nBuy my goods\nEnlarge\n");
+    ASSERT_EQUAL(responses.back().headers, (vector<pair<string, string>>{ {"Connection", "close"} }));
+
+    // The same requests arriving a few bytes at a time give the same answers
+    const string slow = Get("/captcha") + Get("/user_comments?user_id=0", "Connection: close\r\n");
+    const vector<WireResponse> slow_responses = ParseWireResponses(Exchange(server.Port(), slow, 3));
+    ASSERT_EQUAL(slow_responses.size(), 2u);
+    ASSERT_EQUAL(slow_responses[1].content, "Hello\nWhat are you selling?\n");
+}
+
+void TestHttpServerErrors()
+{
+    ServerThread server([](const HttpRequest& request) {
+        if (request.path == "/throw")
+        {
+            throw runtime_error("handler failed");
+        }
+        return HttpResponse(HttpCode::Ok).SetContent(request.body);
+    });
+
+    // A bad request is answered and ends the connection, what follows it is ignored
+    {
+        const vector<WireResponse> responses = ParseWireResponses(
+            Exchange(server.Port(), Post("/", "ok") + "BROKEN\r\n\r\n" + Post("/", "lost")));
+        ASSERT_EQUAL(responses.size(), 2u);
+        ASSERT_EQUAL(responses[0].content, "ok");
+        ASSERT_EQUAL(responses[1].code, 400);
+    }
+    {
+        const vector<WireResponse> responses = ParseWireResponses(Exchange(server.Port(), Get("/throw") + Get("/")));
+        ASSERT_EQUAL(responses.size(), 1u);
+        ASSERT_EQUAL(responses[0].code, 500);
+    }
+    // A client closing its side still gets the answers to what it has sent
+    {
+        const int fd = ConnectTo(server.Port());
+        SendAll(fd, Post("/", "a") + Post("/", "b") + Get("/", "Content-Length: 5\r\n") + "abc");
+        shutdown(fd, SHUT_WR);
+        const vector<WireResponse> responses = ParseWireResponses(ReadUntilClosed(fd));
+        close(fd);
+        ASSERT_EQUAL(responses.size(), 2u);
+        ASSERT_EQUAL(responses[1].content, "b");
+    }
+    // A large pipelined burst exceeds the output limit and has to be served in rounds
+    {
+        const string body(100 * 1024, 'x');
+        string burst;
+        for (int i = 0; i < 40; ++i)
+        {
+            burst += Post("/", body);
+        }
+        burst += Post("/", "last", "Connection: close\r\n");
+        const vector<WireResponse> responses = ParseWireResponses(Exchange(server.Port(), burst));
+        ASSERT_EQUAL(responses.size(), 41u);
+        ASSERT_EQUAL(responses[17].content, body);
+        ASSERT_EQUAL(responses.back().content, "last");
+    }
+}
+
+void TestHttpServerClosesIdleConnections()
+{
+    ServerThread server([](const HttpRequest& request) {
+        return HttpResponse(HttpCode::Ok).SetContent(request.body);
+    }, chrono::milliseconds(100));
+
+    // A silent client and one stuck half way through a request are cut off
+    // without an answer
+    for (const string& sent : { string(), string("GET / HTTP/1.1\r\nHost: loc") })
+    {
+        const int fd = ConnectTo(server.Port());
+        SendAll(fd, sent);
+        ASSERT_EQUAL(ReadUntilClosed(fd), "");
+        close(fd);
+    }
+
+    // The timeout counts from the last request, not from the connection
+    {
+        const int fd = ConnectTo(server.Port());
+        for (int i = 0; i < 5; ++i)
+        {
+            this_thread::sleep_for(chrono::milliseconds(50));
+            SendAll(fd, Post("/", "ping"));
+            string received;
+            char buffer[256];
+            while (received.find("ping") == string::npos)
+            {
+                const ssize_t count = read(fd, buffer, sizeof(buffer));
+                ASSERT(count > 0);
+                received.append(buffer, count);
+            }
+        }
+        close(fd);
+    }
+
+    // A client that does not close after its last response is cut off too,
+    // even while it keeps sending
+    {
+        const int fd = ConnectTo(server.Port());
+        SendAll(fd, Post("/", "bye", "Connection: close\r\n"));
+        ASSERT_EQUAL(ParseWireResponses(ReadUntilClosed(fd)).size(), 1u);
+        bool cut_off = false;
+        for (int i = 0; i < 100 && !cut_off; ++i)
+        {
+            cut_off = send(fd, "x", 1, MSG_NOSIGNAL) < 0;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        ASSERT(cut_off);
+        close(fd);
+    }
+}
+
+void TestHttpServerWaitsForFreeDescriptors()
+{
+    ServerThread server([](const HttpRequest& request) {
+        return HttpResponse(HttpCode::Ok).SetContent(request.body);
+    });
+
+    const int first = ConnectTo(server.Port());
+    SendAll(first, Post("/", "first"));
+    char buffer[256];
+    ASSERT(read(first, buffer, sizeof(buffer)) > 0);
+
+    // From here on the process has no descriptor to spare, so the server
+    // cannot accept the second connection until the first one is closed
+    const int second = socket(AF_INET, SOCK_STREAM, 0);
+    const int lowest_free = dup(0);
+    close(lowest_free);
+    rlimit old_limit;
+    ASSERT(getrlimit(RLIMIT_NOFILE, &old_limit) == 0);
+    rlimit limit = old_limit;
+    limit.rlim_cur = lowest_free;
+    ASSERT(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(server.Port());
+    const bool connected = connect(second, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    SendAll(second, Post("/", "second"));
+
+    // A server that kept retrying would burn the CPU while the test sleeps
+    const clock_t cpu_before = clock();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    const double cpu_ms = 1000.0 * (clock() - cpu_before) / CLOCKS_PER_SEC;
+
+    // Gives up after a while instead of hanging if the answer never comes
+    const timeval read_timeout{ 5, 0 };
+    setsockopt(second, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout));
+    close(first);
+    string received;
+    while (received.find("second") == string::npos)
+    {
+        const ssize_t count = read(second, buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            break;
+        }
+        received.append(buffer, count);
+    }
+    setrlimit(RLIMIT_NOFILE, &old_limit);
+    close(second);
+
+    ASSERT(connected);
+    ASSERT(cpu_ms < 100);
+    const vector<WireResponse> responses = ParseWireResponses(received);
+    ASSERT_EQUAL(responses.size(), 1u);
+    ASSERT_EQUAL(responses[0].content, "second");
+}
+
+void TestHttpServerCommitsInGroups()
+{
+    TempFile file;
+
+    // Comments of users in turn, so the spam rule does not ban anyone
+    const size_t user_count = 10;
+    const size_t comment_count = 100;
+    string session;
+    for (size_t user = 0; user < user_count; ++user)
+    {
+        session += Post("/add_user", "");
+    }
+    for (size_t i = 0; i < comment_count; ++i)
+    {
+        session += Post("/add_comment", to_string(i % user_count) + " comment " + to_string(i));
+    }
+    session += Get("/user_comments?user_id=3", "Connection: close\r\n");
+
+    {
+        CommentJournal journal(file.Path());
+        CommentServer comments(journal, CommentServer::CommitMode::Deferred);
+        const size_t syncs_before = journal.SyncCount();
+        ServerThread server([&comments](const HttpRequest& request) { return comments.ServeRequest(request); },
+            HttpServer::DEFAULT_IDLE_TIMEOUT, [&comments] { comments.Commit(); });
+
+        const vector<WireResponse> responses = ParseWireResponses(Exchange(server.Port(), session));
+        ASSERT_EQUAL(responses.size(), user_count + comment_count + 1);
+        for (const WireResponse& response : responses)
+        {
+            ASSERT_EQUAL(response.code, 200);
+        }
+        // The pipelined requests arrive in a few reads and share their syncs
+        const size_t syncs = journal.SyncCount() - syncs_before;
+        ASSERT(syncs >= 1);
+        ASSERT(syncs < (user_count + comment_count) / 4);
+    }
+    {
+        CommentJournal journal(file.Path());
+        CommentServer comments(journal);
+        ASSERT_EQUAL(comments.ServeRequest({ "GET", "/user_comments", "", {{"user_id", "3"}} }).GetContent(),
+            "comment 3\ncomment 13\ncomment 23\ncomment 33\ncomment 43\ncomment 53\ncomment 63\ncomment 73\ncomment 83\ncomment 93\n");
+    }
+
+    // When the commit fails the answers it was to cover are never sent
+    ServerThread failing([](const HttpRequest& request) { return HttpResponse(HttpCode::Ok).SetContent(request.body); },
+        HttpServer::DEFAULT_IDLE_TIMEOUT, [] { throw runtime_error("commit failed"); });
+    ASSERT_EQUAL(Exchange(failing.Port(), Post("/", "a") + Post("/", "b", "Connection: close\r\n")), "");
+}
+
+void BenchmarkHttpServer()
+{
+    // A mix that does not grow the server state, so every configuration sees the same responses
+    LoadOptions options;
+    options.total_requests = 200000;
+    for (int i = 0; i < 100; ++i)
+    {
+        options.requests.push_back(Get("/user_comments?user_id=" + to_string((i * 37) % 100)));
+        options.requests.push_back(Get("/captcha"));
+        options.requests.push_back(Post("/checkcaptcha", to_string(i) + " 42"));
+    }
+
+    for (auto [connections, depth] : vector<pair<size_t, size_t>>{ {1, 1}, {16, 1}, {64, 1}, {16, 16} })
+    {
+        CommentServer comments;
+        for (int user = 0; user < 100; ++user)
+        {
+            comments.ServeRequest({ "POST", "/add_user" });
+            for (int i = 0; i < 10; ++i)
+            {
+                comments.ServeRequest({ "POST", "/add_comment", to_string(user) + " Comment number " + to_string(i) });
+                comments.ServeRequest({ "POST", "/checkcaptcha", to_string(user) + " 42" });
+            }
+        }
+        ServerThread server([&comments](const HttpRequest& request) { return comments.ServeRequest(request); });
+
+        options.port = server.Port();
+        options.connections = connections;
+        options.pipeline_depth = depth;
+        cerr << "HttpServer, " << connections << " connections, pipeline " << depth << ": " << RunLoad(options) << endl;
+    }
+}
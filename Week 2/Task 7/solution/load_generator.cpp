@@ -0,0 +1,318 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <deque>
+#include <iomanip>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    constexpr std::size_t READ_CHUNK = 64 * 1024;
+    constexpr int IDLE_TIMEOUT_MS = 5000;
+
+    struct ClientConnection
+    {
+        int fd = -1;
+        std::string output;
+        std::size_t output_offset = 0;
+        std::string input;
+        std::size_t input_offset = 0;
+        std::deque<Clock::time_point> sent;
+        bool read_blocked = false;
+        bool write_blocked = false;
+
+        ~ClientConnection()
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    };
+
+    int Connect(std::uint16_t port)
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+        {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "connect");
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    bool StartsWithIgnoreCase(std::string_view s, std::string_view prefix)
+    {
+        return s.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), s.begin(),
+            [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+    }
+
+    // Returns the size of the complete response at the start of data or 0 when
+    // it has not fully arrived yet
+    std::size_t ParseResponse(std::string_view data, int& status)
+    {
+        const std::size_t head_end = data.find("\r\n\r\n");
+        if (head_end == std::string_view::npos)
+        {
+            return 0;
+        }
+        const std::string_view head = data.substr(0, head_end);
+        if (!StartsWithIgnoreCase(head, "HTTP/1.") || head.size() < 12)
+        {
+            throw std::runtime_error("malformed response: " + std::string(head.substr(0, 32)));
+        }
+        status = std::stoi(std::string(head.substr(9, 3)));
+
+        std::size_t content_length = 0;
+        for (std::size_t line = head.find("\r\n"); line != std::string_view::npos; line = head.find("\r\n", line + 2))
+        {
+            constexpr std::string_view CONTENT_LENGTH = "Content-Length:";
+            const std::string_view rest = head.substr(line + 2);
+            if (StartsWithIgnoreCase(rest, CONTENT_LENGTH))
+            {
+                content_length = std::stoul(std::string(rest.substr(CONTENT_LENGTH.size(), rest.find("\r\n") - CONTENT_LENGTH.size())));
+            }
+        }
+
+        const std::size_t size = head_end + 4 + content_length;
+        return data.size() >= size ? size : 0;
+    }
+
+    class Generator
+    {
+    public:
+        explicit Generator(const LoadOptions& a_options) :
+            options(a_options),
+            read_buffer(READ_CHUNK)
+        {
+            latencies.reserve(options.total_requests);
+        }
+
+        ~Generator()
+        {
+            if (epoll_fd >= 0)
+            {
+                close(epoll_fd);
+            }
+        }
+
+        LoadReport Run()
+        {
+            if (options.requests.empty() || options.connections == 0 || options.pipeline_depth == 0)
+            {
+                throw std::invalid_argument("nothing to send");
+            }
+
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "epoll_create1");
+            }
+
+            connections.resize(options.connections);
+            for (ClientConnection& connection : connections)
+            {
+                connection.fd = Connect(options.port);
+                epoll_event event = {};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = &connection;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &event);
+            }
+
+            const auto start = Clock::now();
+            for (ClientConnection& connection : connections)
+            {
+                Pump(connection);
+            }
+
+            std::vector<epoll_event> events(connections.size());
+            while (report.completed < options.total_requests)
+            {
+                const int count = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), IDLE_TIMEOUT_MS);
+                if (count < 0 && errno != EINTR)
+                {
+                    throw std::system_error(errno, std::generic_category(), "epoll_wait");
+                }
+                if (count == 0)
+                {
+                    throw std::runtime_error("the server stopped responding");
+                }
+                for (int i = 0; i < count; ++i)
+                {
+                    auto& connection = *static_cast<ClientConnection*>(events[i].data.ptr);
+                    connection.read_blocked = false;
+                    connection.write_blocked = false;
+                    Pump(connection);
+                }
+            }
+            report.elapsed = Clock::now() - start;
+
+            if (!latencies.empty())
+            {
+                auto percentile = [this](double p) {
+                    auto nth = latencies.begin() + static_cast<std::ptrdiff_t>(p * (latencies.size() - 1));
+                    std::nth_element(latencies.begin(), nth, latencies.end());
+                    return std::chrono::nanoseconds(*nth);
+                };
+                report.p50 = percentile(0.5);
+                report.p99 = percentile(0.99);
+                report.p999 = percentile(0.999);
+                report.max = std::chrono::nanoseconds(*std::max_element(latencies.begin(), latencies.end()));
+            }
+            return report;
+        }
+
+    private:
+        void Pump(ClientConnection& connection)
+        {
+            bool progress = true;
+            while (progress)
+            {
+                progress = false;
+
+                if (connection.sent.size() < options.pipeline_depth && issued < options.total_requests)
+                {
+                    const auto now = Clock::now();
+                    while (connection.sent.size() < options.pipeline_depth && issued < options.total_requests)
+                    {
+                        connection.output += options.requests[issued % options.requests.size()];
+                        connection.sent.push_back(now);
+                        ++issued;
+                    }
+                }
+
+                if (!connection.write_blocked && connection.output_offset < connection.output.size())
+                {
+                    const std::size_t left = connection.output.size() - connection.output_offset;
+                    const ssize_t count = send(connection.fd, connection.output.data() + connection.output_offset, left, MSG_NOSIGNAL);
+                    if (count > 0)
+                    {
+                        connection.output_offset += count;
+                        if (connection.output_offset == connection.output.size())
+                        {
+                            connection.output.clear();
+                            connection.output_offset = 0;
+                        }
+                        connection.write_blocked = static_cast<std::size_t>(count) < left;
+                        progress = true;
+                    }
+                    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        connection.write_blocked = true;
+                    }
+                    else if (errno != EINTR)
+                    {
+                        throw std::system_error(errno, std::generic_category(), "send");
+                    }
+                }
+
+                if (!connection.read_blocked)
+                {
+                    const ssize_t count = read(connection.fd, read_buffer.data(), read_buffer.size());
+                    if (count > 0)
+                    {
+                        connection.input.append(read_buffer.data(), count);
+                        connection.read_blocked = static_cast<std::size_t>(count) < read_buffer.size();
+                        progress = true;
+                    }
+                    else if (count == 0)
+                    {
+                        throw std::runtime_error("the server closed a connection");
+                    }
+                    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        connection.read_blocked = true;
+                    }
+                    else if (errno != EINTR)
+                    {
+                        throw std::system_error(errno, std::generic_category(), "read");
+                    }
+                }
+
+                int status = 0;
+                while (std::size_t size = ParseResponse(std::string_view(connection.input).substr(connection.input_offset), status))
+                {
+                    if (connection.sent.empty())
+                    {
+                        throw std::runtime_error("a response without a request");
+                    }
+                    latencies.push_back((Clock::now() - connection.sent.front()).count());
+                    connection.sent.pop_front();
+                    connection.input_offset += size;
+                    ++report.status_counts[status];
+                    ++report.completed;
+                    progress = true;
+                }
+                if (connection.input_offset > connection.input.size() / 2)
+                {
+                    connection.input.erase(0, connection.input_offset);
+                    connection.input_offset = 0;
+                }
+            }
+        }
+
+        const LoadOptions& options;
+        int epoll_fd = -1;
+        std::vector<char> read_buffer;
+        std::vector<ClientConnection> connections;
+        std::vector<std::chrono::nanoseconds::rep> latencies;
+        std::size_t issued = 0;
+        LoadReport report;
+    };
+}
+
+double LoadReport::RequestsPerSecond() const
+{
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? completed / seconds : 0;
+}
+
+std::ostream& operator << (std::ostream& os, const LoadReport& report)
+{
+    using Micros = std::chrono::duration<double, std::micro>;
+    os << report.completed << " requests in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(report.elapsed).count() << " ms, "
+        << static_cast<std::size_t>(report.RequestsPerSecond()) << " req/s, latency us"
+        << std::fixed << std::setprecision(1)
+        << " p50 " << Micros(report.p50).count()
+        << " p99 " << Micros(report.p99).count()
+        << " p99.9 " << Micros(report.p999).count()
+        << " max " << Micros(report.max).count()
+        << std::defaultfloat << ", status";
+    for (const auto& [status, count] : report.status_counts)
+    {
+        os << " " << status << ": " << count;
+    }
+    return os;
+}
+
+LoadReport RunLoad(const LoadOptions& options)
+{
+    return Generator(options).Run();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Closed-loop HTTP load generator for a server on 127.0.0.1. Every connection
+// keeps pipeline_depth requests in flight and sends the next one as soon as a
+// response arrives; the latency of a request is measured from the moment it is
+// queued for sending until its whole response is read.
+struct LoadOptions
+{
+    std::uint16_t port = 0;
+    std::size_t connections = 16;
+    std::size_t pipeline_depth = 1;
+    std::size_t total_requests = 100000;
+    // Raw HTTP/1.1 requests, sent round-robin across all connections
+    std::vector<std::string> requests;
+};
+
+struct LoadReport
+{
+    std::size_t completed = 0;
+    std::map<int, std::size_t> status_counts;
+    std::chrono::nanoseconds elapsed{ 0 };
+    std::chrono::nanoseconds p50{ 0 }, p99{ 0 }, p999{ 0 }, max{ 0 };
+
+    double RequestsPerSecond() const;
+};
+
+std::ostream& operator << (std::ostream& os, const LoadReport& report);
+
+// Throws std::system_error when it cannot connect and std::runtime_error
+// when a connection breaks or a response cannot be parsed
+LoadReport RunLoad(const LoadOptions& options);
@@ -0,0 +1,130 @@
+#include "response_queue.h"
+
+void ResponseQueue::Push(HttpResponse& response, bool keep_alive)
+{
+    Entry entry;
+    entry.head_offset = heads.size();
+    response.AppendHead(heads, keep_alive);
+    entry.head_size = heads.size() - entry.head_offset;
+    entry.size = entry.head_size + response.GetContentSize();
+
+    const std::vector<std::string_view>& view = response.GetContentView();
+    entry.views_begin = views.size();
+    views.insert(views.end(), view.begin(), view.end());
+    entry.views_end = views.size();
+    if (view.empty())
+    {
+        entry.body = response.TakeContent();
+    }
+
+    size += entry.size;
+    entries.push_back(std::move(entry));
+}
+
+void ResponseQueue::PushRaw(std::string_view response)
+{
+    const std::size_t head_offset = heads.size();
+    heads += response;
+    entries.push_back({ head_offset, response.size(), {}, views.size(), views.size(), response.size() });
+    size += response.size();
+}
+
+bool ResponseQueue::Empty() const
+{
+    return size == 0;
+}
+
+std::size_t ResponseQueue::Size() const
+{
+    return size;
+}
+
+template <typename Callback>
+void ResponseQueue::ForEachPart(const Entry& entry, Callback callback) const
+{
+    if (!callback(std::string_view(heads).substr(entry.head_offset, entry.head_size)))
+    {
+        return;
+    }
+    if (!entry.body.empty())
+    {
+        callback(std::string_view(entry.body));
+        return;
+    }
+    for (std::size_t i = entry.views_begin; i < entry.views_end; ++i)
+    {
+        if (!callback(views[i]))
+        {
+            return;
+        }
+    }
+}
+
+std::size_t ResponseQueue::Gather(iovec* iov, std::size_t max_count) const
+{
+    std::size_t count = 0;
+    std::size_t skip = sent_offset;
+    for (std::size_t i = first; i < entries.size() && count < max_count; ++i)
+    {
+        ForEachPart(entries[i], [&](std::string_view part) {
+            if (skip >= part.size())
+            {
+                skip -= part.size();
+                return true;
+            }
+            if (count == max_count)
+            {
+                return false;
+            }
+            iov[count].iov_base = const_cast<char*>(part.data() + skip);
+            iov[count].iov_len = part.size() - skip;
+            ++count;
+            skip = 0;
+            return true;
+        });
+    }
+    return count;
+}
+
+void ResponseQueue::Consume(std::size_t bytes)
+{
+    size -= bytes;
+    std::size_t sent = sent_offset + bytes;
+    while (first < entries.size() && sent >= entries[first].size)
+    {
+        sent -= entries[first].size;
+        // An owned body is freed as soon as it is out
+        std::string().swap(entries[first].body);
+        ++first;
+    }
+    sent_offset = sent;
+    Compact();
+}
+
+void ResponseQueue::Compact()
+{
+    if (first == entries.size())
+    {
+        // Keeps the capacity of the buffers for the next responses
+        heads.clear();
+        views.clear();
+        entries.clear();
+        first = 0;
+    }
+    else if (first > entries.size() / 2)
+    {
+        // A connection that never catches up still gets the sent part dropped, amortized
+        const std::size_t head_shift = entries[first].head_offset;
+        const std::size_t views_shift = entries[first].views_begin;
+        heads.erase(0, head_shift);
+        views.erase(views.begin(), views.begin() + views_shift);
+        entries.erase(entries.begin(), entries.begin() + first);
+        for (Entry& entry : entries)
+        {
+            entry.head_offset -= head_shift;
+            entry.views_begin -= views_shift;
+            entry.views_end -= views_shift;
+        }
+        first = 0;
+    }
+}
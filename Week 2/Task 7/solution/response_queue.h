@@ -0,0 +1,55 @@
+#pragma once
+
+#include "comment_server.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+
+// Responses of one connection waiting to be sent. The heads are serialized
+// back to back into one buffer and the bodies are kept as the handler produced
+// them - an owned string or views into the handler's storage - so sending is a
+// gather over heads and body parts. The buffers are reused: once the connection
+// has caught up, queuing another response allocates nothing.
+class ResponseQueue
+{
+public:
+    void Push(HttpResponse& response, bool keep_alive);
+    // A complete response with no body, e.g. a canned error
+    void PushRaw(std::string_view response);
+
+    bool Empty() const;
+    // Bytes not sent yet
+    std::size_t Size() const;
+
+    // Points at most max_count iovecs at the unsent data, returns how many are used
+    std::size_t Gather(iovec* iov, std::size_t max_count) const;
+    void Consume(std::size_t bytes);
+
+private:
+    struct Entry
+    {
+        std::size_t head_offset;
+        std::size_t head_size;
+        // Either body is used or the views [views_begin, views_end)
+        std::string body;
+        std::size_t views_begin;
+        std::size_t views_end;
+        std::size_t size;
+    };
+
+    template <typename Callback>
+    void ForEachPart(const Entry& entry, Callback callback) const;
+    void Compact();
+
+    std::string heads;
+    std::vector<std::string_view> views;
+    std::vector<Entry> entries;
+    // entries before first are sent; sent_offset is how much of entries[first] is
+    std::size_t first = 0;
+    std::size_t sent_offset = 0;
+    std::size_t size = 0;
+};
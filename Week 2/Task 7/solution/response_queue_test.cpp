@@ -0,0 +1,223 @@
+#include "comment_server.h"
+#include "http_server.h"
+#include "load_generator.h"
+#include "response_queue.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+// Allocations are counted by the tracker, which this file installs when the
+// program is built with -DALLOC_PROFILE. That build is for the allocation
+// tests only; --serve and the timed benchmarks run without the tracker.
+#define ALLOC_PROFILE_INSTALL
+#include "alloc_profile.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // Sends everything in pieces of at most max_bytes through at most max_iovecs at a time
+    string Drain(ResponseQueue& queue, size_t max_iovecs, size_t max_bytes)
+    {
+        string result;
+        vector<iovec> iov(max_iovecs);
+        while (!queue.Empty())
+        {
+            const size_t count = queue.Gather(iov.data(), iov.size());
+            size_t sent = 0;
+            for (size_t i = 0; i < count && sent < max_bytes; ++i)
+            {
+                const size_t part = min(iov[i].iov_len, max_bytes - sent);
+                result.append(static_cast<const char*>(iov[i].iov_base), part);
+                sent += part;
+            }
+            queue.Consume(sent);
+        }
+        return result;
+    }
+
+    CommentServer MakeServerWithComments(int users, int comments_per_user)
+    {
+        CommentServer server;
+        for (int user = 0; user < users; ++user)
+        {
+            server.ServeRequest({ "POST", "/add_user" });
+        }
+        for (int i = 0; i < comments_per_user; ++i)
+        {
+            for (int user = 0; user < users; ++user)
+            {
+                server.ServeRequest({ "POST", "/add_comment", to_string(user) + " preloaded comment " + to_string(i) });
+            }
+        }
+        return server;
+    }
+}
+
+void TestHttpResponseHead()
+{
+    string head;
+    HttpResponse(HttpCode::Ok).SetContent("12345").AppendHead(head, true);
+    ASSERT_EQUAL(head, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n");
+
+    head.clear();
+    HttpResponse(HttpCode::Found).AddHeader("Location", "/captcha").AppendHead(head, false);
+    ASSERT_EQUAL(head, "HTTP/1.1 302 Found\r\nLocation: /captcha\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+    head.clear();
+    HttpResponse(HttpCode::NotFound).AppendHead(head, true);
+    ASSERT_EQUAL(head, "HTTP/1.1 404 Not found\r\nContent-Length: 0\r\n\r\n");
+}
+
+void TestResponseQueue()
+{
+    vector<HttpResponse> responses;
+    string expected;
+    for (int i = 0; i < 50; ++i)
+    {
+        HttpResponse response(i % 3 == 0 ? HttpCode::Found : HttpCode::Ok);
+        if (i % 3 == 0)
+        {
+            response.AddHeader("Location", "/captcha");
+        }
+        response.SetContent(string(i * 7, 'a' + i % 26));
+        response.AppendHead(expected, i != 49);
+        expected += response.GetContent();
+        responses.push_back(move(response));
+    }
+
+    for (size_t max_iovecs : { 2, 3, 64 })
+    {
+        for (size_t max_bytes : { 1, 17, 1000, 100000 })
+        {
+            ResponseQueue queue;
+            string sent;
+            // Pushing while part of the queue is already out, as a pipelining connection does
+            for (int i = 0; i < 50; ++i)
+            {
+                HttpResponse response = responses[i];
+                queue.Push(response, i != 49);
+                if (i % 10 == 9)
+                {
+                    iovec iov[2];
+                    const size_t count = queue.Gather(iov, 2);
+                    ASSERT(count > 0);
+                    const size_t part = min(iov[0].iov_len, max_bytes);
+                    sent.append(static_cast<const char*>(iov[0].iov_base), part);
+                    queue.Consume(part);
+                }
+            }
+            queue.PushRaw("raw");
+            sent += Drain(queue, max_iovecs, max_bytes);
+            ASSERT_EQUAL(sent, expected + "raw");
+            ASSERT_EQUAL(queue.Size(), 0u);
+        }
+    }
+}
+
+void TestResponseQueueDoesNotAllocate()
+{
+    // Bodies are built by the handler; serializing and sending them is free
+    // once the queue has seen as much at a time before
+    vector<HttpResponse> responses;
+    for (int i = 0; i < 16; ++i)
+    {
+        responses.push_back(HttpResponse(i % 2 ? HttpCode::Ok : HttpCode::Found)
+            .AddHeader("Location", "/captcha")
+            .SetContent("Hello\nWhat are you selling?\n"));
+    }
+    ResponseQueue queue;
+    for (const HttpResponse& response : responses)
+    {
+        HttpResponse copy = response;
+        queue.Push(copy, true);
+    }
+    Drain(queue, 64, 1 << 20);
+
+    ASSERT_ALLOCS_AT_MOST(0, {
+        for (HttpResponse& response : responses)
+        {
+            queue.Push(response, true);
+        }
+        iovec iov[8];
+        while (!queue.Empty())
+        {
+            const size_t count = queue.Gather(iov, 8);
+            size_t bytes = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                bytes += iov[i].iov_len;
+            }
+            queue.Consume(bytes);
+        }
+    });
+}
+
+void BenchmarkUserCommentsResponses()
+{
+    CommentServer server = MakeServerWithComments(100, 10);
+    vector<HttpRequest> requests;
+    for (int user = 0; user < 100; ++user)
+    {
+        requests.push_back({ "GET", "/user_comments", "", {{"user_id", to_string(user)}} });
+    }
+
+    const int count = 1000000;
+    {
+        size_t total = 0;
+        LOG_DURATION("/user_comments x1M, ServeRequest + operator <<");
+        LOG_ALLOCATIONS("/user_comments x1M, ServeRequest + operator <<");
+        for (int i = 0; i < count; ++i)
+        {
+            ostringstream os;
+            os << server.ServeRequest(requests[i % requests.size()]);
+            total += os.str().size();
+        }
+        cerr << total << " bytes serialized" << endl;
+    }
+    {
+        size_t total = 0;
+        ResponseQueue queue;
+        iovec iov[2];
+        LOG_DURATION("/user_comments x1M, ServeRequest + ResponseQueue");
+        LOG_ALLOCATIONS("/user_comments x1M, ServeRequest + ResponseQueue");
+        for (int i = 0; i < count; ++i)
+        {
+            HttpResponse response = server.ServeRequest(requests[i % requests.size()]);
+            queue.Push(response, true);
+            const size_t parts = queue.Gather(iov, 2);
+            size_t bytes = 0;
+            for (size_t part = 0; part < parts; ++part)
+            {
+                bytes += iov[part].iov_len;
+            }
+            total += bytes;
+            queue.Consume(bytes);
+        }
+        cerr << total << " bytes serialized" << endl;
+    }
+
+    HttpServer http_server([&server](const HttpRequest& request) { return server.ServeRequest(request); });
+    std::thread thread([&http_server] { http_server.Run(); });
+    LoadOptions options;
+    options.port = http_server.Port();
+    options.total_requests = 300000;
+    for (int user = 0; user < 100; ++user)
+    {
+        options.requests.push_back("GET /user_comments?user_id=" + to_string(user) + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    }
+    for (auto [connections, depth] : vector<pair<size_t, size_t>>{ {1, 1}, {16, 16} })
+    {
+        options.connections = connections;
+        options.pipeline_depth = depth;
+        cerr << "/user_comments over HTTP, " << connections << " connections, pipeline " << depth << ": " << RunLoad(options) << endl;
+    }
+    http_server.Stop();
+    thread.join();
+}
@@ -0,0 +1,285 @@
+#include "router.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+string_view RouteParams::Get(string_view name) const
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if ((*names)[i] == name)
+        {
+            return values[i];
+        }
+    }
+    return {};
+}
+
+size_t RouteParams::Size() const
+{
+    return count;
+}
+
+string_view RouteParams::operator [] (size_t index) const
+{
+    return values[index];
+}
+
+size_t RouteTable::Add(string method, string_view pattern)
+{
+    if (pattern.empty() || pattern[0] != '/')
+    {
+        throw invalid_argument("route pattern must start with '/': " + string(pattern));
+    }
+
+    Route route;
+    uint32_t node = 0;
+    // "/" is the root itself, any other pattern has a segment after every '/'
+    for (size_t pos = pattern.size() == 1 ? pattern.size() : 1; pos < pattern.size();)
+    {
+        const size_t end = min(pattern.find('/', pos), pattern.size());
+        const string_view segment = pattern.substr(pos, end - pos);
+        if (segment.empty() || segment == ":")
+        {
+            throw invalid_argument("empty segment in route pattern " + string(pattern));
+        }
+
+        if (segment[0] == ':')
+        {
+            if (route.param_names.size() == RouteParams::MAX_COUNT)
+            {
+                throw invalid_argument("too many parameters in route pattern " + string(pattern));
+            }
+            route.param_names.emplace_back(segment.substr(1));
+            if (build_nodes[node].param_child == NONE)
+            {
+                build_nodes[node].param_child = static_cast<uint32_t>(build_nodes.size());
+                build_nodes.emplace_back();
+            }
+            node = build_nodes[node].param_child;
+        }
+        else
+        {
+            auto child = build_nodes[node].literals.find(segment);
+            if (child == build_nodes[node].literals.end())
+            {
+                child = build_nodes[node].literals.emplace(string(segment), static_cast<uint32_t>(build_nodes.size())).first;
+                build_nodes.emplace_back();
+            }
+            node = child->second;
+        }
+        pos = end + 1;
+    }
+
+    for (const auto& [route_method, index] : build_nodes[node].routes)
+    {
+        if (route_method == method)
+        {
+            throw invalid_argument("route added twice: " + method + " " + string(pattern));
+        }
+    }
+    build_nodes[node].routes.emplace_back(move(method), static_cast<uint32_t>(routes.size()));
+    routes.push_back(move(route));
+    nodes.clear();
+    return routes.size() - 1;
+}
+
+void RouteTable::Compile()
+{
+    nodes.clear();
+    seeds.clear();
+    slots.clear();
+    segment_text.clear();
+    methods.clear();
+
+    struct Literal
+    {
+        uint64_t hash;
+        string_view segment;
+        uint32_t child;
+    };
+
+    for (const BuildNode& build_node : build_nodes)
+    {
+        vector<Literal> literals;
+        for (const auto& [segment, child] : build_node.literals)
+        {
+            literals.push_back({ Hash(segment), segment, child });
+        }
+
+        // About two segments per bucket and at least twice as many slots as
+        // segments, which makes a seed that fits a bucket quick to find
+        uint32_t bucket_bits = 0;
+        while ((size_t(2) << bucket_bits) < literals.size())
+        {
+            ++bucket_bits;
+        }
+        uint32_t slot_bits = 1;
+        while ((size_t(1) << slot_bits) < 2 * literals.size())
+        {
+            ++slot_bits;
+        }
+
+        Node node;
+        node.seeds_begin = static_cast<uint32_t>(seeds.size());
+        node.bucket_mask = (uint32_t(1) << bucket_bits) - 1;
+        node.param_child = build_node.param_child;
+        seeds.resize(seeds.size() + node.bucket_mask + 1, 0);
+
+        vector<vector<Literal>> buckets(node.bucket_mask + 1);
+        for (const Literal& literal : literals)
+        {
+            buckets[literal.hash & node.bucket_mask].push_back(literal);
+        }
+        vector<size_t> order(buckets.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        // The largest buckets are placed first, while most slots are free
+        sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+        for (bool placed = false; !placed; ++slot_bits)
+        {
+            if (slot_bits > 24)
+            {
+                throw runtime_error("route segments with colliding hashes");
+            }
+            vector<bool> taken(size_t(1) << slot_bits);
+            placed = true;
+            for (size_t bucket : order)
+            {
+                uint64_t seed = 0;
+                for (vector<uint32_t> used; seed < 4096; ++seed)
+                {
+                    used.clear();
+                    for (const Literal& literal : buckets[bucket])
+                    {
+                        const uint32_t slot = SlotOf(literal.hash, seed, slot_bits);
+                        if (taken[slot] || find(used.begin(), used.end(), slot) != used.end())
+                        {
+                            break;
+                        }
+                        used.push_back(slot);
+                    }
+                    if (used.size() == buckets[bucket].size())
+                    {
+                        for (uint32_t slot : used)
+                        {
+                            taken[slot] = true;
+                        }
+                        break;
+                    }
+                }
+                if (seed == 4096)
+                {
+                    // Too crowded, retried with twice the slots
+                    placed = false;
+                    break;
+                }
+                seeds[node.seeds_begin + bucket] = seed;
+            }
+            if (placed)
+            {
+                node.slot_bits = slot_bits;
+            }
+        }
+
+        node.slots_begin = static_cast<uint32_t>(slots.size());
+        slots.resize(slots.size() + (size_t(1) << node.slot_bits));
+        for (const Literal& literal : literals)
+        {
+            const uint64_t seed = seeds[node.seeds_begin + (literal.hash & node.bucket_mask)];
+            Slot& slot = slots[node.slots_begin + SlotOf(literal.hash, seed, node.slot_bits)];
+            slot.text_offset = static_cast<uint32_t>(segment_text.size());
+            slot.text_size = static_cast<uint32_t>(literal.segment.size());
+            slot.child = literal.child;
+            segment_text += literal.segment;
+        }
+
+        node.methods_begin = static_cast<uint32_t>(methods.size());
+        methods.insert(methods.end(), build_node.routes.begin(), build_node.routes.end());
+        node.methods_end = static_cast<uint32_t>(methods.size());
+        nodes.push_back(node);
+    }
+}
+
+size_t RouteTable::Match(string_view method, string_view path, RouteParams& params) const
+{
+    if (nodes.empty() || path.empty() || path[0] != '/')
+    {
+        return NO_ROUTE;
+    }
+    params.count = 0;
+    const size_t route = MatchFrom(0, method, path, path.size() == 1 ? path.size() + 1 : 1, params);
+    if (route != NO_ROUTE)
+    {
+        params.names = &routes[route].param_names;
+    }
+    return route;
+}
+
+size_t RouteTable::MatchFrom(uint32_t node_index, string_view method, string_view path, size_t pos, RouteParams& params) const
+{
+    const Node& node = nodes[node_index];
+    if (pos > path.size())
+    {
+        for (uint32_t i = node.methods_begin; i < node.methods_end; ++i)
+        {
+            if (methods[i].first == method)
+            {
+                return methods[i].second;
+            }
+        }
+        return NO_ROUTE;
+    }
+
+    const size_t end = min(path.find('/', pos), path.size());
+    const string_view segment = path.substr(pos, end - pos);
+
+    const uint64_t hash = Hash(segment);
+    const uint64_t seed = seeds[node.seeds_begin + (hash & node.bucket_mask)];
+    const Slot& slot = slots[node.slots_begin + SlotOf(hash, seed, node.slot_bits)];
+    if (slot.child != NONE && string_view(segment_text).substr(slot.text_offset, slot.text_size) == segment)
+    {
+        if (const size_t route = MatchFrom(slot.child, method, path, end + 1, params); route != NO_ROUTE)
+        {
+            return route;
+        }
+    }
+
+    if (node.param_child != NONE && !segment.empty())
+    {
+        params.values[params.count++] = segment;
+        if (const size_t route = MatchFrom(node.param_child, method, path, end + 1, params); route != NO_ROUTE)
+        {
+            return route;
+        }
+        --params.count;
+    }
+    return NO_ROUTE;
+}
+
+uint64_t RouteTable::Hash(string_view segment)
+{
+    // FNV-1a with a final mix, so that every bit depends on every byte
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : segment)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+uint32_t RouteTable::SlotOf(uint64_t hash, uint64_t seed, uint32_t slot_bits)
+{
+    return static_cast<uint32_t>(((hash ^ (seed * 0x9e3779b97f4a7c15ULL)) * 0xc4ceb9fe1a85ec53ULL) >> (64 - slot_bits));
+}
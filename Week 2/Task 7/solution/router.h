@@ -0,0 +1,146 @@
+#pragma once
+
+#include "comment_server.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Values of the ":name" segments of a matched route, pointing into the path
+class RouteParams
+{
+public:
+    static constexpr std::size_t MAX_COUNT = 8;
+
+    // Empty when the route has no parameter of that name
+    std::string_view Get(std::string_view name) const;
+    std::size_t Size() const;
+    std::string_view operator [] (std::size_t index) const;
+
+private:
+    friend class RouteTable;
+
+    const std::vector<std::string>* names = nullptr;
+    std::array<std::string_view, MAX_COUNT> values;
+    std::size_t count = 0;
+};
+
+// (method, path pattern) pairs compiled into a trie of path segments. Every
+// node finds its literal children through a perfect hash picked by Compile, so
+// matching costs one hash and one comparison per segment of the path whatever
+// the number of routes. A pattern is "/" followed by segments separated by "/",
+// a segment ":name" matches any nonempty segment. Literal segments are tried
+// before parameters, falling back to the parameter if the rest does not match.
+class RouteTable
+{
+public:
+    static constexpr std::size_t NO_ROUTE = std::numeric_limits<std::size_t>::max();
+
+    // Returns the index of the route, counting from 0 in the order of addition.
+    // Throws std::invalid_argument for a malformed or an already added route.
+    std::size_t Add(std::string method, std::string_view pattern);
+    // Must be called after the last Add, nothing matches before
+    void Compile();
+
+    // Index of the route matching the request or NO_ROUTE; params are filled for a match
+    std::size_t Match(std::string_view method, std::string_view path, RouteParams& params) const;
+
+private:
+    static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+    struct BuildNode
+    {
+        std::map<std::string, std::uint32_t, std::less<>> literals;
+        std::uint32_t param_child = NONE;
+        std::vector<std::pair<std::string, std::uint32_t>> routes;
+    };
+
+    // Literal children of a node are found by hash and displace: a segment
+    // hashed to h falls in the bucket h & bucket_mask, whose seed, picked by
+    // Compile, sends every segment of the bucket to a slot of its own
+    struct Node
+    {
+        std::uint32_t seeds_begin;
+        std::uint32_t bucket_mask;
+        // Slots [slots_begin, slots_begin + 2^slot_bits)
+        std::uint32_t slots_begin;
+        std::uint32_t slot_bits;
+        std::uint32_t param_child;
+        // Routes ending here, by method, in methods[methods_begin, methods_end)
+        std::uint32_t methods_begin;
+        std::uint32_t methods_end;
+    };
+
+    struct Slot
+    {
+        // The segment is segment_text.substr(text_offset, text_size)
+        std::uint32_t text_offset = 0;
+        std::uint32_t text_size = 0;
+        std::uint32_t child = NONE;
+    };
+
+    struct Route
+    {
+        std::vector<std::string> param_names;
+    };
+
+    static std::uint64_t Hash(std::string_view segment);
+    static std::uint32_t SlotOf(std::uint64_t hash, std::uint64_t seed, std::uint32_t slot_bits);
+
+    // pos is where the next segment of path starts, past the end when there are no more
+    std::size_t MatchFrom(std::uint32_t node, std::string_view method, std::string_view path, std::size_t pos, RouteParams& params) const;
+
+    std::vector<BuildNode> build_nodes = std::vector<BuildNode>(1);
+    std::vector<Route> routes;
+
+    std::vector<Node> nodes;
+    std::vector<std::uint64_t> seeds;
+    std::vector<Slot> slots;
+    std::string segment_text;
+    std::vector<std::pair<std::string, std::uint32_t>> methods;
+};
+
+// Dispatches requests to the handlers of the routes they match, with 404 for
+// the rest. A handler is called with the object the router serves, so one
+// compiled router is shared by all the objects of a type.
+template <typename Target>
+class Router
+{
+public:
+    using Handler = std::function<HttpResponse(Target&, const HttpRequest&, const RouteParams&)>;
+
+    Router& Add(std::string method, std::string_view pattern, Handler handler)
+    {
+        table.Add(std::move(method), pattern);
+        handlers.push_back(std::move(handler));
+        return *this;
+    }
+
+    Router& Compile()
+    {
+        table.Compile();
+        return *this;
+    }
+
+    HttpResponse Dispatch(Target& target, const HttpRequest& request) const
+    {
+        RouteParams params;
+        const std::size_t route = table.Match(request.method, request.path, params);
+        if (route == RouteTable::NO_ROUTE)
+        {
+            return HttpResponse(HttpCode::NotFound);
+        }
+        return handlers[route](target, request, params);
+    }
+
+private:
+    RouteTable table;
+    std::vector<Handler> handlers;
+};
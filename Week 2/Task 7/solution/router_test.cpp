@@ -0,0 +1,233 @@
+#include "router.h"
+#include "comment_server.h"
+#include "concurrent_comment_server.h"
+
+#include "test_runner.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    size_t Match(const RouteTable& table, string_view method, string_view path)
+    {
+        RouteParams params;
+        return table.Match(method, path, params);
+    }
+
+    template <typename Server>
+    void TestUserCommentsByPath()
+    {
+        Server server;
+        server.ServeRequest({ "POST", "/add_user" });
+        server.ServeRequest({ "POST", "/add_user" });
+        server.ServeRequest({ "POST", "/add_comment", "1 first" });
+        server.ServeRequest({ "POST", "/add_comment", "0 zero" });
+        server.ServeRequest({ "POST", "/add_comment", "1 second" });
+
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users/1/comments" }).GetContent(), "first\nsecond\n");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users/0/comments" }).GetContent(), "zero\n");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users/1/comments", "", {{"offset", "1"}} }).GetContent(), "second\n");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users/2/comments" }).GetCode(), "404 Not found");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users//comments" }).GetCode(), "404 Not found");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/users/1" }).GetCode(), "404 Not found");
+        ASSERT_EQUAL(server.ServeRequest({ "POST", "/users/1/comments" }).GetCode(), "404 Not found");
+        ASSERT_EQUAL(server.ServeRequest({ "GET", "/add_user" }).GetCode(), "404 Not found");
+        ASSERT_EQUAL(server.ServeRequest({ "DELETE", "/captcha" }).GetCode(), "404 Not found");
+    }
+}
+
+void TestRouteTable()
+{
+    RouteTable table;
+    ASSERT_EQUAL(table.Add("GET", "/"), 0u);
+    ASSERT_EQUAL(table.Add("GET", "/users"), 1u);
+    ASSERT_EQUAL(table.Add("POST", "/users"), 2u);
+    ASSERT_EQUAL(table.Add("GET", "/users/:id"), 3u);
+    ASSERT_EQUAL(table.Add("GET", "/users/me"), 4u);
+    ASSERT_EQUAL(table.Add("GET", "/users/:id/comments/:comment"), 5u);
+    ASSERT_EQUAL(table.Add("GET", "/users/me/settings"), 6u);
+    ASSERT_EQUAL(table.Add("GET", "/:section/about"), 7u);
+
+    RouteParams params;
+    ASSERT_EQUAL(table.Match("GET", "/users", params), RouteTable::NO_ROUTE);
+    table.Compile();
+
+    ASSERT_EQUAL(Match(table, "GET", "/"), 0u);
+    ASSERT_EQUAL(Match(table, "GET", "/users"), 1u);
+    ASSERT_EQUAL(Match(table, "POST", "/users"), 2u);
+    ASSERT_EQUAL(Match(table, "PUT", "/users"), RouteTable::NO_ROUTE);
+
+    ASSERT_EQUAL(table.Match("GET", "/users/42", params), 3u);
+    ASSERT_EQUAL(params.Size(), 1u);
+    ASSERT_EQUAL(params[0], "42");
+    ASSERT_EQUAL(params.Get("id"), "42");
+    ASSERT_EQUAL(params.Get("comment"), "");
+
+    // A literal wins over a parameter, and the parameter is tried when the rest does not match
+    ASSERT_EQUAL(table.Match("GET", "/users/me", params), 4u);
+    ASSERT_EQUAL(params.Size(), 0u);
+    ASSERT_EQUAL(Match(table, "GET", "/users/me/settings"), 6u);
+    ASSERT_EQUAL(table.Match("GET", "/users/me/comments/7", params), 5u);
+    ASSERT_EQUAL(params.Get("id"), "me");
+    ASSERT_EQUAL(params.Get("comment"), "7");
+    ASSERT_EQUAL(table.Match("GET", "/users/about", params), 3u);
+    ASSERT_EQUAL(params.Get("id"), "about");
+    ASSERT_EQUAL(table.Match("GET", "/posts/about", params), 7u);
+    ASSERT_EQUAL(params.Get("section"), "posts");
+    ASSERT_EQUAL(params.Get("id"), "");
+
+    ASSERT_EQUAL(Match(table, "GET", ""), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "users"), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "/users/"), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "//"), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "/users/42/comments"), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "/users/42/comments/"), RouteTable::NO_ROUTE);
+    ASSERT_EQUAL(Match(table, "GET", "/nothing"), RouteTable::NO_ROUTE);
+
+    // Adding undoes Compile
+    ASSERT_EQUAL(table.Add("DELETE", "/users/:id"), 8u);
+    ASSERT_EQUAL(Match(table, "GET", "/users"), RouteTable::NO_ROUTE);
+    table.Compile();
+    ASSERT_EQUAL(Match(table, "DELETE", "/users/1"), 8u);
+    ASSERT_EQUAL(Match(table, "GET", "/users/1"), 3u);
+}
+
+void TestRouteTableWithManyLiterals()
+{
+    RouteTable table;
+    for (int i = 0; i < 5000; ++i)
+    {
+        table.Add("GET", "/r" + to_string(i));
+        table.Add("GET", "/r" + to_string(i) + "/x" + to_string(i % 7));
+    }
+    table.Compile();
+    for (int i = 0; i < 5000; ++i)
+    {
+        ASSERT_EQUAL(Match(table, "GET", "/r" + to_string(i)), size_t(2 * i));
+        ASSERT_EQUAL(Match(table, "GET", "/r" + to_string(i) + "/x" + to_string(i % 7)), size_t(2 * i + 1));
+        ASSERT_EQUAL(Match(table, "GET", "/q" + to_string(i)), RouteTable::NO_ROUTE);
+        ASSERT_EQUAL(Match(table, "GET", "/r" + to_string(i) + "/x" + to_string(i % 7 + 1)), RouteTable::NO_ROUTE);
+    }
+}
+
+void TestRouteTableRejectsMalformedRoutes()
+{
+    const vector<pair<string, string>> malformed = {
+        {"GET", ""}, {"GET", "users"}, {"GET", "/users/"}, {"GET", "//"},
+        {"GET", "/users//comments"}, {"GET", "/users/:"}, {"GET", "/:a/:b/:c/:d/:e/:f/:g/:h/:i"},
+        {"GET", "/users"},
+    };
+    RouteTable table;
+    table.Add("GET", "/users");
+    table.Add("GET", "/:a/:b/:c/:d/:e/:f/:g/:h");
+    for (const auto& [method, pattern] : malformed)
+    {
+        bool thrown = false;
+        try
+        {
+            table.Add(method, pattern);
+        }
+        catch (const invalid_argument&)
+        {
+            thrown = true;
+        }
+        ASSERT(thrown);
+    }
+}
+
+void TestUserCommentsByPathParameter()
+{
+    TestUserCommentsByPath<CommentServer>();
+    TestUserCommentsByPath<ConcurrentCommentServer>();
+}
+
+void BenchmarkRouter()
+{
+    // 200 routes in the shape of a REST API, literal and parametrized
+    vector<pair<string, string>> routes;
+    for (int i = 0; i < 100; ++i)
+    {
+        routes.emplace_back(i % 2 ? "POST" : "GET", "/api/v1/resource" + to_string(i));
+    }
+    for (int i = 0; i < 60; ++i)
+    {
+        routes.emplace_back(i % 2 ? "POST" : "GET", "/api/v1/resource" + to_string(i) + "/:id");
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        routes.emplace_back("GET", "/api/v2/group" + to_string(i) + "/:group/items/:item");
+    }
+
+    RouteTable table;
+    RouteTable small_table;
+    for (const auto& [method, pattern] : routes)
+    {
+        table.Add(method, pattern);
+    }
+    for (size_t i : { 0, 1, 2, 100, 160 })
+    {
+        small_table.Add(routes[i].first, routes[i].second);
+    }
+    table.Compile();
+    small_table.Compile();
+
+    const size_t count = 2000000;
+    size_t sink = 0;
+    // The chain of comparisons the servers used to have, over the literal routes
+    auto chain = [&](string_view method, string_view path) {
+        for (size_t i = 0; i < 100; ++i)
+        {
+            if (routes[i].first == method && routes[i].second == path)
+            {
+                return i;
+            }
+        }
+        return RouteTable::NO_ROUTE;
+    };
+
+    const vector<pair<string, string>> requests = {
+        {"GET", "/api/v1/resource0"},
+        {"POST", "/api/v1/resource99"},
+        {"GET", "/api/v1/resource42/1234"},
+        {"GET", "/api/v2/group39/7/items/abc"},
+        {"GET", "/api/v1/unknown"},
+    };
+    for (const auto& [method, path] : requests)
+    {
+        const string name = method + " " + path;
+        RouteParams params;
+        {
+            LOG_DURATION(name + " x2M, 200 routes");
+            for (size_t i = 0; i < count; ++i)
+            {
+                sink += table.Match(method, path, params);
+            }
+        }
+        if (small_table.Match(method, path, params) != RouteTable::NO_ROUTE)
+        {
+            LOG_DURATION(name + " x2M, 5 routes");
+            for (size_t i = 0; i < count; ++i)
+            {
+                sink += small_table.Match(method, path, params);
+            }
+        }
+        if (path.find("resource", 0) != string::npos && count_if(path.begin(), path.end(), [](char c) { return c == '/'; }) == 3)
+        {
+            LOG_DURATION(name + " x2M, chain of 100 comparisons");
+            for (size_t i = 0; i < count; ++i)
+            {
+                sink += chain(method, path);
+            }
+        }
+    }
+    cerr << "router checksum " << sink << endl;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "test_runner.h"
+
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+// A file that is removed when the test is over
+class TempFile
+{
+public:
+    TempFile()
+    {
+        char name[] = "/tmp/comment_journal_XXXXXX";
+        const int fd = mkstemp(name);
+        ASSERT(fd >= 0);
+        close(fd);
+        path = name;
+    }
+
+    ~TempFile()
+    {
+        unlink(path.c_str());
+    }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    const std::string& Path() const
+    {
+        return path;
+    }
+
+private:
+    std::string path;
+};